@@ -3,3 +3,7 @@
 void DebugTimer_Tic(const char*);
 double DebugTimer_Toc(const char*);
 void DebugTimer_TocAndPrint(const char*);
+
+// Milliseconds since an arbitrary start point. Unlike the named timers, safe to call from any
+// thread.
+double DebugTimer_NowMs();
@@ -0,0 +1,65 @@
+#include "DebugTimer.h"
+
+#include "External/pow2assert.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Fixed table searched by name, so timing a frame never allocates
+struct DebugTimerEntry
+{
+    char m_name[64];
+    double m_startMs;
+};
+
+static const int kMaxTimers = 128;
+static DebugTimerEntry g_timers[kMaxTimers];
+static int g_timerCount = 0;
+
+static DebugTimerEntry* FindTimer(const char* name)
+{
+    for (int i = 0; i < g_timerCount; ++i)
+    {
+        if (strcmp(g_timers[i].m_name, name) == 0)
+        {
+            return &g_timers[i];
+        }
+    }
+    return nullptr;
+}
+
+void DebugTimer_Tic(const char* name)
+{
+    DebugTimerEntry* timer = FindTimer(name);
+    if (!timer)
+    {
+        const size_t bytes = strlen(name) + 1;
+        POW2_ASSERT(g_timerCount < kMaxTimers);
+        POW2_ASSERT(bytes <= sizeof(timer->m_name));
+        timer = &g_timers[g_timerCount++];
+        memcpy(timer->m_name, name, bytes);
+    }
+
+    timer->m_startMs = DebugTimer_NowMs();
+}
+
+double DebugTimer_Toc(const char* name)
+{
+    const DebugTimerEntry* timer = FindTimer(name);
+    POW2_ASSERT(timer);
+
+    return DebugTimer_NowMs() - timer->m_startMs;
+}
+
+void DebugTimer_TocAndPrint(const char* name)
+{
+    fprintf(stderr, "DebugTimer: %s elapsed = %.02fms\n", name, DebugTimer_Toc(name));
+}
+
+double DebugTimer_NowMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
@@ -4,25 +4,53 @@
 
 #include <windows.h>
 
-#include <map>
 #include <stdio.h>
-#include <string>
+#include <string.h>
 
-static std::map<std::string, LARGE_INTEGER> g_timers;
+// Fixed table searched by name, so timing a frame never allocates
+struct DebugTimerEntry
+{
+    char m_name[64];
+    LARGE_INTEGER m_start;
+};
+
+static const int kMaxTimers = 128;
+static DebugTimerEntry g_timers[kMaxTimers];
+static int g_timerCount = 0;
+
+static DebugTimerEntry* FindTimer(const char* name)
+{
+    for (int i = 0; i < g_timerCount; ++i)
+    {
+        if (strcmp(g_timers[i].m_name, name) == 0)
+        {
+            return &g_timers[i];
+        }
+    }
+    return nullptr;
+}
 
 void DebugTimer_Tic(const char* name)
 {
-    LARGE_INTEGER counter;
-    QueryPerformanceCounter(&counter);
-    g_timers[std::string(name)] = counter;
+    DebugTimerEntry* timer = FindTimer(name);
+    if (!timer)
+    {
+        const size_t bytes = strlen(name) + 1;
+        POW2_ASSERT(g_timerCount < kMaxTimers);
+        POW2_ASSERT(bytes <= sizeof(timer->m_name));
+        timer = &g_timers[g_timerCount++];
+        memcpy(timer->m_name, name, bytes);
+    }
+
+    QueryPerformanceCounter(&timer->m_start);
 }
 
 double DebugTimer_Toc(const char* name)
 {
-    auto timer = g_timers.find(name);
-    POW2_ASSERT(timer != g_timers.end());
+    const DebugTimerEntry* timer = FindTimer(name);
+    POW2_ASSERT(timer);
 
-    LARGE_INTEGER before = timer->second;
+    LARGE_INTEGER before = timer->m_start;
     LARGE_INTEGER after;
     QueryPerformanceCounter(&after);
 
@@ -43,3 +71,14 @@ void DebugTimer_TocAndPrint(const char* name)
         str, sizeof(str), "DebugTimer: %s elapsed = %.02fms\n", name, DebugTimer_Toc(name));
     OutputDebugStringA(str);
 }
+
+double DebugTimer_NowMs()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+
+    return double(counter.QuadPart) / double(freq.QuadPart) * 1000;
+}
@@ -0,0 +1,221 @@
+#include "DirtyRegion.h"
+
+#include "External/pow2assert.h"
+
+#include <algorithm>
+
+static void MarkRect(DirtyTiles* tiles, std::vector<uint8_t>* frameTiles, const ScreenRect& rect)
+{
+    if (rect.m_maxX < 0 || rect.m_maxY < 0)
+    {
+        return;  // left of or below the buffer (the divisions below round towards 0)
+    }
+
+    const int size = DirtyTiles::kTileSize;
+    const int minX = rect.m_minX > 0 ? rect.m_minX / size : 0;
+    const int minY = rect.m_minY > 0 ? rect.m_minY / size : 0;
+    const int maxX = std::min(rect.m_maxX / size, tiles->m_tilesX - 1);
+    const int maxY = std::min(rect.m_maxY / size, tiles->m_tilesY - 1);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        uint8_t* row = frameTiles->data() + y * tiles->m_tilesX;
+        for (int x = minX; x <= maxX; ++x)
+        {
+            row[x] = 1;
+        }
+    }
+}
+
+static bool SameRect(const ScreenRect& a, const ScreenRect& b)
+{
+    return a.m_minX == b.m_minX && a.m_minY == b.m_minY &&
+        a.m_maxX == b.m_maxX && a.m_maxY == b.m_maxY;
+}
+
+// Runs of dirty tiles along each row, merged with the rectangle above when they span the same
+// tiles. Built in tiles, then turned into pixels.
+static void BuildRects(DirtyTiles* tiles)
+{
+    std::vector<ScreenRect>& rects = tiles->m_rects;
+    rects.clear();
+    tiles->m_dirtyTiles = 0;
+
+    for (int y = 0; y < tiles->m_tilesY; ++y)
+    {
+        const uint8_t* row = tiles->m_tiles.data() + y * tiles->m_tilesX;
+        for (int x = 0; x < tiles->m_tilesX; ++x)
+        {
+            if (!row[x])
+            {
+                continue;
+            }
+
+            const int first = x;
+            while (x + 1 < tiles->m_tilesX && row[x + 1])
+            {
+                ++x;
+            }
+            tiles->m_dirtyTiles += x - first + 1;
+
+            bool merged = false;
+            for (size_t i = 0; i < rects.size() && !merged; ++i)
+            {
+                ScreenRect& above = rects[i];
+                if (above.m_maxY == y - 1 && above.m_minX == first && above.m_maxX == x)
+                {
+                    above.m_maxY = y;
+                    merged = true;
+                }
+            }
+            if (!merged)
+            {
+                const ScreenRect rect = { first, y, x, y };
+                rects.push_back(rect);
+            }
+        }
+    }
+
+    const int size = DirtyTiles::kTileSize;
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        ScreenRect& rect = rects[i];
+        rect.m_minX *= size;
+        rect.m_minY *= size;
+        rect.m_maxX = std::min((rect.m_maxX + 1) * size, tiles->m_width) - 1;
+        rect.m_maxY = std::min((rect.m_maxY + 1) * size, tiles->m_height) - 1;
+    }
+}
+
+void DirtyRegion::BeginFrame(DirtyTiles* tiles, const void* buffer, int width, int height)
+{
+    POW2_ASSERT(tiles && buffer);
+    POW2_ASSERT(width > 0 && height > 0);
+
+    ++tiles->m_frame;
+    tiles->m_buffer = buffer;
+    tiles->m_draws.clear();
+
+    if (width != tiles->m_width || height != tiles->m_height)
+    {
+        // Nothing drawn at the old size lines up, and shrinking keeps the vectors' memory
+        tiles->m_width = width;
+        tiles->m_height = height;
+        tiles->m_tilesX = (width + DirtyTiles::kTileSize - 1) / DirtyTiles::kTileSize;
+        tiles->m_tilesY = (height + DirtyTiles::kTileSize - 1) / DirtyTiles::kTileSize;
+        const size_t count = (size_t)tiles->m_tilesX * tiles->m_tilesY;
+        for (int i = 0; i < DirtyTiles::kMaxHistory; ++i)
+        {
+            tiles->m_history[i].resize(count);
+        }
+        tiles->m_tiles.resize(count);
+
+        tiles->m_redrawAll = true;
+    }
+}
+
+void DirtyRegion::Invalidate(DirtyTiles* tiles)
+{
+    POW2_ASSERT(tiles);
+    tiles->m_redrawAll = true;
+}
+
+void DirtyRegion::AddDraw(DirtyTiles* tiles, int id, uint32_t key, const ScreenRect& rect)
+{
+    POW2_ASSERT(tiles);
+    POW2_ASSERT(tiles->m_draws.empty() || tiles->m_draws.back().m_id < id);
+
+    const DrawRecord draw = { id, key, rect };
+    tiles->m_draws.push_back(draw);
+}
+
+void DirtyRegion::EndFrame(DirtyTiles* tiles)
+{
+    POW2_ASSERT(tiles && tiles->m_buffer);
+
+    //
+    // What changed since the last frame
+    //
+
+    const int kMaxHistory = DirtyTiles::kMaxHistory;
+    std::vector<uint8_t>& frameTiles = tiles->m_history[tiles->m_frame % kMaxHistory];
+    std::fill(frameTiles.begin(), frameTiles.end(), tiles->m_redrawAll ? 1 : 0);
+
+    const std::vector<DrawRecord>& previous = tiles->m_previousDraws;
+    const std::vector<DrawRecord>& current = tiles->m_draws;
+    size_t p = 0;
+    size_t c = 0;
+    while (!tiles->m_redrawAll && (p < previous.size() || c < current.size()))
+    {
+        if (c == current.size() || (p < previous.size() && previous[p].m_id < current[c].m_id))
+        {
+            MarkRect(tiles, &frameTiles, previous[p++].m_rect);  // gone
+        }
+        else if (p == previous.size() || current[c].m_id < previous[p].m_id)
+        {
+            MarkRect(tiles, &frameTiles, current[c++].m_rect);  // new
+        }
+        else
+        {
+            if (previous[p].m_key != current[c].m_key ||
+                !SameRect(previous[p].m_rect, current[c].m_rect))
+            {
+                MarkRect(tiles, &frameTiles, previous[p].m_rect);
+                MarkRect(tiles, &frameTiles, current[c].m_rect);
+            }
+            ++p;
+            ++c;
+        }
+    }
+
+    //
+    // What changed since the buffer was last drawn
+    //
+
+    int slot = -1;
+    int oldest = 0;
+    for (int i = 0; i < kMaxHistory; ++i)
+    {
+        if (tiles->m_buffers[i] == tiles->m_buffer)
+        {
+            slot = i;
+        }
+        if (tiles->m_bufferFrames[i] < tiles->m_bufferFrames[oldest])
+        {
+            oldest = i;
+        }
+    }
+
+    const uint32_t age = slot >= 0 ? tiles->m_frame - tiles->m_bufferFrames[slot] : 0;
+    if (slot < 0 || age > (uint32_t)kMaxHistory)
+    {
+        std::fill(tiles->m_tiles.begin(), tiles->m_tiles.end(), 1);  // never seen, or too old
+    }
+    else
+    {
+        tiles->m_tiles = frameTiles;
+        for (uint32_t frame = tiles->m_frame - age + 1; frame < tiles->m_frame; ++frame)
+        {
+            const std::vector<uint8_t>& history = tiles->m_history[frame % kMaxHistory];
+            for (size_t i = 0; i < history.size(); ++i)
+            {
+                tiles->m_tiles[i] |= history[i];
+            }
+        }
+    }
+
+    slot = slot >= 0 ? slot : oldest;
+    tiles->m_buffers[slot] = tiles->m_buffer;
+    tiles->m_bufferFrames[slot] = tiles->m_frame;
+
+    BuildRects(tiles);
+
+    tiles->m_previousDraws = tiles->m_draws;  // a copy, so both vectors keep their memory
+    tiles->m_redrawAll = false;
+}
+
+bool DirtyRegion::Overlap(const ScreenRect& a, const ScreenRect& b)
+{
+    return a.m_minX <= b.m_maxX && b.m_minX <= a.m_maxX &&
+        a.m_minY <= b.m_maxY && b.m_minY <= a.m_maxY;
+}
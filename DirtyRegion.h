@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Rasterizer.h"
+
+#include <stdint.h>
+#include <vector>
+
+//
+// DIRTY REGION INPUT: the window rectangle of every draw of a frame, and the buffer it's drawn to
+// DIRTY REGION OUTPUT: rectangles of the buffer that need clearing and drawing again
+//
+// Draws are matched with the previous frame's by id. Where one appeared, went away, moved or
+// changed (its key did) the tiles under both its old and new rectangles are dirty; everything
+// else already holds the right pixels. A frame where nothing changed has nothing to redraw.
+//
+// Buffers are usually a ring (see Swapchain.h), so the one drawn to holds a frame from a few
+// frames back rather than the last one: it gets the dirty tiles of every frame since, as long as
+// that's no more than kMaxHistory frames. The depth buffer is shared by every frame, and always
+// holds the last one.
+//
+
+struct DrawRecord
+{
+    int m_id;        // ascending within a frame
+    uint32_t m_key;  // changes whenever what the draw renders does
+    ScreenRect m_rect;
+};
+
+struct DirtyTiles  // zero is initialisation, see DirtyRegion::BeginFrame
+{
+    static const int kTileSize = 32;
+    static const int kMaxHistory = 4;
+
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    uint32_t m_frame;  // counts from 1
+    const void* m_buffer;
+    bool m_redrawAll;  // set by Invalidate
+
+    std::vector<DrawRecord> m_previousDraws;
+    std::vector<DrawRecord> m_draws;
+
+    // Dirty tiles of the last kMaxHistory frames (slot frame % kMaxHistory), and the frame each
+    // buffer was last drawn in
+    std::vector<uint8_t> m_history[kMaxHistory];
+    const void* m_buffers[kMaxHistory];
+    uint32_t m_bufferFrames[kMaxHistory];
+
+    // This frame's buffer: its dirty tiles, merged into rectangles
+    std::vector<uint8_t> m_tiles;
+    std::vector<ScreenRect> m_rects;
+    int m_dirtyTiles;
+};
+
+namespace DirtyRegion
+{
+    // Starts a frame drawn to buffer (whatever tells buffers apart, the colour buffer say). A
+    // new size redraws everything. Add the frame's draws next.
+    void BeginFrame(DirtyTiles* tiles, const void* buffer, int width, int height);
+
+    // Redraws everything this frame: state every draw depends on changed, or the buffers lost
+    // their contents
+    void Invalidate(DirtyTiles* tiles);
+
+    void AddDraw(DirtyTiles* tiles, int id, uint32_t key, const ScreenRect& rect);
+
+    // Works out m_tiles and m_rects, disjoint and clipped to the buffer, empty when the buffer
+    // is up to date
+    void EndFrame(DirtyTiles* tiles);
+
+    bool Overlap(const ScreenRect& a, const ScreenRect& b);
+}
@@ -0,0 +1,262 @@
+#include "DynamicResolution.h"
+
+#include "External/pow2assert.h"
+
+#include <emmintrin.h>
+#include <math.h>
+
+static const double kHeadroom = 0.9;     // aim a little under the budget
+static const float kScaleSteps = 32;     // scales are multiples of 1 / kScaleSteps
+static const float kScaleUpStep = 1.0f / 16;
+static const int kFramesBeforeScaleUp = 8;
+
+//
+// CONTROLLER
+//
+
+void DynamicResolution::Init(
+    ResolutionController* controller,
+    const DynamicResolutionSettings& settings)
+{
+    POW2_ASSERT(controller);
+    POW2_ASSERT(settings.m_targetMs > 0);
+    POW2_ASSERT(settings.m_minScale > 0 && settings.m_minScale <= settings.m_maxScale);
+
+    *controller = {};
+    controller->m_settings = settings;
+    controller->m_scale = settings.m_maxScale;
+}
+
+float DynamicResolution::Update(ResolutionController* controller, double renderMs)
+{
+    POW2_ASSERT(controller);
+
+    const DynamicResolutionSettings& settings = controller->m_settings;
+    const float scale = controller->m_scale;
+
+    //
+    // Estimate what a full resolution frame costs now
+    //
+
+    const double normalisedMs = renderMs / (scale * scale);
+    controller->m_fullResolutionMs[controller->m_historyNext] = normalisedMs;
+    controller->m_historyNext = (controller->m_historyNext + 1) % ResolutionController::kHistory;
+    if (controller->m_historyCount < ResolutionController::kHistory)
+    {
+        ++controller->m_historyCount;
+    }
+    ++controller->m_framesSinceChange;
+
+    double estimateMs = 0;
+    for (int i = 0; i < controller->m_historyCount; ++i)
+    {
+        estimateMs += controller->m_fullResolutionMs[i];
+    }
+    estimateMs /= controller->m_historyCount;
+
+    // A frame over budget counts straight away, the average is too slow to react to spikes
+    if (renderMs > settings.m_targetMs && normalisedMs > estimateMs)
+    {
+        estimateMs = normalisedMs;
+    }
+
+    //
+    // Scale that fits the budget, snapped to a few sizes so buffers don't change every frame
+    //
+
+    float desired = settings.m_maxScale;
+    if (estimateMs > 0)
+    {
+        desired = (float)sqrt(settings.m_targetMs * kHeadroom / estimateMs);
+    }
+    desired = floorf(desired * kScaleSteps) / kScaleSteps;
+    desired = desired < settings.m_minScale ? settings.m_minScale : desired;
+    desired = desired > settings.m_maxScale ? settings.m_maxScale : desired;
+
+    float next = scale;
+    if (desired < scale)
+    {
+        next = desired;
+    }
+    else if (desired > scale && controller->m_framesSinceChange >= kFramesBeforeScaleUp)
+    {
+        next = fminf(desired, scale + kScaleUpStep);
+    }
+
+    if (next != scale)
+    {
+        controller->m_scale = next;
+        controller->m_framesSinceChange = 0;
+    }
+
+    return controller->m_scale;
+}
+
+void DynamicResolution::ScaledSize(
+    float scale,
+    int width,
+    int height,
+    int* scaledWidth,
+    int* scaledHeight)
+{
+    POW2_ASSERT(scaledWidth && scaledHeight);
+
+    int w = (int)(width * scale + 0.5f);
+    int h = (int)(height * scale + 0.5f);
+    w = w < 1 ? 1 : (w > width ? width : w);
+    h = h < 1 ? 1 : (h > height ? height : h);
+
+    *scaledWidth = width > 0 ? w : 0;
+    *scaledHeight = height > 0 ? h : 0;
+}
+
+RasterBuffers DynamicResolution::ScaledBuffers(
+    const RasterBuffers& buffers,
+    int width,
+    int height,
+    uint32_t* color)
+{
+    POW2_ASSERT((size_t)width <= buffers.m_width && (size_t)height <= buffers.m_height);
+
+    const size_t pixels = (size_t)width * height;
+
+    RasterBuffers scaled = buffers;
+    scaled.m_color = color;
+    scaled.m_width = width;
+    scaled.m_height = height;
+    scaled.m_colorBufferBytes = pixels * buffers.m_bytesPerPixel;
+    scaled.m_fragmentsTmpBufferBytes = pixels * sizeof(FragmentInput);
+    scaled.m_depthBufferBytes = buffers.m_depth ? pixels * sizeof(float) : 0;
+    return scaled;
+}
+
+//
+// UPSCALING
+//
+
+// Blend of two 0xAARRGGBB colours, weight is b's out of 256
+static inline uint32_t LerpColor(uint32_t a, uint32_t b, uint32_t weight)
+{
+    const uint32_t rb =
+        (((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight) >> 8) & 0xff00ff;
+    const uint32_t ag =
+        ((((a >> 8) & 0xff00ff) * (256 - weight) + ((b >> 8) & 0xff00ff) * weight)) & 0xff00ff00;
+    return rb | ag;
+}
+
+// Maps dst texel centres to src: returns the first src texel and the weight of the next one
+static inline void SourceCoordinate(int dst, float step, int srcSize, int* first, uint32_t* weight)
+{
+    float s = (dst + 0.5f) * step - 0.5f;
+    s = s < 0 ? 0 : (s > srcSize - 1 ? (float)(srcSize - 1) : s);
+    *first = (int)s;
+    *weight = (uint32_t)((s - *first) * 256);
+}
+
+void DynamicResolution::UpscaleBilinear(
+    const uint32_t* src,
+    int srcWidth,
+    int srcHeight,
+    uint32_t* dst,
+    int dstWidth,
+    int dstHeight,
+    uint32_t* scratch)
+{
+    POW2_ASSERT(src && dst && scratch);
+    POW2_ASSERT(srcWidth > 0 && srcHeight > 0);
+
+    // Vertically filtered source row, plus a copy of its last texel so x0 + 1 is always valid
+    uint32_t* row = scratch;
+
+    // Per dst column: first source texel << 8 | weight of the next one
+    uint32_t* columns = scratch + srcWidth + 1;
+
+    const float stepX = (float)srcWidth / dstWidth;
+    const float stepY = (float)srcHeight / dstHeight;
+
+    for (int x = 0; x < dstWidth; ++x)
+    {
+        int first;
+        uint32_t weight;
+        SourceCoordinate(x, stepX, srcWidth, &first, &weight);
+        columns[x] = (first << 8) | weight;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int y = 0; y < dstHeight; ++y)
+    {
+        int y0;
+        uint32_t weightY;
+        SourceCoordinate(y, stepY, srcHeight, &y0, &weightY);
+        const int y1 = y0 + 1 < srcHeight ? y0 + 1 : y0;
+        const uint32_t* src0 = src + (size_t)y0 * srcWidth;
+        const uint32_t* src1 = src + (size_t)y1 * srcWidth;
+
+        //
+        // Vertical pass over the source row, four texels at a time:
+        // (a * (256 - w) + b * w) >> 8 fits 16 bit lanes
+        //
+
+        const __m128i w1 = _mm_set1_epi16((short)weightY);
+        const __m128i w0 = _mm_set1_epi16((short)(256 - weightY));
+
+        int x = 0;
+        for (; x + 4 <= srcWidth; x += 4)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i*)(src0 + x));
+            const __m128i b = _mm_loadu_si128((const __m128i*)(src1 + x));
+
+            const __m128i lo = _mm_srli_epi16(_mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)), 8);
+            const __m128i hi = _mm_srli_epi16(_mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)), 8);
+
+            _mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(lo, hi));
+        }
+        for (; x < srcWidth; ++x)
+        {
+            row[x] = LerpColor(src0[x], src1[x], weightY);
+        }
+        row[srcWidth] = row[srcWidth - 1];
+
+        //
+        // Horizontal pass, two dst pixels at a time. Each loads its pair of source texels,
+        // weighs them and adds the two halves of the register.
+        //
+
+        uint32_t* out = dst + (size_t)y * dstWidth;
+
+        x = 0;
+        for (; x + 2 <= dstWidth; x += 2)
+        {
+            const uint32_t c0 = columns[x];
+            const uint32_t c1 = columns[x + 1];
+
+            const __m128i p0 = _mm_unpacklo_epi8(
+                _mm_loadl_epi64((const __m128i*)(row + (c0 >> 8))), zero);
+            const __m128i p1 = _mm_unpacklo_epi8(
+                _mm_loadl_epi64((const __m128i*)(row + (c1 >> 8))), zero);
+
+            const __m128i weights0 = _mm_unpacklo_epi64(
+                _mm_set1_epi16((short)(256 - (c0 & 0xff))), _mm_set1_epi16((short)(c0 & 0xff)));
+            const __m128i weights1 = _mm_unpacklo_epi64(
+                _mm_set1_epi16((short)(256 - (c1 & 0xff))), _mm_set1_epi16((short)(c1 & 0xff)));
+
+            __m128i m0 = _mm_mullo_epi16(p0, weights0);
+            __m128i m1 = _mm_mullo_epi16(p1, weights1);
+            m0 = _mm_add_epi16(m0, _mm_srli_si128(m0, 8));
+            m1 = _mm_add_epi16(m1, _mm_srli_si128(m1, 8));
+
+            const __m128i both = _mm_srli_epi16(_mm_unpacklo_epi64(m0, m1), 8);
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(both, zero));
+        }
+        for (; x < dstWidth; ++x)
+        {
+            const uint32_t c = columns[x];
+            out[x] = LerpColor(row[c >> 8], row[(c >> 8) + 1], c & 0xff);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Rasterizer.h"
+
+#include <stdint.h>
+
+//
+// Picks the internal render resolution from measured Render() times so frames stay within a
+// budget, and scales the result back up to the output size.
+//
+// Cost is assumed proportional to the pixel count, so every measured time is normalised to a
+// full resolution estimate (time / scale^2) and the scale that fits the budget follows. The
+// scale drops as soon as a frame goes over, but only climbs back slowly, so it doesn't
+// oscillate around the budget.
+//
+
+struct DynamicResolutionSettings
+{
+    double m_targetMs;  // budget for Render()
+    float m_minScale;   // of the output size, per axis
+    float m_maxScale;
+};
+
+struct ResolutionController  // see DynamicResolution::Init
+{
+    static const int kHistory = 16;
+
+    DynamicResolutionSettings m_settings;
+    float m_scale;
+    double m_fullResolutionMs[kHistory];  // measured times normalised to scale 1, ring buffer
+    int m_historyCount;
+    int m_historyNext;
+    int m_framesSinceChange;
+};
+
+namespace DynamicResolution
+{
+    void Init(ResolutionController* controller, const DynamicResolutionSettings& settings);
+
+    // Feeds the time Render() took at the current scale and returns the scale for the next frame
+    float Update(ResolutionController* controller, double renderMs);
+
+    // Size of the internal buffers for a scale, never smaller than 1x1 nor bigger than the output
+    void ScaledSize(float scale, int width, int height, int* scaledWidth, int* scaledHeight);
+
+    // Output size buffers viewed as width x height ones (rows packed), so every scale renders
+    // into the same preallocated memory
+    RasterBuffers ScaledBuffers(
+        const RasterBuffers& buffers,
+        int width,
+        int height,
+        uint32_t* color);
+
+    // Bilinear filter from src to dst (both 0xAARRGGBB, rows packed) with SSE2, two output
+    // pixels at a time. scratch must hold srcWidth + dstWidth + 1 uint32_t.
+    void UpscaleBilinear(
+        const uint32_t* src,
+        int srcWidth,
+        int srcHeight,
+        uint32_t* dst,
+        int dstWidth,
+        int dstHeight,
+        uint32_t* scratch);
+}
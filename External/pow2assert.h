@@ -52,7 +52,11 @@ namespace pow2 { namespace Assert
 							   const char* msg, ...);
 }}
 
-#define POW2_HALT() __debugbreak()
+#if defined(_MSC_VER)
+	#define POW2_HALT() __debugbreak()
+#else
+	#define POW2_HALT() __builtin_trap()
+#endif
 #define POW2_UNUSED(x) do { (void)sizeof(x); } while(0)
 
 #ifdef POW2_ASSERTS_ENABLED
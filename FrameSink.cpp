@@ -0,0 +1,526 @@
+#include "FrameSink.h"
+
+#include "DebugTimer.h"
+#include "Log.h"
+#include "SizeOfArray.h"
+
+#include "External/pow2assert.h"
+
+#include <condition_variable>
+#include <emmintrin.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static const char* const kFormatNames[] = {
+    "bgra",
+    "rgba",
+    "y4m" };
+
+static const char kY4mFrameLine[] = "FRAME\n";
+static const size_t kY4mFrameLineBytes = sizeof(kY4mFrameLine) - 1;
+static const int kMaxQueueFrames = 16;
+
+struct FrameSinkSums  // zero is initialisation
+{
+    int m_frames;
+    int m_converted;
+    uint64_t m_bytes;
+    double m_firstWriteMs;
+    double m_lastWrittenMs;
+    double m_convertMs;
+    double m_writeMs;
+    double m_queueWaitMs;
+    int m_maxQueued;
+};
+
+struct FrameSinkState
+{
+    FILE* m_file;
+    FrameSinkSettings m_settings;
+
+    // Converted frames, a ring: Write fills m_queuedCount's, the writer empties m_writtenCount's
+    uint8_t* m_frames[kMaxQueueFrames];
+    size_t m_frameBytes;  // the Y4M FRAME line included
+    uint64_t m_queuedCount;
+    uint64_t m_writtenCount;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_queued;   // the writer waits on this
+    std::condition_variable m_written;  // Write waits on this
+    bool m_quit;                        // protected by m_mutex
+
+    FrameSinkSums m_sums;  // protected by m_mutex
+};
+
+static FrameSinkState g_sink;
+static bool g_open = false;
+static bool g_simd = true;
+
+//
+// CONVERSION
+//
+// Integer BT.601 video range, the usual 8 bit approximations:
+//   Y = (66 R + 129 G + 25 B + 128) / 256 + 16
+//   U = (-38 R - 74 G + 112 B + 128) / 256 + 128
+//   V = (112 R - 94 G - 18 B + 128) / 256 + 128
+// With the offsets folded into the sums every intermediate value is between 0 and 65535, so the
+// SSE2 version can do them in wrapping 16 bit lanes and still get exactly the scalar results.
+//
+
+static const int kLumaBias = 128 + (16 << 8);
+static const int kChromaBias = 128 + (128 << 8);
+
+static inline uint8_t Luma(uint32_t c)
+{
+    const int r = (c >> 16) & 0xff;
+    const int g = (c >> 8) & 0xff;
+    const int b = c & 0xff;
+    return (uint8_t)((66 * r + 129 * g + 25 * b + kLumaBias) >> 8);
+}
+
+// Of 4 summed pixels
+static inline void Chroma(int r4, int g4, int b4, uint8_t* u, uint8_t* v)
+{
+    const int r = (r4 + 2) >> 2;
+    const int g = (g4 + 2) >> 2;
+    const int b = (b4 + 2) >> 2;
+    *u = (uint8_t)((-38 * r - 74 * g + 112 * b + kChromaBias) >> 8);
+    *v = (uint8_t)((112 * r - 94 * g - 18 * b + kChromaBias) >> 8);
+}
+
+// Two output rows (row1 is below row0, and can be row0 again at the bottom of an odd height),
+// from pixel first on
+static void YuvRowsScalar(
+    const uint32_t* row0, const uint32_t* row1, int first, int width,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    for (int x = first; x < width; x += 2)
+    {
+        const int x1 = x + 1 < width ? x + 1 : x;  // odd widths repeat the last column
+        const uint32_t pixels[4] = { row0[x], row0[x1], row1[x], row1[x1] };
+        int r4 = 0;
+        int g4 = 0;
+        int b4 = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            r4 += (pixels[i] >> 16) & 0xff;
+            g4 += (pixels[i] >> 8) & 0xff;
+            b4 += pixels[i] & 0xff;
+        }
+
+        y0[x] = Luma(row0[x]);
+        y1[x] = Luma(row1[x]);
+        y0[x1] = Luma(row0[x1]);
+        y1[x1] = Luma(row1[x1]);
+        Chroma(r4, g4, b4, &u[x / 2], &v[x / 2]);
+    }
+}
+
+// Blue, green and red of 8 pixels, in 16 bit lanes
+static inline void Channels8(const uint32_t* pixels, __m128i* b, __m128i* g, __m128i* r)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i lo = _mm_loadu_si128((const __m128i*)pixels);
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(pixels + 4));
+    *b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+    *g = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+    *r = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+static inline __m128i Luma8(const __m128i& b, const __m128i& g, const __m128i& r)
+{
+    __m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(66));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_add_epi16(y, _mm_set1_epi16((short)kLumaBias));
+    return _mm_srli_epi16(y, 8);
+}
+
+// Averages of the 2x2 blocks of 8 pixels on two rows, in the first 4 16 bit lanes (and again
+// in the last 4)
+static inline __m128i Average2x2(const __m128i& row0, const __m128i& row1)
+{
+    const __m128i sums = _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+    const __m128i average = _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(2)), 2);
+    return _mm_packs_epi32(average, average);
+}
+
+static inline __m128i Chroma8(
+    const __m128i& b, const __m128i& g, const __m128i& r, short rScale, short gScale, short bScale)
+{
+    __m128i c = _mm_mullo_epi16(r, _mm_set1_epi16(rScale));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(g, _mm_set1_epi16(gScale)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(bScale)));
+    c = _mm_add_epi16(c, _mm_set1_epi16((short)kChromaBias));
+    return _mm_srli_epi16(c, 8);
+}
+
+static void YuvRowsSimd(
+    const uint32_t* row0, const uint32_t* row1, int width,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i b0, g0, r0;
+        __m128i b1, g1, r1;
+        Channels8(row0 + x, &b0, &g0, &r0);
+        Channels8(row1 + x, &b1, &g1, &r1);
+
+        _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(Luma8(b0, g0, r0), zero));
+        _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(Luma8(b1, g1, r1), zero));
+
+        const __m128i b = Average2x2(b0, b1);
+        const __m128i g = Average2x2(g0, g1);
+        const __m128i r = Average2x2(r0, r1);
+        const int u4 = _mm_cvtsi128_si32(_mm_packus_epi16(Chroma8(b, g, r, -38, -74, 112), zero));
+        const int v4 = _mm_cvtsi128_si32(_mm_packus_epi16(Chroma8(b, g, r, 112, -94, -18), zero));
+        memcpy(u + x / 2, &u4, sizeof(u4));
+        memcpy(v + x / 2, &v4, sizeof(v4));
+    }
+
+    YuvRowsScalar(row0, row1, x, width, y0, y1, u, v);
+}
+
+static void ConvertYuv420(const uint32_t* color, int width, int height, uint8_t* out)
+{
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    uint8_t* yPlane = out;
+    uint8_t* uPlane = yPlane + (size_t)width * height;
+    uint8_t* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+    for (int y = 0; y < height; y += 2)
+    {
+        // Output rows are top down, the colour buffer bottom up
+        const int y1 = y + 1 < height ? y + 1 : y;
+        const uint32_t* row0 = color + (size_t)(height - 1 - y) * width;
+        const uint32_t* row1 = color + (size_t)(height - 1 - y1) * width;
+        uint8_t* luma0 = yPlane + (size_t)y * width;
+        uint8_t* luma1 = yPlane + (size_t)y1 * width;
+        uint8_t* u = uPlane + (size_t)(y / 2) * chromaWidth;
+        uint8_t* v = vPlane + (size_t)(y / 2) * chromaWidth;
+        if (g_simd)
+        {
+            YuvRowsSimd(row0, row1, width, luma0, luma1, u, v);
+        }
+        else
+        {
+            YuvRowsScalar(row0, row1, 0, width, luma0, luma1, u, v);
+        }
+    }
+}
+
+static void ConvertRgba(const uint32_t* color, int width, int height, uint8_t* out)
+{
+    const __m128i redBlue = _mm_set1_epi32(0x00ff00ff);
+    const __m128i greenAlpha = _mm_set1_epi32((int)0xff00ff00);
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uint32_t* row = color + (size_t)(height - 1 - y) * width;
+        uint32_t* outRow = (uint32_t*)out + (size_t)y * width;
+        int x = 0;
+        if (g_simd)
+        {
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+                const __m128i rb = _mm_and_si128(pixels, redBlue);
+                const __m128i swapped =
+                    _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+                const __m128i rgba = _mm_or_si128(
+                    _mm_and_si128(swapped, redBlue), _mm_and_si128(pixels, greenAlpha));
+                _mm_storeu_si128((__m128i*)(outRow + x), rgba);
+            }
+        }
+        for (; x < width; ++x)
+        {
+            const uint32_t c = row[x];
+            outRow[x] = (c & 0xff00ff00) | ((c & 0xff) << 16) | ((c >> 16) & 0xff);
+        }
+    }
+}
+
+//
+// WRITING
+//
+
+static void WriteBytes(const void* data, size_t bytes)
+{
+    if (fwrite(data, 1, bytes, g_sink.m_file) != bytes)
+    {
+        Log::Error("Cannot write frame");
+    }
+}
+
+static void WriterMain()
+{
+    FrameSinkState& s = g_sink;
+
+    for (;;)
+    {
+        uint64_t frame;
+        {
+            std::unique_lock<std::mutex> lock(s.m_mutex);
+            s.m_queued.wait(lock, [&] {
+                return s.m_quit || s.m_writtenCount != s.m_queuedCount; });
+
+            if (s.m_writtenCount == s.m_queuedCount)
+            {
+                return;  // quitting, and nothing left to write
+            }
+
+            frame = s.m_writtenCount;
+        }
+
+        // Write doesn't touch the frame until m_writtenCount moves past it
+        const double startMs = DebugTimer_NowMs();
+        WriteBytes(s.m_frames[frame % s.m_settings.m_queueFrames], s.m_frameBytes);
+        const double endMs = DebugTimer_NowMs();
+
+        {
+            std::lock_guard<std::mutex> lock(s.m_mutex);
+            ++s.m_sums.m_frames;
+            s.m_sums.m_bytes += s.m_frameBytes;
+            s.m_sums.m_writeMs += endMs - startMs;
+            s.m_sums.m_lastWrittenMs = endMs;
+            ++s.m_writtenCount;
+        }
+        s.m_written.notify_one();
+    }
+}
+
+//
+// EXTERNAL FUNCTIONS
+//
+
+bool FrameSink::Open(const char* path, const FrameSinkSettings& settings)
+{
+    POW2_ASSERT(!g_open);
+    POW2_ASSERT(path);
+    POW2_ASSERT(settings.m_format >= FrameFormat(0) && settings.m_format < FrameFormat::Count);
+    POW2_ASSERT(settings.m_width > 0 && settings.m_height > 0);
+    POW2_ASSERT(settings.m_queueFrames >= 0 && settings.m_queueFrames <= kMaxQueueFrames);
+
+    FrameSinkState& s = g_sink;
+    s.m_file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!s.m_file)
+    {
+        return false;
+    }
+
+    // Frames go out in big writes straight from their buffers, stdio copying them into its own
+    // buffer first would only cost time
+    setvbuf(s.m_file, nullptr, _IONBF, 0);
+
+    s.m_settings = settings;
+    s.m_settings.m_queueFrames =
+        settings.m_queueFrames ? settings.m_queueFrames : kDefaultQueueFrames;
+    s.m_settings.m_fps = settings.m_fps > 0 ? settings.m_fps : 60;
+    s.m_queuedCount = 0;
+    s.m_writtenCount = 0;
+    s.m_quit = false;
+    s.m_sums = {};
+
+    if (settings.m_format == FrameFormat::Y4M)
+    {
+        char header[128];
+        const int length = sprintf(
+            header, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+            settings.m_width, settings.m_height, s.m_settings.m_fps);
+        WriteBytes(header, length);
+    }
+
+    // BGRA is written from the caller's buffer, the rest need frames of their own and a writer
+    if (settings.m_format != FrameFormat::BGRA)
+    {
+        const size_t lineBytes = settings.m_format == FrameFormat::Y4M ? kY4mFrameLineBytes : 0;
+        s.m_frameBytes =
+            lineBytes + GetFrameBytes(settings.m_format, settings.m_width, settings.m_height);
+        for (int i = 0; i < s.m_settings.m_queueFrames; ++i)
+        {
+            s.m_frames[i] = (uint8_t*)malloc(s.m_frameBytes);
+            POW2_ASSERT(s.m_frames[i]);
+            memcpy(s.m_frames[i], kY4mFrameLine, lineBytes);
+        }
+        s.m_thread = std::thread(WriterMain);
+    }
+
+    g_open = true;
+    return true;
+}
+
+void FrameSink::Close()
+{
+    POW2_ASSERT(g_open);
+
+    FrameSinkState& s = g_sink;
+    if (s.m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(s.m_mutex);
+            s.m_quit = true;
+        }
+        s.m_queued.notify_one();
+        s.m_thread.join();
+    }
+
+    for (int i = 0; i < kMaxQueueFrames; ++i)
+    {
+        free(s.m_frames[i]);
+        s.m_frames[i] = nullptr;
+    }
+
+    if (s.m_file != stdout)
+    {
+        fclose(s.m_file);
+    }
+    s.m_file = nullptr;
+    g_open = false;
+}
+
+void FrameSink::Write(const uint32_t* color)
+{
+    POW2_ASSERT(g_open);
+    POW2_ASSERT(color);
+
+    FrameSinkState& s = g_sink;
+    const int width = s.m_settings.m_width;
+    const int height = s.m_settings.m_height;
+    const double startMs = DebugTimer_NowMs();
+
+    if (s.m_settings.m_format == FrameFormat::BGRA)
+    {
+        // No copy: the rows go from the colour buffer to the file, bottom up buffer top row first
+        for (int y = height - 1; y >= 0; --y)
+        {
+            WriteBytes(color + (size_t)y * width, sizeof(uint32_t) * width);
+        }
+        const double endMs = DebugTimer_NowMs();
+
+        std::lock_guard<std::mutex> lock(s.m_mutex);
+        s.m_sums.m_firstWriteMs = s.m_sums.m_frames ? s.m_sums.m_firstWriteMs : startMs;
+        ++s.m_sums.m_frames;
+        s.m_sums.m_bytes += sizeof(uint32_t) * width * height;
+        s.m_sums.m_writeMs += endMs - startMs;
+        s.m_sums.m_lastWrittenMs = endMs;
+        return;
+    }
+
+    uint8_t* frame;
+    {
+        std::unique_lock<std::mutex> lock(s.m_mutex);
+        s.m_sums.m_firstWriteMs = s.m_queuedCount ? s.m_sums.m_firstWriteMs : startMs;
+        s.m_written.wait(lock, [&] {
+            return s.m_queuedCount - s.m_writtenCount < (uint64_t)s.m_settings.m_queueFrames; });
+        frame = s.m_frames[s.m_queuedCount % s.m_settings.m_queueFrames];
+    }
+    const double convertStartMs = DebugTimer_NowMs();
+
+    const size_t lineBytes = s.m_settings.m_format == FrameFormat::Y4M ? kY4mFrameLineBytes : 0;
+    ConvertFrame(s.m_settings.m_format, color, width, height, frame + lineBytes);
+    const double endMs = DebugTimer_NowMs();
+
+    {
+        std::lock_guard<std::mutex> lock(s.m_mutex);
+        ++s.m_queuedCount;
+        ++s.m_sums.m_converted;
+        s.m_sums.m_convertMs += endMs - convertStartMs;
+        s.m_sums.m_queueWaitMs += convertStartMs - startMs;
+        const int queued = (int)(s.m_queuedCount - s.m_writtenCount);
+        s.m_sums.m_maxQueued = queued > s.m_sums.m_maxQueued ? queued : s.m_sums.m_maxQueued;
+    }
+    s.m_queued.notify_one();
+}
+
+void FrameSink::WaitIdle()
+{
+    POW2_ASSERT(g_open);
+
+    FrameSinkState& s = g_sink;
+    std::unique_lock<std::mutex> lock(s.m_mutex);
+    s.m_written.wait(lock, [&] { return s.m_writtenCount == s.m_queuedCount; });
+}
+
+FrameSinkMetrics FrameSink::GetMetrics()
+{
+    POW2_ASSERT(g_open);
+
+    std::lock_guard<std::mutex> lock(g_sink.m_mutex);
+    const FrameSinkSums& sums = g_sink.m_sums;
+
+    FrameSinkMetrics metrics = {};
+    metrics.m_frames = sums.m_frames;
+    metrics.m_bytes = sums.m_bytes;
+    metrics.m_elapsedMs = sums.m_frames ? sums.m_lastWrittenMs - sums.m_firstWriteMs : 0;
+    metrics.m_convertMs = sums.m_converted ? sums.m_convertMs / sums.m_converted : 0;
+    metrics.m_writeMs = sums.m_frames ? sums.m_writeMs / sums.m_frames : 0;
+    metrics.m_queueWaitMs = sums.m_queueWaitMs;
+    metrics.m_maxQueued = sums.m_maxQueued;
+    return metrics;
+}
+
+const char* FrameSink::GetFormatName(FrameFormat format)
+{
+    static_assert(
+        SizeOfArray(kFormatNames) == (size_t)FrameFormat::Count,
+        "One name per format");
+    POW2_ASSERT(format >= FrameFormat(0) && format < FrameFormat::Count);
+    return kFormatNames[(int)format];
+}
+
+size_t FrameSink::GetFrameBytes(FrameFormat format, int width, int height)
+{
+    POW2_ASSERT(format >= FrameFormat(0) && format < FrameFormat::Count);
+
+    const size_t pixels = (size_t)width * height;
+    if (format == FrameFormat::Y4M)
+    {
+        return pixels + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    }
+    return sizeof(uint32_t) * pixels;
+}
+
+void FrameSink::ConvertFrame(
+    FrameFormat format, const uint32_t* color, int width, int height, uint8_t* out)
+{
+    POW2_ASSERT(color && out);
+
+    if (format == FrameFormat::Y4M)
+    {
+        ConvertYuv420(color, width, height, out);
+    }
+    else if (format == FrameFormat::RGBA)
+    {
+        ConvertRgba(color, width, height, out);
+    }
+    else
+    {
+        // Only the row order changes
+        for (int y = 0; y < height; ++y)
+        {
+            memcpy(
+                out + sizeof(uint32_t) * y * width,
+                color + (size_t)(height - 1 - y) * width,
+                sizeof(uint32_t) * width);
+        }
+    }
+}
+
+void FrameSink::SetSimd(bool enabled)
+{
+    g_simd = enabled;
+}
+
+bool FrameSink::GetSimd()
+{
+    return g_simd;
+}
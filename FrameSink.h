@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// FRAME SINK INPUT: rendered colour buffers (bottom up BGRA, as the rasterizer draws them)
+// FRAME SINK OUTPUT: a video stream in a file or pipe, top row first
+//
+// BGRA frames are the colour buffer as it is, so Write hands its rows straight to the file with
+// no copy and returns once they're written. Call it from the swapchain's present thread and the
+// swapchain's buffers are the queue (see Swapchain.h).
+//
+// Other formats are converted into one of the sink's own queued frames and written by the
+// sink's thread, so Write returns as soon as the conversion is done unless every queued frame
+// is still waiting to be written. With the queue full Write waits: frames are never dropped.
+//
+// Y4M is YUV 4:2:0 (BT.601, video range, chroma averaged over 2x2 pixels) with the stream
+// header that ffplay, ffmpeg and most encoders read without being told the size or rate:
+//
+//   Renderer --output - --format y4m scene.mesh | ffmpeg -i - -c:v libx264 out.mp4
+//
+
+enum class FrameFormat
+{
+    BGRA,  // raw, 4 bytes per pixel (ffplay -pixel_format bgra)
+    RGBA,  // raw, 4 bytes per pixel (ffplay -pixel_format rgba)
+    Y4M,
+    Count
+};
+
+struct FrameSinkSettings
+{
+    FrameFormat m_format;
+    int m_width;
+    int m_height;
+    int m_fps;          // the rate players show it at (Y4M only)
+    int m_queueFrames;  // converted frames waiting to be written, 0 for kDefaultQueueFrames
+};
+
+struct FrameSinkMetrics  // since Open
+{
+    int m_frames;             // written
+    uint64_t m_bytes;
+    double m_elapsedMs;       // first Write to the end of the last frame written
+    double m_convertMs;       // average per frame, in Write
+    double m_writeMs;         // average per frame, in the file writes
+    double m_queueWaitMs;     // Write waiting for the writer to free a queued frame, in total
+    int m_maxQueued;
+};
+
+namespace FrameSink
+{
+    static const int kDefaultQueueFrames = 4;
+
+    // Opens path ("-" for stdout) and starts the writer thread. Returns false if the file
+    // can't be opened.
+    bool Open(const char* path, const FrameSinkSettings& settings);
+
+    // Writes whatever is queued, then stops the writer thread and closes the file
+    void Close();
+
+    // Streams a frame of the size given to Open
+    void Write(const uint32_t* color);
+
+    // Blocks until every frame passed to Write is in the file
+    void WaitIdle();
+
+    FrameSinkMetrics GetMetrics();
+
+    const char* GetFormatName(FrameFormat format);
+
+    // Bytes of a converted frame, and the conversion itself (Y4M: the frame's planes, Y then U
+    // then V, without the FRAME line). Exposed for measurement (Tools/Benchmark.cpp
+    // "frame-sink").
+    size_t GetFrameBytes(FrameFormat format, int width, int height);
+    void ConvertFrame(
+        FrameFormat format, const uint32_t* color, int width, int height, uint8_t* out);
+
+    // SSE2 conversion, on by default. Off, plain C++ that gives the same bytes, to compare.
+    void SetSimd(bool enabled);
+    bool GetSimd();
+}
@@ -11,6 +11,7 @@ struct VertexData
     vec4 m_pos;  // window coordinates
     vec4 m_color;
     vec2 m_textureCoord;
+    vec3 m_normal;  // normalised, lighting space (see Lighting.h) once in window coordinates
 };
 
-POW2_STATIC_ASSERT(sizeof(VertexData) == 40);  // size of VertexData is performance-sensitive
+POW2_STATIC_ASSERT(sizeof(VertexData) == 52);  // size of VertexData is performance-sensitive
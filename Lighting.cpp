@@ -0,0 +1,235 @@
+#include "Lighting.h"
+
+#include "Rasterizer.h"
+#include "ThreadPool.h"
+
+#include "External/pow2assert.h"
+
+#include <float.h>
+#include <math.h>
+
+// Material, the same for everything for now
+static const float kAmbient = 0.15f;
+static const float kSpecular = 0.4f;  // shininess is 32, see Evaluate
+
+struct CullJob
+{
+    LightGrid* m_grid;
+    const DepthBuffer* m_depth;
+};
+
+// Squared distance from p to the box [lo, hi]
+static inline float DistanceToBoxSquared(const vec3& p, const vec3& lo, const vec3& hi)
+{
+    const float dx = p.x < lo.x ? lo.x - p.x : (p.x > hi.x ? p.x - hi.x : 0);
+    const float dy = p.y < lo.y ? lo.y - p.y : (p.y > hi.y ? p.y - hi.y : 0);
+    const float dz = p.z < lo.z ? lo.z - p.z : (p.z > hi.z ? p.z - hi.z : 0);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static inline int ClampTile(int tile, int tiles)
+{
+    return tile < 0 ? 0 : (tile < tiles ? tile : tiles - 1);
+}
+
+static void CullTileRow(int tileY, int, void* userData)
+{
+    const CullJob& job = *(const CullJob*)userData;
+    LightGrid* grid = job.m_grid;
+    const DepthBuffer& depth = *job.m_depth;
+    const int tileSize = LightGrid::kTileSize;
+
+    const int minY = tileY * tileSize;
+    const int maxY = minY + tileSize < depth.m_height ? minY + tileSize : depth.m_height;
+
+    // Lights that reach the row at all, so tiles only go through those
+    uint16_t* rowLights = grid->m_rowLights.data() + tileY * grid->m_lightCount;
+    int rowCount = 0;
+    for (int i = 0; i < grid->m_lightCount; ++i)
+    {
+        const Light& light = grid->m_lights[i];
+        if (light.m_type == LightType::DIRECTIONAL ||
+            (light.m_position.y + light.m_range > minY &&
+                light.m_position.y - light.m_range < maxY))
+        {
+            rowLights[rowCount++] = (uint16_t)i;
+        }
+    }
+
+    for (int tileX = 0; tileX < grid->m_tilesX; ++tileX)
+    {
+        const int minX = tileX * tileSize;
+        const int maxX = minX + tileSize < depth.m_width ? minX + tileSize : depth.m_width;
+
+        // Depth range of what was drawn in the tile
+        float minZ = FLT_MAX;
+        float maxZ = -FLT_MAX;
+        for (int y = minY; y < maxY; ++y)
+        {
+            const float* row = depth.m_data + y * depth.m_width;
+            for (int x = minX; x < maxX; ++x)
+            {
+                const float z = row[x];
+                if (z != FLT_MAX)
+                {
+                    minZ = z < minZ ? z : minZ;
+                    maxZ = z > maxZ ? z : maxZ;
+                }
+            }
+        }
+
+        const int tile = tileY * grid->m_tilesX + tileX;
+        uint16_t* tileLights = grid->m_tileLights.data() + tile * LightGrid::kMaxTileLights;
+        int count = 0;
+
+        if (minZ <= maxZ)
+        {
+            const vec3 lo((float)minX, (float)minY, minZ * grid->m_depthToPixels);
+            const vec3 hi((float)maxX, (float)maxY, maxZ * grid->m_depthToPixels);
+
+            for (int i = 0; i < rowCount && count < LightGrid::kMaxTileLights; ++i)
+            {
+                // Spots are tested as the sphere of their range
+                const Light& light = grid->m_lights[rowLights[i]];
+                if (light.m_type == LightType::DIRECTIONAL ||
+                    DistanceToBoxSquared(light.m_position, lo, hi) <
+                        light.m_range * light.m_range)
+                {
+                    tileLights[count++] = rowLights[i];
+                }
+            }
+        }
+
+        grid->m_tileLightCounts[tile] = (uint16_t)count;
+    }
+}
+
+void Lighting::CullLights(
+    LightGrid* grid,
+    const Light* lights,
+    int lightCount,
+    const DepthBuffer& depth,
+    float depthToPixels)
+{
+    POW2_ASSERT(grid);
+    POW2_ASSERT(lights || lightCount == 0);
+    POW2_ASSERT(lightCount >= 0 && lightCount <= LightGrid::kMaxLights);
+
+    grid->m_lights = lights;
+    grid->m_lightCount = lightCount;
+    grid->m_depthToPixels = depthToPixels;
+    grid->m_tilesX = (depth.m_width + LightGrid::kTileSize - 1) / LightGrid::kTileSize;
+    grid->m_tilesY = (depth.m_height + LightGrid::kTileSize - 1) / LightGrid::kTileSize;
+
+    // Only grow with the window and the light count
+    const size_t tiles = (size_t)grid->m_tilesX * grid->m_tilesY;
+    if (grid->m_tileLightCounts.size() < tiles)
+    {
+        grid->m_tileLights.resize(tiles * LightGrid::kMaxTileLights);
+        grid->m_tileLightCounts.resize(tiles);
+    }
+    const size_t rowLights = (size_t)grid->m_tilesY * lightCount;
+    if (grid->m_rowLights.size() < rowLights)
+    {
+        grid->m_rowLights.resize(rowLights);
+    }
+
+    CullJob job = { grid, &depth };
+    ThreadPool::ParallelFor(grid->m_tilesY, CullTileRow, &job);
+}
+
+LightResult Lighting::Evaluate(const LightGrid& grid, const vec3& position, const vec3& normal)
+{
+    LightResult result;
+    result.m_diffuse = vec3(kAmbient, kAmbient, kAmbient);
+    result.m_specular = vec3zero;
+
+    const int tileX = ClampTile((int)position.x / LightGrid::kTileSize, grid.m_tilesX);
+    const int tileY = ClampTile((int)position.y / LightGrid::kTileSize, grid.m_tilesY);
+    const int tile = tileY * grid.m_tilesX + tileX;
+    const uint16_t* tileLights = grid.m_tileLights.data() + tile * LightGrid::kMaxTileLights;
+    const int count = grid.m_tileLightCounts[tile];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Light& light = grid.m_lights[tileLights[i]];
+
+        vec3 toLight;
+        float attenuation = 1;
+        if (light.m_type == LightType::DIRECTIONAL)
+        {
+            toLight = -light.m_direction;
+        }
+        else
+        {
+            // Smooth falloff to 0 at the range
+            const vec3 offset = light.m_position - position;
+            const float distanceSquared = vec3Dot(offset, offset);
+            const float rangeSquared = light.m_range * light.m_range;
+            if (distanceSquared >= rangeSquared || distanceSquared == 0)
+            {
+                continue;
+            }
+            toLight = offset * (1 / sqrtf(distanceSquared));
+            const float falloff = 1 - distanceSquared / rangeSquared;
+            attenuation = falloff * falloff;
+
+            if (light.m_type == LightType::SPOT)
+            {
+                const float cosAngle = -vec3Dot(toLight, light.m_direction);
+                if (cosAngle <= light.m_cosOuter)
+                {
+                    continue;
+                }
+                const float cone =
+                    (cosAngle - light.m_cosOuter) / (light.m_cosInner - light.m_cosOuter);
+                attenuation *= cone < 1 ? cone : 1;
+            }
+        }
+
+        const float lambert = vec3Dot(normal, toLight);
+        if (lambert <= 0)
+        {
+            continue;
+        }
+        result.m_diffuse = result.m_diffuse + light.m_color * (lambert * attenuation);
+
+        // Half vector with the viewer, which is along -z everywhere
+        const vec3 half = toLight + vec3(0, 0, -1);
+        const float halfLengthSquared = vec3Dot(half, half);
+        const float cosHalf =
+            halfLengthSquared > 0 ? vec3Dot(normal, half) / sqrtf(halfLengthSquared) : 0;
+        if (cosHalf > 0)
+        {
+            float specular = cosHalf * cosHalf;  // ^2
+            specular *= specular;                // ^4
+            specular *= specular;                // ^8
+            specular *= specular;                // ^16
+            specular *= specular;                // ^32
+            result.m_specular =
+                result.m_specular + light.m_color * (specular * attenuation * kSpecular);
+        }
+    }
+
+    return result;
+}
+
+void Lighting::GetTileStats(const LightGrid& grid, float* averageLights, int* maxLights)
+{
+    POW2_ASSERT(averageLights && maxLights);
+
+    int lit = 0;
+    int total = 0;
+    int most = 0;
+    const int tiles = grid.m_tilesX * grid.m_tilesY;
+    for (int i = 0; i < tiles; ++i)
+    {
+        const int count = grid.m_tileLightCounts[i];
+        lit += count > 0;
+        total += count;
+        most = count > most ? count : most;
+    }
+
+    *averageLights = lit ? (float)total / lit : 0;
+    *maxLights = most;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MathUtils.h"
+
+#include <stdint.h>
+#include <vector>
+
+struct DepthBuffer;
+
+//
+// LIGHTING INPUT: lights and a depth pre-pass of the scene
+// LIGHTING OUTPUT: per tile light lists, and Blinn-Phong lighting of points against them
+//
+// The window is split in kTileSize tiles and every light is tested against the box each tile's
+// visible depth spans, so a fragment only evaluates the lights that can reach its tile. With
+// lights of limited range the cost follows lights per tile rather than the total.
+//
+// Lighting space is the window in pixels, x right and y up, with window depth scaled to pixels
+// as z (away from the viewer). The projection is orthographic, so the viewer is along -z.
+//
+
+enum class LightType
+{
+    DIRECTIONAL,
+    POINT,
+    SPOT
+};
+
+struct Light
+{
+    LightType m_type;
+    vec3 m_position;   // point and spot, lighting space
+    vec3 m_direction;  // spot and directional: the way the light travels, normalised
+    vec3 m_color;
+    float m_range;     // point and spot: no light reaches past it
+    float m_cosOuter;  // spot: cosines of the cone's half angles, it fades out between them
+    float m_cosInner;
+};
+
+struct LightGrid  // see Lighting::CullLights
+{
+    static const int kTileSize = 16;
+    static const int kMaxTileLights = 256;  // lights past this in a tile are dropped
+    static const int kMaxLights = 65535;
+
+    const Light* m_lights;
+    int m_lightCount;
+    float m_depthToPixels;  // lighting space z of a window depth of 1
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<uint16_t> m_tileLights;  // kMaxTileLights slots per tile, row by row
+    std::vector<uint16_t> m_tileLightCounts;
+    std::vector<uint16_t> m_rowLights;  // scratch, the lights reaching each row of tiles
+};
+
+struct LightResult
+{
+    vec3 m_diffuse;   // ambient included, multiplies the surface colour
+    vec3 m_specular;  // added on top
+};
+
+namespace Lighting
+{
+    // Builds the tile lists for a depth pre-pass (Rasterizer::RasterDepth, FLT_MAX where
+    // nothing was drawn) of the window. Tiles with nothing in them get no lights. lights must
+    // outlive the grid's use. Tiles are spread over the thread pool.
+    void CullLights(
+        LightGrid* grid,
+        const Light* lights,
+        int lightCount,
+        const DepthBuffer& depth,
+        float depthToPixels);
+
+    // Blinn-Phong lighting of a point (lighting space) with a normalised normal, from the
+    // lights of the tile it's in
+    LightResult Evaluate(const LightGrid& grid, const vec3& position, const vec3& normal);
+
+    // Average light count over the tiles with any, and the largest
+    void GetTileStats(const LightGrid& grid, float* averageLights, int* maxLights);
+}
@@ -0,0 +1,847 @@
+#include "Log.h"
+
+#include "SizeOfArray.h"
+#include "ThreadLocal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static const int kArgumentBytes = 224;  // a queued message is 256 bytes
+static const int kMaxSpecLength = 32;   // %[flags][width][.precision][length]conversion
+static const int kWriteBatchBytes = 8192;
+
+enum class LogLevel
+{
+    Debug,
+    Warning,
+    Count
+};
+
+static const char* const kLevelPrefixes[] = {
+    "",
+    "WARNING: " };
+
+// Argument sizes, from the length modifier of a conversion
+enum class LogArgumentSize
+{
+    Default,   // int, or double (none, hh, h, l with floating point)
+    Long,
+    LongLong,
+    IntMax,
+    Size,
+    PtrDiff,
+    LongDouble
+};
+
+struct LogMessage
+{
+    uint64_t m_sequence;  // across every queue, so the writer can keep the order
+    const char* m_fmt;
+    LogLevel m_level;
+    uint32_t m_droppedBefore;  // on its queue, since the last message queued
+    int m_argumentBytes;
+    uint8_t m_arguments[kArgumentBytes];  // 8 bytes a value, strings copied in and terminated
+};
+
+// One producer, the thread it belongs to, and one consumer, the writer
+struct LogQueue
+{
+    std::atomic<uint32_t> m_head;  // messages pushed
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint32_t> m_unreportedDrops;  // the next message, or the idle writer, takes them
+    char m_producerPadding[64];    // keeps the writer's counter off the producer's cache line
+    std::atomic<uint32_t> m_tail;  // messages written
+    char m_consumerPadding[64];    // and the producer's messages
+    LogMessage m_messages[Log::kQueueMessages];
+};
+
+enum WriterState
+{
+    kWriterNotStarted,
+    kWriterRunning,
+    kWriterStopped  // the queues are empty for good, messages are written directly
+};
+
+struct LogState  // zero is initialisation
+{
+    bool m_synchronous;
+    std::atomic<int> m_writerState;
+    std::atomic<int> m_queueCount;
+    std::atomic<uint64_t> m_sequence;
+    std::atomic<bool> m_writerIdle;        // waiting for a message, the next one wakes it
+    std::atomic<uint32_t> m_wakeRequests;  // from the messages that did
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;     // the writer waits on this
+    std::condition_variable m_written;  // Flush and StopWriter wait on this
+    uint32_t m_flushRequests;           // guarded by m_mutex, as is everything below
+    bool m_stop;
+    bool m_writerDone;
+
+    std::atomic<LogQueue*> m_queues[Log::kMaxThreads];  // null until the thread first logs
+};
+
+static LogState g_log;
+static THREAD_LOCAL int t_queue = -1;  // the calling thread's, kMaxThreads or more if none
+
+//
+// FORMAT
+//
+// A queued message keeps its format and a copy of its arguments, so the writer can format it
+// later. Both walk the conversions of the format the same way: the caller to read the
+// arguments off its va_list, the writer to format them one conversion at a time.
+//
+
+struct LogSpec
+{
+    const char* m_start;  // the %
+    int m_length;         // through the conversion character
+    int m_stars;          // * widths and precisions, an int argument each before the value
+    LogArgumentSize m_size;
+    char m_conversion;    // '%' for %%, 0 for a format that ends in the middle of one
+};
+
+static const char* ParseSpec(const char* p, LogSpec* spec)
+{
+    spec->m_start = p++;
+    spec->m_stars = 0;
+    spec->m_size = LogArgumentSize::Default;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+    {
+        ++p;
+    }
+    for (int part = 0; part < 2; ++part)  // width, then precision
+    {
+        if (part == 1)
+        {
+            if (*p != '.')
+            {
+                break;
+            }
+            ++p;
+        }
+        if (*p == '*')
+        {
+            ++spec->m_stars;
+            ++p;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            ++p;
+        }
+    }
+
+    if (p[0] == 'h')
+    {
+        p += p[1] == 'h' ? 2 : 1;  // promoted to int
+    }
+    else if (p[0] == 'l' && p[1] == 'l')
+    {
+        spec->m_size = LogArgumentSize::LongLong;
+        p += 2;
+    }
+    else if (p[0] == 'l')
+    {
+        spec->m_size = LogArgumentSize::Long;
+        ++p;
+    }
+    else if (p[0] == 'j' || p[0] == 'z' || p[0] == 't' || p[0] == 'L')
+    {
+        spec->m_size =
+            p[0] == 'j' ? LogArgumentSize::IntMax :
+            p[0] == 'z' ? LogArgumentSize::Size :
+            p[0] == 't' ? LogArgumentSize::PtrDiff :
+            LogArgumentSize::LongDouble;
+        ++p;
+    }
+
+    spec->m_conversion = *p;
+    if (*p)
+    {
+        ++p;
+    }
+    spec->m_length = (int)(p - spec->m_start);
+    return p;
+}
+
+static bool IsFloatConversion(char c)
+{
+    return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' ||
+        c == 'A';
+}
+
+static bool IsIntegerConversion(char c)
+{
+    return c == 'd' || c == 'i' || c == 'u' || c == 'o' || c == 'x' || c == 'X' || c == 'c';
+}
+
+// Reads the integer argument of the size given, as the caller passed it
+static uint64_t ReadInteger(LogArgumentSize size, bool isSigned, va_list* args)
+{
+    switch (size)
+    {
+        case LogArgumentSize::Long:
+            return isSigned ? (uint64_t)va_arg(*args, long) : va_arg(*args, unsigned long);
+        case LogArgumentSize::LongLong:
+            return isSigned ?
+                (uint64_t)va_arg(*args, long long) : va_arg(*args, unsigned long long);
+        case LogArgumentSize::IntMax:
+            return isSigned ? (uint64_t)va_arg(*args, intmax_t) : va_arg(*args, uintmax_t);
+        case LogArgumentSize::Size:
+            return va_arg(*args, size_t);
+        case LogArgumentSize::PtrDiff:
+            return (uint64_t)va_arg(*args, ptrdiff_t);
+        default:
+            return isSigned ? (uint64_t)va_arg(*args, int) : va_arg(*args, unsigned int);
+    }
+}
+
+static bool PushValue(LogMessage* message, const void* value)
+{
+    if (message->m_argumentBytes + 8 > kArgumentBytes)
+    {
+        return false;
+    }
+    memcpy(message->m_arguments + message->m_argumentBytes, value, 8);
+    message->m_argumentBytes += 8;
+    return true;
+}
+
+// Copies the arguments fmt uses off args. What doesn't fit is left out, and the writer cuts
+// the message where it starts.
+static void PackArguments(LogMessage* message, const char* fmt, va_list* args)
+{
+    message->m_argumentBytes = 0;
+
+    for (const char* p = fmt; *p;)
+    {
+        if (*p != '%')
+        {
+            ++p;
+            continue;
+        }
+
+        LogSpec spec;
+        p = ParseSpec(p, &spec);
+        for (int i = 0; i < spec.m_stars; ++i)
+        {
+            const uint64_t star = (uint64_t)va_arg(*args, int);
+            if (!PushValue(message, &star))
+            {
+                return;
+            }
+        }
+
+        const char c = spec.m_conversion;
+        if (IsIntegerConversion(c))
+        {
+            const uint64_t value = ReadInteger(spec.m_size, c == 'd' || c == 'i', args);
+            if (!PushValue(message, &value))
+            {
+                return;
+            }
+        }
+        else if (IsFloatConversion(c))
+        {
+            const double value = spec.m_size == LogArgumentSize::LongDouble ?
+                (double)va_arg(*args, long double) : va_arg(*args, double);
+            if (!PushValue(message, &value))
+            {
+                return;
+            }
+        }
+        else if (c == 'p')
+        {
+            const uint64_t value = (uint64_t)(uintptr_t)va_arg(*args, void*);
+            if (!PushValue(message, &value))
+            {
+                return;
+            }
+        }
+        else if (c == 's')
+        {
+            const char* string = va_arg(*args, const char*);
+            string = string ? string : "(null)";
+            const int room = kArgumentBytes - message->m_argumentBytes;
+            if (room < 1)
+            {
+                return;
+            }
+            int length = (int)strlen(string);
+            length = length < room - 1 ? length : room - 1;
+            memcpy(message->m_arguments + message->m_argumentBytes, string, length);
+            message->m_arguments[message->m_argumentBytes + length] = 0;
+            message->m_argumentBytes += length + 1;
+        }
+        else if (c == 'n')
+        {
+            (void)va_arg(*args, void*);  // nothing is written back to the caller
+        }
+    }
+}
+
+struct LogText
+{
+    char* m_data;
+    int m_length;
+    int m_size;  // bytes, the terminator included
+};
+
+static void AppendText(LogText* text, const char* string, int length)
+{
+    const int room = text->m_size - 1 - text->m_length;
+    length = length < room ? length : room;
+    memcpy(text->m_data + text->m_length, string, length);
+    text->m_length += length;
+    text->m_data[text->m_length] = 0;
+}
+
+static void AppendFormatted(LogText* text, const char* fmt, ...)
+{
+    const int room = text->m_size - text->m_length;
+    va_list args;
+    va_start(args, fmt);
+    const int length = vsnprintf(text->m_data + text->m_length, room, fmt, args);
+    va_end(args);
+
+    // Some C runtimes return -1 when the text is cut
+    text->m_length += length < 0 || length >= room ? room - 1 : length;
+    text->m_data[text->m_length] = 0;
+}
+
+template <typename T>
+static void AppendValue(LogText* text, const char* spec, const int* stars, int starCount, T value)
+{
+    if (starCount == 0)
+    {
+        AppendFormatted(text, spec, value);
+    }
+    else if (starCount == 1)
+    {
+        AppendFormatted(text, spec, stars[0], value);
+    }
+    else
+    {
+        AppendFormatted(text, spec, stars[0], stars[1], value);
+    }
+}
+
+// The value back as the type the caller passed
+template <typename Signed, typename Unsigned>
+static void AppendInteger(
+    LogText* text, const char* spec, const int* stars, const LogSpec& parsed, uint64_t value)
+{
+    if (parsed.m_conversion == 'd' || parsed.m_conversion == 'i')
+    {
+        AppendValue(text, spec, stars, parsed.m_stars, (Signed)value);
+    }
+    else
+    {
+        AppendValue(text, spec, stars, parsed.m_stars, (Unsigned)value);
+    }
+}
+
+// The message as the caller's vsnprintf would have written it, with the level's prefix and a
+// line break
+static void FormatMessage(const LogMessage& message, LogText* text)
+{
+    text->m_length = 0;
+    text->m_data[0] = 0;
+    AppendText(text, kLevelPrefixes[(int)message.m_level],
+        (int)strlen(kLevelPrefixes[(int)message.m_level]));
+    text->m_size -= 1;  // room for the line break
+
+    int read = 0;
+    const char* p = message.m_fmt;
+    while (*p)
+    {
+        const char* literal = p;
+        while (*p && *p != '%')
+        {
+            ++p;
+        }
+        AppendText(text, literal, (int)(p - literal));
+        if (!*p)
+        {
+            break;
+        }
+
+        LogSpec parsed;
+        p = ParseSpec(p, &parsed);
+        const char c = parsed.m_conversion;
+        if (c == '%')
+        {
+            AppendText(text, "%", 1);
+            continue;
+        }
+        if (c == 'n')
+        {
+            continue;
+        }
+
+        // Arguments left out when the message was queued cut it here
+        const bool hasValue = IsIntegerConversion(c) || IsFloatConversion(c) || c == 'p' ||
+            c == 's';
+        const int bytes = 8 * parsed.m_stars + (hasValue && c != 's' ? 8 : 0);
+        if (read + bytes + (c == 's' ? 1 : 0) > message.m_argumentBytes ||
+            parsed.m_length >= kMaxSpecLength || !hasValue)
+        {
+            AppendText(text, "...", 3);
+            break;
+        }
+
+        char spec[kMaxSpecLength];
+        memcpy(spec, parsed.m_start, parsed.m_length);
+        spec[parsed.m_length] = 0;
+
+        int stars[2] = {};
+        for (int i = 0; i < parsed.m_stars; ++i)
+        {
+            uint64_t star;
+            memcpy(&star, message.m_arguments + read, 8);
+            stars[i] = (int)star;
+            read += 8;
+        }
+
+        const uint8_t* argument = message.m_arguments + read;
+        if (c == 's')
+        {
+            const char* string = (const char*)argument;
+            AppendValue(text, spec, stars, parsed.m_stars, string);
+            read += (int)strlen(string) + 1;
+            continue;
+        }
+
+        uint64_t value;
+        memcpy(&value, argument, 8);
+        read += 8;
+        if (IsIntegerConversion(c))
+        {
+            switch (parsed.m_size)
+            {
+                case LogArgumentSize::Long:
+                    AppendInteger<long, unsigned long>(text, spec, stars, parsed, value);
+                    break;
+                case LogArgumentSize::LongLong:
+                    AppendInteger<long long, unsigned long long>(text, spec, stars, parsed, value);
+                    break;
+                case LogArgumentSize::IntMax:
+                    AppendInteger<intmax_t, uintmax_t>(text, spec, stars, parsed, value);
+                    break;
+                case LogArgumentSize::Size:
+                    AppendInteger<ptrdiff_t, size_t>(text, spec, stars, parsed, value);
+                    break;
+                case LogArgumentSize::PtrDiff:
+                    AppendInteger<ptrdiff_t, size_t>(text, spec, stars, parsed, value);
+                    break;
+                default:
+                    AppendInteger<int, unsigned int>(text, spec, stars, parsed, value);
+                    break;
+            }
+        }
+        else if (IsFloatConversion(c))
+        {
+            double d;
+            memcpy(&d, &value, 8);
+            if (parsed.m_size == LogArgumentSize::LongDouble)
+            {
+                AppendValue(text, spec, stars, parsed.m_stars, (long double)d);
+            }
+            else
+            {
+                AppendValue(text, spec, stars, parsed.m_stars, d);
+            }
+        }
+        else
+        {
+            AppendValue(text, spec, stars, parsed.m_stars, (void*)(uintptr_t)value);
+        }
+    }
+
+    text->m_size += 1;
+    AppendText(text, "\n", 1);
+}
+
+// Formats and writes straight away, on the calling thread
+static void WriteNow(const char* prefix, const char* fmt, va_list* args)
+{
+    char message[Log::kMaxMessageLength];
+    LogText text = { message, 0, sizeof(message) - 1 };  // room for the line break
+    message[0] = 0;
+    AppendText(&text, prefix, (int)strlen(prefix));
+
+    const int room = text.m_size - text.m_length;
+    const int length = vsnprintf(message + text.m_length, room, fmt, *args);
+    text.m_length += length < 0 || length >= room ? room - 1 : length;
+
+    message[text.m_length++] = '\n';
+    message[text.m_length] = 0;
+    Log::Write(message);
+}
+
+//
+// WRITER
+//
+
+static void AppendDrops(LogText* text, uint32_t drops)
+{
+    AppendFormatted(text, "WARNING: %u log messages dropped, their queue was full\n", drops);
+}
+
+// Gives written messages back to their queues
+static void StoreTails(const uint32_t* tails, int queues)
+{
+    for (int i = 0; i < queues; ++i)
+    {
+        LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+        if (queue)
+        {
+            queue->m_tail.store(tails[i], std::memory_order_release);
+        }
+    }
+}
+
+static bool QueuesEmpty(const uint32_t* tails)
+{
+    const int queueCount = g_log.m_queueCount.load();
+    const int queues = queueCount < Log::kMaxThreads ? queueCount : Log::kMaxThreads;
+    for (int i = 0; i < queues; ++i)
+    {
+        LogQueue* queue = g_log.m_queues[i].load();
+        if (queue && queue->m_head.load() != tails[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void WriterMain()
+{
+    char batch[kWriteBatchBytes];
+    LogText batchText = { batch, 0, sizeof(batch) };
+    batch[0] = 0;
+
+    // Messages are only given back to their queues once they're written, so Flush can wait on
+    // the queues alone
+    uint32_t tails[Log::kMaxThreads] = {};
+    uint32_t flushRequests = 0;
+    uint32_t wakeRequests = 0;
+
+    for (;;)
+    {
+        const int queueCount = g_log.m_queueCount.load(std::memory_order_acquire);
+        const int queues = queueCount < Log::kMaxThreads ? queueCount : Log::kMaxThreads;
+
+        // The oldest message at the front of a queue
+        LogQueue* oldest = nullptr;
+        int oldestIndex = 0;
+        for (int i = 0; i < queues; ++i)
+        {
+            LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+            if (!queue || queue->m_head.load(std::memory_order_acquire) == tails[i])
+            {
+                continue;
+            }
+            const LogMessage& message = queue->m_messages[tails[i] % Log::kQueueMessages];
+            if (!oldest ||
+                message.m_sequence <
+                oldest->m_messages[tails[oldestIndex] % Log::kQueueMessages].m_sequence)
+            {
+                oldest = queue;
+                oldestIndex = i;
+            }
+        }
+
+        char message[Log::kMaxMessageLength];
+        LogText text = { message, 0, sizeof(message) };
+        int consumed = -1;
+        if (oldest)
+        {
+            const LogMessage& next = oldest->m_messages[tails[oldestIndex] % Log::kQueueMessages];
+            if (next.m_droppedBefore > 0)
+            {
+                AppendDrops(&text, next.m_droppedBefore);
+            }
+            FormatMessage(next, &text);
+            consumed = oldestIndex;
+        }
+
+        if (text.m_length > 0)
+        {
+            if (batchText.m_length + text.m_length >= batchText.m_size)
+            {
+                Log::Write(batch);
+                batchText.m_length = 0;
+                batch[0] = 0;
+                StoreTails(tails, queues);
+
+                // Flush and Error may be waiting on exactly these messages, and a busy queue
+                // can keep the writer from running dry for as long as it likes
+                std::lock_guard<std::mutex> lock(g_log.m_mutex);
+                g_log.m_written.notify_all();
+            }
+            AppendText(&batchText, message, text.m_length);
+            if (consumed >= 0)
+            {
+                ++tails[consumed];
+            }
+            continue;
+        }
+
+        // Nothing left: report drops no message has taken yet, write what's batched, give the
+        // messages back, then wait for more
+        for (int i = 0; i < queues; ++i)
+        {
+            LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+            const uint32_t drops = queue ? queue->m_unreportedDrops.exchange(0) : 0;
+            if (drops > 0)
+            {
+                AppendDrops(&batchText, drops);
+            }
+        }
+        if (batchText.m_length > 0)
+        {
+            Log::Write(batch);
+            batchText.m_length = 0;
+            batch[0] = 0;
+        }
+        StoreTails(tails, queues);
+
+        std::unique_lock<std::mutex> lock(g_log.m_mutex);
+        g_log.m_written.notify_all();
+        if (g_log.m_stop)
+        {
+            g_log.m_writerDone = true;
+            g_log.m_written.notify_all();
+            return;
+        }
+
+        // Idle, then a last look: a message pushed before the flag was up is seen here, one
+        // pushed after it sees the flag and wakes the writer
+        g_log.m_writerIdle.store(true);
+        if (!QueuesEmpty(tails))
+        {
+            g_log.m_writerIdle.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        g_log.m_wake.wait(lock, [&]
+        {
+            return g_log.m_flushRequests != flushRequests ||
+                g_log.m_wakeRequests.load(std::memory_order_relaxed) != wakeRequests ||
+                g_log.m_stop;
+        });
+        g_log.m_writerIdle.store(false, std::memory_order_relaxed);
+        flushRequests = g_log.m_flushRequests;
+        wakeRequests = g_log.m_wakeRequests.load(std::memory_order_relaxed);
+    }
+}
+
+// At exit, after the writer has written everything queued. It's left to finish on its own,
+// as joining threads while the process exits can deadlock under VS2013.
+static void StopWriter()
+{
+    Log::Flush();
+
+    std::unique_lock<std::mutex> lock(g_log.m_mutex);
+    g_log.m_writerState.store(kWriterStopped, std::memory_order_release);
+    g_log.m_stop = true;
+    g_log.m_wake.notify_one();
+    g_log.m_written.wait(lock, []
+    {
+        return g_log.m_writerDone;
+    });
+    g_log.m_thread.detach();
+}
+
+static bool StartWriter()
+{
+    const int state = g_log.m_writerState.load(std::memory_order_acquire);
+    if (state != kWriterNotStarted)
+    {
+        return state == kWriterRunning;
+    }
+
+    std::lock_guard<std::mutex> lock(g_log.m_mutex);
+    if (g_log.m_writerState.load() == kWriterNotStarted)
+    {
+        g_log.m_thread = std::thread(WriterMain);
+        atexit(StopWriter);
+        g_log.m_writerState.store(kWriterRunning, std::memory_order_release);
+    }
+    return g_log.m_writerState.load() == kWriterRunning;
+}
+
+// False if the message should be written straight away instead
+static bool Enqueue(LogLevel level, const char* fmt, va_list* args)
+{
+    if (g_log.m_synchronous || !StartWriter())
+    {
+        return false;
+    }
+
+    if (t_queue < 0)
+    {
+        t_queue = g_log.m_queueCount.fetch_add(1);
+        // Never freed, the writer may read it after the thread is gone
+        void* memory = t_queue < Log::kMaxThreads ? malloc(sizeof(LogQueue)) : nullptr;
+        if (memory)
+        {
+            LogQueue* created = new (memory) LogQueue;
+            created->m_head.store(0, std::memory_order_relaxed);
+            created->m_dropped.store(0, std::memory_order_relaxed);
+            created->m_unreportedDrops.store(0, std::memory_order_relaxed);
+            created->m_tail.store(0, std::memory_order_relaxed);
+            g_log.m_queues[t_queue].store(created);
+        }
+        else
+        {
+            t_queue = Log::kMaxThreads;
+        }
+    }
+    if (t_queue >= Log::kMaxThreads)
+    {
+        return false;
+    }
+
+    LogQueue& queue = *g_log.m_queues[t_queue].load(std::memory_order_relaxed);
+    const uint32_t head = queue.m_head.load(std::memory_order_relaxed);
+    if (head - queue.m_tail.load(std::memory_order_acquire) == Log::kQueueMessages)
+    {
+        queue.m_dropped.fetch_add(1, std::memory_order_relaxed);
+        queue.m_unreportedDrops.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    LogMessage& message = queue.m_messages[head % Log::kQueueMessages];
+    message.m_sequence = g_log.m_sequence.fetch_add(1, std::memory_order_relaxed);
+    message.m_fmt = fmt;
+    message.m_level = level;
+    message.m_droppedBefore = queue.m_unreportedDrops.load(std::memory_order_relaxed) ?
+        queue.m_unreportedDrops.exchange(0) : 0;
+    PackArguments(&message, fmt, args);
+    queue.m_head.store(head + 1);
+
+    // Only the first message after the writer ran dry takes the mutex (see WriterMain)
+    if (g_log.m_writerIdle.load() && g_log.m_writerIdle.exchange(false))
+    {
+        std::lock_guard<std::mutex> lock(g_log.m_mutex);
+        g_log.m_wakeRequests.fetch_add(1, std::memory_order_relaxed);
+        g_log.m_wake.notify_one();
+    }
+    return true;
+}
+
+void Log::Init()
+{
+    StartWriter();
+}
+
+static void Print(LogLevel level, const char* fmt, va_list* args)
+{
+    static_assert(
+        SizeOfArray(kLevelPrefixes) == (size_t)LogLevel::Count,
+        "One prefix per level");
+
+    if (!Enqueue(level, fmt, args))
+    {
+        WriteNow(kLevelPrefixes[(int)level], fmt, args);
+    }
+}
+
+void Log::Debug(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Print(LogLevel::Debug, fmt, &args);
+    va_end(args);
+}
+
+void Log::Warning(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Print(LogLevel::Warning, fmt, &args);
+    va_end(args);
+}
+
+void Log::Error(const char* fmt, ...)
+{
+    Flush();
+
+    va_list args;
+    va_start(args, fmt);
+    WriteNow("ERROR: ", fmt, &args);
+    va_end(args);
+    exit(1);
+}
+
+void Log::Flush()
+{
+    if (g_log.m_writerState.load(std::memory_order_acquire) != kWriterRunning)
+    {
+        return;
+    }
+
+    // Every message pushed so far, on every queue
+    uint32_t heads[kMaxThreads];
+    const int queueCount = g_log.m_queueCount.load(std::memory_order_acquire);
+    const int queues = queueCount < kMaxThreads ? queueCount : kMaxThreads;
+    for (int i = 0; i < queues; ++i)
+    {
+        LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+        heads[i] = queue ? queue->m_head.load(std::memory_order_acquire) : 0;
+    }
+
+    std::unique_lock<std::mutex> lock(g_log.m_mutex);
+    ++g_log.m_flushRequests;
+    g_log.m_wake.notify_one();
+    g_log.m_written.wait(lock, [&heads, queues]
+    {
+        for (int i = 0; i < queues; ++i)
+        {
+            LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+            const uint32_t tail = queue ? queue->m_tail.load(std::memory_order_acquire) : 0;
+            if ((int32_t)(tail - heads[i]) < 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+uint64_t Log::GetDroppedCount()
+{
+    uint64_t dropped = 0;
+    for (int i = 0; i < kMaxThreads; ++i)
+    {
+        LogQueue* queue = g_log.m_queues[i].load(std::memory_order_acquire);
+        dropped += queue ? queue->m_dropped.load(std::memory_order_relaxed) : 0;
+    }
+    return dropped;
+}
+
+void Log::SetAsynchronous(bool enabled)
+{
+    if (!enabled)
+    {
+        Flush();  // so messages stay in order
+    }
+    g_log.m_synchronous = !enabled;
+}
+
+bool Log::GetAsynchronous()
+{
+    return !g_log.m_synchronous;
+}
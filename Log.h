@@ -1,8 +1,47 @@
 #pragma once
 
+#include <stdint.h>
+
+//
+// Messages are formatted and written by a background thread, so logging costs the calling
+// thread only a copy of the format's arguments into its own queue.
+//
+// Each thread that logs gets its own queue of kQueueMessages messages, allocated when it first
+// logs, up to kMaxThreads threads; threads past that write directly. The writer sleeps while
+// every queue is empty, and the first message after that wakes it. The queue holds the format
+// pointer, so the format must outlive the message. String literals do. The arguments are
+// copied, %s strings included. Messages come out in the order they were logged, across threads.
+//
+// A message that finds its queue full is dropped and counted. The count goes into the output
+// where the drop happened. Error writes everything logged before it, then its own message,
+// and only then exits.
+//
+
 namespace Log
 {
-    void Debug(const char* fmt, ...);
-    void Warning(const char* fmt, ...);
+    static const int kMaxThreads = 32;
+    static const int kQueueMessages = 512;
+    static const int kMaxMessageLength = 1024;  // longer messages are cut
+
+    // Starts the writer thread. The first message starts it otherwise, so this is only needed
+    // where its one heap allocation would get in the way (before measuring heap use).
+    void Init();
+
+    void Debug(const char* fmt, ...);
+    void Warning(const char* fmt, ...);
     void Error(const char* fmt, ...);
+
+    // Blocks until every message logged before the call is written
+    void Flush();
+
+    // Messages dropped because their queue was full
+    uint64_t GetDroppedCount();
+
+    // Queued, on by default. Off, every message is formatted and written by the thread that
+    // logs it, to compare.
+    void SetAsynchronous(bool enabled);
+    bool GetAsynchronous();
+
+    // Writes formatted text, one or more whole lines (platform specific)
+    void Write(const char* text);
 }
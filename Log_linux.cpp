@@ -0,0 +1,9 @@
+#include "Log.h"
+
+#include <stdio.h>
+
+void Log::Write(const char* text)
+{
+    // stderr, so stdout stays free for frame output (see Main_linux.cpp)
+    fputs(text, stderr);
+}
@@ -0,0 +1,690 @@
+#include "DebugTimer.h"
+#include "DynamicResolution.h"
+#include "FrameSink.h"
+#include "Lighting.h"
+#include "Log.h"
+#include "Memory.h"
+#include "PerfCounters.h"
+#include "Rasterizer.h"
+#include "Render.h"
+#include "Swapchain.h"
+#include "ThreadPool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Headless build: renders a fixed number of frames through the swapchain and streams them to a
+// file or pipe (see FrameSink.h), raw BGRA frames top row first by default. For example, to
+// watch the output:
+//
+//   Renderer --output - scene.mesh | ffplay -f rawvideo -pixel_format bgra -video_size 800x600 -
+//   Renderer --output - --format y4m scene.mesh | ffplay -
+//
+// Usage: Renderer [--size WxH] [--frames N] [--buffers N] [--output path|-]
+//                 [--format bgra|rgba|y4m] [--fps N] [--rain]
+//                 [--target-ms ms [--min-scale s]] [--scan-conversion mode]
+//                 [--threads N] [--trace path] [--occluders occluders.mesh]
+//                 [--lod-error px] [--lights N] [--full-redraw] [--perf-counters]
+//                 [--shading-rate 1x1|2x2|4x4] [--adaptive-shading threshold]
+//                 [--spin degrees] [--reprojection N]
+//                 [scene.mesh [texture.dds]]
+//
+// Without --output frames are presented to nowhere, which measures rendering on its own.
+// --format y4m converts to YUV 4:2:0 with a header players read the size and --fps (60 by
+// default) from.
+// --target-ms turns dynamic resolution on: frames render at whatever scale of --size keeps
+// Render() within the budget, and are upscaled to --size for output. --scan-conversion picks
+// the rasterizer's traversal by name (see ScanConversionMode). --threads sizes the job pool, one
+// thread per core by default. --trace writes every frame's jobs as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). --occluders turns occlusion culling on for the scene
+// mesh (see Render_LoadOccluders). --lod-error is how far, in pixels, the scene mesh's level of
+// detail may be from the full mesh, 1 by default and 0 for full detail always. --lights lights
+// the scene mesh with N generated lights (see Render_SetLightCount). Frames only redraw the
+// tiles that changed (see Render_SetIncremental), --full-redraw draws every pixel every frame.
+// --perf-counters reads the CPU's counters around the rasterizer's stages, clears and present
+// (see PerfCounters.h), and reports them every frame and on average, which slows those stages.
+// --shading-rate shades the scene mesh once per block of pixels, --adaptive-shading picks a
+// rate per tile from the last frame, letting pixels move by up to threshold luma levels (see
+// Render_SetShadingRate). --spin turns the scene mesh by that many degrees every frame, and
+// --reprojection reuses the last frame's shading where it can, shading every pixel at least
+// once every N frames (see Render_SetReprojection).
+//
+
+struct AppState  // zero is initialisation
+{
+    RasterBuffers m_buffers;  // output sized, m_color is picked every frame
+    bool m_streaming;         // to the frame sink
+
+    ResolutionController m_resolution;
+    bool m_dynamicResolution;
+    uint32_t* m_scaledColor;
+    uint32_t* m_upscaleScratch;
+    Arena m_bufferArena;  // depth and m_scaledColor, see PushFrameBuffers
+
+    RasterCounters m_rasterCounters;  // of the frame, for the hardware counters' ratios
+    PerfFrame m_perfSums;
+};
+
+static const size_t kBufferArenaBytes = 96 << 20;  // depth and scaled colour at 4K
+
+static AppState g_app;
+
+// Depth and the scaled colour buffer hold the last frame for incremental redraws (see
+// Render_SetIncremental), so they come out of an arena of their own that only a new size
+// empties. Everything else only lives for a frame and comes out of the frame arena, which
+// Memory::EndFrame frees.
+static void PushFrameBuffers(int width, int height)
+{
+    const size_t pixels = (size_t)width * height;
+
+    RasterBuffers& buffers = g_app.m_buffers;
+    if (!buffers.m_depth || buffers.m_width != (size_t)width || buffers.m_height != (size_t)height)
+    {
+        Arena* arena = &g_app.m_bufferArena;
+        Memory::ResetToMark(arena, 0);
+
+        buffers.m_depthBufferBytes = sizeof(float) * pixels;
+        buffers.m_depth = Memory::PushArray<float>(arena, pixels);
+
+        if (g_app.m_dynamicResolution)
+        {
+            g_app.m_scaledColor = Memory::PushArray<uint32_t>(arena, pixels);
+        }
+    }
+
+    buffers.m_width = width;
+    buffers.m_height = height;
+    buffers.m_bytesPerPixel = 4;
+    buffers.m_colorBufferBytes = buffers.m_bytesPerPixel * pixels;
+
+    Arena* frameArena = Memory::GetFrameArena();
+    buffers.m_fragmentsTmpBufferBytes = sizeof(FragmentInput) * pixels;
+    buffers.m_fragmentsTmpBuffer = Memory::PushArray<FragmentInput>(frameArena, pixels);
+
+    if (g_app.m_dynamicResolution)
+    {
+        g_app.m_upscaleScratch = Memory::PushArray<uint32_t>(frameArena, 2 * width + 1);
+    }
+}
+
+// Runs on the swapchain's present thread. The frame sink writes BGRA from the colour buffer
+// before returning, other formats are converted into its queue for its writer thread.
+static void PresentToSink(const uint32_t* color, int, int, void*)
+{
+    if (g_app.m_streaming)
+    {
+        FrameSink::Write(color);
+    }
+}
+
+static void AddPerfFrame(PerfFrame* sums, const PerfFrame& frame)
+{
+    for (int s = 0; s < (int)PerfStage::Count; ++s)
+    {
+        PerfStageTotals& sum = sums->m_stages[s];
+        const PerfStageTotals& stage = frame.m_stages[s];
+        for (int i = 0; i < (int)PerfCounter::Count; ++i)
+        {
+            sum.m_values[i] += stage.m_values[i];
+        }
+        sum.m_ms += stage.m_ms;
+        sum.m_laps += stage.m_laps;
+    }
+}
+
+// A counter's total, or "-" when the CPU doesn't have it
+static const char* FormatCounter(char* text, size_t size, PerfCounter counter, double value)
+{
+    if (!PerfCounters::IsAvailable(counter))
+    {
+        return "-";
+    }
+    snprintf(text, size, value < 10 ? "%.2f" : "%.0f", value);
+    return text;
+}
+
+static const char* FormatIpc(char* text, size_t size, const PerfStageTotals& stage)
+{
+    if (!PerfCounters::IsAvailable(PerfCounter::CYCLES) ||
+        !PerfCounters::IsAvailable(PerfCounter::INSTRUCTIONS))
+    {
+        return "-";
+    }
+    const uint64_t cycles = stage.m_values[(int)PerfCounter::CYCLES];
+    const uint64_t instructions = stage.m_values[(int)PerfCounter::INSTRUCTIONS];
+    snprintf(text, size, "%.2f", cycles ? (double)instructions / cycles : 0);
+    return text;
+}
+
+static void ReportPerfFrame(int frame, const PerfFrame& perf, uint64_t fragments)
+{
+    char line[512];
+    int length = snprintf(
+        line, sizeof(line), "frame %d: %llu fragments", frame, (unsigned long long)fragments);
+    for (int s = 0; s < (int)PerfStage::Count && length < (int)sizeof(line); ++s)
+    {
+        const PerfStageTotals& stage = perf.m_stages[s];
+        char ipc[32];
+        length += snprintf(
+            line + length, sizeof(line) - length, ", %s %.2fms %s IPC",
+            PerfCounters::GetStageName((PerfStage)s), stage.m_ms,
+            FormatIpc(ipc, sizeof(ipc), stage));
+    }
+    Log::Debug("%s", line);
+}
+
+// Per stage and frame, on average: time, cycles, IPC and misses per fragment
+static void ReportPerfSums(const PerfFrame& sums, int frames, uint64_t fragments)
+{
+    const double perFrame = 1.0 / frames;
+    const double perFragment = fragments ? 1.0 / fragments : 0;
+
+    Log::Debug(
+        "hardware counters per frame, %.0f fragments on average (misses per fragment):",
+        fragments * perFrame);
+    Log::Debug(
+        "  %-10s %9s %9s %6s %9s %9s %9s",
+        "stage", "ms", "Mcycles", "IPC", "L1D", "LLC", "branch");
+    for (int s = 0; s < (int)PerfStage::Count; ++s)
+    {
+        const PerfStageTotals& stage = sums.m_stages[s];
+        const uint64_t* values = stage.m_values;
+        char cycles[32];
+        char ipc[32];
+        char l1d[32];
+        char llc[32];
+        char branch[32];
+        Log::Debug(
+            "  %-10s %9.3f %9s %6s %9s %9s %9s",
+            PerfCounters::GetStageName((PerfStage)s), stage.m_ms * perFrame,
+            FormatCounter(
+                cycles, sizeof(cycles), PerfCounter::CYCLES,
+                values[(int)PerfCounter::CYCLES] * perFrame / 1e6),
+            FormatIpc(ipc, sizeof(ipc), stage),
+            FormatCounter(
+                l1d, sizeof(l1d), PerfCounter::L1D_MISSES,
+                values[(int)PerfCounter::L1D_MISSES] * perFragment),
+            FormatCounter(
+                llc, sizeof(llc), PerfCounter::LLC_MISSES,
+                values[(int)PerfCounter::LLC_MISSES] * perFragment),
+            FormatCounter(
+                branch, sizeof(branch), PerfCounter::BRANCH_MISSES,
+                values[(int)PerfCounter::BRANCH_MISSES] * perFragment));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    //
+    // Parse command line
+    //
+
+    int width = 800;
+    int height = 600;
+    int frames = 300;
+    int bufferCount = 2;
+    const char* outputPath = nullptr;
+    FrameSinkSettings sinkSettings = {};
+    DynamicResolutionSettings resolutionSettings = {};
+    resolutionSettings.m_minScale = 0.5f;
+    resolutionSettings.m_maxScale = 1;
+    const char* meshPath = nullptr;
+    const char* texturePath = nullptr;
+    int threadCount = 0;
+    const char* tracePath = nullptr;
+    const char* occludersPath = nullptr;
+    float lodErrorPixels = 1;
+    int lightCount = 0;
+    bool incremental = true;
+    bool perfCounters = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                Log::Error("Bad size %s, expected WxH", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--buffers") == 0 && hasValue)
+        {
+            bufferCount = atoi(argv[++i]);
+            if (bufferCount < 1 || bufferCount > Swapchain::kMaxBuffers)
+            {
+                Log::Error("Buffer count must be 1 to %d", Swapchain::kMaxBuffers);
+            }
+        }
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+        {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            int format = 0;
+            while (format < (int)FrameFormat::Count &&
+                strcmp(name, FrameSink::GetFormatName((FrameFormat)format)))
+            {
+                ++format;
+            }
+            if (format == (int)FrameFormat::Count)
+            {
+                Log::Error("Unknown output format %s", name);
+            }
+            sinkSettings.m_format = (FrameFormat)format;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && hasValue)
+        {
+            sinkSettings.m_fps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--target-ms") == 0 && hasValue)
+        {
+            resolutionSettings.m_targetMs = atof(argv[++i]);
+            g_app.m_dynamicResolution = resolutionSettings.m_targetMs > 0;
+        }
+        else if (strcmp(argv[i], "--min-scale") == 0 && hasValue)
+        {
+            resolutionSettings.m_minScale = (float)atof(argv[++i]);
+            if (resolutionSettings.m_minScale <= 0 || resolutionSettings.m_minScale > 1)
+            {
+                Log::Error("Minimum scale must be in (0, 1]");
+            }
+        }
+        else if (strcmp(argv[i], "--scan-conversion") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            int mode = 0;
+            while (mode < (int)ScanConversionMode::Count &&
+                strcmp(name, Rasterizer::GetScanConversionModeName((ScanConversionMode)mode)))
+            {
+                ++mode;
+            }
+            if (mode == (int)ScanConversionMode::Count)
+            {
+                Log::Error("Unknown scan conversion mode %s", name);
+            }
+            Rasterizer::SetScanConversionMode((ScanConversionMode)mode);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+        {
+            tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--occluders") == 0 && hasValue)
+        {
+            occludersPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--lod-error") == 0 && hasValue)
+        {
+            lodErrorPixels = (float)atof(argv[++i]);
+            if (lodErrorPixels < 0)
+            {
+                Log::Error("LOD error must be 0 or more pixels");
+            }
+        }
+        else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+        {
+            lightCount = atoi(argv[++i]);
+            if (lightCount < 0 || lightCount > LightGrid::kMaxLights)
+            {
+                Log::Error("Light count must be 0 to %d", LightGrid::kMaxLights);
+            }
+        }
+        else if (strcmp(argv[i], "--full-redraw") == 0)
+        {
+            incremental = false;
+        }
+        else if (strcmp(argv[i], "--perf-counters") == 0)
+        {
+            perfCounters = true;
+        }
+        else if (strcmp(argv[i], "--shading-rate") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            int rate = 0;
+            while (rate < (int)ShadingRate::Count &&
+                strcmp(name, Rasterizer::GetShadingRateName((ShadingRate)rate)))
+            {
+                ++rate;
+            }
+            if (rate == (int)ShadingRate::Count)
+            {
+                Log::Error("Unknown shading rate %s", name);
+            }
+            Render_SetShadingRate((ShadingRate)rate);
+        }
+        else if (strcmp(argv[i], "--adaptive-shading") == 0 && hasValue)
+        {
+            const float threshold = (float)atof(argv[++i]);
+            if (threshold <= 0)
+            {
+                Log::Error("Adaptive shading threshold must be more than 0");
+            }
+            Render_SetAdaptiveShading(threshold);
+        }
+        else if (strcmp(argv[i], "--spin") == 0 && hasValue)
+        {
+            Render_SetSpin((float)atof(argv[++i]) * (3.14159265f / 180.0f));
+        }
+        else if (strcmp(argv[i], "--reprojection") == 0 && hasValue)
+        {
+            const int frames = atoi(argv[++i]);
+            if (frames < 1)
+            {
+                Log::Error("Reprojection must be 1 or more frames");
+            }
+            Render_SetReprojection(frames);
+        }
+        else if (strcmp(argv[i], "--rain") == 0)
+        {
+            Render_SetRain(true);
+        }
+        else if (!meshPath)
+        {
+            meshPath = argv[i];
+        }
+        else if (!texturePath)
+        {
+            texturePath = argv[i];
+        }
+        else
+        {
+            Log::Error("Unexpected argument %s", argv[i]);
+        }
+    }
+
+    //
+    // Load scene
+    //
+
+    if (meshPath && !Render_LoadMesh(meshPath))
+    {
+        Log::Error("Cannot load mesh %s", meshPath);
+    }
+
+    Render_SetLodErrorPixels(lodErrorPixels);
+    Render_SetLightCount(lightCount);
+    Render_SetIncremental(incremental);
+
+    if (occludersPath && !Render_LoadOccluders(occludersPath))
+    {
+        Log::Error("Cannot load occluders %s", occludersPath);
+    }
+
+    if (texturePath && !Render_LoadTexture(texturePath))
+    {
+        Log::Error("Cannot load texture %s", texturePath);
+    }
+
+    //
+    // Create buffers and output
+    //
+
+    if (outputPath)
+    {
+        sinkSettings.m_width = width;
+        sinkSettings.m_height = height;
+        if (!FrameSink::Open(outputPath, sinkSettings))
+        {
+            Log::Error("Cannot open %s", outputPath);
+        }
+        g_app.m_streaming = true;
+    }
+
+    FILE* trace = nullptr;
+    if (tracePath)
+    {
+        trace = fopen(tracePath, "w");
+        if (!trace)
+        {
+            Log::Error("Cannot open %s", tracePath);
+        }
+        fputs("[\n", trace);
+    }
+
+    Memory::Init();
+    Memory::CreateArena(&g_app.m_bufferArena, kBufferArenaBytes);
+    Log::Init();
+    ThreadPool::Init(threadCount);
+    if (perfCounters && !PerfCounters::Init())
+    {
+        Log::Warning("No hardware counters (perf_event_open failed), --perf-counters ignored");
+        perfCounters = false;
+    }
+    g_app.m_buffers.m_counters = &g_app.m_rasterCounters;
+    if (g_app.m_dynamicResolution)
+    {
+        DynamicResolution::Init(&g_app.m_resolution, resolutionSettings);
+    }
+
+    Swapchain::Init(PresentToSink, nullptr);
+    Swapchain::Configure(width, height, bufferCount);
+    Render_Invalidate();
+
+    //
+    // Core loop
+    //
+
+    const double startMs = DebugTimer_NowMs();
+    double scaleSum = 0;
+    int framesOverBudget = 0;
+    uint64_t firstFrameHeapAllocations = 0;
+    double redrawnSum = 0;
+    uint64_t fragmentsSum = 0;
+    uint64_t shadedSum = 0;
+    uint64_t reusedSum = 0;
+
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        uint32_t* output = Swapchain::Acquire();
+        PushFrameBuffers(width, height);
+
+        const float scale = g_app.m_dynamicResolution ? g_app.m_resolution.m_scale : 1;
+        int scaledWidth;
+        int scaledHeight;
+        DynamicResolution::ScaledSize(scale, width, height, &scaledWidth, &scaledHeight);
+        const bool scaled = scaledWidth != width || scaledHeight != height;
+
+        RasterBuffers buffers = DynamicResolution::ScaledBuffers(
+            g_app.m_buffers, scaledWidth, scaledHeight, scaled ? g_app.m_scaledColor : output);
+
+        const double renderStartMs = DebugTimer_NowMs();
+        Render(&buffers);
+        const double renderMs = DebugTimer_NowMs() - renderStartMs;
+
+        const RedrawStats redraw = Render_GetRedrawStats();
+        redrawnSum += redraw.m_tiles ? (double)redraw.m_redrawnTiles / redraw.m_tiles : 1;
+
+        if (scaled)
+        {
+            DynamicResolution::UpscaleBilinear(
+                g_app.m_scaledColor, scaledWidth, scaledHeight,
+                output, width, height,
+                g_app.m_upscaleScratch);
+        }
+
+        Swapchain::Submit();
+        Memory::EndFrame();
+
+        const uint64_t fragments = g_app.m_rasterCounters.m_fragments;
+        fragmentsSum += fragments;
+        shadedSum += g_app.m_rasterCounters.m_shadedFragments;
+        reusedSum += g_app.m_rasterCounters.m_reusedFragments;
+        g_app.m_rasterCounters = RasterCounters();
+
+        if (perfCounters)
+        {
+            PerfFrame perf;
+            PerfCounters::EndFrame(&perf);
+            ReportPerfFrame(frame, perf, fragments);
+            AddPerfFrame(&g_app.m_perfSums, perf);
+        }
+
+        if (trace)
+        {
+            ThreadPool::WriteTrace(trace, Render_GetJobs(), frame, frame == 0);
+            if (Render_GetEarlyJobs())
+            {
+                ThreadPool::WriteTrace(trace, *Render_GetEarlyJobs(), frame, false);
+            }
+        }
+
+        // The first frame sets up timers and acceleration structures, after that frames
+        // shouldn't touch the heap
+        if (frame == 0)
+        {
+            firstFrameHeapAllocations = Memory::GetHeapAllocationCount();
+        }
+
+        scaleSum += scale;
+        if (g_app.m_dynamicResolution)
+        {
+            framesOverBudget += renderMs > resolutionSettings.m_targetMs;
+            DynamicResolution::Update(&g_app.m_resolution, renderMs);
+        }
+    }
+
+    Swapchain::WaitIdle();
+    if (g_app.m_streaming)
+    {
+        FrameSink::WaitIdle();
+    }
+    const double totalMs = DebugTimer_NowMs() - startMs;
+
+    if (perfCounters)
+    {
+        // The last frames' presents
+        PerfFrame perf;
+        PerfCounters::EndFrame(&perf);
+        AddPerfFrame(&g_app.m_perfSums, perf);
+    }
+
+    //
+    // Report
+    //
+
+    const SwapchainMetrics metrics = Swapchain::GetMetrics();
+    Log::Debug(
+        "%d frames (%dx%d, %d buffers, %d threads, %s) in %.1fms: %.2fms per frame, %.1f FPS",
+        metrics.m_frames, width, height, bufferCount, ThreadPool::GetThreadCount(),
+        Rasterizer::GetScanConversionModeName(Rasterizer::GetScanConversionMode()),
+        totalMs, totalMs / frames, 1000 * frames / totalMs);
+    Log::Debug(
+        "render %.2fms, acquire wait %.2fms, present %.2fms, latency %.2fms, queue depth %.2f",
+        metrics.m_renderMs, metrics.m_acquireWaitMs, metrics.m_presentMs, metrics.m_latencyMs,
+        metrics.m_queueDepth);
+    Log::Debug(
+        "frame interval %.2fms average, %.2fms worst",
+        metrics.m_frameIntervalMs, metrics.m_frameIntervalMaxMs);
+    if (g_app.m_streaming)
+    {
+        const FrameSinkMetrics sink = FrameSink::GetMetrics();
+        const double seconds = sink.m_elapsedMs / 1000;
+        Log::Debug(
+            "output %s (%s): %d frames, %.1f frames/s, %.1fMB/s",
+            outputPath, FrameSink::GetFormatName(sinkSettings.m_format), sink.m_frames,
+            seconds > 0 ? sink.m_frames / seconds : 0,
+            seconds > 0 ? sink.m_bytes / (1024.0 * 1024.0) / seconds : 0);
+        Log::Debug(
+            "write %.2fms per frame", sink.m_writeMs);
+    }
+    if (g_app.m_streaming && sinkSettings.m_format != FrameFormat::BGRA)
+    {
+        const FrameSinkMetrics sink = FrameSink::GetMetrics();
+        Log::Debug(
+            "convert %.2fms per frame, %.1fms waiting for the queue, %d frames queued at most",
+            sink.m_convertMs, sink.m_queueWaitMs, sink.m_maxQueued);
+    }
+    if (g_app.m_dynamicResolution)
+    {
+        Log::Debug(
+            "resolution scale %.2f average, %d frames over the %.2fms budget",
+            scaleSum / frames, framesOverBudget, resolutionSettings.m_targetMs);
+    }
+    if (occludersPath)
+    {
+        const CullingStats culling = Render_GetCullingStats();
+        Log::Debug(
+            "occlusion culling: %d of %d clusters culled", culling.m_culled, culling.m_clusters);
+    }
+    const LodStats lod = Render_GetLodStats();
+    if (lod.m_lodCount > 1)
+    {
+        Log::Debug(
+            "LOD %d of %d (%.1f pixel error), %d triangles",
+            lod.m_lod, lod.m_lodCount, lodErrorPixels, lod.m_triangles);
+    }
+    Log::Debug(
+        "%.1f%% of the pixels redrawn per frame on average%s",
+        100 * redrawnSum / frames, incremental ? "" : " (full redraw)");
+    const LightingStats lighting = Render_GetLightingStats();
+    if (lighting.m_lights > 0)
+    {
+        Log::Debug(
+            "%d lights, %.1f per lit tile on average, %d at most, culled in %.2fms",
+            lighting.m_lights, lighting.m_averageTileLights, lighting.m_maxTileLights,
+            lighting.m_cullMs);
+    }
+    if (Render_GetShadingRate() != ShadingRate::Rate1x1 || Render_GetAdaptiveShading() > 0)
+    {
+        const ShadingStats shading = Render_GetShadingStats();
+        Log::Debug(
+            "shading rate %s, adaptive %.1f: %.1f%% of the fragments shaded, "
+            "%d/%d/%d tiles at 1x1/2x2/4x4",
+            Rasterizer::GetShadingRateName(Render_GetShadingRate()),
+            Render_GetAdaptiveShading(),
+            fragmentsSum ? 100.0 * shadedSum / fragmentsSum : 0,
+            shading.m_tiles1x1, shading.m_tiles2x2, shading.m_tiles4x4);
+    }
+    if (Render_GetReprojection() > 1)
+    {
+        const uint64_t visible = shadedSum + reusedSum;
+        Log::Debug(
+            "reprojection, every pixel shaded every %d frames: %.1f%% of the visible fragments "
+            "reused, %.1f%% shaded",
+            Render_GetReprojection(),
+            visible ? 100.0 * reusedSum / visible : 0,
+            visible ? 100.0 * shadedSum / visible : 0);
+    }
+    Log::Debug(
+        "frame arena peak %.1fMB, %llu heap allocations after the first frame",
+        Memory::GetFrameArena()->m_peak / (1024.0 * 1024.0),
+        (unsigned long long)(Memory::GetHeapAllocationCount() - firstFrameHeapAllocations));
+    if (perfCounters)
+    {
+        ReportPerfSums(g_app.m_perfSums, frames, fragmentsSum);
+    }
+
+    Render_Finish();
+    Swapchain::Shutdown();
+    ThreadPool::Shutdown();
+    PerfCounters::Shutdown();
+    Memory::DestroyArena(&g_app.m_bufferArena);
+    Memory::Shutdown();
+
+    if (trace)
+    {
+        fputs("\n]\n", trace);
+        fclose(trace);
+    }
+
+    if (g_app.m_streaming)
+    {
+        FrameSink::Close();
+    }
+
+    return 0;
+}
@@ -1,6 +1,12 @@
 #include "DebugTimer.h"
+#include "DynamicResolution.h"
 #include "Log.h"
+#include "Memory.h"
 #include "Rasterizer.h"
+#include "Render.h"
+#include "SizeOfArray.h"
+#include "Swapchain.h"
+#include "ThreadPool.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -9,20 +15,47 @@
 struct AppState  // zero is initialisation
 {
     BITMAPINFO m_bitmapInfo;
-    RasterBuffers m_buffers;
+    RasterBuffers m_buffers;  // window sized, m_color is picked every frame
+    HWND m_window;
     bool m_quit;
+
+    // Dynamic resolution: frames smaller than the window render into m_scaledColor and are
+    // upscaled into the swapchain buffer
+    ResolutionController m_resolution;
+    bool m_fixedResolution;
+    uint32_t* m_scaledColor;
+    uint32_t* m_upscaleScratch;
+    Arena m_bufferArena;  // depth and m_scaledColor, see PushFrameBuffers
+
+    // Job timings of the frames being traced, see kTraceFrames
+    FILE* m_trace;
+    int m_tracedFrames;
 };
 
+static const int kDefaultSwapchainBuffers = 2;
+static const size_t kBufferArenaBytes = 96 << 20;  // depth and scaled colour at 4K
+static const double kFrameBudgetMs = 1000.0 / 60;
+static const float kMinResolutionScale = 0.5f;
+static const int kTraceFrames = 60;  // 'J' writes this many frames' jobs to kTracePath
+static const char kTracePath[] = "RendererJobs.json";
+static const float kLodErrorPixels = 1;  // 'L' toggles between this and full detail
+static const int kLightCounts[] = { 0, 16, 256, 1024 };  // 'G' cycles through them
+static const float kAdaptiveShading = 2;  // 'V' cycles through the shading rates, then this
+static const float kSpin = 0.01f;  // radians per frame, 'M' toggles it
+static const int kReprojectionFrames = 4;  // 'T' toggles reprojection
+
 int g_bitmapHeight;
 int g_bitmapWidth;
 int g_bitmapBytes;
 
-extern void Render(RasterBuffers*);
-
 static AppState g_app;
 
 static void ResizeBitmap(int width, int height)
 {
+    // Waits for the present thread, which reads the bitmap info
+    Swapchain::Configure(width, height, Swapchain::GetBufferCount());
+    Render_Invalidate();
+
     g_bitmapWidth = width;
     g_bitmapHeight = height;
 
@@ -33,51 +66,63 @@ static void ResizeBitmap(int width, int height)
     g_app.m_bitmapInfo.bmiHeader.biBitCount = 32;
     g_app.m_bitmapInfo.bmiHeader.biCompression = BI_RGB;
 
-    //
-    // Destroy buffers
-    //
+    g_bitmapBytes = 4 * width * height;
+}
 
-    if (g_app.m_buffers.m_color)
-    {
-        VirtualFree(g_app.m_buffers.m_color, 0, MEM_RELEASE);
-    }
+// Depth and the scaled colour buffer hold the last frame for incremental redraws (see
+// Render_SetIncremental), so they come out of an arena of their own that only a new size
+// empties. Everything else only lives for a frame and comes out of the frame arena, which
+// Memory::EndFrame frees.
+static void PushFrameBuffers(int width, int height)
+{
+    const size_t pixels = (size_t)width * height;
 
-    if (g_app.m_buffers.m_fragmentsTmpBuffer)
+    RasterBuffers& buffers = g_app.m_buffers;
+    if (!buffers.m_depth || buffers.m_width != (size_t)width || buffers.m_height != (size_t)height)
     {
-        VirtualFree(g_app.m_buffers.m_fragmentsTmpBuffer, 0, MEM_RELEASE);
+        Arena* arena = &g_app.m_bufferArena;
+        Memory::ResetToMark(arena, 0);
+
+        buffers.m_depthBufferBytes = sizeof(float) * pixels;
+        buffers.m_depth = Memory::PushArray<float>(arena, pixels);
+
+        // For every resolution scale, it's never bigger than the window
+        g_app.m_scaledColor = Memory::PushArray<uint32_t>(arena, pixels);
     }
 
-    //
-    // Create new buffers
-    //
+    buffers.m_width = width;
+    buffers.m_height = height;
+    buffers.m_bytesPerPixel = 4;
+    buffers.m_colorBufferBytes = buffers.m_bytesPerPixel * pixels;
+
+    Arena* frameArena = Memory::GetFrameArena();
+    buffers.m_fragmentsTmpBufferBytes = sizeof(FragmentInput) * pixels;
+    buffers.m_fragmentsTmpBuffer = Memory::PushArray<FragmentInput>(frameArena, pixels);
 
-    g_app.m_buffers.m_bytesPerPixel = 4;
-    g_app.m_buffers.m_colorBufferBytes = g_app.m_buffers.m_bytesPerPixel * width * height;
-    g_app.m_buffers.m_color = (uint32_t*)VirtualAlloc(
-        0, g_app.m_buffers.m_colorBufferBytes, MEM_COMMIT, PAGE_READWRITE);
-    g_bitmapBytes = g_app.m_buffers.m_colorBufferBytes;
-    
-    g_app.m_buffers.m_fragmentsTmpBufferBytes = sizeof(FragmentInput) * width * height;
-    g_app.m_buffers.m_fragmentsTmpBuffer = (FragmentInput*)VirtualAlloc(
-        0, g_app.m_buffers.m_fragmentsTmpBufferBytes, MEM_COMMIT, PAGE_READWRITE);
-    
-    //g_app.m_buffers.m_depth = nullptr;
-    g_app.m_buffers.m_width = width;
-    g_app.m_buffers.m_height = height;
-
-    Render(&g_app.m_buffers);
+    g_app.m_upscaleScratch = Memory::PushArray<uint32_t>(frameArena, 2 * width + 1);
 }
 
-static void DrawBitmap(HDC hdc, RECT clientRect)
+// Runs on the swapchain's present thread
+static void PresentToWindow(const uint32_t* color, int width, int height, void* userData)
 {
+    HWND window = *(HWND*)userData;
+    if (!window)
+    {
+        return;
+    }
+
+    HDC hdc = GetDC(window);
+    RECT clientRect;
+    GetClientRect(window, &clientRect);
     StretchDIBits(
         hdc,
-        0, 0, g_bitmapWidth, g_bitmapHeight,
+        0, 0, width, height,
         0, 0, clientRect.right - clientRect.left, clientRect.bottom - clientRect.top,
-        g_app.m_buffers.m_color,
+        color,
         &g_app.m_bitmapInfo,
         DIB_RGB_COLORS,
         SRCCOPY);
+    ReleaseDC(window, hdc);
 }
 
 static LRESULT CALLBACK WindowCallback(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
@@ -96,6 +141,105 @@ static LRESULT CALLBACK WindowCallback(HWND window, UINT message, WPARAM wparam,
         }
         break;
 
+        case WM_KEYDOWN:
+        {
+            if (wparam == 'W')
+            {
+                // NORMAL -> WIREFRAME -> WIREFRAME_OVERLAY -> NORMAL
+                RenderMode mode = Render_GetMode();
+                mode = mode == RenderMode::NORMAL ? RenderMode::WIREFRAME :
+                    mode == RenderMode::WIREFRAME ? RenderMode::WIREFRAME_OVERLAY :
+                    RenderMode::NORMAL;
+                Render_SetMode(mode);
+            }
+            else if (wparam == 'R')
+            {
+                Render_SetBackend(Render_GetBackend() == RenderBackend::RASTERIZER ?
+                    RenderBackend::RAY_TRACER : RenderBackend::RASTERIZER);
+            }
+            else if (wparam == 'P')
+            {
+                Render_SetRain(!Render_GetRain());
+            }
+            else if (wparam == 'B')
+            {
+                // Single -> double -> triple buffering
+                const int bufferCount = Swapchain::GetBufferCount() % Swapchain::kMaxBuffers + 1;
+                Swapchain::Configure(g_bitmapWidth, g_bitmapHeight, bufferCount);
+                Swapchain::ResetMetrics();
+                Render_Invalidate();
+            }
+            else if (wparam == 'D')
+            {
+                g_app.m_fixedResolution = !g_app.m_fixedResolution;
+            }
+            else if (wparam == 'S')
+            {
+                // Next scan conversion mode, to compare them on the same scene
+                const int mode = ((int)Rasterizer::GetScanConversionMode() + 1) %
+                    (int)ScanConversionMode::Count;
+                Rasterizer::SetScanConversionMode((ScanConversionMode)mode);
+            }
+            else if (wparam == 'L')
+            {
+                Render_SetLodErrorPixels(Render_GetLodErrorPixels() > 0 ? 0 : kLodErrorPixels);
+            }
+            else if (wparam == 'I')
+            {
+                Render_SetIncremental(!Render_GetIncremental());
+            }
+            else if (wparam == 'G')
+            {
+                const int count = SizeOfArray(kLightCounts);
+                int next = 0;
+                while (next < count && kLightCounts[next] != Render_GetLightCount())
+                {
+                    ++next;
+                }
+                Render_SetLightCount(kLightCounts[(next + 1) % count]);
+            }
+            else if (wparam == 'V')
+            {
+                // 1x1 -> 2x2 -> 4x4 -> adaptive -> 1x1
+                const int rate = (int)Render_GetShadingRate();
+                if (Render_GetAdaptiveShading() > 0)
+                {
+                    Render_SetAdaptiveShading(0);
+                }
+                else if (rate + 1 < (int)ShadingRate::Count)
+                {
+                    Render_SetShadingRate((ShadingRate)(rate + 1));
+                }
+                else
+                {
+                    Render_SetShadingRate(ShadingRate::Rate1x1);
+                    Render_SetAdaptiveShading(kAdaptiveShading);
+                }
+            }
+            else if (wparam == 'M')
+            {
+                Render_SetSpin(Render_GetSpin() != 0 ? 0 : kSpin);
+            }
+            else if (wparam == 'T')
+            {
+                Render_SetReprojection(Render_GetReprojection() > 1 ? 0 : kReprojectionFrames);
+            }
+            else if (wparam == 'J' && !g_app.m_trace)
+            {
+                g_app.m_trace = fopen(kTracePath, "w");
+                if (g_app.m_trace)
+                {
+                    fputs("[\n", g_app.m_trace);
+                    g_app.m_tracedFrames = 0;
+                }
+                else
+                {
+                    Log::Warning("Cannot open %s", kTracePath);
+                }
+            }
+        }
+        break;
+
         case WM_CLOSE:
         {
             g_app.m_quit = true;
@@ -110,9 +254,9 @@ static LRESULT CALLBACK WindowCallback(HWND window, UINT message, WPARAM wparam,
 
         case WM_PAINT:
         {
+            // Nothing to draw here, the present thread repaints the whole window every frame
             PAINTSTRUCT paint;
-            HDC deviceContext = BeginPaint(window, &paint);
-            DrawBitmap(deviceContext, paint.rcPaint);
+            BeginPaint(window, &paint);
             EndPaint(window, &paint);
         }
         break;
@@ -127,12 +271,97 @@ static LRESULT CALLBACK WindowCallback(HWND window, UINT message, WPARAM wparam,
     return result;
 }
 
+// Splits the command line in place on spaces, honouring double quotes. Returns the arguments
+// count.
+static int ParseCommandLine(char* cmdLine, char** args, int maxArgs)
+{
+    int count = 0;
+    char* c = cmdLine;
+
+    while (*c && count < maxArgs)
+    {
+        while (*c == ' ' || *c == '\t')
+        {
+            ++c;
+        }
+
+        if (!*c)
+        {
+            break;
+        }
+
+        char terminator = ' ';
+        if (*c == '"')
+        {
+            terminator = '"';
+            ++c;
+        }
+
+        args[count++] = c;
+
+        while (*c && *c != terminator && !(terminator == ' ' && *c == '\t'))
+        {
+            ++c;
+        }
+
+        if (*c)
+        {
+            *c++ = 0;
+        }
+    }
+
+    return count;
+}
+
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     //
-    // Create window
+    // Load scene
+    //
+    // Usage: Renderer.exe [scene.mesh [texture.dds [occluders.mesh]]]
+    //
+
+    char* args[4];
+    int argsCount = ParseCommandLine(lpCmdLine, args, 4);
+
+    if (argsCount >= 1 && !Render_LoadMesh(args[0]))
+    {
+        Log::Error("Cannot load mesh %s", args[0]);
+        return 1;
+    }
+
+    if (argsCount >= 2 && !Render_LoadTexture(args[1]))
+    {
+        Log::Error("Cannot load texture %s", args[1]);
+        return 1;
+    }
+
+    if (argsCount >= 3 && !Render_LoadOccluders(args[2]))
+    {
+        Log::Error("Cannot load occluders %s", args[2]);
+        return 1;
+    }
+
+    Render_SetLodErrorPixels(kLodErrorPixels);
+    Render_SetIncremental(true);
+
+    DynamicResolutionSettings resolutionSettings = {};
+    resolutionSettings.m_targetMs = kFrameBudgetMs;
+    resolutionSettings.m_minScale = kMinResolutionScale;
+    resolutionSettings.m_maxScale = 1;
+    DynamicResolution::Init(&g_app.m_resolution, resolutionSettings);
+
+    //
+    // Create window, which sends the first WM_SIZE and so configures the swapchain
     //
 
+    Memory::Init();
+    Memory::CreateArena(&g_app.m_bufferArena, kBufferArenaBytes);
+    Log::Init();
+    ThreadPool::Init(0);
+    Swapchain::Init(PresentToWindow, &g_app.m_window);
+    Swapchain::Configure(0, 0, kDefaultSwapchainBuffers);
+
     const wchar_t kClassName[] = L"RendererWindowClass";
     const wchar_t kWindowName[] = L"Manuel Freire Renderer 2015";
 
@@ -168,6 +397,8 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         return 1;
     }
 
+    g_app.m_window = window;
+
     //
     // Core loop
     //
@@ -194,38 +425,125 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         DebugTimer_Tic("Frame");
 
         //
-        // Render
+        // Render into the next free buffer and hand it to the present thread. Waits here if
+        // every buffer is still queued. Below full resolution, render into the scaled buffer
+        // and upscale into the swapchain's.
         //
 
-        Render(&g_app.m_buffers);
+        uint32_t* output = Swapchain::Acquire();
+        PushFrameBuffers(g_bitmapWidth, g_bitmapHeight);
 
-        //
-        // Draw colour buffer
-        //
+        const float scale = g_app.m_fixedResolution ? 1 : g_app.m_resolution.m_scale;
+        int width;
+        int height;
+        DynamicResolution::ScaledSize(scale, g_bitmapWidth, g_bitmapHeight, &width, &height);
+        const bool scaled = width != g_bitmapWidth || height != g_bitmapHeight;
 
-        DebugTimer_Tic("DrawBuffer");
+        RasterBuffers buffers = DynamicResolution::ScaledBuffers(
+            g_app.m_buffers, width, height, scaled ? g_app.m_scaledColor : output);
 
-        HDC hdc = GetDC(window);
-        RECT rect;
-        GetClientRect(window, &rect);
-        DrawBitmap(hdc, rect);
-        ReleaseDC(window, hdc);
+        const double renderStartMs = DebugTimer_NowMs();
+        Render(&buffers);
+        const double renderMs = DebugTimer_NowMs() - renderStartMs;
 
-        DebugTimer_TocAndPrint("DrawBuffer");
+        if (scaled)
+        {
+            DynamicResolution::UpscaleBilinear(
+                g_app.m_scaledColor, width, height,
+                output, g_bitmapWidth, g_bitmapHeight,
+                g_app.m_upscaleScratch);
+        }
+
+        Swapchain::Submit();
+        Memory::EndFrame();
+
+        if (g_app.m_trace)
+        {
+            ThreadPool::WriteTrace(
+                g_app.m_trace, Render_GetJobs(), g_app.m_tracedFrames, g_app.m_tracedFrames == 0);
+            if (Render_GetEarlyJobs())
+            {
+                ThreadPool::WriteTrace(
+                    g_app.m_trace, *Render_GetEarlyJobs(), g_app.m_tracedFrames, false);
+            }
+            if (++g_app.m_tracedFrames == kTraceFrames)
+            {
+                fputs("\n]\n", g_app.m_trace);
+                fclose(g_app.m_trace);
+                g_app.m_trace = nullptr;
+                Log::Debug("Wrote %d frames of jobs to %s", kTraceFrames, kTracePath);
+            }
+        }
+
+        if (!g_app.m_fixedResolution)
+        {
+            DynamicResolution::Update(&g_app.m_resolution, renderMs);
+        }
 
         //
         // Measure frame time
         //
 
         double frameTime = DebugTimer_Toc("Frame");
-        wchar_t windowName[128];
-        swprintf(
-            windowName,
-            sizeof(windowName),
-            L"%s (%dx%d, %.02fms, %.0f FPS)",
-            kWindowName, g_bitmapWidth, g_bitmapHeight, frameTime, 1000.0 / frameTime);
-        SetWindowText(window, windowName);
+
+        static int s_titleFrames = 0;
+        static uint64_t s_titleHeapAllocations = 0;
+        if (++s_titleFrames == 30)
+        {
+            s_titleFrames = 0;
+            const SwapchainMetrics metrics = Swapchain::GetMetrics();
+            Swapchain::ResetMetrics();
+
+            // Should stay at 0 once the first frames have set everything up
+            const uint64_t heapAllocations = Memory::GetHeapAllocationCount();
+            const int recentHeapAllocations = (int)(heapAllocations - s_titleHeapAllocations);
+            s_titleHeapAllocations = heapAllocations;
+
+            const LodStats lod = Render_GetLodStats();
+            const RedrawStats redraw = Render_GetRedrawStats();
+            const int redrawnPercent =
+                redraw.m_tiles ? 100 * redraw.m_redrawnTiles / redraw.m_tiles : 100;
+
+            wchar_t rayTraceText[64] = L"";
+            if (Render_GetBackend() == RenderBackend::RAY_TRACER)
+            {
+                const RayTraceStats rayTrace = Render_GetRayTraceStats();
+                swprintf(
+                    rayTraceText,
+                    sizeof(rayTraceText) / sizeof(rayTraceText[0]),
+                    L", BVH %.02fms, trace %.02fms at %.1f Mrays/s",
+                    rayTrace.m_bvhMs, rayTrace.m_traceMs, rayTrace.m_mraysPerSecond);
+            }
+
+            wchar_t windowName[256];
+            swprintf(
+                windowName,
+                sizeof(windowName) / sizeof(windowName[0]),
+                L"%s (%dx%d at %.0f%%, %S%s, LOD %d %d triangles, %d lights, %d%% redrawn, "
+                L"%.02fms, %.0f FPS, %d buffers: "
+                L"render %.02fms, wait %.02fms, present %.02fms, latency %.02fms, queue %.1f, "
+                L"%d heap allocations)",
+                kWindowName, g_bitmapWidth, g_bitmapHeight, 100 * scale,
+                Rasterizer::GetScanConversionModeName(Rasterizer::GetScanConversionMode()),
+                rayTraceText, lod.m_lod, lod.m_triangles, Render_GetLightCount(), redrawnPercent,
+                frameTime, 1000.0 / frameTime,
+                Swapchain::GetBufferCount(), metrics.m_renderMs, metrics.m_acquireWaitMs,
+                metrics.m_presentMs, metrics.m_latencyMs, metrics.m_queueDepth,
+                recentHeapAllocations);
+            SetWindowText(window, windowName);
+        }
     }
 
+    if (g_app.m_trace)
+    {
+        fclose(g_app.m_trace);  // cut short, the closing ] is optional
+    }
+
+    Render_Finish();
+    Swapchain::Shutdown();
+    ThreadPool::Shutdown();
+    Memory::DestroyArena(&g_app.m_bufferArena);
+    Memory::Shutdown();
+
     return 0;
 }
@@ -0,0 +1,559 @@
+#pragma once
+
+#include "MathUtils.h"
+
+#include <emmintrin.h>
+#include <math.h>
+
+//
+// SSE2 versions of the math types, for code that works on several values at once.
+//
+// floatx4 is four floats in an SSE register. floatx8 is eight floats in two registers, because
+// the build targets SSE2 and not AVX. Code written against floatx8 keeps its width if that
+// changes.
+//
+// vec3x4 and vec3x8 are structures of arrays: all the x, then all the y, then all the z. Each
+// operator works lane by lane, so a function written once for vec3xN<F> handles 4 or 8
+// vectors. vec3x4Load and vec3x4Get move vectors in and out of the lanes.
+//
+// Comparisons give masks: every bit is set in the lanes where they hold. floatxSelect picks
+// between two values lane by lane, so a branch on a value becomes a select.
+//
+// The exact operations round the way the scalar ones do, so they give the same results bit for
+// bit: divide, floatxSqrt, floatxRcp, vec3xNormalize. They have no checks, so dividing by zero
+// gives inf or NaN. The Fast ones use the SSE approximations (12 bits) refined by a
+// Newton-Raphson step to about 22 bits, and cost a fraction of a divide or square root.
+//
+// 32-bit x86 can't pass more than three SSE values by value, so everything takes const
+// references. The types need 16 byte alignment, which the stack gives and a std::vector
+// doesn't under VS2013. Load them from float arrays rather than keeping them in one.
+//
+
+//
+// floatx4
+//
+
+struct floatx4
+{
+    __m128 m;
+
+    floatx4()
+    {}
+
+    explicit floatx4(__m128 m_)
+        : m(m_)
+    {}
+
+    floatx4(float s)
+        : m(_mm_set1_ps(s))
+    {}
+
+    floatx4(float a, float b, float c, float d)
+        : m(_mm_setr_ps(a, b, c, d))
+    {}
+};
+
+struct maskx4
+{
+    __m128 m;
+
+    maskx4()
+    {}
+
+    explicit maskx4(__m128 m_)
+        : m(m_)
+    {}
+};
+
+inline floatx4 floatx4Load(const float* p)  // unaligned
+{
+    return floatx4(_mm_loadu_ps(p));
+}
+
+inline void floatx4Store(const floatx4& a, float* p)  // unaligned
+{
+    _mm_storeu_ps(p, a.m);
+}
+
+inline floatx4 operator+(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_add_ps(a.m, b.m));
+}
+
+inline floatx4 operator-(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_sub_ps(a.m, b.m));
+}
+
+inline floatx4 operator-(const floatx4& a)
+{
+    return floatx4(_mm_xor_ps(a.m, _mm_set1_ps(-0.0f)));
+}
+
+inline floatx4 operator*(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_mul_ps(a.m, b.m));
+}
+
+inline floatx4 operator/(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_div_ps(a.m, b.m));
+}
+
+inline maskx4 operator<(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmplt_ps(a.m, b.m));
+}
+
+inline maskx4 operator<=(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmple_ps(a.m, b.m));
+}
+
+inline maskx4 operator>(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmpgt_ps(a.m, b.m));
+}
+
+inline maskx4 operator>=(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmpge_ps(a.m, b.m));
+}
+
+inline maskx4 operator==(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmpeq_ps(a.m, b.m));
+}
+
+inline maskx4 operator!=(const floatx4& a, const floatx4& b)
+{
+    return maskx4(_mm_cmpneq_ps(a.m, b.m));
+}
+
+inline maskx4 operator&(const maskx4& a, const maskx4& b)
+{
+    return maskx4(_mm_and_ps(a.m, b.m));
+}
+
+inline maskx4 operator|(const maskx4& a, const maskx4& b)
+{
+    return maskx4(_mm_or_ps(a.m, b.m));
+}
+
+inline maskx4 operator~(const maskx4& a)
+{
+    return maskx4(_mm_xor_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))));
+}
+
+// Bit n set if lane n is
+inline int floatxMoveMask(const maskx4& a)
+{
+    return _mm_movemask_ps(a.m);
+}
+
+// a where the mask is set, b elsewhere
+inline floatx4 floatxSelect(const maskx4& mask, const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_or_ps(_mm_and_ps(mask.m, a.m), _mm_andnot_ps(mask.m, b.m)));
+}
+
+inline floatx4 floatxMin(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_min_ps(a.m, b.m));
+}
+
+inline floatx4 floatxMax(const floatx4& a, const floatx4& b)
+{
+    return floatx4(_mm_max_ps(a.m, b.m));
+}
+
+inline floatx4 floatxSqrt(const floatx4& a)
+{
+    return floatx4(_mm_sqrt_ps(a.m));
+}
+
+inline floatx4 floatxRcp(const floatx4& a)
+{
+    return floatx4(_mm_div_ps(_mm_set1_ps(1.0f), a.m));
+}
+
+inline floatx4 floatxRcpFast(const floatx4& a)
+{
+    const __m128 r = _mm_rcp_ps(a.m);
+    return floatx4(_mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(a.m, r))));
+}
+
+// 1 / sqrt(a), 0 gives NaN
+inline floatx4 floatxRsqrtFast(const floatx4& a)
+{
+    const __m128 r = _mm_rsqrt_ps(a.m);
+    const __m128 halfARR = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), a.m), _mm_mul_ps(r, r));
+    return floatx4(_mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), halfARR)));
+}
+
+//
+// floatx8
+//
+
+struct floatx8
+{
+    floatx4 lo;  // lanes 0 to 3
+    floatx4 hi;  // lanes 4 to 7
+
+    floatx8()
+    {}
+
+    floatx8(const floatx4& lo_, const floatx4& hi_)
+        : lo(lo_)
+        , hi(hi_)
+    {}
+
+    floatx8(float s)
+        : lo(s)
+        , hi(s)
+    {}
+};
+
+struct maskx8
+{
+    maskx4 lo;
+    maskx4 hi;
+
+    maskx8()
+    {}
+
+    maskx8(const maskx4& lo_, const maskx4& hi_)
+        : lo(lo_)
+        , hi(hi_)
+    {}
+};
+
+inline floatx8 floatx8Load(const float* p)  // unaligned
+{
+    return floatx8(floatx4Load(p), floatx4Load(p + 4));
+}
+
+inline void floatx8Store(const floatx8& a, float* p)  // unaligned
+{
+    floatx4Store(a.lo, p);
+    floatx4Store(a.hi, p + 4);
+}
+
+inline floatx8 operator+(const floatx8& a, const floatx8& b)
+{
+    return floatx8(a.lo + b.lo, a.hi + b.hi);
+}
+
+inline floatx8 operator-(const floatx8& a, const floatx8& b)
+{
+    return floatx8(a.lo - b.lo, a.hi - b.hi);
+}
+
+inline floatx8 operator-(const floatx8& a)
+{
+    return floatx8(-a.lo, -a.hi);
+}
+
+inline floatx8 operator*(const floatx8& a, const floatx8& b)
+{
+    return floatx8(a.lo * b.lo, a.hi * b.hi);
+}
+
+inline floatx8 operator/(const floatx8& a, const floatx8& b)
+{
+    return floatx8(a.lo / b.lo, a.hi / b.hi);
+}
+
+inline maskx8 operator<(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo < b.lo, a.hi < b.hi);
+}
+
+inline maskx8 operator<=(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo <= b.lo, a.hi <= b.hi);
+}
+
+inline maskx8 operator>(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo > b.lo, a.hi > b.hi);
+}
+
+inline maskx8 operator>=(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo >= b.lo, a.hi >= b.hi);
+}
+
+inline maskx8 operator==(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo == b.lo, a.hi == b.hi);
+}
+
+inline maskx8 operator!=(const floatx8& a, const floatx8& b)
+{
+    return maskx8(a.lo != b.lo, a.hi != b.hi);
+}
+
+inline maskx8 operator&(const maskx8& a, const maskx8& b)
+{
+    return maskx8(a.lo & b.lo, a.hi & b.hi);
+}
+
+inline maskx8 operator|(const maskx8& a, const maskx8& b)
+{
+    return maskx8(a.lo | b.lo, a.hi | b.hi);
+}
+
+inline maskx8 operator~(const maskx8& a)
+{
+    return maskx8(~a.lo, ~a.hi);
+}
+
+inline int floatxMoveMask(const maskx8& a)
+{
+    return floatxMoveMask(a.lo) | floatxMoveMask(a.hi) << 4;
+}
+
+inline floatx8 floatxSelect(const maskx8& mask, const floatx8& a, const floatx8& b)
+{
+    return floatx8(floatxSelect(mask.lo, a.lo, b.lo), floatxSelect(mask.hi, a.hi, b.hi));
+}
+
+inline floatx8 floatxMin(const floatx8& a, const floatx8& b)
+{
+    return floatx8(floatxMin(a.lo, b.lo), floatxMin(a.hi, b.hi));
+}
+
+inline floatx8 floatxMax(const floatx8& a, const floatx8& b)
+{
+    return floatx8(floatxMax(a.lo, b.lo), floatxMax(a.hi, b.hi));
+}
+
+inline floatx8 floatxSqrt(const floatx8& a)
+{
+    return floatx8(floatxSqrt(a.lo), floatxSqrt(a.hi));
+}
+
+inline floatx8 floatxRcp(const floatx8& a)
+{
+    return floatx8(floatxRcp(a.lo), floatxRcp(a.hi));
+}
+
+inline floatx8 floatxRcpFast(const floatx8& a)
+{
+    return floatx8(floatxRcpFast(a.lo), floatxRcpFast(a.hi));
+}
+
+inline floatx8 floatxRsqrtFast(const floatx8& a)
+{
+    return floatx8(floatxRsqrtFast(a.lo), floatxRsqrtFast(a.hi));
+}
+
+//
+// vec3x4, vec3x8
+//
+
+template <typename F>
+struct vec3xN
+{
+    F x;
+    F y;
+    F z;
+
+    vec3xN()
+    {}
+
+    vec3xN(const F& x_, const F& y_, const F& z_)
+        : x(x_)
+        , y(y_)
+        , z(z_)
+    {}
+};
+
+typedef vec3xN<floatx4> vec3x4;
+typedef vec3xN<floatx8> vec3x8;
+
+// a in lane 0 to d in lane 3
+inline vec3x4 vec3x4Load(const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+{
+    return vec3x4(
+        floatx4(a.x, b.x, c.x, d.x),
+        floatx4(a.y, b.y, c.y, d.y),
+        floatx4(a.z, b.z, c.z, d.z));
+}
+
+inline vec3 vec3x4Get(const vec3x4& a, int lane)
+{
+    float x[4];
+    float y[4];
+    float z[4];
+    floatx4Store(a.x, x);
+    floatx4Store(a.y, y);
+    floatx4Store(a.z, z);
+    return vec3(x[lane], y[lane], z[lane]);
+}
+
+template <typename F>
+inline vec3xN<F> operator+(const vec3xN<F>& a, const vec3xN<F>& b)
+{
+    return vec3xN<F>(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+template <typename F>
+inline vec3xN<F> operator-(const vec3xN<F>& a, const vec3xN<F>& b)
+{
+    return vec3xN<F>(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+template <typename F>
+inline vec3xN<F> operator-(const vec3xN<F>& a)
+{
+    return vec3xN<F>(-a.x, -a.y, -a.z);
+}
+
+template <typename F>
+inline vec3xN<F> operator*(const vec3xN<F>& a, const F& s)
+{
+    return vec3xN<F>(a.x * s, a.y * s, a.z * s);
+}
+
+template <typename F>
+inline vec3xN<F> operator/(const vec3xN<F>& a, const F& s)
+{
+    return vec3xN<F>(a.x / s, a.y / s, a.z / s);
+}
+
+template <typename F>
+inline F vec3xDot(const vec3xN<F>& a, const vec3xN<F>& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template <typename F>
+inline vec3xN<F> vec3xCross(const vec3xN<F>& a, const vec3xN<F>& b)
+{
+    return vec3xN<F>(
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x);
+}
+
+template <typename F>
+inline F vec3xLength(const vec3xN<F>& a)
+{
+    return floatxSqrt(vec3xDot(a, a));
+}
+
+// The same as vec3Normalize lane by lane, but zero length gives NaN instead of an error
+template <typename F>
+inline vec3xN<F> vec3xNormalize(const vec3xN<F>& a)
+{
+    return a / vec3xLength(a);
+}
+
+template <typename F>
+inline vec3xN<F> vec3xNormalizeFast(const vec3xN<F>& a)
+{
+    return a * floatxRsqrtFast(vec3xDot(a, a));
+}
+
+template <typename F, typename M>
+inline vec3xN<F> vec3xSelect(const M& mask, const vec3xN<F>& a, const vec3xN<F>& b)
+{
+    return vec3xN<F>(
+        floatxSelect(mask, a.x, b.x),
+        floatxSelect(mask, a.y, b.y),
+        floatxSelect(mask, a.z, b.z));
+}
+
+//
+// mat4
+//
+// Column vectors, so a * b transforms by b and then by a.
+//
+
+struct mat4
+{
+    floatx4 c[4];
+};
+
+inline floatx4 floatx4FromVec4(const vec4& a)
+{
+    return floatx4Load(&a.x);
+}
+
+inline vec4 vec4FromFloatx4(const floatx4& a)
+{
+    vec4 result;
+    floatx4Store(a, &result.x);
+    return result;
+}
+
+inline mat4 mat4Columns(const floatx4& c0, const floatx4& c1, const floatx4& c2, const floatx4& c3)
+{
+    mat4 result;
+    result.c[0] = c0;
+    result.c[1] = c1;
+    result.c[2] = c2;
+    result.c[3] = c3;
+    return result;
+}
+
+inline mat4 mat4Identity()
+{
+    return mat4Columns(
+        floatx4(1, 0, 0, 0),
+        floatx4(0, 1, 0, 0),
+        floatx4(0, 0, 1, 0),
+        floatx4(0, 0, 0, 1));
+}
+
+inline mat4 mat4Translation(const vec3& t)
+{
+    return mat4Columns(
+        floatx4(1, 0, 0, 0),
+        floatx4(0, 1, 0, 0),
+        floatx4(0, 0, 1, 0),
+        floatx4(t.x, t.y, t.z, 1));
+}
+
+inline mat4 mat4Scale(const vec3& s)
+{
+    return mat4Columns(
+        floatx4(s.x, 0, 0, 0),
+        floatx4(0, s.y, 0, 0),
+        floatx4(0, 0, s.z, 0),
+        floatx4(0, 0, 0, 1));
+}
+
+// About the y axis, turning z towards x
+inline mat4 mat4RotationY(float radians)
+{
+    const float c = cosf(radians);
+    const float s = sinf(radians);
+    return mat4Columns(
+        floatx4(c, 0, -s, 0),
+        floatx4(0, 1, 0, 0),
+        floatx4(s, 0, c, 0),
+        floatx4(0, 0, 0, 1));
+}
+
+inline floatx4 mat4Transform(const mat4& m, const floatx4& v)
+{
+    const __m128 x = _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 y = _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 z = _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 w = _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 3, 3, 3));
+    return floatx4(_mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(m.c[0].m, x), _mm_mul_ps(m.c[1].m, y)),
+        _mm_add_ps(_mm_mul_ps(m.c[2].m, z), _mm_mul_ps(m.c[3].m, w))));
+}
+
+inline mat4 operator*(const mat4& a, const mat4& b)
+{
+    return mat4Columns(
+        mat4Transform(a, b.c[0]),
+        mat4Transform(a, b.c[1]),
+        mat4Transform(a, b.c[2]),
+        mat4Transform(a, b.c[3]));
+}
@@ -12,10 +12,7 @@ vec3 operator/(const vec3& a, float s)
         return vec3zero;
     }
 
-    return vec3(
-        a.x / s,
-        a.y / s,
-        a.z / s);
+    return vec3DivideUnchecked(a, s);
 }
 
 float vec3Length(const vec3& v)
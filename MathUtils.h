@@ -1,5 +1,7 @@
 #pragma once
 
+#include <math.h>
+
 //
 // vec2
 //
@@ -50,6 +52,11 @@ vec3 vec3Cross(const vec3& a, const vec3& b);
 float vec3Length(const vec3& a);
 vec3 vec3Normalize(const vec3& a);
 
+// The same without the check for zero, so without a branch or a call, for hot paths that have
+// ruled zero out already. Zero gives inf or NaN.
+vec3 vec3DivideUnchecked(const vec3& a, float s);
+vec3 vec3NormalizeUnchecked(const vec3& a);
+
 #define vec3zero vec3(0, 0, 0)
 #define vec3one vec3(1, 1, 1)
 
@@ -148,6 +155,19 @@ inline vec3 vec3Cross(const vec3& a, const vec3& b)
         a.x * b.y - a.y * b.x);
 }
 
+inline vec3 vec3DivideUnchecked(const vec3& a, float s)
+{
+    return vec3(
+        a.x / s,
+        a.y / s,
+        a.z / s);
+}
+
+inline vec3 vec3NormalizeUnchecked(const vec3& a)
+{
+    return vec3DivideUnchecked(a, sqrtf(vec3Dot(a, a)));
+}
+
 inline vec3 vec4xyz(const vec4& a)
 {
     return vec3(a.x, a.y, a.z);
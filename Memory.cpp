@@ -0,0 +1,169 @@
+#include "Memory.h"
+
+#include "Log.h"
+
+#include "External/pow2assert.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+struct MemoryState  // zero is initialisation
+{
+    Arena m_frame;
+    Arena m_threads[Memory::kMaxThreads];
+};
+
+static MemoryState g_memory;
+static bool g_initialised = false;
+
+// Static storage, so it's zero before any constructor runs and allocates
+static std::atomic<uint64_t> g_heapAllocations;
+
+//
+// HEAP COUNTER
+//
+// Replaces the global operator new, the array and nothrow forms call this one
+//
+
+void* operator new(size_t bytes)
+{
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* memory = malloc(bytes > 0 ? bytes : 1);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) throw()
+{
+    free(memory);
+}
+
+uint64_t Memory::GetHeapAllocationCount()
+{
+    return g_heapAllocations.load(std::memory_order_relaxed);
+}
+
+//
+// ARENAS
+//
+
+void Memory::CreateArena(Arena* arena, size_t capacity)
+{
+    POW2_ASSERT(arena);
+
+    *arena = {};
+    capacity = (capacity + kCommitBytes - 1) / kCommitBytes * kCommitBytes;
+    arena->m_base = (uint8_t*)ReservePages(capacity);
+    if (!arena->m_base)
+    {
+        Log::Error("Cannot reserve %uMB for an arena", (unsigned)(capacity >> 20));
+    }
+    arena->m_reserved = capacity;
+}
+
+void Memory::DestroyArena(Arena* arena)
+{
+    POW2_ASSERT(arena);
+
+    if (arena->m_base)
+    {
+        ReleasePages(arena->m_base, arena->m_reserved);
+    }
+    *arena = {};
+}
+
+void* Memory::Push(Arena* arena, size_t bytes)
+{
+    POW2_ASSERT(arena && arena->m_base);
+
+    const size_t start = (arena->m_used + kAlignment - 1) & ~(kAlignment - 1);
+    const size_t end = start + bytes;
+
+    if (end > arena->m_committed)
+    {
+        if (end > arena->m_reserved)
+        {
+            Log::Error(
+                "Arena out of space: %uMB reserved, %uMB needed",
+                (unsigned)(arena->m_reserved >> 20), (unsigned)((end + (1 << 20) - 1) >> 20));
+        }
+
+        // Commit whole steps so a growing arena doesn't commit a page at a time
+        const size_t committed = (end + kCommitBytes - 1) / kCommitBytes * kCommitBytes;
+        if (!CommitPages(arena->m_base + arena->m_committed, committed - arena->m_committed))
+        {
+            Log::Error("Cannot commit %uMB of arena memory", (unsigned)(committed >> 20));
+        }
+        arena->m_committed = committed;
+    }
+
+    arena->m_used = end;
+    arena->m_peak = end > arena->m_peak ? end : arena->m_peak;
+    return arena->m_base + start;
+}
+
+void Memory::ResetToMark(Arena* arena, size_t mark)
+{
+    POW2_ASSERT(arena && mark <= arena->m_used);
+    arena->m_used = mark;
+}
+
+//
+// FRAME AND THREAD ARENAS
+//
+
+void Memory::Init()
+{
+    POW2_ASSERT(!g_initialised);
+
+    CreateArena(&g_memory.m_frame, kFrameArenaBytes);
+    g_initialised = true;
+}
+
+void Memory::Shutdown()
+{
+    POW2_ASSERT(g_initialised);
+
+    DestroyArena(&g_memory.m_frame);
+    for (int i = 0; i < kMaxThreads; ++i)
+    {
+        DestroyArena(&g_memory.m_threads[i]);
+    }
+    g_initialised = false;
+}
+
+Arena* Memory::GetFrameArena()
+{
+    POW2_ASSERT(g_initialised);
+    return &g_memory.m_frame;
+}
+
+Arena* Memory::GetThreadArena(int threadIndex)
+{
+    POW2_ASSERT(g_initialised);
+    POW2_ASSERT(threadIndex >= 0 && threadIndex < kMaxThreads);
+
+    // Only thread threadIndex ever touches this entry, no need to lock
+    Arena* arena = &g_memory.m_threads[threadIndex];
+    if (!arena->m_base)
+    {
+        CreateArena(arena, kThreadArenaBytes);
+    }
+    return arena;
+}
+
+void Memory::EndFrame()
+{
+    POW2_ASSERT(g_initialised);
+
+    ResetToMark(&g_memory.m_frame, 0);
+    for (int i = 0; i < kMaxThreads; ++i)
+    {
+        g_memory.m_threads[i].m_used = 0;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Linear allocators for transient data.
+//
+// An arena reserves a range of address space up front and commits pages as it grows, so growing
+// never moves or copies anything. Allocating is a pointer bump and everything is freed at once by
+// going back to a mark. Once an arena has grown to a frame's needs, frames cost no system calls
+// and no heap allocations.
+//
+// The frame arena holds whatever lives for one frame (fragment buffers, depth, scratch) and
+// EndFrame empties it. Every pool thread also gets a sub-arena of its own for scratch made inside
+// parallel tasks, so threads never share an allocator.
+//
+
+struct Arena  // zero is an empty arena, see Memory::CreateArena
+{
+    uint8_t* m_base;
+    size_t m_reserved;   // address space
+    size_t m_committed;  // backed by memory, always a multiple of Memory::kCommitBytes
+    size_t m_used;
+    size_t m_peak;
+};
+
+namespace Memory
+{
+    static const size_t kAlignment = 16;             // of every allocation, enough for SSE
+    static const size_t kCommitBytes = 2 << 20;      // arenas grow by this much, a huge page
+    static const size_t kFrameArenaBytes =
+        (size_t)(sizeof(void*) == 8 ? 1024 : 384) << 20;  // fits 4K frames either way
+    static const size_t kThreadArenaBytes = 32 << 20;
+    static const int kMaxThreads = 64;
+
+    // Reserves capacity bytes of address space, none of it committed yet
+    void CreateArena(Arena* arena, size_t capacity);
+    void DestroyArena(Arena* arena);
+
+    // Returns kAlignment aligned, uninitialised memory. Running out of the reservation is fatal.
+    void* Push(Arena* arena, size_t bytes);
+
+    template <typename T>
+    T* PushArray(Arena* arena, size_t count)
+    {
+        return (T*)Push(arena, sizeof(T) * count);
+    }
+
+    // Frees everything pushed since the mark was taken. Committed pages are kept for reuse.
+    inline size_t GetMark(const Arena& arena) { return arena.m_used; }
+    void ResetToMark(Arena* arena, size_t mark);
+
+    // Frame arena and per thread sub-arenas. Thread arenas are created on first use, each by the
+    // thread it belongs to.
+    void Init();
+    void Shutdown();
+    Arena* GetFrameArena();
+    Arena* GetThreadArena(int threadIndex);  // ThreadPool thread index
+
+    // Empties the frame arena and every thread arena. Nothing pushed during the frame may be
+    // used after this.
+    void EndFrame();
+
+    // Calls to the global operator new since startup (every container, string and thread goes
+    // through it). A steady state frame shouldn't change it.
+    uint64_t GetHeapAllocationCount();
+
+    // Page level allocation (platform specific). Reserve returns null on failure and Commit false.
+    // On Linux committed ranges are backed by transparent huge pages where available.
+    void* ReservePages(size_t bytes);
+    bool CommitPages(void* address, size_t bytes);
+    void ReleasePages(void* address, size_t bytes);
+}
@@ -0,0 +1,46 @@
+#include "Memory.h"
+
+#include <sys/mman.h>
+
+void* Memory::ReservePages(size_t bytes)
+{
+    // Reserved with no access and no swap accounting, Commit makes ranges usable. Reserving a
+    // huge page more than asked leaves room to align the base, which transparent huge pages need.
+    void* view = mmap(
+        NULL, bytes + kCommitBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (view == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    // Give the unaligned head and the tail back
+    const uintptr_t start = (uintptr_t)view;
+    const uintptr_t aligned = (start + kCommitBytes - 1) & ~(uintptr_t)(kCommitBytes - 1);
+    if (aligned > start)
+    {
+        munmap(view, aligned - start);
+    }
+    munmap((void*)(aligned + bytes), start + kCommitBytes - aligned);
+
+    return (void*)aligned;
+}
+
+bool Memory::CommitPages(void* address, size_t bytes)
+{
+    if (mprotect(address, bytes, PROT_READ | PROT_WRITE) != 0)
+    {
+        return false;
+    }
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint: without THP support (or with it disabled) these stay 4KB pages
+    madvise(address, bytes, MADV_HUGEPAGE);
+#endif
+
+    return true;
+}
+
+void Memory::ReleasePages(void* address, size_t bytes)
+{
+    munmap(address, bytes);
+}
@@ -0,0 +1,24 @@
+#include "Memory.h"
+
+#include "External/pow2assert.h"
+
+#include <windows.h>
+
+// Large pages (MEM_LARGE_PAGES) need the "lock pages in memory" privilege and can't be committed
+// piecemeal, so arenas use normal pages on Windows
+
+void* Memory::ReservePages(size_t bytes)
+{
+    return VirtualAlloc(0, bytes, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool Memory::CommitPages(void* address, size_t bytes)
+{
+    return VirtualAlloc(address, bytes, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+
+void Memory::ReleasePages(void* address, size_t bytes)
+{
+    POW2_UNUSED(bytes);
+    VirtualFree(address, 0, MEM_RELEASE);  // the whole reservation, MEM_RELEASE takes no size
+}
@@ -0,0 +1,217 @@
+#include "MeshFile.h"
+
+#include "Log.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool WritePadding(FILE* file, uint64_t fromOffset, uint64_t toOffset)
+{
+    static const char zeros[256] = {};
+    while (fromOffset < toOffset)
+    {
+        size_t bytes = sizeof(zeros);
+        if (toOffset - fromOffset < bytes)
+        {
+            bytes = (size_t)(toOffset - fromOffset);
+        }
+        if (fwrite(zeros, 1, bytes, file) != bytes)
+        {
+            return false;
+        }
+        fromOffset += bytes;
+    }
+    return true;
+}
+
+bool MeshFile::Write(
+    const char* path,
+    const VertexData* vertices,
+    int vertexCount,
+    const int* indices,
+    int indexCount,
+    const MeshFileLod* lods,
+    int lodCount)
+{
+    POW2_ASSERT(vertices || vertexCount == 0);
+    POW2_ASSERT(indices || indexCount == 0);
+    POW2_ASSERT(indexCount % 3 == 0);
+    POW2_ASSERT(lods ? lodCount >= 1 && lodCount <= kMeshFileMaxLods : lodCount == 0);
+
+    MeshFileHeader header = {};
+    header.m_magic = kMeshFileMagic;
+    header.m_version = kMeshFileVersion;
+    header.m_vertexStride = sizeof(VertexData);
+    header.m_indexStride = sizeof(int);
+    header.m_vertexCount = vertexCount;
+    header.m_indexCount = indexCount;
+    header.m_vertexOffset = AlignUp(sizeof(MeshFileHeader), kMeshFileAlignment);
+    header.m_indexOffset = AlignUp(
+        header.m_vertexOffset + header.m_vertexCount * sizeof(VertexData), kMeshFileAlignment);
+    header.m_fileBytes = header.m_indexOffset + header.m_indexCount * sizeof(int);
+
+    if (lods)
+    {
+        header.m_lodCount = lodCount;
+        for (int i = 0; i < lodCount; ++i)
+        {
+            header.m_lods[i] = lods[i];
+        }
+    }
+    else
+    {
+        header.m_lodCount = 1;
+        header.m_lods[0].m_indexCount = indexCount;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        header.m_boundsMin[i] = vertexCount > 0 ? INFINITY : 0;
+        header.m_boundsMax[i] = vertexCount > 0 ? -INFINITY : 0;
+    }
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const float pos[3] = { vertices[i].m_pos.x, vertices[i].m_pos.y, vertices[i].m_pos.z };
+        for (int j = 0; j < 3; ++j)
+        {
+            header.m_boundsMin[j] = fminf(header.m_boundsMin[j], pos[j]);
+            header.m_boundsMax[j] = fmaxf(header.m_boundsMax[j], pos[j]);
+        }
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        Log::Warning("Cannot open %s for writing", path);
+        return false;
+    }
+
+    bool ok =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        WritePadding(file, sizeof(header), header.m_vertexOffset) &&
+        fwrite(vertices, sizeof(VertexData), vertexCount, file) == (size_t)vertexCount &&
+        WritePadding(
+            file,
+            header.m_vertexOffset + header.m_vertexCount * sizeof(VertexData),
+            header.m_indexOffset) &&
+        fwrite(indices, sizeof(int), indexCount, file) == (size_t)indexCount;
+
+    ok &= (fclose(file) == 0);
+
+    if (!ok)
+    {
+        Log::Warning("Cannot write %s", path);
+    }
+
+    return ok;
+}
+
+bool MeshFile::Validate(const void* data, size_t bytes, MappedMesh* mesh)
+{
+    POW2_ASSERT(mesh);
+
+    if (bytes < sizeof(MeshFileHeader))
+    {
+        Log::Warning("Mesh file too small (%u bytes)", (unsigned)bytes);
+        return false;
+    }
+
+    const MeshFileHeader* header = (const MeshFileHeader*)data;
+
+    if (header->m_magic != kMeshFileMagic)
+    {
+        Log::Warning("Not a mesh file");
+        return false;
+    }
+
+    if (header->m_version != kMeshFileVersion)
+    {
+        Log::Warning(
+            "Mesh file version %u, expected %u (re-run the converter)",
+            header->m_version,
+            kMeshFileVersion);
+        return false;
+    }
+
+    if (header->m_vertexStride != sizeof(VertexData) || header->m_indexStride != sizeof(int))
+    {
+        Log::Warning("Mesh file layout doesn't match VertexData");
+        return false;
+    }
+
+    const uint64_t vertexBytes = header->m_vertexCount * sizeof(VertexData);
+    const uint64_t indexBytes = header->m_indexCount * sizeof(int);
+    if (header->m_fileBytes > bytes ||
+        header->m_vertexOffset % kMeshFileAlignment != 0 ||
+        header->m_indexOffset % kMeshFileAlignment != 0 ||
+        header->m_vertexCount > INT32_MAX ||
+        header->m_indexCount > INT32_MAX ||
+        header->m_vertexOffset > header->m_fileBytes ||
+        header->m_indexOffset > header->m_fileBytes ||
+        vertexBytes > header->m_fileBytes - header->m_vertexOffset ||  // a sum could wrap
+        indexBytes > header->m_fileBytes - header->m_indexOffset ||
+        header->m_indexCount % 3 != 0 ||
+        header->m_lodCount < 1 ||
+        header->m_lodCount > kMeshFileMaxLods)
+    {
+        Log::Warning("Mesh file is truncated or corrupt");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->m_lodCount; ++i)
+    {
+        const MeshFileLod& lod = header->m_lods[i];
+        if ((uint64_t)lod.m_firstIndex + lod.m_indexCount > header->m_indexCount ||
+            lod.m_firstIndex % 3 != 0 ||
+            lod.m_indexCount % 3 != 0)
+        {
+            Log::Warning("Mesh file LOD %u is corrupt", i);
+            return false;
+        }
+    }
+
+    const uint8_t* base = (const uint8_t*)data;
+    mesh->m_header = header;
+    mesh->m_vertices = (const VertexData*)(base + header->m_vertexOffset);
+    const int* indices = (const int*)(base + header->m_indexOffset);
+    mesh->m_vertexCount = (int)header->m_vertexCount;
+    mesh->m_lodCount = (int)header->m_lodCount;
+    for (int i = 0; i < mesh->m_lodCount; ++i)
+    {
+        mesh->m_lods[i].m_indices = indices + header->m_lods[i].m_firstIndex;
+        mesh->m_lods[i].m_indexCount = (int)header->m_lods[i].m_indexCount;
+        mesh->m_lods[i].m_error = header->m_lods[i].m_error;
+    }
+    mesh->m_indices = mesh->m_lods[0].m_indices;
+    mesh->m_indexCount = mesh->m_lods[0].m_indexCount;
+    return true;
+}
+
+bool MeshFile::ValidateIndices(const MappedMesh& mesh)
+{
+    POW2_ASSERT(mesh.m_header);
+
+    // The whole index block, every LOD is a range of it
+    const int* indices =
+        (const int*)((const uint8_t*)mesh.m_header + mesh.m_header->m_indexOffset);
+    const int indexCount = (int)mesh.m_header->m_indexCount;
+    for (int i = 0; i < indexCount; ++i)
+    {
+        if ((unsigned)indices[i] >= (unsigned)mesh.m_vertexCount)
+        {
+            Log::Warning(
+                "Mesh file index %d is %d, past the %d vertices",
+                i,
+                indices[i],
+                mesh.m_vertexCount);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Geometry.h"
+
+#include "External/pow2assert.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// BINARY MESH FORMAT
+//
+// Produced offline by Tools/MeshTool.cpp and memory mapped at load time. The vertex and index
+// blocks are stored exactly as the rasterizer consumes them (VertexData and clockwise int
+// triangles) so the loader can hand out pointers into the mapping without parsing or copying.
+// Multi-byte values are little-endian.
+//
+// Layout:
+//   MeshFileHeader
+//   padding up to kMeshFileAlignment
+//   VertexData[m_vertexCount]
+//   padding up to kMeshFileAlignment
+//   int[m_indexCount]
+//
+// A file holds a chain of levels of detail (Tools/MeshTool.cpp "lod"). They share the vertex
+// block, and the index block holds each level's triangles in turn, the full mesh (LOD 0) first.
+//
+
+static const uint32_t kMeshFileMagic = 0x48534d52;  // "RMSH"
+static const uint32_t kMeshFileVersion = 3;
+static const uint32_t kMeshFileAlignment = 4096;  // blocks start on a page boundary
+static const int kMeshFileMaxLods = 8;
+
+struct MeshFileLod
+{
+    uint32_t m_firstIndex;  // range of the index block
+    uint32_t m_indexCount;
+    float m_error;  // how far the surface may be from LOD 0's, object space distance
+    uint32_t m_reserved;
+};
+
+struct MeshFileHeader
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_vertexStride;  // sizeof(VertexData) when the file was written
+    uint32_t m_indexStride;   // sizeof(int) when the file was written
+    uint64_t m_vertexCount;
+    uint64_t m_indexCount;
+    uint64_t m_vertexOffset;  // from the start of the file
+    uint64_t m_indexOffset;   // from the start of the file
+    uint64_t m_fileBytes;
+    float m_boundsMin[3];  // object space
+    float m_boundsMax[3];
+    uint32_t m_lodCount;  // at least 1
+    uint32_t m_reserved[3];
+    MeshFileLod m_lods[kMeshFileMaxLods];  // coarser and coarser, errors never go down
+};
+
+POW2_STATIC_ASSERT(sizeof(MeshFileHeader) == 224);  // on-disk layout, bump the version on changes
+
+struct MeshLod
+{
+    const int* m_indices;  // points into the mapping
+    int m_indexCount;
+    float m_error;
+};
+
+struct MappedMesh  // zero is initialisation
+{
+    const MeshFileHeader* m_header;
+    const VertexData* m_vertices;  // points into the mapping, object space positions
+    const int* m_indices;          // points into the mapping, LOD 0's clockwise triangles
+    int m_vertexCount;
+    int m_indexCount;
+    MeshLod m_lods[kMeshFileMaxLods];  // m_lods[0] is m_indices
+    int m_lodCount;
+    const void* m_mapping;
+    size_t m_mappingBytes;
+};
+
+namespace MeshFile
+{
+    // Writes a mesh file. lods are ranges of indices, LOD 0 first; null writes indices as the only
+    // level. Returns false if the file cannot be written.
+    bool Write(
+        const char* path,
+        const VertexData* vertices,
+        int vertexCount,
+        const int* indices,
+        int indexCount,
+        const MeshFileLod* lods,
+        int lodCount);
+
+    // Checks the header and block bounds of a file already in memory and fills in the pointers
+    // of mesh. Doesn't touch the vertex or index blocks, so it's safe to call on a fresh mapping.
+    bool Validate(const void* data, size_t bytes, MappedMesh* mesh);
+
+    // Checks every index refers to a vertex of the mesh. Reads the whole index block, so the
+    // loaders call it once rather than Validate on every mapping.
+    bool ValidateIndices(const MappedMesh& mesh);
+
+    // Maps a mesh file read-only (platform specific). Pages are shared with any other process
+    // mapping the same file and are only faulted in when the renderer reads them.
+    bool Map(const char* path, MappedMesh* mesh);
+    void Unmap(MappedMesh* mesh);
+}
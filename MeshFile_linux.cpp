@@ -0,0 +1,65 @@
+#include "MeshFile.h"
+
+#include "Log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MeshFile::Map(const char* path, MappedMesh* mesh)
+{
+    POW2_ASSERT(mesh);
+
+    *mesh = {};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        Log::Warning("Cannot open mesh file %s", path);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        Log::Warning("Cannot map mesh file %s (bad size)", path);
+        close(fd);
+        return false;
+    }
+
+    // MAP_SHARED so every process rendering the same file shares the page cache
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping keeps the file open
+    if (view == MAP_FAILED)
+    {
+        Log::Warning("Cannot map mesh file %s", path);
+        return false;
+    }
+
+    mesh->m_mapping = view;
+    mesh->m_mappingBytes = (size_t)info.st_size;
+
+    if (!Validate(view, mesh->m_mappingBytes, mesh))
+    {
+        Unmap(mesh);
+        return false;
+    }
+
+    // Kick off readahead in the background, Map() doesn't wait for it
+    madvise(view, mesh->m_mappingBytes, MADV_WILLNEED);
+
+    return true;
+}
+
+void MeshFile::Unmap(MappedMesh* mesh)
+{
+    POW2_ASSERT(mesh);
+
+    if (mesh->m_mapping)
+    {
+        munmap((void*)mesh->m_mapping, mesh->m_mappingBytes);
+    }
+
+    *mesh = {};
+}
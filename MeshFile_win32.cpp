@@ -0,0 +1,75 @@
+#include "MeshFile.h"
+
+#include "Log.h"
+
+#include <windows.h>
+
+bool MeshFile::Map(const char* path, MappedMesh* mesh)
+{
+    POW2_ASSERT(mesh);
+
+    *mesh = {};
+
+    HANDLE file = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        Log::Warning("Cannot open mesh file %s", path);
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) ||
+        size.QuadPart == 0 ||
+        (unsigned long long)size.QuadPart > SIZE_MAX)
+    {
+        Log::Warning("Cannot map mesh file %s (bad size)", path);
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);  // the mapping keeps the file open
+    if (!mapping)
+    {
+        Log::Warning("Cannot map mesh file %s", path);
+        return false;
+    }
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);  // the view keeps the mapping alive
+    if (!view)
+    {
+        Log::Warning("Cannot map mesh file %s (out of address space?)", path);
+        return false;
+    }
+
+    mesh->m_mapping = view;
+    mesh->m_mappingBytes = (size_t)size.QuadPart;
+
+    if (!Validate(view, mesh->m_mappingBytes, mesh))
+    {
+        Unmap(mesh);
+        return false;
+    }
+
+    return true;
+}
+
+void MeshFile::Unmap(MappedMesh* mesh)
+{
+    POW2_ASSERT(mesh);
+
+    if (mesh->m_mapping)
+    {
+        UnmapViewOfFile(mesh->m_mapping);
+    }
+
+    *mesh = {};
+}
@@ -0,0 +1,529 @@
+#include "MeshOptimize.h"
+
+#include "External/pow2assert.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+//
+// FIFO CACHE
+//
+// A vertex is in the cache if fewer than size misses happened since it was last loaded. Misses
+// count up from past size, so a stamp of 0 is never in the cache, and skipping the count ahead
+// by size empties it.
+//
+
+struct FifoCache
+{
+    std::vector<uint32_t> m_stamps;  // per vertex, the miss count when it was loaded
+    uint32_t m_misses;
+    uint32_t m_size;
+};
+
+static void InitCache(FifoCache* cache, int vertexCount, int size)
+{
+    cache->m_stamps.assign(vertexCount, 0);
+    cache->m_size = (uint32_t)size;
+    cache->m_misses = cache->m_size + 1;
+}
+
+static void ResetCache(FifoCache* cache)
+{
+    cache->m_misses += cache->m_size + 1;
+}
+
+// Looks up the triangle's vertices and loads the missing ones, returns how many missed
+static int CacheTriangle(FifoCache* cache, const int* triangle)
+{
+    int misses = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        uint32_t& stamp = cache->m_stamps[triangle[i]];
+        if (cache->m_misses - stamp > cache->m_size)
+        {
+            stamp = cache->m_misses++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+//
+// VERTEX CACHE
+//
+// Greedy: the next triangle is the best scoring one among those using a vertex in a simulated
+// kCacheSize LRU cache, or the first one not drawn yet when none are left. A vertex scores for
+// being recently used (the last triangle's three all the same, as their order there doesn't
+// matter) and for having few triangles left, so lone triangles don't get left behind to cost a
+// cache miss each at the end.
+//
+
+static const int kCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+static float VertexScore(int cachePosition, int liveTriangles)
+{
+    if (liveTriangles == 0)
+    {
+        return -1;  // nothing left to draw with it
+    }
+
+    float score = 0;
+    if (cachePosition >= 0 && cachePosition < 3)
+    {
+        score = kLastTriangleScore;
+    }
+    else if (cachePosition >= 3)
+    {
+        const float scale = 1.0f / (kCacheSize - 3);
+        score = powf(1 - (cachePosition - 3) * scale, kCacheDecayPower);
+    }
+
+    return score + kValenceBoostScale * powf((float)liveTriangles, -kValenceBoostPower);
+}
+
+void MeshOptimize::OptimizeVertexCache(int* indices, int indexCount, int vertexCount)
+{
+    POW2_ASSERT(indices || indexCount == 0);
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    const int triangleCount = indexCount / 3;
+
+    // Triangles around every vertex, the ones not drawn yet first (live of them)
+    std::vector<int> firstTriangle(vertexCount + 1, 0);
+    for (int i = 0; i < indexCount; ++i)
+    {
+        POW2_ASSERT(indices[i] >= 0 && indices[i] < vertexCount);
+        ++firstTriangle[indices[i] + 1];
+    }
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        firstTriangle[v + 1] += firstTriangle[v];
+    }
+    std::vector<int> live(vertexCount, 0);
+    std::vector<int> triangles(indexCount);
+    for (int i = 0; i < indexCount; ++i)
+    {
+        const int v = indices[i];
+        triangles[firstTriangle[v] + live[v]++] = i / 3;
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        vertexScores[v] = VertexScore(-1, live[v]);
+    }
+
+    std::vector<uint8_t> drawn(triangleCount, 0);
+    std::vector<int> output;
+    output.reserve(indexCount);
+
+    int cache[kCacheSize + 3];
+    int cacheCount = 0;
+    int nextUndrawn = 0;
+    int best = triangleCount > 0 ? 0 : -1;
+
+    while (best >= 0)
+    {
+        const int* triangle = indices + 3 * best;
+        drawn[best] = 1;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // Take the triangle off its vertices' live lists
+        for (int i = 0; i < 3; ++i)
+        {
+            const int v = triangle[i];
+            int* around = triangles.data() + firstTriangle[v];
+            for (int j = 0; j < live[v]; ++j)
+            {
+                if (around[j] == best)
+                {
+                    std::swap(around[j], around[live[v] - 1]);
+                    --live[v];
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front of the cache, the rest shift back
+        int newCache[kCacheSize + 3];
+        int newCount = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (std::find(newCache, newCache + newCount, triangle[i]) == newCache + newCount)
+            {
+                newCache[newCount++] = triangle[i];
+            }
+        }
+        const int triangleVertices = newCount;
+        for (int i = 0; i < cacheCount; ++i)
+        {
+            if (std::find(newCache, newCache + triangleVertices, cache[i]) ==
+                newCache + triangleVertices)
+            {
+                newCache[newCount++] = cache[i];
+            }
+        }
+
+        // Rescore what's in the cache or just fell out of it, and pick the best triangle around it
+        for (int i = 0; i < newCount; ++i)
+        {
+            const int v = newCache[i];
+            cachePositions[v] = i < kCacheSize ? i : -1;
+            vertexScores[v] = VertexScore(cachePositions[v], live[v]);
+        }
+
+        best = -1;
+        float bestScore = -FLT_MAX;
+        for (int i = 0; i < newCount; ++i)
+        {
+            const int v = newCache[i];
+            const int* around = triangles.data() + firstTriangle[v];
+            for (int j = 0; j < live[v]; ++j)
+            {
+                const int t = around[j];
+                const int* other = indices + 3 * t;
+                const float score =
+                    vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+                if (score > bestScore)
+                {
+                    best = t;
+                    bestScore = score;
+                }
+            }
+        }
+
+        cacheCount = newCount < kCacheSize ? newCount : kCacheSize;
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        if (best < 0)
+        {
+            // Nothing left around the cache, carry on from the first triangle not drawn yet
+            while (nextUndrawn < triangleCount && drawn[nextUndrawn])
+            {
+                ++nextUndrawn;
+            }
+            best = nextUndrawn < triangleCount ? nextUndrawn : -1;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+//
+// OVERDRAW
+//
+// Runs start where the cache order jumped to an unrelated triangle (all three vertices missed),
+// and are cut again wherever restarting the cache there keeps the run's misses per triangle
+// within threshold of the whole run's. Runs further out of the mesh draw first: those are more
+// likely to be in front from any direction, so the depth test rejects more of what's behind
+// them. How far out is the distance from the mesh's centroid to the run's plane (through its
+// centroid, across its average normal). Back faces are drawn too, so which side of the plane
+// the centroid is on doesn't matter, and neither does the winding.
+//
+
+struct TriangleRun
+{
+    int m_first;  // triangle
+    int m_count;
+    float m_key;  // higher draws first
+};
+
+static vec3 Position(const VertexData* vertices, int vertex)
+{
+    const vec4& p = vertices[vertex].m_pos;
+    return vec3(p.x, p.y, p.z);
+}
+
+void MeshOptimize::OptimizeOverdraw(
+    int* indices,
+    int indexCount,
+    const VertexData* vertices,
+    int vertexCount,
+    float threshold)
+{
+    POW2_ASSERT(indices || indexCount == 0);
+    POW2_ASSERT(vertices || vertexCount == 0);
+    POW2_ASSERT(indexCount % 3 == 0);
+    POW2_ASSERT(threshold >= 1);
+
+    const int triangleCount = indexCount / 3;
+    FifoCache cache;
+    InitCache(&cache, vertexCount, kStatsCacheSize);
+
+    std::vector<int> hardStarts;
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        if (CacheTriangle(&cache, indices + 3 * t) == 3)
+        {
+            hardStarts.push_back(t);
+        }
+    }
+    hardStarts.push_back(triangleCount);
+
+    std::vector<TriangleRun> runs;
+    for (size_t h = 0; h + 1 < hardStarts.size(); ++h)
+    {
+        const int first = hardStarts[h];
+        const int end = hardStarts[h + 1];
+
+        ResetCache(&cache);
+        int hardMisses = 0;
+        for (int t = first; t < end; ++t)
+        {
+            hardMisses += CacheTriangle(&cache, indices + 3 * t);
+        }
+        const float limit = threshold * hardMisses / (end - first);
+
+        ResetCache(&cache);
+        TriangleRun run = { first, 0, 0 };
+        int misses = 0;
+        for (int t = first; t < end; ++t)
+        {
+            misses += CacheTriangle(&cache, indices + 3 * t);
+            ++run.m_count;
+            if (t + 1 < end && misses <= limit * run.m_count)
+            {
+                runs.push_back(run);
+                run.m_first = t + 1;
+                run.m_count = 0;
+                misses = 0;
+                ResetCache(&cache);
+            }
+        }
+        runs.push_back(run);
+    }
+
+    // Area weighted centroids and normals (the cross products are twice the area long)
+    vec3 meshCentroid = vec3zero;
+    float meshArea = 0;
+    std::vector<vec3> runCentroids(runs.size(), vec3zero);
+    std::vector<vec3> runNormals(runs.size(), vec3zero);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        float runArea = 0;
+        for (int t = runs[r].m_first; t < runs[r].m_first + runs[r].m_count; ++t)
+        {
+            const vec3 p0 = Position(vertices, indices[3 * t]);
+            const vec3 p1 = Position(vertices, indices[3 * t + 1]);
+            const vec3 p2 = Position(vertices, indices[3 * t + 2]);
+            const vec3 normal = vec3Cross(p1 - p0, p2 - p0);
+            const float area = sqrtf(vec3Dot(normal, normal));
+            const vec3 centroid = (p0 + p1 + p2) * (1.0f / 3);
+
+            runCentroids[r] = runCentroids[r] + centroid * area;
+            runNormals[r] = runNormals[r] + normal;
+            runArea += area;
+        }
+        meshCentroid = meshCentroid + runCentroids[r];
+        meshArea += runArea;
+        runCentroids[r] = runArea > 0 ? runCentroids[r] * (1 / runArea) : runCentroids[r];
+    }
+    meshCentroid = meshArea > 0 ? meshCentroid * (1 / meshArea) : meshCentroid;
+
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        const vec3 offset = runCentroids[r] - meshCentroid;
+        const float length = sqrtf(vec3Dot(runNormals[r], runNormals[r]));
+        runs[r].m_key = length > 0 ? fabsf(vec3Dot(offset, runNormals[r])) / length : 0;
+    }
+
+    std::stable_sort(runs.begin(), runs.end(), [](const TriangleRun& a, const TriangleRun& b) {
+        return a.m_key > b.m_key; });
+
+    std::vector<int> output;
+    output.reserve(indexCount);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        const int* first = indices + 3 * runs[r].m_first;
+        output.insert(output.end(), first, first + 3 * runs[r].m_count);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+//
+// VERTEX FETCH
+//
+
+int MeshOptimize::OptimizeVertexFetch(
+    VertexData* vertices, int vertexCount, int* indices, int indexCount)
+{
+    POW2_ASSERT(vertices || vertexCount == 0);
+    POW2_ASSERT(indices || indexCount == 0);
+
+    std::vector<int> remap(vertexCount, -1);
+    int used = 0;
+    for (int i = 0; i < indexCount; ++i)
+    {
+        POW2_ASSERT(indices[i] >= 0 && indices[i] < vertexCount);
+        int& vertex = remap[indices[i]];
+        if (vertex < 0)
+        {
+            vertex = used++;
+        }
+        indices[i] = vertex;
+    }
+
+    int unused = used;
+    const std::vector<VertexData> source(vertices, vertices + vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        remap[v] = remap[v] >= 0 ? remap[v] : unused++;
+        vertices[remap[v]] = source[v];
+    }
+
+    return used;
+}
+
+//
+// STATISTICS
+//
+// Overdraw is measured on a kOverdrawGrid square grid fitted around the mesh, orthographic along
+// each axis both ways. Pixel centres inside a triangle (of either winding) are its fragments.
+//
+
+static const int kOverdrawGrid = 256;
+
+static void DrawView(
+    const int* indices,
+    int indexCount,
+    const VertexData* vertices,
+    int axis,
+    float direction,
+    const vec3& boundsMin,
+    float scale,
+    std::vector<float>* depth,
+    uint64_t* fragmentsPassed,
+    uint64_t* pixelsCovered)
+{
+    const int axisX = (axis + 1) % 3;
+    const int axisY = (axis + 2) % 3;
+    std::fill(depth->begin(), depth->end(), FLT_MAX);
+
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            const vec3 p = Position(vertices, indices[i + k]);
+            const float* c = &p.x;
+            const float* lo = &boundsMin.x;
+            x[k] = (c[axisX] - lo[axisX]) * scale;
+            y[k] = (c[axisY] - lo[axisY]) * scale;
+            z[k] = c[axis] * direction;
+        }
+
+        const float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0)
+        {
+            continue;
+        }
+        const float invArea = 1 / area;
+
+        const int minX = std::max((int)floorf(std::min(x[0], std::min(x[1], x[2]))), 0);
+        const int minY = std::max((int)floorf(std::min(y[0], std::min(y[1], y[2]))), 0);
+        const int maxX = std::min((int)ceilf(std::max(x[0], std::max(x[1], x[2]))),
+            kOverdrawGrid - 1);
+        const int maxY = std::min((int)ceilf(std::max(y[0], std::max(y[1], y[2]))),
+            kOverdrawGrid - 1);
+
+        for (int py = minY; py <= maxY; ++py)
+        {
+            for (int px = minX; px <= maxX; ++px)
+            {
+                const float cx = px + 0.5f;
+                const float cy = py + 0.5f;
+                const float w0 = ((x[1] - cx) * (y[2] - cy) - (y[1] - cy) * (x[2] - cx)) * invArea;
+                const float w1 = ((x[2] - cx) * (y[0] - cy) - (y[2] - cy) * (x[0] - cx)) * invArea;
+                const float w2 = 1 - w0 - w1;
+                if (w0 < 0 || w1 < 0 || w2 < 0)
+                {
+                    continue;
+                }
+
+                float& pixel = (*depth)[py * kOverdrawGrid + px];
+                const float fragment = w0 * z[0] + w1 * z[1] + w2 * z[2];
+                if (fragment < pixel)
+                {
+                    *pixelsCovered += pixel == FLT_MAX;
+                    pixel = fragment;
+                    ++*fragmentsPassed;
+                }
+            }
+        }
+    }
+}
+
+MeshOptimizeStats MeshOptimize::Analyze(
+    const int* indices,
+    int indexCount,
+    const VertexData* vertices,
+    int vertexCount)
+{
+    POW2_ASSERT(indices || indexCount == 0);
+    POW2_ASSERT(vertices || vertexCount == 0);
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    MeshOptimizeStats stats = {};
+    if (indexCount == 0)
+    {
+        return stats;
+    }
+
+    FifoCache cache;
+    InitCache(&cache, vertexCount, kStatsCacheSize);
+    std::vector<uint8_t> used(vertexCount, 0);
+    int misses = 0;
+    int usedCount = 0;
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        misses += CacheTriangle(&cache, indices + i);
+        for (int k = 0; k < 3; ++k)
+        {
+            usedCount += used[indices[i + k]] == 0;
+            used[indices[i + k]] = 1;
+        }
+    }
+    stats.m_acmr = (float)misses / (indexCount / 3);
+    stats.m_atvr = (float)misses / usedCount;
+
+    vec3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    vec3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (int i = 0; i < indexCount; ++i)
+    {
+        const vec3 p = Position(vertices, indices[i]);
+        boundsMin = vec3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y),
+            std::min(boundsMin.z, p.z));
+        boundsMax = vec3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y),
+            std::max(boundsMax.z, p.z));
+    }
+    const vec3 extent = boundsMax - boundsMin;
+
+    std::vector<float> depth(kOverdrawGrid * kOverdrawGrid);
+    uint64_t fragmentsPassed = 0;
+    uint64_t pixelsCovered = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float* size = &extent.x;
+        const float largest = std::max(size[(axis + 1) % 3], size[(axis + 2) % 3]);
+        const float scale = largest > 0 ? (kOverdrawGrid - 1) / largest : 0;
+        for (int side = 0; side < 2; ++side)
+        {
+            DrawView(
+                indices, indexCount, vertices, axis, side ? -1.0f : 1.0f, boundsMin, scale,
+                &depth, &fragmentsPassed, &pixelsCovered);
+        }
+    }
+    stats.m_overdraw = pixelsCovered ? (float)fragmentsPassed / pixelsCovered : 0;
+
+    return stats;
+}
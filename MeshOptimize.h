@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Geometry.h"
+
+//
+// MESH OPTIMIZE INPUT: a triangle list (indices into a vertex block)
+// MESH OPTIMIZE OUTPUT: the same triangles in an order that is cheaper to draw
+//
+// Three passes, meant to run in this order, offline (Tools/MeshTool.cpp "optimize"):
+//   - OptimizeVertexCache orders triangles so the vertices they share are reused while still in
+//     a post-transform cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+//   - OptimizeOverdraw cuts that order into runs where restarting the cache costs little, and
+//     draws the runs on the outside of the mesh first, so they hide more of what comes after
+//     them (after Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+//     Reduced Overdraw")
+//   - OptimizeVertexFetch renumbers the vertices in the order the triangles use them, so the
+//     vertex block is read front to back
+//
+// None of them change what's drawn, only the order (and with it which of two fragments at the
+// same depth wins). Triangles keep their winding.
+//
+
+struct MeshOptimizeStats
+{
+    // Vertices transformed per triangle with a kStatsCacheSize entry FIFO post-transform cache
+    // (as in most GPUs): 3 without any reuse, around 0.5 at best for big regular meshes
+    float m_acmr;
+
+    // Vertices transformed per vertex used, 1 at best
+    float m_atvr;
+
+    // Fragments passing the depth test per covered pixel, drawing in index order with no back
+    // face culling (as the renderer does) from the 6 axis directions, 1 at best
+    float m_overdraw;
+};
+
+namespace MeshOptimize
+{
+    static const int kStatsCacheSize = 16;
+
+    void OptimizeVertexCache(int* indices, int indexCount, int vertexCount);
+
+    // Call after OptimizeVertexCache. threshold is how much worse than the input's the vertex
+    // cache efficiency of every run may get (1.05 is 5%), larger allows more, shorter runs.
+    void OptimizeOverdraw(
+        int* indices,
+        int indexCount,
+        const VertexData* vertices,
+        int vertexCount,
+        float threshold);
+
+    // Reorders vertices and updates indices to match, vertices nothing uses go last. Returns how
+    // many vertices are used. Pass every index range that shares the vertices (all the levels of
+    // detail of a mesh file), the first range sets the order.
+    int OptimizeVertexFetch(VertexData* vertices, int vertexCount, int* indices, int indexCount);
+
+    MeshOptimizeStats Analyze(
+        const int* indices,
+        int indexCount,
+        const VertexData* vertices,
+        int vertexCount);
+}
@@ -0,0 +1,260 @@
+#include "Occlusion.h"
+
+#include "External/pow2assert.h"
+
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+static const int kFullMask = 0xffff;
+
+// Edge function a * x + b * y + c, positive inside a counter-clockwise triangle
+struct OccluderEdge
+{
+    float m_a;
+    float m_b;
+    float m_c;
+};
+
+static OccluderEdge MakeEdge(float x0, float y0, float x1, float y1)
+{
+    OccluderEdge edge;
+    edge.m_a = y0 - y1;
+    edge.m_b = x1 - x0;
+    edge.m_c = x0 * y1 - x1 * y0;
+    return edge;
+}
+
+// Bit 4 * row + column for each of the 4x4 samples of cell (x, y) inside all three edges
+static int CoverageMask(const OccluderEdge* edges, int x, int y)
+{
+    const __m128 offsets = _mm_setr_ps(0.125f, 0.375f, 0.625f, 0.875f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sampleX = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+
+    __m128 rowStart[3];
+    __m128 rowStep[3];
+    for (int e = 0; e < 3; ++e)
+    {
+        const float base = edges[e].m_b * (y + 0.125f) + edges[e].m_c;
+        rowStart[e] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[e].m_a), sampleX), _mm_set1_ps(base));
+        rowStep[e] = _mm_set1_ps(edges[e].m_b * 0.25f);
+    }
+
+    int mask = 0;
+    for (int row = 0; row < 4; ++row)
+    {
+        const __m128 inside = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(rowStart[0], zero), _mm_cmpge_ps(rowStart[1], zero)),
+            _mm_cmpge_ps(rowStart[2], zero));
+        mask |= _mm_movemask_ps(inside) << (4 * row);
+
+        for (int e = 0; e < 3; ++e)
+        {
+            rowStart[e] = _mm_add_ps(rowStart[e], rowStep[e]);
+        }
+    }
+    return mask;
+}
+
+static void RasterOccluder(OcclusionBuffer* buffer, const vec4& p0, const vec4& p1, const vec4& p2)
+{
+    // To cell coordinates
+    float x[3] = { p0.x, p1.x, p2.x };
+    float y[3] = { p0.y, p1.y, p2.y };
+    float z[3] = { p0.z, p1.z, p2.z };
+    for (int i = 0; i < 3; ++i)
+    {
+        x[i] *= buffer->m_cellsPerPixelX;
+        y[i] *= buffer->m_cellsPerPixelY;
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0)
+    {
+        return;
+    }
+    if (area < 0)
+    {
+        // Clockwise, swap two vertices
+        const float x1 = x[1];
+        const float y1 = y[1];
+        const float z1 = z[1];
+        x[1] = x[2];
+        y[1] = y[2];
+        z[1] = z[2];
+        x[2] = x1;
+        y[2] = y1;
+        z[2] = z1;
+        area = -area;
+    }
+
+    const int minX = (int)fmaxf(floorf(fminf(fminf(x[0], x[1]), x[2])), 0);
+    const int minY = (int)fmaxf(floorf(fminf(fminf(y[0], y[1]), y[2])), 0);
+    const int maxX =
+        (int)fminf(floorf(fmaxf(fmaxf(x[0], x[1]), x[2])), OcclusionBuffer::kWidth - 1.0f);
+    const int maxY =
+        (int)fminf(floorf(fmaxf(fmaxf(y[0], y[1]), y[2])), OcclusionBuffer::kHeight - 1.0f);
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    const OccluderEdge edges[3] = {
+        MakeEdge(x[0], y[0], x[1], y[1]),
+        MakeEdge(x[1], y[1], x[2], y[2]),
+        MakeEdge(x[2], y[2], x[0], y[0]) };
+
+    // Depth plane. Over a cell it peaks at a corner, and never goes past the farthest vertex
+    // inside the triangle.
+    const float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    const float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    const float cornerOffset = fmaxf(dzdx, 0) + fmaxf(dzdy, 0);
+    const float farthest = fmaxf(fmaxf(z[0], z[1]), z[2]);
+
+    for (int cy = minY; cy <= maxY; ++cy)
+    {
+        for (int cx = minX; cx <= maxX; ++cx)
+        {
+            const int mask = CoverageMask(edges, cx, cy);
+            if (!mask)
+            {
+                continue;
+            }
+
+            const float planeZ = z[0] + dzdx * (cx - x[0]) + dzdy * (cy - y[0]) + cornerOffset;
+            const float cellZ = planeZ < farthest ? planeZ : farthest;
+            const int cell = cy * OcclusionBuffer::kWidth + cx;
+            float& depth = buffer->m_depth[cell];
+
+            if (cellZ >= depth)
+            {
+                continue;  // the cell is already covered nearer than this
+            }
+
+            if (mask == kFullMask)
+            {
+                depth = cellZ;
+                continue;
+            }
+
+            const int layerMask = buffer->m_layerMask[cell] | mask;
+            const float layerDepth =
+                cellZ > buffer->m_layerDepth[cell] ? cellZ : buffer->m_layerDepth[cell];
+            if (layerMask == kFullMask)
+            {
+                depth = layerDepth < depth ? layerDepth : depth;
+                buffer->m_layerMask[cell] = 0;
+                buffer->m_layerDepth[cell] = -FLT_MAX;
+            }
+            else
+            {
+                buffer->m_layerMask[cell] = (uint16_t)layerMask;
+                buffer->m_layerDepth[cell] = layerDepth;
+            }
+        }
+    }
+}
+
+void Occlusion::Clear(OcclusionBuffer* buffer, int width, int height)
+{
+    POW2_ASSERT(buffer);
+    POW2_ASSERT(width > 0 && height > 0);
+
+    const int cells = OcclusionBuffer::kWidth * OcclusionBuffer::kHeight;
+    for (int i = 0; i < cells + 3; ++i)
+    {
+        buffer->m_depth[i] = FLT_MAX;
+    }
+    for (int i = 0; i < cells; ++i)
+    {
+        buffer->m_layerDepth[i] = -FLT_MAX;
+        buffer->m_layerMask[i] = 0;
+    }
+
+    buffer->m_cellsPerPixelX = (float)OcclusionBuffer::kWidth / width;
+    buffer->m_cellsPerPixelY = (float)OcclusionBuffer::kHeight / height;
+}
+
+void Occlusion::RasterOccluders(
+    OcclusionBuffer* buffer,
+    const VertexData* vertices,
+    const int* indices,
+    int indexCount)
+{
+    POW2_ASSERT(buffer && vertices && indices);
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        RasterOccluder(
+            buffer,
+            vertices[indices[i]].m_pos,
+            vertices[indices[i + 1]].m_pos,
+            vertices[indices[i + 2]].m_pos);
+    }
+}
+
+ScreenBounds Occlusion::ComputeBounds(
+    const VertexData* vertices,
+    const int* indices,
+    int indexCount)
+{
+    POW2_ASSERT(vertices && indices);
+
+    // x, y, z (and w) of every position at once
+    __m128 minimum = _mm_set1_ps(FLT_MAX);
+    __m128 maximum = _mm_set1_ps(-FLT_MAX);
+    for (int i = 0; i < indexCount; ++i)
+    {
+        const __m128 p = _mm_loadu_ps(&vertices[indices[i]].m_pos.x);
+        minimum = _mm_min_ps(minimum, p);
+        maximum = _mm_max_ps(maximum, p);
+    }
+
+    float lo[4];
+    float hi[4];
+    _mm_storeu_ps(lo, minimum);
+    _mm_storeu_ps(hi, maximum);
+
+    ScreenBounds bounds = { lo[0], lo[1], hi[0], hi[1], lo[2] };
+    return bounds;
+}
+
+bool Occlusion::IsVisible(const OcclusionBuffer& buffer, const ScreenBounds& bounds)
+{
+    // Every cell the bounds touch
+    const float minX = floorf(bounds.m_minX * buffer.m_cellsPerPixelX);
+    const float minY = floorf(bounds.m_minY * buffer.m_cellsPerPixelY);
+    const float maxX = floorf(bounds.m_maxX * buffer.m_cellsPerPixelX);
+    const float maxY = floorf(bounds.m_maxY * buffer.m_cellsPerPixelY);
+    if (maxX < 0 || maxY < 0 ||
+        minX >= OcclusionBuffer::kWidth || minY >= OcclusionBuffer::kHeight ||
+        minX > maxX || minY > maxY)
+    {
+        return false;  // outside the window (or empty)
+    }
+
+    const int x0 = minX > 0 ? (int)minX : 0;
+    const int y0 = minY > 0 ? (int)minY : 0;
+    const int x1 = maxX < OcclusionBuffer::kWidth - 1 ? (int)maxX : OcclusionBuffer::kWidth - 1;
+    const int y1 = maxY < OcclusionBuffer::kHeight - 1 ? (int)maxY : OcclusionBuffer::kHeight - 1;
+
+    // Visible if it's in front of (or level with) the occluders in any cell, four at a time
+    const __m128 nearest = _mm_set1_ps(bounds.m_minZ);
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float* row = buffer.m_depth + y * OcclusionBuffer::kWidth;
+        for (int x = x0; x <= x1; x += 4)
+        {
+            const int lanes = x1 - x + 1 < 4 ? x1 - x + 1 : 4;
+            const __m128 depth = _mm_loadu_ps(row + x);
+            const int inFront = _mm_movemask_ps(_mm_cmple_ps(nearest, depth));
+            if (inFront & ((1 << lanes) - 1))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Geometry.h"
+
+#include <stdint.h>
+
+//
+// OCCLUSION INPUT: occluder triangles and object bounds, in window coordinates
+// OCCLUSION OUTPUT: whether objects are hidden behind the occluders
+//
+// Occluders are rasterized into a small depth buffer whose cells keep the farthest depth of the
+// occluders covering all of the cell, so an object whose nearest depth is behind that in every
+// cell its bounds touch can't be seen. Coverage is gathered as a 4x4 sample mask per cell:
+// triangles covering part of a cell add their samples to a working layer, and once the masks of
+// several triangles fill the cell the farthest of their depths becomes the cell's. Triangles
+// covering the whole cell update it straight away.
+//
+// Samples are points, like the rasterizer's pixel centres, so cracks between occluders thinner
+// than a sample can hide what's behind them. Occluders must also be inside whatever they stand
+// for: culling is only as conservative as they are.
+//
+
+struct ScreenBounds
+{
+    float m_minX;  // window coordinates
+    float m_minY;
+    float m_maxX;
+    float m_maxY;
+    float m_minZ;  // nearest depth, smaller is nearer
+};
+
+struct OcclusionBuffer  // see Occlusion::Clear
+{
+    static const int kWidth = 256;
+    static const int kHeight = 128;
+
+    float m_depth[kWidth * kHeight + 3];       // FLT_MAX until covered, padded for 4 wide loads
+    float m_layerDepth[kWidth * kHeight];      // farthest depth in the working layer
+    uint16_t m_layerMask[kWidth * kHeight];    // samples covered by the working layer
+    float m_cellsPerPixelX;
+    float m_cellsPerPixelY;
+};
+
+namespace Occlusion
+{
+    // Empties the buffer and stretches it over a window of width x height pixels
+    void Clear(OcclusionBuffer* buffer, int width, int height);
+
+    // Either winding is fine
+    void RasterOccluders(
+        OcclusionBuffer* buffer,
+        const VertexData* vertices,
+        const int* indices,
+        int indexCount);
+
+    ScreenBounds ComputeBounds(const VertexData* vertices, const int* indices, int indexCount);
+
+    // False if the bounds are outside the window or behind the occluders everywhere
+    bool IsVisible(const OcclusionBuffer& buffer, const ScreenBounds& bounds);
+}
@@ -0,0 +1,329 @@
+#include "Particles.h"
+
+#include "Rasterizer.h"
+
+#include "External/pow2assert.h"
+
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+static const int kMaxStreakLength = 64;  // pixels
+
+//
+// HELPER FUNCTIONS
+//
+
+static inline float RandomFloat(uint32_t* state)  // [0, 1)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline float RandomRange(uint32_t* state, float min, float max)
+{
+    return min + (max - min) * RandomFloat(state);
+}
+
+static void MoveParticle(ParticlePool* pool, int from, int to)
+{
+    pool->m_posX[to] = pool->m_posX[from];
+    pool->m_posY[to] = pool->m_posY[from];
+    pool->m_posZ[to] = pool->m_posZ[from];
+    pool->m_velX[to] = pool->m_velX[from];
+    pool->m_velY[to] = pool->m_velY[from];
+    pool->m_velZ[to] = pool->m_velZ[from];
+    pool->m_life[to] = pool->m_life[from];
+    pool->m_color[to] = pool->m_color[from];
+}
+
+// alpha is 0..256
+static inline uint32_t BlendColor(uint32_t dst, uint32_t src, uint32_t alpha)
+{
+    const uint32_t rb =
+        (((src & 0xff00ff) * alpha + (dst & 0xff00ff) * (256 - alpha)) >> 8) & 0xff00ff;
+    const uint32_t g =
+        (((src & 0x00ff00) * alpha + (dst & 0x00ff00) * (256 - alpha)) >> 8) & 0x00ff00;
+    return 0xff000000 | rb | g;
+}
+
+static inline void BlendPixel(
+    RasterBuffers* buffers,
+    size_t pixel,
+    float z,
+    uint32_t color,
+    uint32_t alpha,
+    bool depthTest)
+{
+    if (depthTest && z > buffers->m_depth[pixel])
+    {
+        return;
+    }
+    buffers->m_color[pixel] = BlendColor(buffers->m_color[pixel], color, alpha);
+}
+
+//
+// POOL
+//
+
+void Particles::Create(ParticlePool* pool, int capacity)
+{
+    POW2_ASSERT(pool);
+    POW2_ASSERT(capacity > 0);
+
+    *pool = {};
+
+    // One allocation for all the arrays, each rounded up to whole SSE registers
+    const int paddedCapacity = (capacity + 3) & ~3;
+    const size_t arrayBytes = paddedCapacity * sizeof(float);
+    char* memory = (char*)_mm_malloc(8 * arrayBytes, 16);
+    POW2_ASSERT(memory);
+    memset(memory, 0, 8 * arrayBytes);
+
+    pool->m_posX = (float*)(memory + 0 * arrayBytes);
+    pool->m_posY = (float*)(memory + 1 * arrayBytes);
+    pool->m_posZ = (float*)(memory + 2 * arrayBytes);
+    pool->m_velX = (float*)(memory + 3 * arrayBytes);
+    pool->m_velY = (float*)(memory + 4 * arrayBytes);
+    pool->m_velZ = (float*)(memory + 5 * arrayBytes);
+    pool->m_life = (float*)(memory + 6 * arrayBytes);
+    pool->m_color = (uint32_t*)(memory + 7 * arrayBytes);
+
+    pool->m_capacity = capacity;
+    pool->m_randomState = 2463534242u;
+}
+
+void Particles::Destroy(ParticlePool* pool)
+{
+    POW2_ASSERT(pool);
+
+    _mm_free(pool->m_posX);
+    *pool = {};
+}
+
+int Particles::Emit(ParticlePool* pool, const ParticleEmitter& emitter, int count)
+{
+    POW2_ASSERT(pool);
+
+    if (count > pool->m_capacity - pool->m_count)
+    {
+        count = pool->m_capacity - pool->m_count;
+    }
+
+    uint32_t* random = &pool->m_randomState;
+    const vec3& jitter = emitter.m_velocityJitter;
+
+    for (int i = pool->m_count; i < pool->m_count + count; ++i)
+    {
+        pool->m_posX[i] = RandomRange(random, emitter.m_min.x, emitter.m_max.x);
+        pool->m_posY[i] = RandomRange(random, emitter.m_min.y, emitter.m_max.y);
+        pool->m_posZ[i] = RandomRange(random, emitter.m_min.z, emitter.m_max.z);
+        pool->m_velX[i] = emitter.m_velocity.x + RandomRange(random, -jitter.x, jitter.x);
+        pool->m_velY[i] = emitter.m_velocity.y + RandomRange(random, -jitter.y, jitter.y);
+        pool->m_velZ[i] = emitter.m_velocity.z + RandomRange(random, -jitter.z, jitter.z);
+        pool->m_life[i] = emitter.m_life;
+        pool->m_color[i] = emitter.m_color;
+    }
+
+    pool->m_count += count;
+    return count;
+}
+
+//
+// SIMULATION
+//
+
+void Particles::Update(ParticlePool* pool, const vec3& acceleration, float minY, float dt)
+{
+    POW2_ASSERT(pool);
+
+    //
+    // Integrate (semi-implicit Euler). The padding past m_count is integrated too, it's
+    // cheaper than a scalar tail and nobody reads it.
+    //
+
+    const __m128 dv = _mm_set1_ps(dt);
+    const __m128 ax = _mm_set1_ps(acceleration.x * dt);
+    const __m128 ay = _mm_set1_ps(acceleration.y * dt);
+    const __m128 az = _mm_set1_ps(acceleration.z * dt);
+
+    for (int i = 0; i < pool->m_count; i += 4)
+    {
+        const __m128 vx = _mm_add_ps(_mm_load_ps(pool->m_velX + i), ax);
+        const __m128 vy = _mm_add_ps(_mm_load_ps(pool->m_velY + i), ay);
+        const __m128 vz = _mm_add_ps(_mm_load_ps(pool->m_velZ + i), az);
+        _mm_store_ps(pool->m_velX + i, vx);
+        _mm_store_ps(pool->m_velY + i, vy);
+        _mm_store_ps(pool->m_velZ + i, vz);
+
+        const __m128 px = _mm_add_ps(_mm_load_ps(pool->m_posX + i), _mm_mul_ps(vx, dv));
+        const __m128 py = _mm_add_ps(_mm_load_ps(pool->m_posY + i), _mm_mul_ps(vy, dv));
+        const __m128 pz = _mm_add_ps(_mm_load_ps(pool->m_posZ + i), _mm_mul_ps(vz, dv));
+        _mm_store_ps(pool->m_posX + i, px);
+        _mm_store_ps(pool->m_posY + i, py);
+        _mm_store_ps(pool->m_posZ + i, pz);
+        _mm_store_ps(pool->m_life + i, _mm_sub_ps(_mm_load_ps(pool->m_life + i), dv));
+    }
+
+    //
+    // Remove dead particles, skipping whole groups of four with nothing to do
+    //
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 floor = _mm_set1_ps(minY);
+    int count = pool->m_count;
+    int i = 0;
+
+    while (i < count)
+    {
+        if ((i & 3) == 0 && i + 4 <= count)
+        {
+            const __m128 dead = _mm_or_ps(
+                _mm_cmple_ps(_mm_load_ps(pool->m_life + i), zero),
+                _mm_cmplt_ps(_mm_load_ps(pool->m_posY + i), floor));
+            if (_mm_movemask_ps(dead) == 0)
+            {
+                i += 4;
+                continue;
+            }
+        }
+
+        if (pool->m_life[i] <= 0 || pool->m_posY[i] < minY)
+        {
+            MoveParticle(pool, --count, i);  // the moved one is checked next
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    pool->m_count = count;
+}
+
+//
+// RENDERING
+//
+
+static void RenderPoints(
+    RasterBuffers* buffers,
+    const ParticlePool& pool,
+    const ParticleRenderSettings& settings)
+{
+    const int width = (int)buffers->m_width;
+    const int height = (int)buffers->m_height;
+    const int size = settings.m_pointSize > 0 ? settings.m_pointSize : 1;
+    const bool depthTest = settings.m_depthTest && buffers->m_depth;
+
+    for (int i = 0; i < pool.m_count; ++i)
+    {
+        int minX = (int)pool.m_posX[i] - size / 2;
+        int minY = (int)pool.m_posY[i] - size / 2;
+        int maxX = minX + size;
+        int maxY = minY + size;
+        minX = minX > 0 ? minX : 0;
+        minY = minY > 0 ? minY : 0;
+        maxX = maxX < width ? maxX : width;
+        maxY = maxY < height ? maxY : height;
+
+        const uint32_t color = pool.m_color[i];
+        const uint32_t alpha = (color >> 24) + (color >> 31);  // 0..256
+        const float z = pool.m_posZ[i];
+
+        for (int y = minY; y < maxY; ++y)
+        {
+            const size_t row = (size_t)y * width;
+            for (int x = minX; x < maxX; ++x)
+            {
+                BlendPixel(buffers, row + x, z, color, alpha, depthTest);
+            }
+        }
+    }
+}
+
+static void RenderStreaks(
+    RasterBuffers* buffers,
+    const ParticlePool& pool,
+    const ParticleRenderSettings& settings)
+{
+    const int width = (int)buffers->m_width;
+    const int height = (int)buffers->m_height;
+    const bool depthTest = settings.m_depthTest && buffers->m_depth;
+
+    for (int i = 0; i < pool.m_count; ++i)
+    {
+        const float headX = pool.m_posX[i];
+        const float headY = pool.m_posY[i];
+        float dx = -pool.m_velX[i] * settings.m_streakSeconds;
+        float dy = -pool.m_velY[i] * settings.m_streakSeconds;
+
+        int steps = (int)fmaxf(fabsf(dx), fabsf(dy));
+        if (steps > kMaxStreakLength)
+        {
+            dx *= (float)kMaxStreakLength / steps;
+            dy *= (float)kMaxStreakLength / steps;
+            steps = kMaxStreakLength;
+        }
+        steps = steps > 0 ? steps : 1;
+
+        // Whole streak inside the buffers is the common case and needs no per pixel clipping
+        const float tailX = headX + dx;
+        const float tailY = headY + dy;
+        const bool inside =
+            fminf(headX, tailX) >= 0 && fmaxf(headX, tailX) < width &&
+            fminf(headY, tailY) >= 0 && fmaxf(headY, tailY) < height;
+        if (!inside &&
+            (fmaxf(headX, tailX) < 0 || fminf(headX, tailX) >= width ||
+             fmaxf(headY, tailY) < 0 || fminf(headY, tailY) >= height))
+        {
+            continue;
+        }
+
+        const uint32_t color = pool.m_color[i];
+        const float z = pool.m_posZ[i];
+
+        // 16.16 fixed point DDA, alpha fading linearly to 0 at the tail
+        const int stepX = (int)(dx * 65536 / steps);
+        const int stepY = (int)(dy * 65536 / steps);
+        const int alphaStart = ((color >> 24) + (color >> 31)) << 16;
+        const int alphaStep = alphaStart / steps;
+        int x = (int)(headX * 65536);
+        int y = (int)(headY * 65536);
+        int alpha = alphaStart;
+
+        for (int s = 0; s < steps; ++s)
+        {
+            const int px = x >> 16;
+            const int py = y >> 16;
+            if (inside || (px >= 0 && px < width && py >= 0 && py < height))
+            {
+                const size_t pixel = (size_t)py * width + px;
+                BlendPixel(buffers, pixel, z, color, alpha >> 16, depthTest);
+            }
+            x += stepX;
+            y += stepY;
+            alpha -= alphaStep;
+        }
+    }
+}
+
+void Particles::Render(
+    RasterBuffers* buffers,
+    const ParticlePool& pool,
+    const ParticleRenderSettings& settings)
+{
+    POW2_ASSERT(buffers);
+
+    if (settings.m_shape == ParticleShape::POINT)
+    {
+        RenderPoints(buffers, pool, settings);
+    }
+    else
+    {
+        RenderStreaks(buffers, pool, settings);
+    }
+}
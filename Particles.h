@@ -0,0 +1,75 @@
+#pragma once
+
+#include "MathUtils.h"
+
+#include <stdint.h>
+
+struct RasterBuffers;
+
+//
+// PARTICLES INPUT: emitters and forces, in window coordinates
+// PARTICLES OUTPUT: point sprites or streaks blended into the colour buffer
+//
+// Particles are stored as structure of arrays so Update can integrate four at a time with SSE.
+// They never go through RasterTriangle: each one is a handful of pixels, and triangle setup
+// would cost far more than the pixels themselves.
+//
+
+struct ParticlePool  // zero is initialisation, see Particles::Create
+{
+    // m_capacity entries each, 16 byte aligned and padded to a multiple of 4
+    float* m_posX;
+    float* m_posY;
+    float* m_posZ;
+    float* m_velX;
+    float* m_velY;
+    float* m_velZ;
+    float* m_life;  // seconds left
+    uint32_t* m_color;  // 0xAARRGGBB, alpha is the opacity
+
+    int m_count;  // live particles are always [0, m_count)
+    int m_capacity;
+    uint32_t m_randomState;
+};
+
+struct ParticleEmitter
+{
+    vec3 m_min;  // new particles are spread uniformly over this box
+    vec3 m_max;
+    vec3 m_velocity;
+    vec3 m_velocityJitter;  // +/- per axis
+    float m_life;  // seconds
+    uint32_t m_color;
+};
+
+enum class ParticleShape
+{
+    POINT,  // m_pointSize x m_pointSize square
+    STREAK  // line towards the previous position, fading out at the tail (motion blur)
+};
+
+struct ParticleRenderSettings
+{
+    ParticleShape m_shape;
+    int m_pointSize;
+    float m_streakSeconds;  // streak length in seconds of motion
+    bool m_depthTest;       // against RasterBuffers::m_depth, which particles never write
+};
+
+namespace Particles
+{
+    void Create(ParticlePool* pool, int capacity);
+    void Destroy(ParticlePool* pool);
+
+    // Adds up to count particles, fewer if the pool is full. Returns how many were added.
+    int Emit(ParticlePool* pool, const ParticleEmitter& emitter, int count);
+
+    // Integrates velocity and position over dt (SSE, four particles at a time). Particles die
+    // when their life runs out or they fall below minY, and the last ones move into their slots.
+    void Update(ParticlePool* pool, const vec3& acceleration, float minY, float dt);
+
+    void Render(
+        RasterBuffers* buffers,
+        const ParticlePool& pool,
+        const ParticleRenderSettings& settings);
+}
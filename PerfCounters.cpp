@@ -0,0 +1,193 @@
+#include "PerfCounters.h"
+
+#include "DebugTimer.h"
+#include "SizeOfArray.h"
+#include "ThreadLocal.h"
+
+#include "External/pow2assert.h"
+
+#include <atomic>
+#include <string.h>
+
+static const int kCounterCount = (int)PerfCounter::Count;
+static const int kStageCount = (int)PerfStage::Count;
+static const int kMaxThreads = 64;  // threads past this many count nothing
+
+static const char* const kStageNames[] = {
+    "setup",
+    "traversal",
+    "shading",
+    "clear",
+    "present" };
+
+static const char* const kCounterNames[] = {
+    "cycles",
+    "instructions",
+    "L1D misses",
+    "LLC misses",
+    "branch misses" };
+
+struct PerfStageSums  // added to by every thread
+{
+    std::atomic<uint64_t> m_values[kCounterCount];
+    std::atomic<uint64_t> m_ns;
+    std::atomic<uint64_t> m_laps;
+};
+
+struct PerfThread
+{
+    int m_group;
+    bool m_counters[kCounterCount];  // opened on this thread
+};
+
+struct PerfCountersState
+{
+    bool m_enabled;
+    bool m_available[kCounterCount];
+    int m_generation;  // one more every Init, threads open their group again when it changes
+    std::atomic<int> m_threadCount;
+    PerfThread m_threads[kMaxThreads];
+    PerfStageSums m_stages[kStageCount];
+};
+
+static PerfCountersState g_perf;
+static THREAD_LOCAL int t_generation = 0;
+static THREAD_LOCAL int t_thread = -1;
+
+bool PerfCounters::Init()
+{
+    POW2_ASSERT(!g_perf.m_enabled);
+
+    // Whatever the calling thread can open, every thread asks for
+    for (int i = 0; i < kCounterCount; ++i)
+    {
+        g_perf.m_available[i] = true;
+    }
+    const int probe = OpenGroup(g_perf.m_available);
+    if (probe < 0)
+    {
+        return false;
+    }
+    CloseGroup(probe);
+
+    PerfFrame discard;
+    EndFrame(&discard);
+
+    ++g_perf.m_generation;
+    g_perf.m_threadCount = 0;
+    g_perf.m_enabled = true;
+    return true;
+}
+
+void PerfCounters::Shutdown()
+{
+    if (!g_perf.m_enabled)
+    {
+        return;
+    }
+
+    const int threadCount = g_perf.m_threadCount.load();
+    for (int i = 0; i < threadCount && i < kMaxThreads; ++i)
+    {
+        if (g_perf.m_threads[i].m_group >= 0)
+        {
+            CloseGroup(g_perf.m_threads[i].m_group);
+        }
+    }
+    g_perf.m_enabled = false;
+}
+
+bool PerfCounters::IsEnabled()
+{
+    return g_perf.m_enabled;
+}
+
+bool PerfCounters::IsAvailable(PerfCounter counter)
+{
+    POW2_ASSERT(counter >= PerfCounter(0) && counter < PerfCounter::Count);
+    return g_perf.m_enabled && g_perf.m_available[(int)counter];
+}
+
+void PerfCounters::Read(PerfSample* sample)
+{
+    POW2_ASSERT(sample);
+
+    memset(sample->m_values, 0, sizeof(sample->m_values));
+    sample->m_ms = DebugTimer_NowMs();
+    if (!g_perf.m_enabled)
+    {
+        return;
+    }
+
+    if (t_generation != g_perf.m_generation)
+    {
+        t_generation = g_perf.m_generation;
+        t_thread = g_perf.m_threadCount.fetch_add(1);
+        if (t_thread < kMaxThreads)
+        {
+            PerfThread& thread = g_perf.m_threads[t_thread];
+            memcpy(thread.m_counters, g_perf.m_available, sizeof(thread.m_counters));
+            thread.m_group = OpenGroup(thread.m_counters);
+        }
+    }
+
+    if (t_thread < kMaxThreads && g_perf.m_threads[t_thread].m_group >= 0)
+    {
+        const PerfThread& thread = g_perf.m_threads[t_thread];
+        ReadGroup(thread.m_group, thread.m_counters, sample->m_values);
+    }
+}
+
+void PerfCounters::Lap(PerfStage stage, PerfSample* last)
+{
+    POW2_ASSERT(stage >= PerfStage(0) && stage < PerfStage::Count);
+    POW2_ASSERT(last);
+
+    PerfSample now;
+    Read(&now);
+
+    PerfStageSums& sums = g_perf.m_stages[(int)stage];
+    for (int i = 0; i < kCounterCount; ++i)
+    {
+        sums.m_values[i].fetch_add(now.m_values[i] - last->m_values[i], std::memory_order_relaxed);
+    }
+    sums.m_ns.fetch_add((uint64_t)((now.m_ms - last->m_ms) * 1e6), std::memory_order_relaxed);
+    sums.m_laps.fetch_add(1, std::memory_order_relaxed);
+
+    *last = now;
+}
+
+void PerfCounters::EndFrame(PerfFrame* frame)
+{
+    POW2_ASSERT(frame);
+
+    for (int s = 0; s < kStageCount; ++s)
+    {
+        PerfStageSums& sums = g_perf.m_stages[s];
+        PerfStageTotals& totals = frame->m_stages[s];
+        for (int i = 0; i < kCounterCount; ++i)
+        {
+            totals.m_values[i] = sums.m_values[i].exchange(0, std::memory_order_relaxed);
+        }
+        totals.m_ms = sums.m_ns.exchange(0, std::memory_order_relaxed) / 1e6;
+        totals.m_laps = sums.m_laps.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+const char* PerfCounters::GetStageName(PerfStage stage)
+{
+    static_assert(
+        SizeOfArray(kStageNames) == (size_t)PerfStage::Count,
+        "One name per stage");
+    POW2_ASSERT(stage >= PerfStage(0) && stage < PerfStage::Count);
+    return kStageNames[(int)stage];
+}
+
+const char* PerfCounters::GetCounterName(PerfCounter counter)
+{
+    static_assert(
+        SizeOfArray(kCounterNames) == (size_t)PerfCounter::Count,
+        "One name per counter");
+    POW2_ASSERT(counter >= PerfCounter(0) && counter < PerfCounter::Count);
+    return kCounterNames[(int)counter];
+}
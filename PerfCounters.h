@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// PERF COUNTERS INPUT: stages of the frame, marked out on whichever thread runs them
+// PERF COUNTERS OUTPUT: hardware counter totals per stage, collected between frames
+//
+// Every thread counts with its own group of counters, read together, so a stage only adds up
+// the instructions it ran and not what other threads did meanwhile. Reading the group is a
+// system call (around a microsecond), which shows when it's done around every triangle: compare
+// timings with counting off. Off, the default and the only option on Windows, marking a stage
+// is a branch on PerfCounters::IsEnabled.
+//
+// Linux only, through perf_event_open. Counters the CPU or kernel don't offer (virtual machines
+// often have none, and kernel.perf_event_paranoid can forbid them) are unavailable, see
+// PerfCounters::IsAvailable, and read as 0.
+//
+
+enum class PerfStage
+{
+    SETUP,      // Rasterizer::RasterTriangle, bounding box and edge setup
+    TRAVERSAL,  // ... finding the covered pixels
+    SHADING,    // ... depth test, shading and writing the fragments
+    CLEAR,      // buffers cleared before drawing, whole or dirty rectangles
+    PRESENT,    // Swapchain present function, on the present thread
+    Count
+};
+
+enum class PerfCounter
+{
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,  // level 1 data cache read misses
+    LLC_MISSES,  // last level cache misses
+    BRANCH_MISSES,
+    Count
+};
+
+struct PerfSample  // a read of the calling thread's counters
+{
+    uint64_t m_values[(int)PerfCounter::Count];
+    double m_ms;
+};
+
+struct PerfStageTotals
+{
+    uint64_t m_values[(int)PerfCounter::Count];
+    double m_ms;
+    uint64_t m_laps;  // times the stage ran
+};
+
+struct PerfFrame
+{
+    PerfStageTotals m_stages[(int)PerfStage::Count];
+};
+
+namespace PerfCounters
+{
+    // Turns counting on. False, and counting stays off, if none of the counters can be opened.
+    bool Init();
+    void Shutdown();  // after every thread that counted is done with its stages
+
+    bool IsEnabled();
+    bool IsAvailable(PerfCounter counter);
+
+    // Reads the calling thread's counters. The first read on a thread opens them.
+    void Read(PerfSample* sample);
+
+    // Adds what the calling thread counted since *last to stage, and moves *last on to now, so
+    // stages that follow each other chain their laps
+    void Lap(PerfStage stage, PerfSample* last);
+
+    // The totals since the last call, from every thread, then starts again. Present runs behind
+    // rendering, so its totals are of the frames presented meanwhile.
+    void EndFrame(PerfFrame* frame);
+
+    const char* GetStageName(PerfStage stage);
+    const char* GetCounterName(PerfCounter counter);
+
+    // Counter groups (platform specific). OpenGroup opens the calling thread's counters among
+    // those set in counters, clears the ones it can't open, and returns -1 if it opened none.
+    // ReadGroup fills values for the counters it opened.
+    int OpenGroup(bool counters[(int)PerfCounter::Count]);
+    bool ReadGroup(
+        int group, const bool counters[(int)PerfCounter::Count],
+        uint64_t values[(int)PerfCounter::Count]);
+    void CloseGroup(int group);
+}
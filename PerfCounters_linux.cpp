@@ -0,0 +1,116 @@
+#include "PerfCounters.h"
+
+#include <linux/perf_event.h>
+
+#include <mutex>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const int kCounterCount = (int)PerfCounter::Count;
+static const int kMaxGroups = 64;
+
+struct CounterConfig
+{
+    uint32_t m_type;
+    uint64_t m_config;
+};
+
+static const CounterConfig kCounterConfigs[kCounterCount] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    {
+        PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES } };
+
+// Descriptors of every open group, leader first. The leader's read returns the whole group.
+struct CounterGroup
+{
+    int m_fds[kCounterCount];
+    int m_fdCount;  // 0 when the slot is free
+};
+
+static std::mutex g_groupsMutex;
+static CounterGroup g_groups[kMaxGroups];
+
+static int OpenCounter(const CounterConfig& config, int leader)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = config.m_type;
+    attr.config = config.m_config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;  // reading the counters is a system call, leave it out
+    attr.exclude_hv = 1;
+
+    // This thread only, on whichever CPU it runs
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+int PerfCounters::OpenGroup(bool counters[(int)PerfCounter::Count])
+{
+    std::lock_guard<std::mutex> lock(g_groupsMutex);
+
+    int group = -1;
+    for (int i = 0; i < kMaxGroups && group < 0; ++i)
+    {
+        group = g_groups[i].m_fdCount == 0 ? i : -1;
+    }
+    if (group < 0)
+    {
+        memset(counters, 0, sizeof(bool) * kCounterCount);
+        return -1;
+    }
+
+    CounterGroup& fds = g_groups[group];
+    for (int i = 0; i < kCounterCount; ++i)
+    {
+        const int leader = fds.m_fdCount > 0 ? fds.m_fds[0] : -1;
+        const int fd = counters[i] ? OpenCounter(kCounterConfigs[i], leader) : -1;
+        counters[i] = fd >= 0;
+        if (fd >= 0)
+        {
+            fds.m_fds[fds.m_fdCount++] = fd;
+        }
+    }
+
+    return fds.m_fdCount ? group : -1;
+}
+
+bool PerfCounters::ReadGroup(
+    int group, const bool counters[(int)PerfCounter::Count],
+    uint64_t values[(int)PerfCounter::Count])
+{
+    // PERF_FORMAT_GROUP: the number of counters, then their values in the order they were opened
+    uint64_t data[1 + kCounterCount];
+    const ssize_t bytes = read(g_groups[group].m_fds[0], data, sizeof(data));
+    if (bytes < (ssize_t)sizeof(uint64_t) ||
+        bytes < (ssize_t)(sizeof(uint64_t) * (1 + data[0])))
+    {
+        return false;
+    }
+
+    int next = 1;
+    for (int i = 0; i < kCounterCount; ++i)
+    {
+        values[i] = counters[i] ? data[next++] : 0;
+    }
+    return true;
+}
+
+void PerfCounters::CloseGroup(int group)
+{
+    std::lock_guard<std::mutex> lock(g_groupsMutex);
+
+    CounterGroup& fds = g_groups[group];
+    for (int i = fds.m_fdCount - 1; i >= 0; --i)
+    {
+        close(fds.m_fds[i]);
+    }
+    fds.m_fdCount = 0;
+}
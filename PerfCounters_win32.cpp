@@ -0,0 +1,22 @@
+#include "PerfCounters.h"
+
+#include <string.h>
+
+// No counters, PerfCounters::Init fails and nothing is counted
+
+int PerfCounters::OpenGroup(bool counters[(int)PerfCounter::Count])
+{
+    memset(counters, 0, sizeof(bool) * (int)PerfCounter::Count);
+    return -1;
+}
+
+bool PerfCounters::ReadGroup(
+    int, const bool[(int)PerfCounter::Count], uint64_t values[(int)PerfCounter::Count])
+{
+    memset(values, 0, sizeof(uint64_t) * (int)PerfCounter::Count);
+    return false;
+}
+
+void PerfCounters::CloseGroup(int)
+{
+}
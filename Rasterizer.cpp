@@ -1,7 +1,12 @@
 #include "Rasterizer.h"
 
 #include "DebugTimer.h"
+#include "Lighting.h"
 #include "Log.h"
+#include "MathSimd.h"
+#include "PerfCounters.h"
+#include "ShadingRates.h"
+#include "SizeOfArray.h"
 
 #include "External/pow2assert.h"
 
@@ -13,14 +18,32 @@
 // Keeping multiple parallel implementations to evaluate relative performance.
 //
 
+#ifndef PROFILE
 #define PROFILE 1
+#endif
 
-enum class ScanConversionMode
-{
-    FirstApproach
-};
+static ScanConversionMode g_scanConversionMode = ScanConversionMode::FirstApproach;
+
+static const char* const kScanConversionModeNames[] = {
+    "FirstApproach",
+    "IncrementalEdges",
+    "RowSpans" };
+
+static const float kShadowAmbient = 0.25f;  // light left in fully shadowed fragments
+
+// Triangles whose clipped bounding box fits in a block this size take RasterSmallTriangle
+static const int kSmallTriangleBlock = 8;
+static bool g_smallTrianglePath = true;
+
+static const char* const kShadingRateNames[] = {
+    "1x1",
+    "2x2",
+    "4x4" };
 
-static const ScanConversionMode g_scanConversionMode = ScanConversionMode::FirstApproach;
+// Coarse shading keeps the colours of the blocks it shaded last, by block column. Fragments come
+// a row at a time, so a triangle up to this many blocks wide shades each block once (wider
+// ones may shade one again, which gives the same colour).
+static const int kCoarseCacheBlocks = 64;
 
 //
 // DATA STRUCTURES
@@ -41,6 +64,25 @@ struct ScanData
     FragmentInput* m_fragmentsIn;
     int m_capacity;
     int m_fragmentsCount;
+
+    // Weight changes from one pixel to the next along x and y, for shading points other than
+    // the fragments (coarse shading rates)
+    float m_stepX[3];
+    float m_stepY[3];
+};
+
+struct CoarseBlock
+{
+    int m_x;  // in blocks, -1 for none
+    int m_y;
+    ShadingRate m_rate;
+    uint32_t m_color;
+};
+
+struct ShadingCounts
+{
+    int m_shaded;
+    int m_reused;
 };
 
 struct Plane
@@ -72,44 +114,92 @@ static inline vec4 BufferColorToColor(const uint32_t c)
     return ret;
 }
 
+static inline float Saturate(float value)
+{
+    return value < 0 ? 0 : (value > 1 ? 1 : value);
+}
+
+static inline int ClampInt(int value, int minValue, int maxValue)
+{
+    return value < minValue ? minValue : (value > maxValue ? maxValue : value);
+}
+
+// Pixels triangles may write to: the buffers, within the scissor if there's one
+static inline ScreenRect ClipRect(const RasterBuffers& buffers)
+{
+    ScreenRect clip = { 0, 0, (int)buffers.m_width - 1, (int)buffers.m_height - 1 };
+    if (buffers.m_scissor)
+    {
+        const ScreenRect& scissor = *buffers.m_scissor;
+        clip.m_minX = scissor.m_minX > clip.m_minX ? scissor.m_minX : clip.m_minX;
+        clip.m_minY = scissor.m_minY > clip.m_minY ? scissor.m_minY : clip.m_minY;
+        clip.m_maxX = scissor.m_maxX < clip.m_maxX ? scissor.m_maxX : clip.m_maxX;
+        clip.m_maxY = scissor.m_maxY < clip.m_maxY ? scissor.m_maxY : clip.m_maxY;
+    }
+    return clip;
+}
+
 //
 // PIPELINE FUNCTIONS
 //
 
-static void TriangleSetup(TriangleData* triangle, const TriangleInput& input)
+// Returns false if the triangle has no area on screen and should be skipped.
+static bool TriangleSetup(TriangleData* triangle, const TriangleInput& input)
 {
     // TODO(manuel): check CW / CCW
 
+    // Coverage is computed on the window plane, so depth is dropped here. Otherwise the edge
+    // planes of a triangle that isn't parallel to the screen don't match the traversal.
     vec3 vertices[3];
     for (int i = 0; i < 3; ++i)
     {
-        vertices[i] = vec4xyz(input.m_vertexArray[input.m_indices[i]].m_pos);
+        const vec4& pos = input.m_vertexArray[input.m_indices[i]].m_pos;
+        vertices[i] = vec3(pos.x, pos.y, 0);
+    }
+
+    const vec3 area = vec3Cross(vertices[1] - vertices[0], vertices[2] - vertices[0]);
+    if (fabsf(area.z) < 1e-6f)
+    {
+        return false;
     }
     
-    const vec3 vAB = vec3Normalize(vertices[1] - vertices[0]);
-    const vec3 vBC = vec3Normalize(vertices[2] - vertices[1]);
-    const vec3 vCA = vec3Normalize(vertices[0] - vertices[2]);
-    
-    triangle->m_normal = vec3Normalize(vec3Cross(-vCA, vAB));
-    
-    const vec3 edgeNormals[3] = {
-        vec3Normalize(vec3Cross(vBC, triangle->m_normal)),    // BC edge
-        vec3Normalize(vec3Cross(vCA, triangle->m_normal)),    // CA edge
-        vec3Normalize(vec3Cross(vAB, triangle->m_normal)) };  // AB edge
-    const Plane edgePlanes[3] = {
-        { edgeNormals[0], vec3Dot(edgeNormals[0], vertices[1]) },
-        { edgeNormals[1], vec3Dot(edgeNormals[1], vertices[2]) },
-        { edgeNormals[2], vec3Dot(edgeNormals[2], vertices[0]) } };
-    const float distToEdges[3] = {
-        vec3Dot(vertices[0], edgePlanes[0].n) - edgePlanes[0].d,
-        vec3Dot(vertices[1], edgePlanes[1].n) - edgePlanes[1].d,
-        vec3Dot(vertices[2], edgePlanes[2].n) - edgePlanes[2].d };
-    
+    // The edges side by side, the fourth lane repeats the first. The area test rules out zero
+    // lengths, so the normalisations are unchecked.
+    const vec3x4 edges = vec3xNormalize(
+        vec3x4Load(vertices[1], vertices[2], vertices[0], vertices[0]) -
+        vec3x4Load(vertices[0], vertices[1], vertices[2], vertices[2]));
+    const vec3 vAB = vec3x4Get(edges, 0);
+    const vec3 vBC = vec3x4Get(edges, 1);
+    const vec3 vCA = vec3x4Get(edges, 2);
+
+    triangle->m_normal = vec3NormalizeUnchecked(vec3Cross(-vCA, vAB));
+    const vec3x4 normal(
+        floatx4(triangle->m_normal.x),
+        floatx4(triangle->m_normal.y),
+        floatx4(triangle->m_normal.z));
+
+    // BC, CA and AB edge planes, each through the vertex at the start of its edge
+    const vec3x4 edgeNormals =
+        vec3xNormalize(vec3xCross(vec3x4Load(vBC, vCA, vAB, vAB), normal));
+    const floatx4 edgeDistances =
+        vec3xDot(edgeNormals, vec3x4Load(vertices[1], vertices[2], vertices[0], vertices[0]));
+    const floatx4 distToEdges =
+        vec3xDot(vec3x4Load(vertices[0], vertices[1], vertices[2], vertices[2]), edgeNormals) -
+        edgeDistances;
+
+    // Slivers (dense meshes seen edge on) can pass the area test and still round to a zero
+    // height once normalised
+    if (floatxMoveMask(distToEdges == floatx4(0)) & 7)
+    {
+        return false;
+    }
+
+    const vec3x4 interpNormals = -edgeNormals / distToEdges;
     for (int i = 0; i < 3; ++i)
     {
-        triangle->m_interpNormals[i] = -edgeNormals[i] / distToEdges[i];
+        triangle->m_interpNormals[i] = vec3x4Get(interpNormals, i);
     }
-    
+
     triangle->m_minX = (int)fminf(
         fminf(vertices[0].x, vertices[1].x),
         vertices[2].x);
@@ -122,9 +212,11 @@ static void TriangleSetup(TriangleData* triangle, const TriangleInput& input)
     triangle->m_maxY = (int)fmaxf(
         fmaxf(vertices[0].y, vertices[1].y),
         vertices[2].y);
+
+    return true;
 }
 
-static void TriangleTraversal(
+static void TraversalFirstApproach(
     ScanData* scan,
     FragmentInput* fragmentsTmpBuffer,
     const TriangleInput& input,
@@ -171,46 +263,615 @@ static void TriangleTraversal(
     }
 }
 
+// The weight of vertex v is 1 - m_interpNormals[v] . (p - vertex v), a plane over the window.
+// Returns its value at (x, y) and its steps along x and y.
+static inline float InterpPlane(
+    const TriangleInput& input,
+    const TriangleData& triangle,
+    int v,
+    float x,
+    float y,
+    float* stepX,
+    float* stepY)
+{
+    const vec4& pos = input.m_vertexArray[input.m_indices[v]].m_pos;
+    const vec3& n = triangle.m_interpNormals[v];
+    *stepX = -n.x;
+    *stepY = -n.y;
+    return 1 - n.x * (x - pos.x) - n.y * (y - pos.y);
+}
+
+// Same weights as the first approach, stepped from pixel to pixel instead of recomputed. Each
+// row starts from an exact value so errors don't build up, and stops once it has left the
+// triangle.
+static void TraversalIncrementalEdges(
+    ScanData* scan,
+    FragmentInput* fragmentsTmpBuffer,
+    const TriangleInput& input,
+    const TriangleData& triangle)
+{
+    *scan = {};
+    scan->m_fragmentsIn = fragmentsTmpBuffer;
+
+    const int minX = (int)triangle.m_minX;
+    const int maxX = (int)triangle.m_maxX;
+    const int minY = (int)triangle.m_minY;
+    const int maxY = (int)triangle.m_maxY;
+
+    float corner[3];  // weights at (minX, minY)
+    float stepX[3];
+    float stepY[3];
+    for (int v = 0; v < 3; ++v)
+    {
+        corner[v] = InterpPlane(
+            input, triangle, v, (float)minX, (float)minY, &stepX[v], &stepY[v]);
+    }
+
+    FragmentInput* fragments = scan->m_fragmentsIn;
+    int count = 0;
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        const float dy = (float)(y - minY);
+        float w0 = corner[0] + stepY[0] * dy;
+        float w1 = corner[1] + stepY[1] * dy;
+        float w2 = corner[2] + stepY[2] * dy;
+        bool inside = false;
+
+        for (int x = minX; x <= maxX; ++x)
+        {
+            // The weights add up to 1, so none of them can be over 1 if all are positive
+            if (w0 >= 0 && w1 >= 0 && w2 >= 0)
+            {
+                inside = true;
+                fragments[count++] = { x, y, { w0, w1, w2 } };
+            }
+            else if (inside)
+            {
+                break;  // triangles are convex, the rest of the row is outside
+            }
+
+            w0 += stepX[0];
+            w1 += stepX[1];
+            w2 += stepX[2];
+        }
+    }
+
+    scan->m_fragmentsCount = count;
+}
+
+static inline bool InsideAt(const float w[3], const float stepX[3], float t)
+{
+    return w[0] + stepX[0] * t >= 0 && w[1] + stepX[1] * t >= 0 && w[2] + stepX[2] * t >= 0;
+}
+
+// Solves where each row enters and leaves the triangle (the x where each weight crosses 0) and
+// fills that span without testing pixels. Best when the bounding box is mostly empty: slivers
+// and big triangles.
+static void TraversalRowSpans(
+    ScanData* scan,
+    FragmentInput* fragmentsTmpBuffer,
+    const TriangleInput& input,
+    const TriangleData& triangle)
+{
+    *scan = {};
+    scan->m_fragmentsIn = fragmentsTmpBuffer;
+
+    const int minX = (int)triangle.m_minX;
+    const int maxX = (int)triangle.m_maxX;
+    const int minY = (int)triangle.m_minY;
+    const int maxY = (int)triangle.m_maxY;
+
+    FragmentInput* fragments = scan->m_fragmentsIn;
+    int count = 0;
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float w[3];
+        float stepX[3];
+        float stepY;
+
+        // Every weight must stay positive: w[v] + stepX[v] * t >= 0, t being pixels from minX
+        float tFirst = 0;
+        float tLast = (float)(maxX - minX);
+        for (int v = 0; v < 3; ++v)
+        {
+            w[v] = InterpPlane(input, triangle, v, (float)minX, (float)y, &stepX[v], &stepY);
+
+            if (stepX[v] > 0)
+            {
+                tFirst = fmaxf(tFirst, ceilf(-w[v] / stepX[v]));
+            }
+            else if (stepX[v] < 0)
+            {
+                tLast = fminf(tLast, floorf(-w[v] / stepX[v]));
+            }
+            else if (w[v] < 0)
+            {
+                tLast = -1;  // parallel to the row and outside
+            }
+        }
+
+        // The division rounds differently from stepping the weights, so move each end until it
+        // agrees with the per pixel test the other modes use. It is a pixel at most.
+        tFirst = fmaxf(tFirst - 1, 0);
+        while (tFirst <= tLast && !InsideAt(w, stepX, tFirst))
+        {
+            ++tFirst;
+        }
+        tLast = fminf(tLast + 1, (float)(maxX - minX));
+        while (tLast >= tFirst && !InsideAt(w, stepX, tLast))
+        {
+            --tLast;
+        }
+
+        if (tFirst > tLast)
+        {
+            continue;
+        }
+
+        const int first = minX + (int)tFirst;
+        const int last = minX + (int)tLast;
+        for (int v = 0; v < 3; ++v)
+        {
+            w[v] += stepX[v] * tFirst;
+        }
+
+        for (int x = first; x <= last; ++x)
+        {
+            fragments[count++] = { x, y, { w[0], w[1], w[2] } };
+            w[0] += stepX[0];
+            w[1] += stepX[1];
+            w[2] += stepX[2];
+        }
+    }
+
+    scan->m_fragmentsCount = count;
+}
+
+static void TriangleTraversal(
+    ScanData* scan,
+    FragmentInput* fragmentsTmpBuffer,
+    const TriangleInput& input,
+    const TriangleData& triangle)
+{
+    switch (g_scanConversionMode)
+    {
+        case ScanConversionMode::IncrementalEdges:
+            TraversalIncrementalEdges(scan, fragmentsTmpBuffer, input, triangle);
+            break;
+
+        case ScanConversionMode::RowSpans:
+            TraversalRowSpans(scan, fragmentsTmpBuffer, input, triangle);
+            break;
+
+        default:
+            TraversalFirstApproach(scan, fragmentsTmpBuffer, input, triangle);
+            break;
+    }
+}
+
+// Shades one fragment from the weights of the triangle's three vertices
+static inline vec4 ShadeFragment(const TriangleInput& input, const float* interpValues)
+{
+    // Calculate colour
+    vec4 baseColor = vec4(0, 0, 0, 0);
+    vec2 textureCoord = vec2(0, 0);
+    for (int v = 0; v < 3; ++v)
+    {
+        const VertexData& vertex = input.m_vertexArray[input.m_indices[v]];
+
+        float value = interpValues[v];
+
+        baseColor = baseColor + (vertex.m_color * value);
+        
+        textureCoord.x += vertex.m_textureCoord.x * value;
+        textureCoord.y += vertex.m_textureCoord.y * value;
+    }
+    
+    textureCoord.x = fmaxf(textureCoord.x, 0);
+    textureCoord.x = fminf(textureCoord.x, 1);
+    textureCoord.y = fmaxf(textureCoord.y, 0);
+    textureCoord.y = fminf(textureCoord.y, 1);
+    
+    // Texturing (clamp), a coordinate of exactly 1 is still the last texel
+    int texturePoint[2];
+    texturePoint[0] = ClampInt(
+        (int)(textureCoord.x * input.m_texture.m_width), 0, input.m_texture.m_width - 1);
+    texturePoint[1] = ClampInt(
+        (int)(textureCoord.y * input.m_texture.m_height), 0, input.m_texture.m_height - 1);
+    vec4 textureColor = BufferColorToColor(
+        Texture::FetchTexel(input.m_texture, texturePoint[0], texturePoint[1]));
+    
+    // Produce fragment
+    vec4 outColor = baseColor * textureColor;
+
+    if (input.m_lighting)
+    {
+        // Position and normal in lighting space, the position from the vertices so the ray
+        // tracer (which only has weights) lights the same
+        const LightGrid& lighting = *input.m_lighting;
+        vec3 position = vec3zero;
+        vec3 normal = vec3zero;
+        for (int v = 0; v < 3; ++v)
+        {
+            const VertexData& vertex = input.m_vertexArray[input.m_indices[v]];
+            position = position + vec4xyz(vertex.m_pos) * interpValues[v];
+            normal = normal + vertex.m_normal * interpValues[v];
+        }
+        position.z *= lighting.m_depthToPixels;
+
+        const float lengthSquared = vec3Dot(normal, normal);
+        if (lengthSquared > 0)
+        {
+            normal = normal * (1 / sqrtf(lengthSquared));
+            const LightResult light = Lighting::Evaluate(lighting, position, normal);
+            outColor.x = Saturate(outColor.x * light.m_diffuse.x + light.m_specular.x);
+            outColor.y = Saturate(outColor.y * light.m_diffuse.y + light.m_specular.y);
+            outColor.z = Saturate(outColor.z * light.m_diffuse.z + light.m_specular.z);
+        }
+    }
+
+    if (input.m_shadow)
+    {
+        const ShadowInput& shadow = *input.m_shadow;
+        vec3 shadowCoord = vec3zero;
+        for (int v = 0; v < 3; ++v)
+        {
+            shadowCoord = shadowCoord +
+                vec4xyz(shadow.m_shadowCoords[input.m_indices[v]]) * interpValues[v];
+        }
+
+        const float lit = Rasterizer::SampleShadow(
+            *shadow.m_shadowMap, shadowCoord, shadow.m_bias, shadow.m_pcfRadius);
+        const float light = kShadowAmbient + (1 - kShadowAmbient) * lit;
+        outColor = vec4(outColor.x * light, outColor.y * light, outColor.z * light, outColor.w);
+    }
+
+    return outColor;
+}
+
+// Less or equal, writing the fragment's depth if it passes
+static inline bool DepthTest(
+    RasterBuffers* buffers,
+    const TriangleInput& input,
+    const FragmentInput& fragIn,
+    size_t pixel)
+{
+    float z = 0;
+    for (int v = 0; v < 3; ++v)
+    {
+        z += input.m_vertexArray[input.m_indices[v]].m_pos.z * fragIn.m_interpValues[v];
+    }
+
+    if (z > buffers->m_depth[pixel])
+    {
+        return false;
+    }
+
+    buffers->m_depth[pixel] = z;
+    return true;
+}
+
+// Whether the pixel is among those shaded this frame regardless of reprojection. A hash rather
+// than a regular pattern, so the pixels refreshed together are scattered.
+static inline bool RefreshedThisFrame(const ReprojectionInput& reprojection, int x, int y)
+{
+    const uint32_t hash = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u);
+    return (int)(hash % reprojection.m_refreshFrames) == reprojection.m_refreshPhase;
+}
+
+// Looks the fragment up in the last frame: true, with its colour then, if the nearest pixel to
+// where it was held the same surface
+static inline bool Reproject(
+    const RasterBuffers& buffers,
+    const TriangleInput& input,
+    const FragmentInput& fragIn,
+    uint32_t* color)
+{
+    const ReprojectionInput& reprojection = *input.m_reprojection;
+    if (RefreshedThisFrame(reprojection, fragIn.m_x, fragIn.m_y))
+    {
+        return false;
+    }
+
+    vec3 previous = vec3zero;
+    for (int v = 0; v < 3; ++v)
+    {
+        previous = previous +
+            vec4xyz(reprojection.m_previousPositions[input.m_indices[v]]) *
+            fragIn.m_interpValues[v];
+    }
+
+    // Disoccluded: off the last frame, or something else was in front there
+    const float x = floorf(previous.x + 0.5f);
+    const float y = floorf(previous.y + 0.5f);
+    if (x < 0 || y < 0 || x >= buffers.m_width || y >= buffers.m_height)
+    {
+        return false;
+    }
+    const size_t pixel = (size_t)y * buffers.m_width + (size_t)x;
+    if (fabsf(reprojection.m_previousDepth[pixel] - previous.z) > reprojection.m_depthTolerance)
+    {
+        return false;
+    }
+
+    *color = reprojection.m_previousColor[pixel];
+    return true;
+}
+
+// Shades each block once, at its centre: the weights are stepped there from the first fragment
+// of the block that passes the depth test, and clamped to the triangle for blocks on its edges
+static void TriangleShadingCoarse(
+    RasterBuffers* buffers,
+    const TriangleInput& input,
+    const ScanData& scan,
+    const ShadingRateTiles* tiles,
+    ShadingCounts* counts)
+{
+    const int tileSize = ShadingRateTiles::kTileSize;
+
+    CoarseBlock cache[kCoarseCacheBlocks];
+    for (int i = 0; i < kCoarseCacheBlocks; ++i)
+    {
+        cache[i].m_x = -1;
+    }
+
+    for (int i = 0; i < scan.m_fragmentsCount; ++i)
+    {
+        const FragmentInput& fragIn = scan.m_fragmentsIn[i];
+        const size_t pixel = fragIn.m_y * buffers->m_width + fragIn.m_x;
+
+        if (buffers->m_depth && !DepthTest(buffers, input, fragIn, pixel))
+        {
+            continue;
+        }
+
+        if (input.m_reprojection && Reproject(*buffers, input, fragIn, &buffers->m_color[pixel]))
+        {
+            ++counts->m_reused;
+            continue;
+        }
+
+        ShadingRate rate = input.m_shadingRate;
+        if (tiles)
+        {
+            const ShadingRate tileRate =
+                tiles->m_rates[(fragIn.m_y / tileSize) * tiles->m_tilesX + fragIn.m_x / tileSize];
+            rate = tileRate > rate ? tileRate : rate;
+        }
+
+        if (rate == ShadingRate::Rate1x1)
+        {
+            buffers->m_color[pixel] =
+                ColorToBufferColor(ShadeFragment(input, fragIn.m_interpValues));
+            ++counts->m_shaded;
+            continue;
+        }
+
+        const int shift = (int)rate;  // blocks are 1 << shift pixels square
+        const int blockX = fragIn.m_x >> shift;
+        const int blockY = fragIn.m_y >> shift;
+        CoarseBlock& block = cache[blockX % kCoarseCacheBlocks];
+        if (block.m_x != blockX || block.m_y != blockY || block.m_rate != rate)
+        {
+            const float centre = ((1 << shift) - 1) * 0.5f;
+            const float dx = (blockX << shift) + centre - fragIn.m_x;
+            const float dy = (blockY << shift) + centre - fragIn.m_y;
+            float interp[3];
+            float sum = 0;
+            for (int v = 0; v < 3; ++v)
+            {
+                interp[v] = fragIn.m_interpValues[v] + scan.m_stepX[v] * dx + scan.m_stepY[v] * dy;
+                interp[v] = interp[v] > 0 ? interp[v] : 0;
+                sum += interp[v];
+            }
+            for (int v = 0; v < 3; ++v)
+            {
+                interp[v] /= sum;
+            }
+
+            block.m_x = blockX;
+            block.m_y = blockY;
+            block.m_rate = rate;
+            block.m_color = ColorToBufferColor(ShadeFragment(input, interp));
+            ++counts->m_shaded;
+        }
+
+        buffers->m_color[pixel] = block.m_color;
+    }
+}
+
 static void TriangleShading(
     RasterBuffers* buffers,
     const TriangleInput& input,
-    const ScanData& scan)
+    const ScanData& scan,
+    ShadingCounts* counts)
 {
+    // Tiles for another size (the rates of the frame before a resize) are left alone
+    const ShadingRateTiles* tiles = buffers->m_shadingRates;
+    if (tiles && (tiles->m_width != (int)buffers->m_width ||
+        tiles->m_height != (int)buffers->m_height))
+    {
+        tiles = nullptr;
+    }
+
+    if (tiles || input.m_shadingRate != ShadingRate::Rate1x1)
+    {
+        TriangleShadingCoarse(buffers, input, scan, tiles, counts);
+        return;
+    }
+
     for (int i = 0; i < scan.m_fragmentsCount; ++i)
     {
         const FragmentInput& fragIn = scan.m_fragmentsIn[i];
+        const size_t pixel = fragIn.m_y * buffers->m_width + fragIn.m_x;
+
+        // Depth test before any shading work
+        if (buffers->m_depth && !DepthTest(buffers, input, fragIn, pixel))
+        {
+            continue;
+        }
+
+        if (input.m_reprojection && Reproject(*buffers, input, fragIn, &buffers->m_color[pixel]))
+        {
+            ++counts->m_reused;
+            continue;
+        }
+
+        buffers->m_color[pixel] = ColorToBufferColor(ShadeFragment(input, fragIn.m_interpValues));
+        ++counts->m_shaded;
+    }
+}
+
+// Bit 8 * row + column for each pixel of the block at (minX, minY) inside all three edges.
+// Weights are planes w = origin + stepX * column + stepY * row, evaluated a row of eight at a
+// time.
+static uint64_t SmallTriangleCoverage(
+    const float origin[3],
+    const float stepX[3],
+    const float stepY[3],
+    int width,
+    int height)
+{
+    const floatx8 zero(0);
+    const floatx8 columns(floatx4(0, 1, 2, 3), floatx4(4, 5, 6, 7));
+
+    floatx8 weights[3];
+    floatx8 rowStep[3];
+    for (int v = 0; v < 3; ++v)
+    {
+        weights[v] = floatx8(origin[v]) + floatx8(stepX[v]) * columns;
+        rowStep[v] = floatx8(stepY[v]);
+    }
+
+    const int columnMask = (1 << width) - 1;
+    uint64_t mask = 0;
+    for (int row = 0; row < height; ++row)
+    {
+        const maskx8 inside = (weights[0] >= zero) & (weights[1] >= zero) & (weights[2] >= zero);
+        mask |= (uint64_t)(floatxMoveMask(inside) & columnMask) << (8 * row);
 
-        // Calculate colour
-        vec4 baseColor = vec4(0, 0, 0, 0);
-        vec2 textureCoord = vec2(0, 0);
         for (int v = 0; v < 3; ++v)
         {
-            const VertexData& vertex = input.m_vertexArray[input.m_indices[v]];
+            weights[v] = weights[v] + rowStep[v];
+        }
+    }
+    return mask;
+}
+
+// Setup and traversal for triangles that fit in a kSmallTriangleBlock block, where the general
+// setup (normalised edge planes) costs more than covering the pixels. The weights come straight
+// from the edge functions, the same planes as TriangleSetup's up to rounding, and the fragments
+// are shaded as usual. Returns false, having done nothing, if the triangle is too big. perf,
+// when counting, is the sample the stages lap from.
+static bool RasterSmallTriangle(
+    RasterBuffers* buffers, const TriangleInput& input, PerfSample* perf)
+{
+    const vec4& p0 = input.m_vertexArray[input.m_indices[0]].m_pos;
+    const vec4& p1 = input.m_vertexArray[input.m_indices[1]].m_pos;
+    const vec4& p2 = input.m_vertexArray[input.m_indices[2]].m_pos;
 
-            float value = fragIn.m_interpValues[v];
+    // Same bounding box as TriangleSetup's, clipped to the buffers (and scissor)
+    const float lowX = p0.x < p1.x ? (p0.x < p2.x ? p0.x : p2.x) : (p1.x < p2.x ? p1.x : p2.x);
+    const float lowY = p0.y < p1.y ? (p0.y < p2.y ? p0.y : p2.y) : (p1.y < p2.y ? p1.y : p2.y);
+    const float highX = p0.x > p1.x ? (p0.x > p2.x ? p0.x : p2.x) : (p1.x > p2.x ? p1.x : p2.x);
+    const float highY = p0.y > p1.y ? (p0.y > p2.y ? p0.y : p2.y) : (p1.y > p2.y ? p1.y : p2.y);
+    const ScreenRect clip = ClipRect(*buffers);
+    const int minX = (int)lowX > clip.m_minX ? (int)lowX : clip.m_minX;
+    const int minY = (int)lowY > clip.m_minY ? (int)lowY : clip.m_minY;
+    const int maxX = ClampInt((int)highX, minX - 1, clip.m_maxX);
+    const int maxY = ClampInt((int)highY, minY - 1, clip.m_maxY);
+    const int width = maxX - minX + 1;
+    const int height = maxY - minY + 1;
+    if (width > kSmallTriangleBlock || height > kSmallTriangleBlock)
+    {
+        return false;
+    }
 
-            baseColor = baseColor + (vertex.m_color * value);
-            
-            textureCoord.x += vertex.m_textureCoord.x * value;
-            textureCoord.y += vertex.m_textureCoord.y * value;
+    const float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+    if (fabsf(area) < 1e-6f)
+    {
+        if (perf)
+        {
+            PerfCounters::Lap(PerfStage::SETUP, perf);
         }
-        
-        textureCoord.x = fmaxf(textureCoord.x, 0);
-        textureCoord.x = fminf(textureCoord.x, 1);
-        textureCoord.y = fmaxf(textureCoord.y, 0);
-        textureCoord.y = fminf(textureCoord.y, 1);
-        
-        // Texturing (clamp)
-        int texturePoint[2];
-        texturePoint[0] = (int)(textureCoord.x * input.m_texture.m_width);
-        texturePoint[1] = (int)(textureCoord.y * input.m_texture.m_height);
-        vec4 textureColor = BufferColorToColor(
-            input.m_texture.m_data[texturePoint[1] * input.m_texture.m_width + texturePoint[0]]);
-        
-        // Produce fragment
-        vec4 outColor = baseColor * textureColor;
-        buffers->m_color[fragIn.m_y * buffers->m_width + fragIn.m_x] = ColorToBufferColor(outColor);
+        return true;  // no area on screen, as in TriangleSetup
+    }
+
+    // Weight of vertex v: the edge function of the opposite edge over the area, positive inside
+    // for either winding
+    const vec4* const positions[3] = { &p0, &p1, &p2 };
+    const float invArea = 1 / area;
+    float origin[3];
+    float stepX[3];
+    float stepY[3];
+    for (int v = 0; v < 3; ++v)
+    {
+        const vec4& a = *positions[(v + 1) % 3];
+        const vec4& b = *positions[(v + 2) % 3];
+        stepX[v] = (a.y - b.y) * invArea;
+        stepY[v] = (b.x - a.x) * invArea;
+        origin[v] = ((b.x - a.x) * (minY - a.y) - (b.y - a.y) * (minX - a.x)) * invArea;
+    }
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::SETUP, perf);
     }
+
+    ScanData scan = {};
+    scan.m_fragmentsIn = buffers->m_fragmentsTmpBuffer;
+    for (int v = 0; v < 3; ++v)
+    {
+        scan.m_stepX[v] = stepX[v];
+        scan.m_stepY[v] = stepY[v];
+    }
+
+    const uint64_t mask =
+        width > 0 && height > 0 ? SmallTriangleCoverage(origin, stepX, stepY, width, height) : 0;
+    for (int row = 0; row < height && (mask >> (8 * row)); ++row)
+    {
+        int rowMask = (int)(mask >> (8 * row)) & 0xff;
+        for (int column = 0; rowMask; ++column, rowMask >>= 1)
+        {
+            if (rowMask & 1)
+            {
+                scan.m_fragmentsIn[scan.m_fragmentsCount++] = {
+                    minX + column,
+                    minY + row,
+                    {
+                        origin[0] + stepX[0] * column + stepY[0] * row,
+                        origin[1] + stepX[1] * column + stepY[1] * row,
+                        origin[2] + stepX[2] * column + stepY[2] * row } };
+            }
+        }
+    }
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::TRAVERSAL, perf);
+    }
+
+    ShadingCounts shading = {};
+    TriangleShading(buffers, input, scan, &shading);
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::SHADING, perf);
+    }
+
+    if (buffers->m_counters)
+    {
+        RasterCounters& counters = *buffers->m_counters;
+        ++counters.m_triangles;
+        counters.m_boundingBoxPixels += width > 0 && height > 0 ? (uint64_t)width * height : 0;
+        counters.m_fragments += scan.m_fragmentsCount;
+        counters.m_shadedFragments += shading.m_shaded;
+        counters.m_reusedFragments += shading.m_reused;
+    }
+
+    return true;
 }
 
 //
@@ -223,6 +884,20 @@ void Rasterizer::RasterTriangle(RasterBuffers* buffers, const TriangleInput& inp
 
     POW2_ASSERT(ColorToBufferColor(BufferColorToColor(0xafbfcfdf)) == 0xafbfcfdf);
 
+    // Hardware counters, when on, lap from here through the stages
+    PerfSample perfSample;
+    PerfSample* perf = nullptr;
+    if (PerfCounters::IsEnabled())
+    {
+        perf = &perfSample;
+        PerfCounters::Read(perf);
+    }
+
+    if (g_smallTrianglePath && RasterSmallTriangle(buffers, input, perf))
+    {
+        return;
+    }
+
     TriangleData triangleData;
     ScanData scanData;
 
@@ -233,21 +908,70 @@ void Rasterizer::RasterTriangle(RasterBuffers* buffers, const TriangleInput& inp
     DebugTimer_Tic("TriangleSetup");
 #endif
 
-    TriangleSetup(&triangleData, input);
+    bool visible = TriangleSetup(&triangleData, input);
     
 #if PROFILE
     profileSetupTimeMs = DebugTimer_Toc("TriangleSetup");
+#endif
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::SETUP, perf);
+    }
+
+    if (!visible)
+    {
+        return;
+    }
+
+    // Clip the bounding box to the buffers (and scissor)
+    const ScreenRect clip = ClipRect(*buffers);
+    triangleData.m_minX = fmaxf(triangleData.m_minX, (float)clip.m_minX);
+    triangleData.m_minY = fmaxf(triangleData.m_minY, (float)clip.m_minY);
+    triangleData.m_maxX = fminf(triangleData.m_maxX, (float)clip.m_maxX);
+    triangleData.m_maxY = fminf(triangleData.m_maxY, (float)clip.m_maxY);
+
+#if PROFILE
     DebugTimer_Tic("TriangleTraversal");
 #endif
     
     TriangleTraversal(&scanData, buffers->m_fragmentsTmpBuffer, input, triangleData);
+    for (int v = 0; v < 3; ++v)
+    {
+        // The weights are 1 - m_interpNormals[v] . (p - vertex v)
+        scanData.m_stepX[v] = -triangleData.m_interpNormals[v].x;
+        scanData.m_stepY[v] = -triangleData.m_interpNormals[v].y;
+    }
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::TRAVERSAL, perf);
+    }
 
 #if PROFILE
     profileTraversalTimeMs = DebugTimer_Toc("TriangleTraversal");
     DebugTimer_Tic("TriangleShading");
 #endif
     
-    TriangleShading(buffers, input, scanData);
+    ShadingCounts shading = {};
+    TriangleShading(buffers, input, scanData, &shading);
+
+    if (perf)
+    {
+        PerfCounters::Lap(PerfStage::SHADING, perf);
+    }
+
+    if (buffers->m_counters)
+    {
+        RasterCounters& counters = *buffers->m_counters;
+        const int width = (int)triangleData.m_maxX - (int)triangleData.m_minX + 1;
+        const int height = (int)triangleData.m_maxY - (int)triangleData.m_minY + 1;
+        ++counters.m_triangles;
+        counters.m_boundingBoxPixels += width > 0 && height > 0 ? (uint64_t)width * height : 0;
+        counters.m_fragments += scanData.m_fragmentsCount;
+        counters.m_shadedFragments += shading.m_shaded;
+        counters.m_reusedFragments += shading.m_reused;
+    }
     
 #if PROFILE
     profileShadingTimeMs = DebugTimer_Toc("TriangleShading");
@@ -271,3 +995,301 @@ void Rasterizer::RasterTriangle(RasterBuffers* buffers, const TriangleInput& inp
     Log::Debug("\tTime per generated fragment: %.0fns", timePerGeneratedFragmentNs);
 #endif
 }
+
+void Rasterizer::SetScanConversionMode(ScanConversionMode mode)
+{
+    POW2_ASSERT(mode >= ScanConversionMode(0) && mode < ScanConversionMode::Count);
+    g_scanConversionMode = mode;
+}
+
+ScanConversionMode Rasterizer::GetScanConversionMode()
+{
+    return g_scanConversionMode;
+}
+
+void Rasterizer::SetSmallTrianglePath(bool enabled)
+{
+    g_smallTrianglePath = enabled;
+}
+
+bool Rasterizer::GetSmallTrianglePath()
+{
+    return g_smallTrianglePath;
+}
+
+const char* Rasterizer::GetShadingRateName(ShadingRate rate)
+{
+    static_assert(
+        SizeOfArray(kShadingRateNames) == (size_t)ShadingRate::Count,
+        "One name per shading rate");
+    POW2_ASSERT(rate >= ShadingRate(0) && rate < ShadingRate::Count);
+    return kShadingRateNames[(int)rate];
+}
+
+const char* Rasterizer::GetScanConversionModeName(ScanConversionMode mode)
+{
+    static_assert(
+        SizeOfArray(kScanConversionModeNames) == (size_t)ScanConversionMode::Count,
+        "One name per mode");
+    POW2_ASSERT(mode >= ScanConversionMode(0) && mode < ScanConversionMode::Count);
+    return kScanConversionModeNames[(int)mode];
+}
+
+// Liang-Barsky clipping of the segment a -> b against [0, maxX] x [0, maxY]. Returns false if
+// nothing is left.
+static bool ClipLine(vec3* a, vec3* b, float maxX, float maxY)
+{
+    const float dx = b->x - a->x;
+    const float dy = b->y - a->y;
+    const float p[4] = { -dx, dx, -dy, dy };
+    const float q[4] = { a->x, maxX - a->x, a->y, maxY - a->y };
+
+    float t0 = 0;
+    float t1 = 1;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0)
+            {
+                return false;  // parallel and outside
+            }
+        }
+        else
+        {
+            const float t = q[i] / p[i];
+            if (p[i] < 0)
+            {
+                t0 = fmaxf(t0, t);
+            }
+            else
+            {
+                t1 = fminf(t1, t);
+            }
+        }
+    }
+
+    if (t0 > t1)
+    {
+        return false;
+    }
+
+    const vec3 delta = *b - *a;
+    const vec3 start = *a;
+    *a = start + delta * t0;
+    *b = start + delta * t1;
+    return true;
+}
+
+uint32_t Rasterizer::ShadeFragment(const TriangleInput& input, const float interpValues[3])
+{
+    return ColorToBufferColor(::ShadeFragment(input, interpValues));
+}
+
+void Rasterizer::RasterLines(RasterBuffers* buffers, const LineBatch& batch)
+{
+    POW2_ASSERT(buffers);
+    POW2_ASSERT(!batch.m_depthTest || buffers->m_depth);
+
+    uint32_t* color = buffers->m_color;
+    const float* depth = buffers->m_depth;
+    const int width = (int)buffers->m_width;
+    const float maxX = (float)buffers->m_width - 1;
+    const float maxY = (float)buffers->m_height - 1;
+
+    for (int i = 0; i < batch.m_edgeCount; ++i)
+    {
+        vec3 a = vec4xyz(batch.m_vertexArray[batch.m_edges[2 * i]].m_pos);
+        vec3 b = vec4xyz(batch.m_vertexArray[batch.m_edges[2 * i + 1]].m_pos);
+
+        // Most edges are fully on screen, only clip the rest
+        const bool inside =
+            a.x >= 0 && a.x <= maxX && a.y >= 0 && a.y <= maxY &&
+            b.x >= 0 && b.x <= maxX && b.y >= 0 && b.y <= maxY;
+        if (!inside && !ClipLine(&a, &b, maxX, maxY))
+        {
+            continue;
+        }
+
+        int x0 = (int)(a.x + 0.5f);
+        int y0 = (int)(a.y + 0.5f);
+        const int x1 = (int)(b.x + 0.5f);
+        const int y1 = (int)(b.y + 0.5f);
+
+        const int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+        const int dy = y1 > y0 ? y0 - y1 : y1 - y0;  // negative
+        const int stepX = x0 < x1 ? 1 : -1;
+        const int stepY = y0 < y1 ? width : -width;
+        const int steps = dx > -dy ? dx : -dy;
+
+        // Depth is linear along the segment in window space
+        float z = a.z - batch.m_depthBias;
+        const float dz = steps > 0 ? (b.z - a.z) / steps : 0;
+
+        int pixel = y0 * width + x0;
+        int error = dx + dy;
+
+        for (int step = 0; step <= steps; ++step)
+        {
+            if (!batch.m_depthTest || z <= depth[pixel])
+            {
+                color[pixel] = batch.m_color;
+            }
+
+            const int error2 = 2 * error;
+            if (error2 >= dy)
+            {
+                error += dy;
+                pixel += stepX;
+            }
+            if (error2 <= dx)
+            {
+                error += dx;
+                pixel += stepY;
+            }
+            z += dz;
+        }
+    }
+}
+
+void Rasterizer::RasterDepth(
+    DepthBuffer* target,
+    const VertexData* vertexArray,
+    const int* indices,
+    int indexCount)
+{
+    POW2_ASSERT(target);
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    float* depth = target->m_data;
+    const int width = target->m_width;
+    const int maxX = target->m_width - 1;
+    const int maxY = target->m_height - 1;
+
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        const vec4& v0 = vertexArray[indices[i]].m_pos;
+        const vec4& v1 = vertexArray[indices[i + 1]].m_pos;
+        const vec4& v2 = vertexArray[indices[i + 2]].m_pos;
+
+        // Twice the signed area. Either winding is accepted, edges are flipped to match.
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (fabsf(area) < 1e-6f)
+        {
+            continue;
+        }
+        const float sign = area > 0 ? 1.0f : -1.0f;
+        area *= sign;
+
+        int minX = (int)fmaxf(fminf(fminf(v0.x, v1.x), v2.x), 0);
+        int minY = (int)fmaxf(fminf(fminf(v0.y, v1.y), v2.y), 0);
+        int triMaxX = (int)fminf(fmaxf(fmaxf(v0.x, v1.x), v2.x), (float)maxX);
+        int triMaxY = (int)fminf(fmaxf(fmaxf(v0.y, v1.y), v2.y), (float)maxY);
+        if (minX > triMaxX || minY > triMaxY)
+        {
+            continue;
+        }
+
+        // Edge functions, each one is zero on an edge and positive on the side of the opposite
+        // vertex: e0 is edge v1 -> v2, e1 is v2 -> v0 and e2 is v0 -> v1.
+        const float e0dx = -(v2.y - v1.y) * sign;
+        const float e0dy = (v2.x - v1.x) * sign;
+        const float e1dx = -(v0.y - v2.y) * sign;
+        const float e1dy = (v0.x - v2.x) * sign;
+        const float e2dx = -(v1.y - v0.y) * sign;
+        const float e2dy = (v1.x - v0.x) * sign;
+
+        const float px = (float)minX;
+        const float py = (float)minY;
+        float e0Row = (px - v1.x) * e0dx + (py - v1.y) * e0dy;
+        float e1Row = (px - v2.x) * e1dx + (py - v2.y) * e1dy;
+        float e2Row = (px - v0.x) * e2dx + (py - v0.y) * e2dy;
+
+        // z plane: z = z0 + (e1 * (z1 - z0) + e2 * (z2 - z0)) / area
+        const float invArea = 1 / area;
+        const float dz1 = (v1.z - v0.z) * invArea;
+        const float dz2 = (v2.z - v0.z) * invArea;
+        const float zdx = e1dx * dz1 + e2dx * dz2;
+        const float zdy = e1dy * dz1 + e2dy * dz2;
+        float zRow = v0.z + e1Row * dz1 + e2Row * dz2;
+
+        for (int y = minY; y <= triMaxY; ++y)
+        {
+            float e0 = e0Row;
+            float e1 = e1Row;
+            float e2 = e2Row;
+            float z = zRow;
+            float* row = depth + y * width;
+            bool inside = false;
+
+            for (int x = minX; x <= triMaxX; ++x)
+            {
+                if (e0 >= 0 && e1 >= 0 && e2 >= 0)
+                {
+                    inside = true;
+                    if (z < row[x])
+                    {
+                        row[x] = z;
+                    }
+                }
+                else if (inside)
+                {
+                    break;  // triangles are convex, the rest of the row is outside
+                }
+
+                e0 += e0dx;
+                e1 += e1dx;
+                e2 += e2dx;
+                z += zdx;
+            }
+
+            e0Row += e0dy;
+            e1Row += e1dy;
+            e2Row += e2dy;
+            zRow += zdy;
+        }
+    }
+}
+
+void Rasterizer::ClearDepth(DepthBuffer* target, float value)
+{
+    POW2_ASSERT(target);
+
+    const int count = target->m_width * target->m_height;
+    for (int i = 0; i < count; ++i)
+    {
+        target->m_data[i] = value;
+    }
+}
+
+float Rasterizer::SampleShadow(
+    const DepthBuffer& shadowMap,
+    const vec3& position,
+    float bias,
+    int pcfRadius)
+{
+    const int x = (int)position.x;
+    const int y = (int)position.y;
+    if (x < 0 || y < 0 || x >= shadowMap.m_width || y >= shadowMap.m_height)
+    {
+        return 1;
+    }
+
+    const float depth = position.z - bias;
+    int lit = 0;
+    int samples = 0;
+
+    for (int sy = y - pcfRadius; sy <= y + pcfRadius; ++sy)
+    {
+        const int rowY = ClampInt(sy, 0, shadowMap.m_height - 1);
+        const float* row = shadowMap.m_data + rowY * shadowMap.m_width;
+
+        for (int sx = x - pcfRadius; sx <= x + pcfRadius; ++sx)
+        {
+            lit += (depth <= row[ClampInt(sx, 0, shadowMap.m_width - 1)]);
+            ++samples;
+        }
+    }
+
+    return lit / (float)samples;
+}
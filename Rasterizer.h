@@ -2,20 +2,60 @@
 
 #include "Geometry.h"
 #include "MathUtils.h"
+#include "Texture.h"
 
 #include <stddef.h>
 #include <stdint.h>
 
+struct LightGrid;
+struct ShadingRateTiles;
+
 //
 // RASTERIZER INPUT: triangles
 // RASTERIZER OUTPUT: buffers
 //
 
-struct TextureData
+struct DepthBuffer
 {
+    float* m_data;  // m_width * m_height, smaller is nearer
     int m_width;
     int m_height;
-    uint32_t* m_data;
+};
+
+struct ShadowInput
+{
+    const DepthBuffer* m_shadowMap;  // rendered with Rasterizer::RasterDepth
+    const vec4* m_shadowCoords;      // per vertex light window coordinates, same indices as
+                                     // TriangleInput::m_vertexArray
+    float m_bias;
+    int m_pcfRadius;  // 0 is a single sample, n filters (2n + 1)^2 samples
+};
+
+// Last frame's shading, to reuse where the same surface was visible then (reverse reprojection).
+// A fragment's position last frame comes from its vertices' positions then, with its weights.
+// When the depth stored there matches, the colour stored there is taken instead of shading.
+// Pixels are also shaded in turn whatever the test says, 1 / m_refreshFrames of them a frame,
+// so shading that changes where the surface doesn't catches up within m_refreshFrames frames.
+struct ReprojectionInput
+{
+    const vec4* m_previousPositions;  // per vertex window coordinates last frame, same indices
+                                      // as TriangleInput::m_vertexArray
+    const uint32_t* m_previousColor;  // last frame's buffers, the size of this frame's
+    const float* m_previousDepth;
+    float m_depthTolerance;  // window depth
+    int m_refreshFrames;
+    int m_refreshPhase;  // this frame's turn, 0 to m_refreshFrames - 1
+};
+
+// Pixels per shading of the fragment shader. Coverage and depth stay per pixel: coarse rates
+// shade each NxN block of the buffer (at multiples of N) once, at its centre, and every pixel
+// of it the triangle covers and that passes the depth test gets that colour.
+enum class ShadingRate
+{
+    Rate1x1,  // every pixel, the default
+    Rate2x2,
+    Rate4x4,
+    Count
 };
 
 struct TriangleInput
@@ -23,6 +63,10 @@ struct TriangleInput
     const VertexData* m_vertexArray;
     TextureData m_texture;
     int m_indices[3];  // Clockwise
+    const ShadowInput* m_shadow;  // optional
+    const LightGrid* m_lighting;  // optional, Blinn-Phong with the vertex normals
+    ShadingRate m_shadingRate;    // of the draw, RasterBuffers::m_shadingRates can make it coarser
+    const ReprojectionInput* m_reprojection;  // optional
 };
 
 struct FragmentInput
@@ -33,19 +77,101 @@ struct FragmentInput
     float m_interpValues[3];
 };
 
+struct RasterCounters  // added to by RasterTriangle, zero to start counting
+{
+    uint64_t m_triangles;          // that reached traversal
+    uint64_t m_boundingBoxPixels;  // of those triangles, clipped to the buffers
+    uint64_t m_fragments;          // covered pixels, before the depth test
+    uint64_t m_shadedFragments;    // times the fragment shader ran, after the depth test
+    uint64_t m_reusedFragments;    // taken from the last frame instead (reprojection)
+};
+
+struct ScreenRect
+{
+    int m_minX;  // pixels, inclusive
+    int m_minY;
+    int m_maxX;
+    int m_maxY;
+};
+
 struct RasterBuffers
 {
     uint32_t* m_color;
     FragmentInput* m_fragmentsTmpBuffer;
-    //uint32_t* m_depth;
+    float* m_depth;  // optional, smaller is nearer (same convention as DepthBuffer)
+    RasterCounters* m_counters;  // optional
+    const ScreenRect* m_scissor;  // optional, triangles leave pixels outside alone (not lines)
+    const ShadingRateTiles* m_shadingRates;  // optional, the coarser of the tile's and the draw's
     size_t m_width;
     size_t m_height;
     size_t m_colorBufferBytes;
     size_t m_fragmentsTmpBufferBytes;
+    size_t m_depthBufferBytes;
     size_t m_bytesPerPixel;
 };
 
+// Ways of finding the pixels a triangle covers, kept side by side to compare their performance
+// (Tools/Benchmark.cpp "variants"). They cover the same pixels, with weights that only differ
+// by rounding.
+enum class ScanConversionMode
+{
+    FirstApproach,     // every pixel of the bounding box, weights from the edge planes
+    IncrementalEdges,  // weights stepped pixel to pixel, rows end when they leave the triangle
+    RowSpans,          // each row's span solved from the edges, no per pixel tests
+    Count
+};
+
+struct LineBatch
+{
+    const VertexData* m_vertexArray;  // window coordinates
+    const int* m_edges;  // pairs of indices into m_vertexArray
+    int m_edgeCount;
+    uint32_t m_color;
+    bool m_depthTest;   // against RasterBuffers::m_depth, which lines never write
+    float m_depthBias;  // pulls lines towards the viewer so they win over their own faces
+};
+
 namespace Rasterizer
 {
     void RasterTriangle(RasterBuffers* buffers, const TriangleInput& input);
+
+    // Used by every following RasterTriangle, FirstApproach by default
+    void SetScanConversionMode(ScanConversionMode mode);
+    ScanConversionMode GetScanConversionMode();
+    const char* GetScanConversionModeName(ScanConversionMode mode);
+
+    // Triangles whose bounding box fits in 8x8 pixels skip setup and the scan conversion mode:
+    // their coverage is worked out for the whole block at once as a bit mask. On by default,
+    // the image only changes by rounding.
+    void SetSmallTrianglePath(bool enabled);
+    bool GetSmallTrianglePath();
+
+    const char* GetShadingRateName(ShadingRate rate);
+
+    // Shading stage on its own, for other backends: returns the colour of a point of the
+    // triangle given the weights of its three vertices. Sampling goes through the texture's
+    // block cache, so give each thread its own.
+    uint32_t ShadeFragment(const TriangleInput& input, const float interpValues[3]);
+
+    // One pixel wide lines, clipped to the buffers and drawn with integer Bresenham
+    void RasterLines(RasterBuffers* buffers, const LineBatch& batch);
+
+    // Depth only path for shadow maps and depth pre-passes. Renders a list of triangles (window
+    // coordinates, indices as in TriangleInput) with edge functions and a z plane only: no
+    // attribute setup, no fragment storage and no shading.
+    void RasterDepth(
+        DepthBuffer* target,
+        const VertexData* vertexArray,
+        const int* indices,
+        int indexCount);
+
+    void ClearDepth(DepthBuffer* target, float value);
+
+    // Returns the lit fraction (0..1) of a point given in the shadow map's window coordinates.
+    // Points outside the shadow map are lit.
+    float SampleShadow(
+        const DepthBuffer& shadowMap,
+        const vec3& position,
+        float bias,
+        int pcfRadius);
 }
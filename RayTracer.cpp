@@ -0,0 +1,646 @@
+#include "RayTracer.h"
+
+#include "DebugTimer.h"
+#include "Memory.h"
+#include "ThreadPool.h"
+
+#include "External/pow2assert.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <emmintrin.h>
+
+//
+// CONFIGURATION
+//
+
+static const int kBinCount = 16;
+static const int kMaxLeafTriangles = 4;
+static const float kTraversalCost = 1.0f;     // SAH cost of visiting a node...
+static const float kIntersectionCost = 1.0f;  // ...relative to testing a triangle
+static const int kTileSize = 32;  // pixels, one thread pool task each
+static const int kMaxStackDepth = 64;  // traversal holds at most a node's depth + 2 entries
+
+// SAH splits can be lopsided without limit on pathological meshes. Past kMedianSplitDepth nodes
+// are split at the centroid median instead, which halves them, so even INT_MAX triangles are
+// down to leaves within 31 more levels and the tree fits the traversal stack.
+static const int kMaxBvhDepth = kMaxStackDepth - 2;
+static const int kMedianSplitDepth = kMaxBvhDepth - 31;
+
+//
+// BUILD
+//
+
+struct Aabb
+{
+    vec3 m_min;
+    vec3 m_max;
+};
+
+static inline void AabbReset(Aabb* box)
+{
+    box->m_min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    box->m_max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+static inline void AabbGrow(Aabb* box, const vec3& p)
+{
+    box->m_min = vec3(fminf(box->m_min.x, p.x), fminf(box->m_min.y, p.y), fminf(box->m_min.z, p.z));
+    box->m_max = vec3(fmaxf(box->m_max.x, p.x), fmaxf(box->m_max.y, p.y), fmaxf(box->m_max.z, p.z));
+}
+
+// Union, so growing by an empty (reset) box leaves box unchanged
+static inline void AabbGrow(Aabb* box, const Aabb& other)
+{
+    box->m_min = vec3(
+        fminf(box->m_min.x, other.m_min.x),
+        fminf(box->m_min.y, other.m_min.y),
+        fminf(box->m_min.z, other.m_min.z));
+    box->m_max = vec3(
+        fmaxf(box->m_max.x, other.m_max.x),
+        fmaxf(box->m_max.y, other.m_max.y),
+        fmaxf(box->m_max.z, other.m_max.z));
+}
+
+static inline float AabbHalfArea(const Aabb& box)
+{
+    const vec3 e = box.m_max - box.m_min;
+    return e.x < 0 ? 0 : e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static inline float Component(const vec3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+struct BuildContext
+{
+    Bvh* m_bvh;
+    std::vector<Aabb> m_bounds;     // per triangle
+    std::vector<vec3> m_centroids;  // per triangle
+};
+
+static void SetNodeBounds(BvhNode* node, const Aabb& box)
+{
+    node->m_min[0] = box.m_min.x;
+    node->m_min[1] = box.m_min.y;
+    node->m_min[2] = box.m_min.z;
+    node->m_max[0] = box.m_max.x;
+    node->m_max[1] = box.m_max.y;
+    node->m_max[2] = box.m_max.z;
+}
+
+// Finds the cheapest split over kBinCount centroid bins per axis and partitions the triangles
+// at it. Returns the triangles on the left, or 0 if the node is better off as a leaf.
+static int SahSplit(
+    BuildContext* context,
+    const Aabb& bounds,
+    const Aabb& centroidBounds,
+    int first,
+    int count)
+{
+    int* triangles = context->m_bvh->m_triangles.data();
+
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestSplit = 0;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float minC = Component(centroidBounds.m_min, axis);
+        const float extent = Component(centroidBounds.m_max, axis) - minC;
+        if (extent <= 0)
+        {
+            continue;
+        }
+
+        Aabb binBounds[kBinCount];
+        int binCounts[kBinCount] = {};
+        for (int b = 0; b < kBinCount; ++b)
+        {
+            AabbReset(&binBounds[b]);
+        }
+
+        const float scale = kBinCount / extent;
+        for (int i = first; i < first + count; ++i)
+        {
+            const int t = triangles[i] / 3;
+            int b = (int)((Component(context->m_centroids[t], axis) - minC) * scale);
+            b = b < kBinCount ? b : kBinCount - 1;
+            ++binCounts[b];
+            AabbGrow(&binBounds[b], context->m_bounds[t]);
+        }
+
+        // Sweep from the right to get the cost of every right side, then from the left
+        float rightAreas[kBinCount];
+        int rightCounts[kBinCount];
+        Aabb right;
+        AabbReset(&right);
+        int rightCount = 0;
+        for (int b = kBinCount - 1; b > 0; --b)
+        {
+            AabbGrow(&right, binBounds[b]);
+            rightCount += binCounts[b];
+            rightAreas[b] = AabbHalfArea(right);
+            rightCounts[b] = rightCount;
+        }
+
+        Aabb left;
+        AabbReset(&left);
+        int leftCount = 0;
+        for (int split = 1; split < kBinCount; ++split)
+        {
+            AabbGrow(&left, binBounds[split - 1]);
+            leftCount += binCounts[split - 1];
+            if (leftCount == 0 || rightCounts[split] == 0)
+            {
+                continue;
+            }
+
+            const float cost =
+                AabbHalfArea(left) * leftCount + rightAreas[split] * rightCounts[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    const float leafCost = kIntersectionCost * count;
+    const float splitCost =
+        kTraversalCost + kIntersectionCost * bestCost / fmaxf(AabbHalfArea(bounds), 1e-12f);
+    if (bestAxis < 0 || (splitCost >= leafCost && count <= kMaxLeafTriangles))
+    {
+        return 0;
+    }
+
+    const float minC = Component(centroidBounds.m_min, bestAxis);
+    const float scale = kBinCount / (Component(centroidBounds.m_max, bestAxis) - minC);
+    int* middle = std::partition(triangles + first, triangles + first + count, [&](int index) {
+        int b = (int)((Component(context->m_centroids[index / 3], bestAxis) - minC) * scale);
+        return (b < kBinCount ? b : kBinCount - 1) < bestSplit;
+    });
+
+    const int leftCount = (int)(middle - (triangles + first));
+    POW2_ASSERT(leftCount > 0 && leftCount < count);
+    return leftCount;
+}
+
+// Splits the triangles at the median centroid along the widest axis
+static int MedianSplit(BuildContext* context, const Aabb& centroidBounds, int first, int count)
+{
+    const vec3 extent = centroidBounds.m_max - centroidBounds.m_min;
+    const int axis =
+        extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    int* triangles = context->m_bvh->m_triangles.data();
+    const int leftCount = count / 2;
+    std::nth_element(triangles + first, triangles + first + leftCount, triangles + first + count,
+        [&](int a, int b) {
+            return Component(context->m_centroids[a / 3], axis) <
+                Component(context->m_centroids[b / 3], axis);
+        });
+    return leftCount;
+}
+
+static void Subdivide(BuildContext* context, int nodeIndex, int first, int count, int depth)
+{
+    Bvh* bvh = context->m_bvh;
+    int* triangles = bvh->m_triangles.data();
+
+    Aabb bounds;
+    Aabb centroidBounds;
+    AabbReset(&bounds);
+    AabbReset(&centroidBounds);
+    for (int i = first; i < first + count; ++i)
+    {
+        const int t = triangles[i] / 3;
+        AabbGrow(&bounds, context->m_bounds[t]);
+        AabbGrow(&centroidBounds, context->m_centroids[t]);
+    }
+
+    BvhNode* node = &bvh->m_nodes[nodeIndex];
+    SetNodeBounds(node, bounds);
+    node->m_leftFirst = first;
+    node->m_count = count;
+
+    if (count <= 2)
+    {
+        return;
+    }
+
+    POW2_ASSERT(depth < kMaxBvhDepth);
+    int leftCount;
+    if (depth >= kMedianSplitDepth)
+    {
+        leftCount = MedianSplit(context, centroidBounds, first, count);
+    }
+    else
+    {
+        leftCount = SahSplit(context, bounds, centroidBounds, first, count);
+        if (leftCount == 0)
+        {
+            return;
+        }
+    }
+
+    const int leftIndex = bvh->m_nodeCount;
+    bvh->m_nodeCount += 2;
+
+    node = &bvh->m_nodes[nodeIndex];
+    node->m_leftFirst = leftIndex;
+    node->m_count = 0;
+
+    Subdivide(context, leftIndex, first, leftCount, depth + 1);
+    Subdivide(context, leftIndex + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+void RayTracer::BuildBvh(
+    Bvh* bvh,
+    const VertexData* vertexArray,
+    const int* indices,
+    int indexCount)
+{
+    POW2_ASSERT(bvh);
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    const int triangleCount = indexCount / 3;
+
+    BuildContext context;
+    context.m_bvh = bvh;
+    context.m_bounds.resize(triangleCount);
+    context.m_centroids.resize(triangleCount);
+
+    bvh->m_triangles.resize(triangleCount);
+    bvh->m_nodes.resize(triangleCount > 0 ? 2 * triangleCount - 1 : 1);
+    bvh->m_nodeCount = 1;
+
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        Aabb& box = context.m_bounds[t];
+        AabbReset(&box);
+        for (int v = 0; v < 3; ++v)
+        {
+            AabbGrow(&box, vec4xyz(vertexArray[indices[3 * t + v]].m_pos));
+        }
+        context.m_centroids[t] = (box.m_min + box.m_max) * 0.5f;
+        bvh->m_triangles[t] = 3 * t;
+    }
+
+    Subdivide(&context, 0, 0, triangleCount, 0);
+}
+
+void RayTracer::RefitBvh(Bvh* bvh, const VertexData* vertexArray, const int* indices)
+{
+    POW2_ASSERT(bvh);
+
+    // Children are stored after their parents, so a reverse walk is bottom up
+    for (int n = bvh->m_nodeCount - 1; n >= 0; --n)
+    {
+        BvhNode* node = &bvh->m_nodes[n];
+        Aabb box;
+        AabbReset(&box);
+
+        if (node->m_count > 0)
+        {
+            for (int i = node->m_leftFirst; i < node->m_leftFirst + node->m_count; ++i)
+            {
+                const int first = bvh->m_triangles[i];
+                for (int v = 0; v < 3; ++v)
+                {
+                    AabbGrow(&box, vec4xyz(vertexArray[indices[first + v]].m_pos));
+                }
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 2; ++c)
+            {
+                const BvhNode& child = bvh->m_nodes[node->m_leftFirst + c];
+                AabbGrow(&box, vec3(child.m_min[0], child.m_min[1], child.m_min[2]));
+                AabbGrow(&box, vec3(child.m_max[0], child.m_max[1], child.m_max[2]));
+            }
+        }
+
+        SetNodeBounds(node, box);
+    }
+}
+
+//
+// TRAVERSAL
+//
+// Four rays at a time (a 2x2 pixel quad), one per SSE lane.
+//
+
+struct RayPacket
+{
+    __m128 m_originX;
+    __m128 m_originY;
+    __m128 m_originZ;
+    __m128 m_dirX;
+    __m128 m_dirY;
+    __m128 m_dirZ;
+    __m128 m_invDirX;
+    __m128 m_invDirY;
+    __m128 m_invDirZ;
+
+    // Closest hit so far
+    __m128 m_t;  // 0 for lanes that don't trace anything
+    __m128 m_u;
+    __m128 m_v;
+    __m128i m_triangle;  // first index of the triangle, -1 if nothing was hit
+};
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Returns a lane mask of the rays that enter the node before their closest hit
+static inline int IntersectBox(const RayPacket& packet, const BvhNode& node)
+{
+    const __m128 minX = _mm_set1_ps(node.m_min[0]);
+    const __m128 minY = _mm_set1_ps(node.m_min[1]);
+    const __m128 minZ = _mm_set1_ps(node.m_min[2]);
+    const __m128 maxX = _mm_set1_ps(node.m_max[0]);
+    const __m128 maxY = _mm_set1_ps(node.m_max[1]);
+    const __m128 maxZ = _mm_set1_ps(node.m_max[2]);
+
+    const __m128 t1x = _mm_mul_ps(_mm_sub_ps(minX, packet.m_originX), packet.m_invDirX);
+    const __m128 t2x = _mm_mul_ps(_mm_sub_ps(maxX, packet.m_originX), packet.m_invDirX);
+    const __m128 t1y = _mm_mul_ps(_mm_sub_ps(minY, packet.m_originY), packet.m_invDirY);
+    const __m128 t2y = _mm_mul_ps(_mm_sub_ps(maxY, packet.m_originY), packet.m_invDirY);
+    const __m128 t1z = _mm_mul_ps(_mm_sub_ps(minZ, packet.m_originZ), packet.m_invDirZ);
+    const __m128 t2z = _mm_mul_ps(_mm_sub_ps(maxZ, packet.m_originZ), packet.m_invDirZ);
+
+    __m128 tNear = _mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y));
+    __m128 tFar = _mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y));
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t1z, t2z));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t1z, t2z));
+    tNear = _mm_max_ps(tNear, _mm_setzero_ps());
+    tFar = _mm_min_ps(tFar, packet.m_t);
+
+    return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+
+// Moller-Trumbore, updating the closest hit of every lane
+static inline void IntersectTriangle(
+    RayPacket* packet,
+    const VertexData* vertexArray,
+    const int* indices,
+    int first)
+{
+    const vec4& p0 = vertexArray[indices[first]].m_pos;
+    const vec4& p1 = vertexArray[indices[first + 1]].m_pos;
+    const vec4& p2 = vertexArray[indices[first + 2]].m_pos;
+
+    const __m128 e1x = _mm_set1_ps(p1.x - p0.x);
+    const __m128 e1y = _mm_set1_ps(p1.y - p0.y);
+    const __m128 e1z = _mm_set1_ps(p1.z - p0.z);
+    const __m128 e2x = _mm_set1_ps(p2.x - p0.x);
+    const __m128 e2y = _mm_set1_ps(p2.y - p0.y);
+    const __m128 e2z = _mm_set1_ps(p2.z - p0.z);
+
+    // p = dir x e2
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(packet->m_dirY, e2z), _mm_mul_ps(packet->m_dirZ, e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(packet->m_dirZ, e2x), _mm_mul_ps(packet->m_dirX, e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(packet->m_dirX, e2y), _mm_mul_ps(packet->m_dirY, e2x));
+
+    const __m128 det = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // s = origin - p0
+    const __m128 sx = _mm_sub_ps(packet->m_originX, _mm_set1_ps(p0.x));
+    const __m128 sy = _mm_sub_ps(packet->m_originY, _mm_set1_ps(p0.y));
+    const __m128 sz = _mm_sub_ps(packet->m_originZ, _mm_set1_ps(p0.z));
+
+    const __m128 u = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)),
+        invDet);
+
+    // q = s x e1
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+    const __m128 v = _mm_mul_ps(
+        _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(packet->m_dirX, qx), _mm_mul_ps(packet->m_dirY, qy)),
+            _mm_mul_ps(packet->m_dirZ, qz)),
+        invDet);
+    const __m128 t = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+        invDet);
+
+    // Edges are inclusive like the rasterizer's, so shared edges have no cracks
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 hit = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, packet->m_t));
+
+    if (_mm_movemask_ps(hit) == 0)
+    {
+        return;
+    }
+
+    packet->m_t = Select(hit, t, packet->m_t);
+    packet->m_u = Select(hit, u, packet->m_u);
+    packet->m_v = Select(hit, v, packet->m_v);
+    packet->m_triangle = _mm_castps_si128(Select(
+        hit, _mm_castsi128_ps(_mm_set1_epi32(first)), _mm_castsi128_ps(packet->m_triangle)));
+}
+
+static void TracePacket(
+    RayPacket* packet,
+    const Bvh& bvh,
+    const VertexData* vertexArray,
+    const int* indices)
+{
+    int stack[kMaxStackDepth];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    const BvhNode* nodes = bvh.m_nodes.data();
+    const int* triangles = bvh.m_triangles.data();
+    const bool dirZPositive = _mm_movemask_ps(_mm_cmpge_ps(packet->m_dirZ, _mm_setzero_ps())) != 0;
+
+    while (stackSize > 0)
+    {
+        const BvhNode& node = nodes[stack[--stackSize]];
+
+        if (!IntersectBox(*packet, node))
+        {
+            continue;
+        }
+
+        if (node.m_count > 0)
+        {
+            for (int i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; ++i)
+            {
+                IntersectTriangle(packet, vertexArray, indices, triangles[i]);
+            }
+            continue;
+        }
+
+        // Visit the child nearest along the rays first so the far one is more likely culled
+        POW2_ASSERT(stackSize + 2 <= kMaxStackDepth);
+        const int left = node.m_leftFirst;
+        const bool leftFirst = (nodes[left].m_min[2] <= nodes[left + 1].m_min[2]) == dirZPositive;
+        stack[stackSize++] = leftFirst ? left + 1 : left;
+        stack[stackSize++] = leftFirst ? left : left + 1;
+    }
+}
+
+//
+// RENDERING
+//
+
+struct TraceJob
+{
+    RasterBuffers* m_buffers;
+    const Bvh* m_bvh;
+    const VertexData* m_vertexArray;
+    const int* m_indices;
+    TextureData m_texture;
+    const LightGrid* m_lighting;
+    int m_tilesX;
+    float m_originZ;
+};
+
+static void TraceTile(int tileIndex, int threadIndex, void* userData)
+{
+    const TraceJob& job = *(const TraceJob*)userData;
+    RasterBuffers* buffers = job.m_buffers;
+
+    const int width = (int)buffers->m_width;
+    const int height = (int)buffers->m_height;
+    const int minX = (tileIndex % job.m_tilesX) * kTileSize;
+    const int minY = (tileIndex / job.m_tilesX) * kTileSize;
+    const int maxX = minX + kTileSize < width ? minX + kTileSize : width;
+    const int maxY = minY + kTileSize < height ? minY + kTileSize : height;
+
+    // The block cache isn't thread safe, give each tile its own out of the thread's scratch
+    Arena* scratch = Memory::GetThreadArena(threadIndex);
+    const size_t scratchMark = Memory::GetMark(*scratch);
+    TriangleInput input = { job.m_vertexArray, job.m_texture };
+    input.m_lighting = job.m_lighting;
+    if (input.m_texture.m_blockCache)
+    {
+        TextureBlockCache* cache = Memory::PushArray<TextureBlockCache>(scratch, 1);
+        *cache = {};
+        input.m_texture.m_blockCache = cache;
+    }
+
+    for (int y = minY; y < maxY; y += 2)
+    {
+        for (int x = minX; x < maxX; x += 2)
+        {
+            // Pixels are sampled at integer coordinates, like RasterTriangle does
+            RayPacket packet;
+            packet.m_originX = _mm_setr_ps((float)x, (float)x + 1, (float)x, (float)x + 1);
+            packet.m_originY = _mm_setr_ps((float)y, (float)y, (float)y + 1, (float)y + 1);
+            packet.m_originZ = _mm_set1_ps(job.m_originZ);
+            packet.m_dirX = _mm_setzero_ps();
+            packet.m_dirY = _mm_setzero_ps();
+            packet.m_dirZ = _mm_set1_ps(1.0f);
+            packet.m_invDirX = _mm_set1_ps(1e30f);  // avoids inf * 0 = NaN in the slab test
+            packet.m_invDirY = _mm_set1_ps(1e30f);
+            packet.m_invDirZ = _mm_set1_ps(1.0f);
+            packet.m_u = _mm_setzero_ps();
+            packet.m_v = _mm_setzero_ps();
+            packet.m_triangle = _mm_set1_epi32(-1);
+
+            // Lanes outside the buffers (odd sizes) don't trace anything
+            const bool inX = (x + 1 < maxX);
+            const bool inY = (y + 1 < maxY);
+            packet.m_t = _mm_setr_ps(FLT_MAX, inX ? FLT_MAX : 0, inY ? FLT_MAX : 0,
+                inX && inY ? FLT_MAX : 0);
+
+            TracePacket(&packet, *job.m_bvh, job.m_vertexArray, job.m_indices);
+
+            float t[4];
+            float u[4];
+            float v[4];
+            int triangle[4];
+            _mm_storeu_ps(t, packet.m_t);
+            _mm_storeu_ps(u, packet.m_u);
+            _mm_storeu_ps(v, packet.m_v);
+            _mm_storeu_si128((__m128i*)triangle, packet.m_triangle);
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (triangle[lane] < 0)
+                {
+                    continue;
+                }
+
+                const size_t pixel = (y + lane / 2) * buffers->m_width + x + lane % 2;
+                const float z = job.m_originZ + t[lane];
+                if (buffers->m_depth)
+                {
+                    if (z > buffers->m_depth[pixel])
+                    {
+                        continue;
+                    }
+                    buffers->m_depth[pixel] = z;
+                }
+
+                const int first = triangle[lane];
+                input.m_indices[0] = job.m_indices[first];
+                input.m_indices[1] = job.m_indices[first + 1];
+                input.m_indices[2] = job.m_indices[first + 2];
+                const float interp[3] = { 1 - u[lane] - v[lane], u[lane], v[lane] };
+
+                buffers->m_color[pixel] = Rasterizer::ShadeFragment(input, interp);
+            }
+        }
+    }
+
+    Memory::ResetToMark(scratch, scratchMark);
+}
+
+RayTracerStats RayTracer::Trace(
+    RasterBuffers* buffers,
+    const Bvh& bvh,
+    const VertexData* vertexArray,
+    const int* indices,
+    const TextureData& texture,
+    const LightGrid* lighting)
+{
+    POW2_ASSERT(buffers);
+
+    RayTracerStats stats = {};
+
+    if (bvh.m_triangles.empty())
+    {
+        return stats;
+    }
+
+    DebugTimer_Tic("RayTracer");
+
+    TraceJob job;
+    job.m_buffers = buffers;
+    job.m_bvh = &bvh;
+    job.m_vertexArray = vertexArray;
+    job.m_indices = indices;
+    job.m_texture = texture;
+    job.m_lighting = lighting;
+    job.m_tilesX = ((int)buffers->m_width + kTileSize - 1) / kTileSize;
+    job.m_originZ = bvh.m_nodes[0].m_min[2] - 1;  // in front of everything
+
+    const int tilesY = ((int)buffers->m_height + kTileSize - 1) / kTileSize;
+    ThreadPool::ParallelFor(job.m_tilesX * tilesY, TraceTile, &job);
+
+    stats.m_rays = (int)(buffers->m_width * buffers->m_height);
+    stats.m_timeMs = DebugTimer_Toc("RayTracer");
+    stats.m_mraysPerSecond = stats.m_rays / (stats.m_timeMs * 1000);
+    return stats;
+}
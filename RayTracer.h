@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Geometry.h"
+#include "Rasterizer.h"
+
+#include <vector>
+
+//
+// RAY TRACER INPUT: the rasterizer's window space VertexData arrays and index lists
+// RAY TRACER OUTPUT: the rasterizer's buffers
+//
+// Primary rays are orthographic along +z from every pixel, which is the projection the
+// rasterizer uses, so both backends render the same image (up to rounding at texel edges).
+//
+
+struct BvhNode  // 32 bytes
+{
+    float m_min[3];
+    int m_leftFirst;  // first of two consecutive children (inner node) or first triangle (leaf)
+    float m_max[3];
+    int m_count;      // triangles in a leaf, 0 for inner nodes
+};
+
+struct Bvh
+{
+    std::vector<BvhNode> m_nodes;  // children are always stored after their parent
+    std::vector<int> m_triangles;  // index of the first index of each triangle, leaf order
+    int m_nodeCount;
+};
+
+struct RayTracerStats
+{
+    int m_rays;
+    double m_timeMs;
+    double m_mraysPerSecond;
+};
+
+namespace RayTracer
+{
+    // Binned SAH build
+    void BuildBvh(Bvh* bvh, const VertexData* vertexArray, const int* indices, int indexCount);
+
+    // Recomputes the bounds after vertices moved, keeping the tree. Much cheaper than a rebuild,
+    // but quality degrades if triangles move a lot relative to each other.
+    void RefitBvh(Bvh* bvh, const VertexData* vertexArray, const int* indices);
+
+    // Traces and shades one ray per pixel, in 2x2 SSE packets spread over the thread pool.
+    // Writes colour (and depth if there's a depth buffer) for pixels that hit something.
+    // lighting is optional, as in TriangleInput.
+    RayTracerStats Trace(
+        RasterBuffers* buffers,
+        const Bvh& bvh,
+        const VertexData* vertexArray,
+        const int* indices,
+        const TextureData& texture,
+        const LightGrid* lighting);
+}
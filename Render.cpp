@@ -1,29 +1,209 @@
+#include "Render.h"
+
 #include "DebugTimer.h"
+#include "DirtyRegion.h"
+#include "Lighting.h"
+#include "MathSimd.h"
 #include "MathUtils.h"
+#include "MeshFile.h"
+#include "Occlusion.h"
+#include "Particles.h"
+#include "PerfCounters.h"
 #include "Rasterizer.h"
+#include "RayTracer.h"
+#include "ShadingRates.h"
 #include "SizeOfArray.h"
+#include "ThreadPool.h"
+#include "Wireframe.h"
 
 #include "External/pow2assert.h"
 
+#include <algorithm>
+#include <float.h>
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
+#include <vector>
 
-enum class RenderMode
+// The next frame's vertices, see StartNextVertices
+struct NextVerticesData
 {
-    NORMAL,
-    WIREFRAME
+    RasterBuffers m_buffers;  // a copy, only the size is read
+    float m_spinAngle;
+    int m_lod;
+    int m_slot;
+    bool m_pending;  // started and not taken (or dropped) by a frame yet
 };
 
-struct RenderState
+struct RenderState  // zero is initialisation
 {
     RenderMode m_mode;
+    RenderBackend m_backend;
+    bool m_rain;
+
+    // A frame is a graph of jobs, kept after the frame for its timings
+    JobGraph m_jobs;
+
+    // Mesh window vertices only depend on the window size, they're redone when it changes
+    size_t m_meshVerticesWidth;
+    size_t m_meshVerticesHeight;
+
+    // Mesh clusters hidden behind the occluders, worked out again with the vertices
+    OcclusionBuffer m_occlusion;
+    int m_culledClusters;
+
+    // Scene mesh level of detail, the coarsest within m_lodErrorPixels of the full mesh
+    float m_lodErrorPixels;
+    int m_lod;
+
+    // Lights are placed in the window and culled against its depth, both redone with the
+    // vertices or when the count changes
+    int m_lightCount;
+    bool m_lightsChanged;
+    double m_lightCullMs;
+
+    // Incremental rendering redraws the tiles where mesh clusters changed since the colour
+    // buffer was last drawn. Anything every cluster depends on redraws everything.
+    bool m_incremental;
+    bool m_redrawAll;
+    const float* m_depthBuffer;  // the one of the last frame, a new one redraws everything
+    DirtyTiles m_dirty;
+
+    // Scene mesh shading rate, and tile rates chosen from each frame for the next one when the
+    // adaptive shading threshold isn't 0
+    ShadingRate m_shadingRate;
+    float m_adaptiveShading;
+    ShadingRateTiles m_shadingRates;
+
+    // The scene mesh turns about its vertical axis by m_spin radians a frame
+    float m_spin;
+    float m_spinAngle;
+
+    // Mesh window vertices and cluster bounds are double buffered, m_meshSlot is the frame's.
+    // While a spinning mesh is drawn from one slot, the next frame's vertices are worked out in
+    // the other, guessing it keeps the size and LOD. m_nextJobs alternate, so the ones the last
+    // frame started are kept for their timings while this frame's run.
+    int m_meshSlot;
+    NextVerticesData m_next;
+    JobGraph m_nextJobs[2];
+    int m_nextJobsIndex;                 // the last started
+    const JobGraph* m_finishedNextJobs;  // the ones this frame took its vertices from, or null
+
+    // Reprojection: each pixel is shaded at least once every m_reprojectionFrames frames (0 is
+    // off), and may reuse the last frame's shading in between. The last frame's colour and depth
+    // are kept here, m_previousWidth is 0 when there are none.
+    int m_reprojectionFrames;
+    std::vector<uint32_t> m_previousColor;
+    std::vector<float> m_previousDepth;
+    size_t m_previousWidth;
+    size_t m_previousHeight;
+    uint32_t m_storedFrames;
+
+    // The ray tracer's BVH is built once per index list and refit every frame after that
+    Bvh m_bvh;
+    const int* m_bvhIndices;
+    int m_bvhIndexCount;
+    RayTraceStats m_rayTraceStats;
+};
+
+static const uint32_t kWireframeColor = 0xffffffff;
+static const uint32_t kWireframeOverlayColor = 0xff000000;
+static const float kWireframeDepthBias = 1e-3f;
+
+// Render has no frame time yet, so the rain is simulated at a fixed rate
+static const float kRainTimeStep = 1.0f / 60;
+static const int kRainCapacity = 200000;
+static const float kRainDropsPerPixelPerSecond = 0.02f;
+static const uint32_t kRainColor = 0x80c0d0ff;  // alpha is the opacity
+
+static const int kMaxClearJobs = 8;
+
+static const float kTwoPi = 6.28318531f;  // the spin angle wraps around at a turn
+
+// Window depth two surfaces may be apart and still count as the same when reprojecting. The
+// mesh's depth spans 0 to 1, and the nearest pixel to where a fragment was is up to half a pixel
+// away from it.
+static const float kReprojectionDepthTolerance = 0.01f;
+
+// Occlusion culling works on runs of this many consecutive mesh triangles. Mesh files keep
+// triangles in the order they were modelled or generated, so runs are spatially coherent.
+static const int kClusterTriangles = 256;
+
+// Generated lights, see Render_SetLightCount
+static const float kKeyLightIntensity = 0.5f;
+static const float kLightIntensity = 0.8f;
+static const float kLightRange = 0.15f;  // of the smaller window side
+static const int kSpotLightEvery = 4;
+static const float kSpotCosOuter = 0.8f;
+static const float kSpotCosInner = 0.95f;
+
+// What the jobs of the frame being rendered work on, see Render
+struct FrameJobData
+{
+    RasterBuffers* m_buffers;
+    TextureData m_texture;
+
+    const VertexData* m_vertices;
+    const int* m_indices;
+    int m_indexCount;
+    const int* m_edges;
+    int m_edgeCount;
+    const uint8_t* m_visibleClusters;  // null draws every triangle
+    const LightGrid* m_lighting;       // null is unlit
+    const ReprojectionInput* m_reprojection;  // null shades every fragment
+    bool m_storeShading;               // for the next frame to reuse
+
+    int m_clearJobCount;
 };
 
+struct ClearJobData
+{
+    const FrameJobData* m_frame;
+    int m_index;
+};
+
+static RenderState g_renderState;
+
+static int ClusterCount(int indexCount)
+{
+    return (indexCount / 3 + kClusterTriangles - 1) / kClusterTriangles;
+}
+
 // TODO(manuel): Temporary hack
 static const int g_textureSize = 16;
 static uint32_t g_texture[g_textureSize][g_textureSize];
 static bool g_initialised = false;
 
+static MappedMesh g_mesh;
+static std::vector<VertexData> g_meshWindowVertices[2];  // see RenderState::m_meshSlot
+static std::vector<vec4> g_meshPreviousPositions;  // window, last frame (reprojection)
+static std::vector<int> g_meshEdges[kMeshFileMaxLods];
+static std::vector<uint8_t> g_meshVisibleClusters;
+static std::vector<ScreenBounds> g_meshClusterBounds[2];  // window coordinates, with the vertices
+static std::vector<uint8_t> g_redrawClusters;  // visible and in the rectangle being redrawn
+
+static MappedMesh g_occluders;  // same object space as g_mesh
+static std::vector<VertexData> g_occluderWindowVertices;
+
+static TextureData g_loadedTexture;
+static TextureBlockCache g_textureBlockCache;
+
+static ParticlePool g_rain;
+
+static std::vector<Light> g_lights;
+static std::vector<float> g_lightDepth;  // depth pre-pass the lights are culled against
+static LightGrid g_lightGrid;
+
+// Waits for the next frame's vertices, if a frame started them
+static void FinishNextVertices()
+{
+    RenderState& state = g_renderState;
+    if (state.m_next.m_pending)
+    {
+        ThreadPool::Wait(&state.m_nextJobs[state.m_nextJobsIndex]);
+    }
+}
+
 void InitTexture()
 {
     // Init test texture
@@ -47,6 +227,979 @@ void InitTexture()
     }
 }
 
+bool Render_LoadMesh(const char* path)
+{
+    FinishNextVertices();
+    g_renderState.m_next.m_pending = false;
+
+    MeshFile::Unmap(&g_mesh);
+    for (int i = 0; i < 2; ++i)
+    {
+        g_meshWindowVertices[i].clear();
+        g_meshClusterBounds[i].clear();
+    }
+    g_meshPreviousPositions.clear();
+    for (int i = 0; i < kMeshFileMaxLods; ++i)
+    {
+        g_meshEdges[i].clear();
+    }
+    g_meshVisibleClusters.clear();
+    g_redrawClusters.clear();
+    g_renderState.m_meshVerticesWidth = 0;
+    g_renderState.m_meshVerticesHeight = 0;
+    g_renderState.m_lod = 0;
+    g_renderState.m_previousWidth = 0;
+
+    if (!MeshFile::Map(path, &g_mesh))
+    {
+        return false;
+    }
+    if (!MeshFile::ValidateIndices(g_mesh))
+    {
+        MeshFile::Unmap(&g_mesh);
+        return false;
+    }
+
+    // LOD 0 has the most triangles, so the most clusters
+    g_meshPreviousPositions.resize(g_mesh.m_vertexCount);
+    const int clusters = ClusterCount(g_mesh.m_indexCount);
+    for (int i = 0; i < 2; ++i)
+    {
+        g_meshWindowVertices[i].resize(g_mesh.m_vertexCount);
+        g_meshClusterBounds[i].resize(clusters);
+    }
+    g_meshVisibleClusters.assign(clusters, 1);
+    g_redrawClusters.resize(clusters);
+
+    // Edges only depend on the indices, extract them once per LOD for the wireframe modes
+    std::vector<uint64_t> scratch(g_mesh.m_indexCount);
+    for (int i = 0; i < g_mesh.m_lodCount; ++i)
+    {
+        const MeshLod& lod = g_mesh.m_lods[i];
+        std::vector<int>& edges = g_meshEdges[i];
+        edges.resize(2 * lod.m_indexCount);
+        int edgeCount = Wireframe::ExtractEdges(
+            lod.m_indices, lod.m_indexCount, edges.data(), scratch.data());
+        edges.resize(2 * edgeCount);
+        edges.shrink_to_fit();
+    }
+
+    return true;
+}
+
+bool Render_LoadOccluders(const char* path)
+{
+    MeshFile::Unmap(&g_occluders);
+    g_occluderWindowVertices.clear();
+    g_renderState.m_meshVerticesWidth = 0;
+    g_renderState.m_meshVerticesHeight = 0;
+    g_renderState.m_culledClusters = 0;
+
+    if (!MeshFile::Map(path, &g_occluders))
+    {
+        return false;
+    }
+    if (!MeshFile::ValidateIndices(g_occluders))
+    {
+        MeshFile::Unmap(&g_occluders);
+        return false;
+    }
+
+    g_occluderWindowVertices.resize(g_occluders.m_vertexCount);
+    return true;
+}
+
+CullingStats Render_GetCullingStats()
+{
+    CullingStats stats = {};
+    if (g_mesh.m_vertices)
+    {
+        stats.m_clusters = ClusterCount(g_mesh.m_lods[g_renderState.m_lod].m_indexCount);
+        stats.m_culled = g_renderState.m_culledClusters;
+    }
+    return stats;
+}
+
+void Render_SetLodErrorPixels(float pixels)
+{
+    g_renderState.m_lodErrorPixels = pixels;
+}
+
+float Render_GetLodErrorPixels()
+{
+    return g_renderState.m_lodErrorPixels;
+}
+
+LodStats Render_GetLodStats()
+{
+    LodStats stats = {};
+    if (g_mesh.m_vertices)
+    {
+        stats.m_lod = g_renderState.m_lod;
+        stats.m_lodCount = g_mesh.m_lodCount;
+        stats.m_triangles = g_mesh.m_lods[g_renderState.m_lod].m_indexCount / 3;
+    }
+    return stats;
+}
+
+void Render_SetLightCount(int count)
+{
+    POW2_ASSERT(count >= 0 && count <= LightGrid::kMaxLights);
+    g_renderState.m_lightCount = count;
+    g_renderState.m_lightsChanged = true;
+    g_renderState.m_redrawAll = true;
+    g_lights.resize(count);
+}
+
+int Render_GetLightCount()
+{
+    return g_renderState.m_lightCount;
+}
+
+LightingStats Render_GetLightingStats()
+{
+    LightingStats stats = {};
+    if (g_mesh.m_vertices && g_renderState.m_lightCount > 0 && g_lightGrid.m_lights)
+    {
+        stats.m_lights = g_lightGrid.m_lightCount;
+        Lighting::GetTileStats(g_lightGrid, &stats.m_averageTileLights, &stats.m_maxTileLights);
+        stats.m_cullMs = g_renderState.m_lightCullMs;
+    }
+    return stats;
+}
+
+void Render_SetIncremental(bool enabled)
+{
+    g_renderState.m_incremental = enabled;
+}
+
+bool Render_GetIncremental()
+{
+    return g_renderState.m_incremental;
+}
+
+void Render_Invalidate()
+{
+    g_renderState.m_redrawAll = true;
+}
+
+RedrawStats Render_GetRedrawStats()
+{
+    const DirtyTiles& dirty = g_renderState.m_dirty;
+    RedrawStats stats = {};
+    if (g_mesh.m_vertices)
+    {
+        stats.m_tiles = dirty.m_tilesX * dirty.m_tilesY;
+        stats.m_redrawnTiles = dirty.m_dirtyTiles;
+    }
+    return stats;
+}
+
+void Render_SetShadingRate(ShadingRate rate)
+{
+    POW2_ASSERT(rate >= ShadingRate(0) && rate < ShadingRate::Count);
+    g_renderState.m_shadingRate = rate;
+    g_renderState.m_redrawAll = true;
+}
+
+ShadingRate Render_GetShadingRate()
+{
+    return g_renderState.m_shadingRate;
+}
+
+void Render_SetAdaptiveShading(float threshold)
+{
+    POW2_ASSERT(threshold >= 0);
+    g_renderState.m_adaptiveShading = threshold;
+    g_renderState.m_shadingRates.m_width = 0;  // full rate until a frame was measured
+    g_renderState.m_redrawAll = true;
+}
+
+float Render_GetAdaptiveShading()
+{
+    return g_renderState.m_adaptiveShading;
+}
+
+ShadingStats Render_GetShadingStats()
+{
+    const ShadingRateTiles& tiles = g_renderState.m_shadingRates;
+    ShadingStats stats = {};
+    if (g_renderState.m_adaptiveShading > 0 && tiles.m_width)
+    {
+        stats.m_tiles1x1 = tiles.m_tileCounts[(int)ShadingRate::Rate1x1];
+        stats.m_tiles2x2 = tiles.m_tileCounts[(int)ShadingRate::Rate2x2];
+        stats.m_tiles4x4 = tiles.m_tileCounts[(int)ShadingRate::Rate4x4];
+    }
+    return stats;
+}
+
+void Render_SetSpin(float radiansPerFrame)
+{
+    FinishNextVertices();  // it reads the spin
+    g_renderState.m_spin = radiansPerFrame;
+}
+
+float Render_GetSpin()
+{
+    return g_renderState.m_spin;
+}
+
+void Render_SetReprojection(int frames)
+{
+    POW2_ASSERT(frames >= 0);
+    g_renderState.m_reprojectionFrames = frames;
+    g_renderState.m_previousWidth = 0;
+    g_renderState.m_redrawAll = true;
+}
+
+int Render_GetReprojection()
+{
+    return g_renderState.m_reprojectionFrames;
+}
+
+void Render_SetMode(RenderMode mode)
+{
+    g_renderState.m_mode = mode;
+    g_renderState.m_redrawAll = true;
+}
+
+RenderMode Render_GetMode()
+{
+    return g_renderState.m_mode;
+}
+
+void Render_SetBackend(RenderBackend backend)
+{
+    g_renderState.m_backend = backend;
+    g_renderState.m_redrawAll = true;
+}
+
+RenderBackend Render_GetBackend()
+{
+    return g_renderState.m_backend;
+}
+
+RayTraceStats Render_GetRayTraceStats()
+{
+    return g_renderState.m_rayTraceStats;
+}
+
+void Render_SetRain(bool enabled)
+{
+    g_renderState.m_rain = enabled;
+    g_renderState.m_redrawAll = true;
+
+    if (enabled && !g_rain.m_capacity)
+    {
+        Particles::Create(&g_rain, kRainCapacity);
+    }
+    else if (!enabled && g_rain.m_capacity)
+    {
+        Particles::Destroy(&g_rain);
+    }
+}
+
+bool Render_GetRain()
+{
+    return g_renderState.m_rain;
+}
+
+static void UpdateRain(const RasterBuffers& buffers)
+{
+    // Drops start just above the window, a little slanted, and die at the bottom
+    const float width = (float)buffers.m_width;
+    const float height = (float)buffers.m_height;
+
+    ParticleEmitter emitter = {};
+    emitter.m_min = vec3(-0.1f * width, height, 0);
+    emitter.m_max = vec3(width, 1.1f * height, 0);
+    emitter.m_velocity = vec3(0.1f * height, -1.5f * height, 0);
+    emitter.m_velocityJitter = vec3(0.01f * height, 0.3f * height, 0);
+    emitter.m_life = 2;
+    emitter.m_color = kRainColor;
+
+    const float drops = width * height * kRainDropsPerPixelPerSecond * kRainTimeStep;
+    Particles::Emit(&g_rain, emitter, (int)drops);
+    Particles::Update(&g_rain, vec3(0, -height, 0), 0, kRainTimeStep);
+}
+
+static void DrawRain(RasterBuffers* buffers)
+{
+    ParticleRenderSettings settings = {};
+    settings.m_shape = ParticleShape::STREAK;
+    settings.m_streakSeconds = 0.02f;
+    Particles::Render(buffers, g_rain, settings);
+}
+
+static void TraceGeometry(
+    RasterBuffers* buffers,
+    const VertexData* vertices,
+    const int* indices,
+    int indexCount,
+    const TextureData& texture,
+    const LightGrid* lighting)
+{
+    RenderState& state = g_renderState;
+
+    const double startMs = DebugTimer_NowMs();
+    if (state.m_bvhIndices != indices || state.m_bvhIndexCount != indexCount)
+    {
+        RayTracer::BuildBvh(&state.m_bvh, vertices, indices, indexCount);
+        state.m_bvhIndices = indices;
+        state.m_bvhIndexCount = indexCount;
+    }
+    else
+    {
+        RayTracer::RefitBvh(&state.m_bvh, vertices, indices);
+    }
+    state.m_rayTraceStats.m_bvhMs = DebugTimer_NowMs() - startMs;
+
+    const RayTracerStats stats =
+        RayTracer::Trace(buffers, state.m_bvh, vertices, indices, texture, lighting);
+    state.m_rayTraceStats.m_traceMs = stats.m_timeMs;
+    state.m_rayTraceStats.m_mraysPerSecond = stats.m_mraysPerSecond;
+}
+
+static void DrawGeometry(
+    RasterBuffers* buffers,
+    const VertexData* vertices,
+    const int* indices,
+    int indexCount,
+    const int* edges,
+    int edgeCount,
+    const TextureData& texture,
+    const uint8_t* visibleClusters,
+    const LightGrid* lighting,
+    const ReprojectionInput* reprojection)
+{
+    POW2_ASSERT(indexCount % 3 == 0);
+
+    const RenderMode mode = g_renderState.m_mode;
+
+    //
+    // Rasterize (or trace) each triangle
+    //
+
+    if (mode == RenderMode::NORMAL || mode == RenderMode::WIREFRAME_OVERLAY)
+    {
+        if (g_renderState.m_backend == RenderBackend::RAY_TRACER)
+        {
+            TraceGeometry(buffers, vertices, indices, indexCount, texture, lighting);
+        }
+        else
+        {
+            const int clusterIndices = 3 * kClusterTriangles;
+            for (int first = 0; first < indexCount; first += clusterIndices)
+            {
+                if (visibleClusters && !visibleClusters[first / clusterIndices])
+                {
+                    continue;
+                }
+
+                const int end = indexCount - first > clusterIndices ?
+                    first + clusterIndices : indexCount;
+                for (int i = first; i < end; i += 3)
+                {
+                    TriangleInput input = {
+                        vertices,
+                        texture,
+                        { indices[i], indices[i + 1], indices[i + 2] } };
+                    input.m_lighting = lighting;
+                    input.m_shadingRate = g_renderState.m_shadingRate;
+                    input.m_reprojection = reprojection;
+
+                    Rasterizer::RasterTriangle(buffers, input);
+                }
+            }
+        }
+    }
+
+    //
+    // Draw each unique edge once
+    //
+
+    if (mode == RenderMode::WIREFRAME || mode == RenderMode::WIREFRAME_OVERLAY)
+    {
+        const bool overlay = (mode == RenderMode::WIREFRAME_OVERLAY);
+
+        LineBatch batch = {};
+        batch.m_vertexArray = vertices;
+        batch.m_edges = edges;
+        batch.m_edgeCount = edgeCount;
+        batch.m_color = overlay ? kWireframeOverlayColor : kWireframeColor;
+        batch.m_depthTest = overlay && buffers->m_depth;
+        batch.m_depthBias = kWireframeDepthBias;
+
+        Rasterizer::RasterLines(buffers, batch);
+    }
+}
+
+bool Render_LoadTexture(const char* path)
+{
+    if (g_loadedTexture.m_data)
+    {
+        Texture::Free(&g_loadedTexture);
+        g_textureBlockCache = {};
+    }
+
+    if (!Texture::LoadDds(path, &g_loadedTexture))
+    {
+        return false;
+    }
+
+    g_loadedTexture.m_blockCache = &g_textureBlockCache;
+    g_renderState.m_redrawAll = true;
+    return true;
+}
+
+// Object space size of the scene mesh as fit to the window. Once it has turned it's fit at every
+// angle: across and in depth it spans the diagonal of its x and z extents.
+static vec3 MeshFitExtent()
+{
+    const MeshFileHeader& header = *g_mesh.m_header;
+    vec3 extent(
+        header.m_boundsMax[0] - header.m_boundsMin[0],
+        header.m_boundsMax[1] - header.m_boundsMin[1],
+        header.m_boundsMax[2] - header.m_boundsMin[2]);
+    if (g_renderState.m_spin != 0 || g_renderState.m_spinAngle != 0)
+    {
+        const float diagonal = sqrtf(extent.x * extent.x + extent.z * extent.z);
+        extent.x = diagonal;
+        extent.z = diagonal;
+    }
+    return extent;
+}
+
+// Window pixels per object space unit of the scene mesh, see TransformMeshVertices
+static float MeshPixelsPerUnit(const RasterBuffers& buffers)
+{
+    const vec3 extent = MeshFitExtent();
+    const float maxExtent = fmaxf(fmaxf(extent.x, extent.y), 1e-6f);
+    return 0.8f * fminf((float)buffers.m_width, (float)buffers.m_height) / maxExtent;
+}
+
+// Lighting space z of a window depth of 1, so the mesh keeps its proportions
+static float MeshDepthToPixels(const RasterBuffers& buffers)
+{
+    return MeshFitExtent().z * MeshPixelsPerUnit(buffers);
+}
+
+static void TransformMeshVertices(
+    const RasterBuffers& buffers,
+    float spinAngle,
+    const VertexData* in,
+    int vertexCount,
+    VertexData* out)
+{
+    //
+    // Fit the object space bounds of the scene mesh in the window (orthographic, looking down
+    // -z), turned about the vertical axis through their centre by the spin angle. Colour and
+    // texture coordinates are copied straight out of the mapping, normals get the same turn
+    // and the same flip as z.
+    //
+
+    const MeshFileHeader& header = *g_mesh.m_header;
+    const vec3 boundsMin(header.m_boundsMin[0], header.m_boundsMin[1], header.m_boundsMin[2]);
+    const vec3 boundsMax(header.m_boundsMax[0], header.m_boundsMax[1], header.m_boundsMax[2]);
+    const vec3 center = (boundsMin + boundsMax) * 0.5f;
+    const vec3 extent = MeshFitExtent();
+
+    const float wD2 = (float)buffers.m_width / 2;
+    const float hD2 = (float)buffers.m_height / 2;
+    const float scale = MeshPixelsPerUnit(buffers);
+    const float depthScale = extent.z > 0 ? 1 / extent.z : 0;
+
+    // Positions: to the centre, turn, scale (flipping z so 0 is nearest), to the window centre.
+    // Normals: the turn and the flip.
+    const mat4 turn = mat4RotationY(spinAngle);
+    const mat4 toWindow =
+        mat4Translation(vec3(wD2, hD2, 0.5f)) *
+        mat4Scale(vec3(scale, scale, -depthScale)) *
+        turn *
+        mat4Translation(-center);
+    const mat4 toWindowNormal = mat4Scale(vec3(1, 1, -1)) * turn;
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const vec4& p = in[i].m_pos;
+        const vec3& n = in[i].m_normal;
+        out[i].m_pos = vec4FromFloatx4(mat4Transform(toWindow, floatx4(p.x, p.y, p.z, 1)));
+        out[i].m_color = in[i].m_color;
+        out[i].m_textureCoord = in[i].m_textureCoord;
+        out[i].m_normal = vec4xyz(
+            vec4FromFloatx4(mat4Transform(toWindowNormal, floatx4(n.x, n.y, n.z, 0))));
+    }
+}
+
+static inline float RandomFloat(uint32_t* state)  // [0, 1)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// The same lights for a given count and window. Points are scattered through the depth the mesh
+// spans, spots hang in front of it and point roughly into the screen.
+static void PlaceLights(const RasterBuffers& buffers)
+{
+    const float width = (float)buffers.m_width;
+    const float height = (float)buffers.m_height;
+    const float depth = MeshDepthToPixels(buffers);
+    const float range = kLightRange * fminf(width, height);
+
+    uint32_t random = 0x9e3779b9;
+    for (size_t i = 0; i < g_lights.size(); ++i)
+    {
+        Light& light = g_lights[i];
+        light.m_cosOuter = kSpotCosOuter;
+        light.m_cosInner = kSpotCosInner;
+
+        if (i == 0)
+        {
+            // Key light from the top left
+            light.m_type = LightType::DIRECTIONAL;
+            light.m_position = vec3zero;
+            light.m_direction = vec3Normalize(vec3(0.4f, -0.5f, 1));
+            light.m_color = vec3(kKeyLightIntensity, kKeyLightIntensity, kKeyLightIntensity);
+            light.m_range = 0;
+            continue;
+        }
+
+        const float x = width * RandomFloat(&random);
+        const float y = height * RandomFloat(&random);
+        const float z = depth * (RandomFloat(&random) * 0.6f - 0.1f);
+        light.m_color = vec3(
+            kLightIntensity * (0.2f + 0.8f * RandomFloat(&random)),
+            kLightIntensity * (0.2f + 0.8f * RandomFloat(&random)),
+            kLightIntensity * (0.2f + 0.8f * RandomFloat(&random)));
+
+        if (i % kSpotLightEvery == 0)
+        {
+            light.m_type = LightType::SPOT;
+            light.m_position = vec3(x, y, -range);
+            light.m_direction = vec3Normalize(vec3(
+                RandomFloat(&random) - 0.5f, RandomFloat(&random) - 0.5f, 1));
+            light.m_range = 2 * range;
+        }
+        else
+        {
+            light.m_type = LightType::POINT;
+            light.m_position = vec3(x, y, z);
+            light.m_direction = vec3(0, 0, 1);
+            light.m_range = range;
+        }
+    }
+}
+
+// The coarsest LOD whose error is at most m_lodErrorPixels on screen. The mesh is fit to the
+// window, so a smaller window takes a coarser LOD and the triangle count follows the pixels
+// the mesh covers.
+static int SelectMeshLod(const RasterBuffers& buffers)
+{
+    const float maxError = g_renderState.m_lodErrorPixels / MeshPixelsPerUnit(buffers);
+    if (maxError <= 0)
+    {
+        return 0;
+    }
+
+    int lod = 0;
+    while (lod + 1 < g_mesh.m_lodCount && g_mesh.m_lods[lod + 1].m_error <= maxError)
+    {
+        ++lod;
+    }
+    return lod;
+}
+
+//
+// FRAME JOBS
+//
+// Clearing, vertex processing and the rain simulation don't touch each other's data and run
+// side by side. Occlusion and light culling need the vertices, geometry (triangles, then edges)
+// waits for the buffers and both cullings, and the rain is drawn last, over it.
+//
+// A spinning mesh needs new vertices every frame. Each frame starts the next one's in a graph
+// of its own, left running when Render returns, so they're done while this frame is drawn and
+// presented. The next frame takes them if it has the size and LOD they were worked out for.
+//
+
+static void ClearJob(int, void* userData)
+{
+    const ClearJobData& data = *(const ClearJobData*)userData;
+    const RasterBuffers& buffers = *data.m_frame->m_buffers;
+    const int index = data.m_index;
+    const int count = data.m_frame->m_clearJobCount;
+
+    PerfSample perf;
+    const bool counting = PerfCounters::IsEnabled();
+    if (counting)
+    {
+        PerfCounters::Read(&perf);
+    }
+
+    // Each job clears the same slice of every buffer
+    uint8_t* color = (uint8_t*)buffers.m_color;
+    const size_t colorStart = buffers.m_colorBufferBytes * index / count;
+    const size_t colorEnd = buffers.m_colorBufferBytes * (index + 1) / count;
+    memset(color + colorStart, 0x7f, colorEnd - colorStart);
+
+    uint8_t* fragments = (uint8_t*)buffers.m_fragmentsTmpBuffer;
+    const size_t fragmentsStart = buffers.m_fragmentsTmpBufferBytes * index / count;
+    const size_t fragmentsEnd = buffers.m_fragmentsTmpBufferBytes * (index + 1) / count;
+    memset(fragments + fragmentsStart, 0, fragmentsEnd - fragmentsStart);
+
+    if (buffers.m_depth)
+    {
+        const size_t depthCount = buffers.m_depthBufferBytes / sizeof(float);
+        const size_t end = depthCount * (index + 1) / count;
+        for (size_t i = depthCount * index / count; i < end; ++i)
+        {
+            buffers.m_depth[i] = FLT_MAX;
+        }
+    }
+
+    if (counting)
+    {
+        PerfCounters::Lap(PerfStage::CLEAR, &perf);
+    }
+}
+
+// The scene mesh's window vertices, and the bounds of the clusters of a LOD's triangles
+static void TransformMesh(
+    const RasterBuffers& buffers,
+    float spinAngle,
+    const int* indices,
+    int indexCount,
+    int slot)
+{
+    VertexData* vertices = g_meshWindowVertices[slot].data();
+    TransformMeshVertices(buffers, spinAngle, g_mesh.m_vertices, g_mesh.m_vertexCount, vertices);
+
+    const int clusterIndices = 3 * kClusterTriangles;
+    for (int first = 0; first < indexCount; first += clusterIndices)
+    {
+        const int count = indexCount - first > clusterIndices ?
+            clusterIndices : indexCount - first;
+        g_meshClusterBounds[slot][first / clusterIndices] =
+            Occlusion::ComputeBounds(vertices, indices + first, count);
+    }
+}
+
+static void VerticesJob(int, void* userData)
+{
+    const FrameJobData& frame = *(const FrameJobData*)userData;
+    TransformMesh(
+        *frame.m_buffers,
+        g_renderState.m_spinAngle,
+        frame.m_indices,
+        frame.m_indexCount,
+        g_renderState.m_meshSlot);
+}
+
+static void NextVerticesJob(int, void* userData)
+{
+    const NextVerticesData& next = *(const NextVerticesData*)userData;
+    const MeshLod& lod = g_mesh.m_lods[next.m_lod];
+    TransformMesh(next.m_buffers, next.m_spinAngle, lod.m_indices, lod.m_indexCount, next.m_slot);
+}
+
+static void OcclusionJob(int, void* userData)
+{
+    const FrameJobData& frame = *(const FrameJobData*)userData;
+    const RasterBuffers& buffers = *frame.m_buffers;
+    OcclusionBuffer* occlusion = &g_renderState.m_occlusion;
+
+    TransformMeshVertices(
+        buffers, g_renderState.m_spinAngle, g_occluders.m_vertices, g_occluders.m_vertexCount,
+        g_occluderWindowVertices.data());
+
+    Occlusion::Clear(occlusion, (int)buffers.m_width, (int)buffers.m_height);
+    Occlusion::RasterOccluders(
+        occlusion, g_occluderWindowVertices.data(), g_occluders.m_indices,
+        g_occluders.m_indexCount);
+
+    int culled = 0;
+    const int clusters = ClusterCount(frame.m_indexCount);
+    for (int c = 0; c < clusters; ++c)
+    {
+        g_meshVisibleClusters[c] = Occlusion::IsVisible(
+            *occlusion, g_meshClusterBounds[g_renderState.m_meshSlot][c]);
+        culled += !g_meshVisibleClusters[c];
+    }
+    g_renderState.m_culledClusters = culled;
+}
+
+static void LightsJob(int, void* userData)
+{
+    const FrameJobData& frame = *(const FrameJobData*)userData;
+    const RasterBuffers& buffers = *frame.m_buffers;
+
+    PlaceLights(buffers);
+
+    // Depth pre-pass of the whole mesh, so lights behind occluded clusters still get culled
+    // against what's in front of them
+    g_lightDepth.resize(buffers.m_width * buffers.m_height);
+    DepthBuffer depth = { g_lightDepth.data(), (int)buffers.m_width, (int)buffers.m_height };
+    Rasterizer::ClearDepth(&depth, FLT_MAX);
+    Rasterizer::RasterDepth(&depth, frame.m_vertices, frame.m_indices, frame.m_indexCount);
+
+    const double startMs = DebugTimer_NowMs();
+    Lighting::CullLights(
+        &g_lightGrid, g_lights.data(), (int)g_lights.size(), depth, MeshDepthToPixels(buffers));
+    g_renderState.m_lightCullMs = DebugTimer_NowMs() - startMs;
+}
+
+// Pixels a cluster's triangles can touch, the rasterizer's bounding boxes put together
+static ScreenRect ClusterRect(int cluster)
+{
+    const ScreenBounds& bounds = g_meshClusterBounds[g_renderState.m_meshSlot][cluster];
+    const ScreenRect rect = {
+        (int)floorf(bounds.m_minX),
+        (int)floorf(bounds.m_minY),
+        (int)floorf(bounds.m_maxX),
+        (int)floorf(bounds.m_maxY) };
+    return rect;
+}
+
+static void ClearRect(const RasterBuffers& buffers, const ScreenRect& rect)
+{
+    PerfSample perf;
+    const bool counting = PerfCounters::IsEnabled();
+    if (counting)
+    {
+        PerfCounters::Read(&perf);
+    }
+
+    for (int y = rect.m_minY; y <= rect.m_maxY; ++y)
+    {
+        const size_t row = y * buffers.m_width;
+        const size_t width = rect.m_maxX - rect.m_minX + 1;
+        memset(buffers.m_color + row + rect.m_minX, 0x7f, width * sizeof(uint32_t));
+        if (buffers.m_depth)
+        {
+            std::fill_n(buffers.m_depth + row + rect.m_minX, width, FLT_MAX);
+        }
+    }
+
+    if (counting)
+    {
+        PerfCounters::Lap(PerfStage::CLEAR, &perf);
+    }
+}
+
+// Incremental frames: each dirty rectangle is cleared and the clusters over it drawn again,
+// scissored to it so pixels outside keep what they have
+static void RedrawJob(int, void* userData)
+{
+    const FrameJobData& frame = *(const FrameJobData*)userData;
+    const std::vector<ScreenRect>& rects = g_renderState.m_dirty.m_rects;
+    const int clusters = ClusterCount(frame.m_indexCount);
+
+    for (size_t r = 0; r < rects.size(); ++r)
+    {
+        const ScreenRect& rect = rects[r];
+        ClearRect(*frame.m_buffers, rect);
+
+        for (int c = 0; c < clusters; ++c)
+        {
+            const bool visible = !frame.m_visibleClusters || frame.m_visibleClusters[c];
+            g_redrawClusters[c] = visible && DirtyRegion::Overlap(ClusterRect(c), rect);
+        }
+
+        RasterBuffers buffers = *frame.m_buffers;
+        buffers.m_scissor = &rect;
+        DrawGeometry(
+            &buffers,
+            frame.m_vertices,
+            frame.m_indices,
+            frame.m_indexCount,
+            frame.m_edges,
+            frame.m_edgeCount,
+            frame.m_texture,
+            g_redrawClusters.data(),
+            frame.m_lighting,
+            nullptr);
+    }
+}
+
+// Keeps the frame's colour and depth for the next one to reproject, before anything that
+// shouldn't be reused (rain) is drawn over them
+static void StoreShading(const RasterBuffers& buffers)
+{
+    RenderState& state = g_renderState;
+    const size_t pixels = buffers.m_width * buffers.m_height;
+    state.m_previousColor.resize(pixels);
+    state.m_previousDepth.resize(pixels);
+    memcpy(state.m_previousColor.data(), buffers.m_color, pixels * sizeof(uint32_t));
+    memcpy(state.m_previousDepth.data(), buffers.m_depth, pixels * sizeof(float));
+    state.m_previousWidth = buffers.m_width;
+    state.m_previousHeight = buffers.m_height;
+    ++state.m_storedFrames;
+}
+
+static void GeometryJob(int, void* userData)
+{
+    const FrameJobData& frame = *(const FrameJobData*)userData;
+    DrawGeometry(
+        frame.m_buffers,
+        frame.m_vertices,
+        frame.m_indices,
+        frame.m_indexCount,
+        frame.m_edges,
+        frame.m_edgeCount,
+        frame.m_texture,
+        frame.m_visibleClusters,
+        frame.m_lighting,
+        frame.m_reprojection);
+
+    if (frame.m_storeShading)
+    {
+        StoreShading(*frame.m_buffers);
+    }
+}
+
+static void RainUpdateJob(int, void* userData)
+{
+    UpdateRain(*((const FrameJobData*)userData)->m_buffers);
+}
+
+static void RainDrawJob(int, void* userData)
+{
+    DrawRain(((const FrameJobData*)userData)->m_buffers);
+}
+
+// Starts working out the next frame's vertices in the slot this frame doesn't draw from
+static void StartNextVertices(const RasterBuffers& buffers, int lod, float spinAngle)
+{
+    RenderState& state = g_renderState;
+    NextVerticesData& next = state.m_next;
+    next.m_buffers = buffers;
+    next.m_spinAngle = spinAngle;
+    next.m_lod = lod;
+    next.m_slot = 1 - state.m_meshSlot;
+    next.m_pending = true;
+
+    state.m_nextJobsIndex = 1 - state.m_nextJobsIndex;
+    JobGraph* graph = &state.m_nextJobs[state.m_nextJobsIndex];
+    ThreadPool::ResetGraph(graph);
+    ThreadPool::AddJob(graph, "NextVertices", NextVerticesJob, &next);
+    ThreadPool::Kick(graph);
+}
+
+// verticesChanged runs what depends on the vertices, transformVertices works them out first
+// (they may be there already, see StartNextVertices)
+static void RunFrameJobs(
+    FrameJobData* frame,
+    ClearJobData* clears,
+    bool verticesChanged,
+    bool transformVertices,
+    bool cullLights)
+{
+    JobGraph* graph = &g_renderState.m_jobs;
+    ThreadPool::ResetGraph(graph);
+
+    int before[kMaxClearJobs + 3];  // what geometry waits for
+    int beforeCount = 0;
+
+    for (int i = 0; i < frame->m_clearJobCount; ++i)
+    {
+        clears[i].m_frame = frame;
+        clears[i].m_index = i;
+        before[beforeCount++] = ThreadPool::AddJob(graph, "Clear", ClearJob, &clears[i]);
+    }
+
+    const int vertices =
+        transformVertices ? ThreadPool::AddJob(graph, "Vertices", VerticesJob, frame) : -1;
+    if (vertices >= 0)
+    {
+        before[beforeCount++] = vertices;
+    }
+
+    if (verticesChanged && g_occluders.m_vertices)
+    {
+        const int occlusion = ThreadPool::AddJob(graph, "Occlusion", OcclusionJob, frame);
+        if (vertices >= 0)
+        {
+            ThreadPool::AddDependency(graph, occlusion, vertices);
+        }
+        before[beforeCount++] = occlusion;
+    }
+
+    if (cullLights)
+    {
+        const int lights = ThreadPool::AddJob(graph, "Lights", LightsJob, frame);
+        if (vertices >= 0)
+        {
+            ThreadPool::AddDependency(graph, lights, vertices);
+        }
+        before[beforeCount++] = lights;
+    }
+
+    const int rainUpdate =
+        g_renderState.m_rain ? ThreadPool::AddJob(graph, "RainUpdate", RainUpdateJob, frame) : -1;
+
+    const int geometry = ThreadPool::AddJob(graph, "Geometry", GeometryJob, frame);
+    for (int i = 0; i < beforeCount; ++i)
+    {
+        ThreadPool::AddDependency(graph, geometry, before[i]);
+    }
+
+    if (rainUpdate >= 0)
+    {
+        const int rainDraw = ThreadPool::AddJob(graph, "RainDraw", RainDrawJob, frame);
+        ThreadPool::AddDependency(graph, rainDraw, geometry);
+        ThreadPool::AddDependency(graph, rainDraw, rainUpdate);
+    }
+
+    ThreadPool::Kick(graph);
+    ThreadPool::Wait(graph);
+}
+
+static void RunRedrawJobs(FrameJobData* frame)
+{
+    JobGraph* graph = &g_renderState.m_jobs;
+    ThreadPool::ResetGraph(graph);
+
+    if (!g_renderState.m_dirty.m_rects.empty())
+    {
+        ThreadPool::AddJob(graph, "Redraw", RedrawJob, frame);
+        ThreadPool::Kick(graph);
+        ThreadPool::Wait(graph);
+    }
+}
+
+// Every visible cluster is a draw, whose content only changes with the LOD (or anything
+// that redraws everything)
+static void AddMeshDraws(const FrameJobData& frame)
+{
+    const int clusters = ClusterCount(frame.m_indexCount);
+    for (int c = 0; c < clusters; ++c)
+    {
+        if (!frame.m_visibleClusters || frame.m_visibleClusters[c])
+        {
+            DirtyRegion::AddDraw(
+                &g_renderState.m_dirty, c, (uint32_t)g_renderState.m_lod, ClusterRect(c));
+        }
+    }
+}
+
+const JobGraph& Render_GetJobs()
+{
+    return g_renderState.m_jobs;
+}
+
+const JobGraph* Render_GetEarlyJobs()
+{
+    return g_renderState.m_finishedNextJobs;
+}
+
+void Render_Finish()
+{
+    FinishNextVertices();
+}
+
 void Render(RasterBuffers* buffers)
 {   
     if (!g_initialised)  // TODO(manuel): Temporary hack
@@ -55,18 +1208,156 @@ void Render(RasterBuffers* buffers)
         InitTexture();
     }
 
-    DebugTimer_Tic(__FUNCTION__);
+    FinishNextVertices();
+    g_renderState.m_finishedNextJobs = nullptr;
 
-    //
-    // Clear buffer
-    //
+    FrameJobData frame = {};
+    frame.m_buffers = buffers;
+
+    frame.m_texture = { g_textureSize, g_textureSize, (uint32_t*)g_texture };
+    if (g_loadedTexture.m_data)
+    {
+        frame.m_texture = g_loadedTexture;
+    }
+
+    // Enough clear jobs to keep every thread busy while the vertices are done
+    const int threadCount = ThreadPool::GetThreadCount();
+    frame.m_clearJobCount = threadCount < 1 ? 1 : threadCount;
+    frame.m_clearJobCount =
+        frame.m_clearJobCount < kMaxClearJobs ? frame.m_clearJobCount : kMaxClearJobs;
+    ClearJobData clears[kMaxClearJobs];
+
+    if (g_mesh.m_vertices)
+    {
+        RenderState& state = g_renderState;
+        const int lod = SelectMeshLod(*buffers);
 
-    DebugTimer_Tic("ClearBuffers");
+        const bool spinning = state.m_spin != 0;
+        if (spinning)
+        {
+            state.m_spinAngle = fmodf(state.m_spinAngle + state.m_spin, kTwoPi);
+        }
 
-    memset(buffers->m_color, 0x7f, buffers->m_colorBufferBytes);
-    memset(buffers->m_fragmentsTmpBuffer, 0, buffers->m_fragmentsTmpBufferBytes);
+        // The culled clusters depend on the LOD's triangles too
+        const bool verticesChanged =
+            state.m_meshVerticesWidth != buffers->m_width ||
+            state.m_meshVerticesHeight != buffers->m_height ||
+            state.m_lod != lod ||
+            spinning;
+        state.m_meshVerticesWidth = buffers->m_width;
+        state.m_meshVerticesHeight = buffers->m_height;
+        state.m_lod = lod;
 
-    DebugTimer_TocAndPrint("ClearBuffers");
+        // The last frame may have worked out this one's vertices already. The slot drawn from
+        // last frame keeps its vertices for reprojection until the next frame's go in it.
+        NextVerticesData& next = state.m_next;
+        const bool nextReady = next.m_pending &&
+            next.m_buffers.m_width == buffers->m_width &&
+            next.m_buffers.m_height == buffers->m_height &&
+            next.m_lod == lod &&
+            next.m_spinAngle == state.m_spinAngle;
+        if (next.m_pending)
+        {
+            state.m_finishedNextJobs = &state.m_nextJobs[state.m_nextJobsIndex];
+            next.m_pending = false;
+        }
+        const int previousSlot = state.m_meshSlot;
+        if (nextReady)
+        {
+            state.m_meshSlot = next.m_slot;
+        }
+        const bool transformVertices = verticesChanged && !nextReady;
+
+        const bool lit = state.m_lightCount > 0;
+        const bool cullLights = lit && (verticesChanged || state.m_lightsChanged);
+        state.m_lightsChanged = false;
+
+        // Indices are read straight from the mapping
+        frame.m_vertices = g_meshWindowVertices[state.m_meshSlot].data();
+        frame.m_indices = g_mesh.m_lods[lod].m_indices;
+        frame.m_indexCount = g_mesh.m_lods[lod].m_indexCount;
+        frame.m_edges = g_meshEdges[lod].data();
+        frame.m_edgeCount = (int)g_meshEdges[lod].size() / 2;
+        frame.m_visibleClusters = g_occluders.m_vertices ? g_meshVisibleClusters.data() : nullptr;
+        frame.m_lighting = lit ? &g_lightGrid : nullptr;
+
+        // The tile rates come from the last frame, drawn at the same size or ignored
+        const bool adaptive = state.m_adaptiveShading > 0;
+        RasterBuffers meshBuffers = *buffers;
+        meshBuffers.m_shadingRates = adaptive && state.m_shadingRates.m_width ?
+            &state.m_shadingRates : nullptr;
+        frame.m_buffers = &meshBuffers;
+
+        // Shading is reused from a last frame of the same size, unless something that changes
+        // every pixel (more lights, a new mode) asked for everything to be drawn again
+        const bool reprojecting = state.m_reprojectionFrames > 1 && buffers->m_depth &&
+            state.m_mode == RenderMode::NORMAL && state.m_backend == RenderBackend::RASTERIZER;
+        ReprojectionInput reprojection = {};
+        if (reprojecting && !state.m_redrawAll &&
+            state.m_previousWidth == buffers->m_width &&
+            state.m_previousHeight == buffers->m_height)
+        {
+            // Last frame's slot still holds its positions, until they're transformed again
+            const std::vector<VertexData>& previous = g_meshWindowVertices[previousSlot];
+            for (size_t i = 0; i < previous.size(); ++i)
+            {
+                g_meshPreviousPositions[i] = previous[i].m_pos;
+            }
+
+            reprojection.m_previousPositions = g_meshPreviousPositions.data();
+            reprojection.m_previousColor = state.m_previousColor.data();
+            reprojection.m_previousDepth = state.m_previousDepth.data();
+            reprojection.m_depthTolerance = kReprojectionDepthTolerance;
+            reprojection.m_refreshFrames = state.m_reprojectionFrames;
+            reprojection.m_refreshPhase = state.m_storedFrames % state.m_reprojectionFrames;
+            frame.m_reprojection = &reprojection;
+        }
+        frame.m_storeShading = reprojecting;
+
+        // Cluster bounds are only there once the vertices are, so a frame that redraws
+        // everything adds its draws afterwards
+        const bool incremental = state.m_incremental && state.m_mode == RenderMode::NORMAL &&
+            state.m_backend == RenderBackend::RASTERIZER && !state.m_rain && !reprojecting;
+        const bool redrawAll = !incremental || state.m_redrawAll || verticesChanged ||
+            cullLights || state.m_depthBuffer != buffers->m_depth;
+        state.m_redrawAll = false;
+        state.m_depthBuffer = buffers->m_depth;
+
+        DirtyTiles* dirty = &state.m_dirty;
+        DirtyRegion::BeginFrame(
+            dirty, buffers->m_color, (int)buffers->m_width, (int)buffers->m_height);
+        // The next frame's vertices are worked out from the start of this one's jobs. They go
+        // in the slot reprojection has just read last frame's positions from.
+        if (spinning)
+        {
+            StartNextVertices(*buffers, lod, fmodf(state.m_spinAngle + state.m_spin, kTwoPi));
+        }
+
+        if (redrawAll)
+        {
+            DirtyRegion::Invalidate(dirty);
+            RunFrameJobs(&frame, clears, verticesChanged, transformVertices, cullLights);
+            AddMeshDraws(frame);
+            DirtyRegion::EndFrame(dirty);
+        }
+        else
+        {
+            AddMeshDraws(frame);
+            DirtyRegion::EndFrame(dirty);
+            RunRedrawJobs(&frame);
+        }
+
+        if (adaptive && dirty->m_dirtyTiles > 0)
+        {
+            ShadingRates::Choose(
+                &state.m_shadingRates,
+                buffers->m_color,
+                (int)buffers->m_width,
+                (int)buffers->m_height,
+                state.m_adaptiveShading);
+        }
+        return;
+    }
 
     //
     // Setup geometry (in window coordinates already)
@@ -94,8 +1385,8 @@ void Render(RasterBuffers* buffers)
         vertices[i].w = 1;
     }
 
-    static int frame = 0;
-    ++frame;
+    static int frameIndex = 0;
+    ++frameIndex;
 
     const VertexData vertexData[] = {
         { vertices[0], { 0, 1, 0, 1 }, { 0.0f, 0.0f } },
@@ -110,19 +1401,15 @@ void Render(RasterBuffers* buffers)
 
     POW2_ASSERT(SizeOfArray(triangles) % 3 == 0);
 
-    //
-    // Rasterize each triangle
-    //
-
-    for (int i = 0; i < SizeOfArray(triangles); i += 3)
-    {
-        TriangleInput input = {
-            vertexData, 
-            { g_textureSize, g_textureSize, (uint32_t*)g_texture },
-            { triangles[i], triangles[i + 1], triangles[i + 2] } };
+    int edges[2 * (SizeOfArray(triangles))];
+    uint64_t edgeScratch[SizeOfArray(triangles)];
+    int edgeCount = Wireframe::ExtractEdges(triangles, SizeOfArray(triangles), edges, edgeScratch);
 
-        Rasterizer::RasterTriangle(buffers, input);
-    }
+    frame.m_vertices = vertexData;
+    frame.m_indices = triangles;
+    frame.m_indexCount = SizeOfArray(triangles);
+    frame.m_edges = edges;
+    frame.m_edgeCount = edgeCount;
 
-    DebugTimer_TocAndPrint(__FUNCTION__);
+    RunFrameJobs(&frame, clears, false, false, false);
 }
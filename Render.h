@@ -0,0 +1,161 @@
+#pragma once
+
+struct JobGraph;
+struct RasterBuffers;
+enum class ShadingRate;  // see Rasterizer.h
+
+enum class RenderMode
+{
+    NORMAL,
+    WIREFRAME,         // unique edges only
+    WIREFRAME_OVERLAY  // shaded geometry with depth tested edges on top
+};
+
+enum class RenderBackend
+{
+    RASTERIZER,
+    RAY_TRACER  // BVH traced primary rays, same image as the rasterizer
+};
+
+// Runs the frame as a graph of jobs on the ThreadPool and returns once it's done. Work for the
+// next frame may be left running (the vertices of a spinning mesh), Render_Finish waits for it.
+void Render(RasterBuffers* buffers);
+
+// The last frame's jobs, with their timings (see ThreadPool::WriteTrace)
+const JobGraph& Render_GetJobs();
+
+// The jobs the frame before the last one started for it, finished, null if there were none.
+// They overlap that frame's jobs.
+const JobGraph* Render_GetEarlyJobs();
+
+// Waits for any work Render left running, before shutting the ThreadPool down
+void Render_Finish();
+
+// Replaces the test geometry with a mesh file produced by Tools/MeshTool.cpp. The file stays
+// mapped for the lifetime of the app.
+bool Render_LoadMesh(const char* path);
+
+// Occluders for the scene mesh, usually a few large triangles inside its walls and solid parts
+// (same object space, also made with Tools/MeshTool.cpp). The mesh is then drawn in clusters of
+// consecutive triangles and clusters hidden behind the occluders are skipped (see Occlusion.h).
+// The result only changes with the window size.
+bool Render_LoadOccluders(const char* path);
+
+struct CullingStats
+{
+    int m_clusters;
+    int m_culled;
+};
+
+CullingStats Render_GetCullingStats();
+
+// Scene mesh files can hold a chain of simplified versions of the mesh (Tools/MeshTool.cpp
+// "lod"). Render draws the coarsest whose surface is within this many pixels of the full
+// mesh's, picked again whenever the window size changes. 0, the default, always draws the full
+// mesh.
+void Render_SetLodErrorPixels(float pixels);
+float Render_GetLodErrorPixels();
+
+struct LodStats
+{
+    int m_lod;  // 0 is the full mesh
+    int m_lodCount;
+    int m_triangles;
+};
+
+LodStats Render_GetLodStats();
+
+// Lights the scene mesh with this many generated lights, Blinn-Phong from the mesh normals: a
+// directional key light and point and spot lights of limited range scattered over the window.
+// They're culled against 16x16 pixel tiles of a depth pre-pass (see Lighting.h) so each pixel
+// only evaluates the lights near it. 0, the default, leaves the mesh unlit.
+void Render_SetLightCount(int count);
+int Render_GetLightCount();
+
+struct LightingStats
+{
+    int m_lights;
+    float m_averageTileLights;  // over the tiles with any
+    int m_maxTileLights;
+    double m_cullMs;  // the last time they were culled
+};
+
+LightingStats Render_GetLightingStats();
+
+// Incremental rendering: a frame only clears and draws again the tiles where the scene mesh's
+// clusters changed since its colour buffer was last drawn (see DirtyRegion.h), so a frame where
+// nothing changed costs next to nothing. Colour buffers must keep what Render drew in them, a
+// ring of a few is fine, and the depth buffer must be the same one every frame. Wireframes, the
+// ray tracer and rain redraw everything. Off by default.
+void Render_SetIncremental(bool enabled);
+bool Render_GetIncremental();
+
+// Redraws everything next frame, for when the buffers lost their contents (the swapchain
+// reallocated them say)
+void Render_Invalidate();
+
+struct RedrawStats  // of the last frame
+{
+    int m_tiles;
+    int m_redrawnTiles;
+};
+
+RedrawStats Render_GetRedrawStats();
+
+// Variable rate shading of the scene mesh: every triangle is shaded at this rate (see
+// ShadingRate), 1x1 by default. Adaptive shading also picks a rate for each 16x16 tile from how
+// detailed the last frame was there (see ShadingRates.h) and the coarser of the two wins.
+// threshold is the luma levels (of 255) it lets pixels move by on average, 0, the default, is
+// off. Only the rasterizer has coarse rates.
+void Render_SetShadingRate(ShadingRate rate);
+ShadingRate Render_GetShadingRate();
+void Render_SetAdaptiveShading(float threshold);
+float Render_GetAdaptiveShading();
+
+struct ShadingStats  // tiles at each rate for the next frame, none without adaptive shading
+{
+    int m_tiles1x1;
+    int m_tiles2x2;
+    int m_tiles4x4;
+};
+
+ShadingStats Render_GetShadingStats();
+
+// Turns the scene mesh about its vertical axis by this many radians every frame, 0, the default,
+// stops it where it is. Once turned it's fit to the window at every angle, so it's smaller.
+void Render_SetSpin(float radiansPerFrame);
+float Render_GetSpin();
+
+// Reverse reprojection caching of the scene mesh's shading (see ReprojectionInput): a pixel
+// whose surface was visible last frame takes its colour from then instead of being shaded,
+// except for a rotating 1 / frames of the pixels that are shaded every frame. While most of the
+// image carries over, shading work drops towards 1 / frames of the fragments, and shading that
+// changes (the lights on a turning mesh) lags up to frames frames behind. Only the rasterizer
+// in the normal mode reuses shading, and every frame is drawn in full while it's on. 0 or 1,
+// the default, is off.
+void Render_SetReprojection(int frames);
+int Render_GetReprojection();
+
+// Replaces the test checkerboard with a DDS texture (DXT1, DXT5 or uncompressed 32 bit).
+// Compressed textures are decoded on the fly through a block cache.
+bool Render_LoadTexture(const char* path);
+
+void Render_SetMode(RenderMode mode);
+RenderMode Render_GetMode();
+
+// Wireframe edges are always rasterized, the backend only changes how triangles are drawn
+void Render_SetBackend(RenderBackend backend);
+RenderBackend Render_GetBackend();
+
+struct RayTraceStats  // of the last frame the ray tracer drew
+{
+    double m_bvhMs;  // building the BVH for a new mesh, refitting it otherwise
+    double m_traceMs;
+    double m_mraysPerSecond;
+};
+
+RayTraceStats Render_GetRayTraceStats();
+
+// Rain particles drawn as streaks over the scene
+void Render_SetRain(bool enabled);
+bool Render_GetRain();
@@ -0,0 +1,113 @@
+#include "ShadingRates.h"
+
+#include "External/pow2assert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Rec. 601 weights in eighths, good enough to tell flat from busy
+static inline uint8_t Luma(uint32_t c)
+{
+    const int r = (c >> 16) & 0xff;
+    const int g = (c >> 8) & 0xff;
+    const int b = c & 0xff;
+    return (uint8_t)((2 * r + 5 * g + b) >> 3);
+}
+
+// Sums the luma changes between neighbouring pixels into the tiles they're in (the left and
+// lower pixel's)
+static void SumChanges(ShadingRateTiles* tiles, const uint32_t* color)
+{
+    const int size = ShadingRateTiles::kTileSize;
+    const int width = tiles->m_width;
+
+    memset(tiles->m_changesX.data(), 0, tiles->m_changesX.size() * sizeof(int));
+    memset(tiles->m_changesY.data(), 0, tiles->m_changesY.size() * sizeof(int));
+
+    const uint8_t* previous = nullptr;
+    for (int y = 0; y < tiles->m_height; ++y)
+    {
+        const uint32_t* row = color + (size_t)y * width;
+        uint8_t* luma = tiles->m_luma[y & 1].data();
+        for (int x = 0; x < width; ++x)
+        {
+            luma[x] = Luma(row[x]);
+        }
+
+        int* changesX = tiles->m_changesX.data() + (y / size) * tiles->m_tilesX;
+        int* changesY = tiles->m_changesY.data() + (y / size) * tiles->m_tilesX;
+        for (int tile = 0; tile < tiles->m_tilesX; ++tile)
+        {
+            const int first = tile * size;
+            const int end = first + size < width ? first + size : width;
+            int sumX = 0;
+            int sumY = 0;
+            for (int x = first; x < end; ++x)
+            {
+                sumX += x + 1 < width ? abs(luma[x + 1] - luma[x]) : 0;
+                sumY += previous ? abs(luma[x] - previous[x]) : 0;
+            }
+            changesX[tile] += sumX;
+            changesY[tile] += sumY;
+        }
+
+        previous = luma;
+    }
+}
+
+void ShadingRates::Choose(
+    ShadingRateTiles* tiles,
+    const uint32_t* color,
+    int width,
+    int height,
+    float threshold)
+{
+    POW2_ASSERT(tiles);
+    POW2_ASSERT(color);
+    POW2_ASSERT(width > 0 && height > 0);
+    POW2_ASSERT(threshold >= 0);
+
+    const int size = ShadingRateTiles::kTileSize;
+    tiles->m_width = width;
+    tiles->m_height = height;
+    tiles->m_tilesX = (width + size - 1) / size;
+    tiles->m_tilesY = (height + size - 1) / size;
+
+    const size_t tileCount = (size_t)tiles->m_tilesX * tiles->m_tilesY;
+    tiles->m_rates.resize(tileCount);
+    tiles->m_changesX.resize(tileCount);
+    tiles->m_changesY.resize(tileCount);
+    tiles->m_luma[0].resize(width);
+    tiles->m_luma[1].resize(width);
+    memset(tiles->m_tileCounts, 0, sizeof(tiles->m_tileCounts));
+
+    SumChanges(tiles, color);
+
+    for (int ty = 0; ty < tiles->m_tilesY; ++ty)
+    {
+        const int tileHeight = ty * size + size < height ? size : height - ty * size;
+        for (int tx = 0; tx < tiles->m_tilesX; ++tx)
+        {
+            const int tileWidth = tx * size + size < width ? size : width - tx * size;
+            const int tile = ty * tiles->m_tilesX + tx;
+            const int changes = tiles->m_changesX[tile] > tiles->m_changesY[tile] ?
+                tiles->m_changesX[tile] : tiles->m_changesY[tile];
+            const float change = changes / (float)(tileWidth * tileHeight);
+
+            // Pixels of an NxN block are N / 4 from its centre along each axis on average, so
+            // about N / 2 steps of change away from the colour they get
+            ShadingRate rate = ShadingRate::Rate1x1;
+            if (change * 2 <= threshold)
+            {
+                rate = ShadingRate::Rate4x4;
+            }
+            else if (change <= threshold)
+            {
+                rate = ShadingRate::Rate2x2;
+            }
+
+            tiles->m_rates[tile] = rate;
+            ++tiles->m_tileCounts[(int)rate];
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Rasterizer.h"
+
+#include <stdint.h>
+#include <vector>
+
+//
+// SHADING RATES INPUT: a frame's colour buffer
+// SHADING RATES OUTPUT: a shading rate for each tile of the buffer, to draw the next frame with
+//
+// Content adaptive: each tile is shaded as coarsely as it can be without its colours moving by
+// more than a threshold, going by how fast luma changes across it (the mean change from one
+// pixel to the next). Flat and smoothly shaded tiles go coarse, textured ones and ones with
+// edges in them stay at full rate. Coarse shading turns a ramp into steps that climb as much in
+// total, so a tile measures about the same whatever rate drew it and doesn't drift coarser frame
+// after frame. Coverage is per pixel at any rate, so silhouettes stay sharp regardless.
+//
+
+struct ShadingRateTiles  // zero is initialisation, no tiles
+{
+    static const int kTileSize = 16;  // a multiple of the largest block, 4
+
+    int m_width;  // of the buffer
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<ShadingRate> m_rates;  // row by row from the bottom, like the buffers
+
+    int m_tileCounts[(int)ShadingRate::Count];  // how many tiles are at each rate
+
+    // Scratch: luma of the last two rows, luma changes along x and y summed per tile
+    std::vector<uint8_t> m_luma[2];
+    std::vector<int> m_changesX;
+    std::vector<int> m_changesY;
+};
+
+namespace ShadingRates
+{
+    // threshold is in 8 bit luma levels: the most a coarse rate may move a pixel's luma by on
+    // average. Rates are sized for the buffer, draws into buffers of other sizes ignore them.
+    void Choose(
+        ShadingRateTiles* tiles,
+        const uint32_t* color,
+        int width,
+        int height,
+        float threshold);
+}
@@ -1,3 +1,3 @@
 #pragma once
 
-#define SizeOfArray(a) sizeof(a) / sizeof(a[0])
+#define SizeOfArray(a) (sizeof(a) / sizeof(a[0]))
@@ -0,0 +1,287 @@
+#include "Swapchain.h"
+
+#include "DebugTimer.h"
+#include "PerfCounters.h"
+
+#include "External/pow2assert.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+
+struct SwapchainSums  // zero is initialisation
+{
+    int m_submits;
+    double m_renderMs;
+    double m_acquireWaitMs;
+    double m_queueDepth;
+
+    int m_frames;  // presented
+    double m_presentMs;
+    double m_latencyMs;
+    int m_intervals;
+    double m_frameIntervalMs;
+    double m_frameIntervalMaxMs;
+};
+
+struct SwapchainState
+{
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;  // present thread waits on this
+    std::condition_variable m_presented;  // render thread waits on this
+    bool m_quit;
+
+    PresentFunction m_present;
+    void* m_userData;
+
+    uint32_t* m_colors[Swapchain::kMaxBuffers];
+    int m_bufferCount;
+    int m_width;
+    int m_height;
+
+    // Frame numbers, the buffer of frame n is n % m_bufferCount. Protected by m_mutex.
+    uint64_t m_submitCount;
+    uint64_t m_presentCount;
+    double m_submitMs[Swapchain::kMaxBuffers];  // when each buffer's frame was submitted
+
+    // Render thread only
+    bool m_acquired;
+    double m_acquireMs;
+    double m_acquireWaitMs;
+
+    // Protected by m_mutex
+    double m_lastPresentEndMs;
+    SwapchainSums m_sums;
+};
+
+static SwapchainState g_swapchain;
+static bool g_initialised = false;
+
+static void PresentMain()
+{
+    SwapchainState& s = g_swapchain;
+
+    for (;;)
+    {
+        uint64_t frame;
+        {
+            std::unique_lock<std::mutex> lock(s.m_mutex);
+            s.m_submitted.wait(lock, [&] {
+                return s.m_quit || s.m_presentCount != s.m_submitCount; });
+
+            if (s.m_presentCount == s.m_submitCount)
+            {
+                return;  // quitting, and nothing left to present
+            }
+
+            frame = s.m_presentCount;
+        }
+
+        // The buffer can't change until m_presentCount moves on, no need to hold the lock
+        const int buffer = (int)(frame % s.m_bufferCount);
+        PerfSample perf;
+        const bool counting = PerfCounters::IsEnabled();
+        if (counting)
+        {
+            PerfCounters::Read(&perf);
+        }
+
+        const double startMs = DebugTimer_NowMs();
+        s.m_present(s.m_colors[buffer], s.m_width, s.m_height, s.m_userData);
+        const double endMs = DebugTimer_NowMs();
+
+        if (counting)
+        {
+            PerfCounters::Lap(PerfStage::PRESENT, &perf);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s.m_mutex);
+
+            SwapchainSums& sums = s.m_sums;
+            ++sums.m_frames;
+            sums.m_presentMs += endMs - startMs;
+            sums.m_latencyMs += endMs - s.m_submitMs[buffer];
+            if (s.m_lastPresentEndMs > 0)
+            {
+                const double interval = endMs - s.m_lastPresentEndMs;
+                ++sums.m_intervals;
+                sums.m_frameIntervalMs += interval;
+                if (interval > sums.m_frameIntervalMaxMs)
+                {
+                    sums.m_frameIntervalMaxMs = interval;
+                }
+            }
+            s.m_lastPresentEndMs = endMs;
+
+            ++s.m_presentCount;
+        }
+        s.m_presented.notify_one();
+    }
+}
+
+static void FreeBuffers()
+{
+    for (int i = 0; i < Swapchain::kMaxBuffers; ++i)
+    {
+        free(g_swapchain.m_colors[i]);
+        g_swapchain.m_colors[i] = nullptr;
+    }
+}
+
+void Swapchain::Init(PresentFunction present, void* userData)
+{
+    POW2_ASSERT(!g_initialised);
+    POW2_ASSERT(present);
+
+    SwapchainState& s = g_swapchain;
+    s.m_quit = false;
+    s.m_present = present;
+    s.m_userData = userData;
+    s.m_bufferCount = 0;
+    s.m_width = 0;
+    s.m_height = 0;
+    s.m_submitCount = 0;
+    s.m_presentCount = 0;
+    s.m_acquired = false;
+    s.m_lastPresentEndMs = 0;
+    s.m_sums = {};
+
+    s.m_thread = std::thread(PresentMain);
+    g_initialised = true;
+}
+
+void Swapchain::Shutdown()
+{
+    POW2_ASSERT(g_initialised);
+    POW2_ASSERT(!g_swapchain.m_acquired);
+
+    {
+        std::lock_guard<std::mutex> lock(g_swapchain.m_mutex);
+        g_swapchain.m_quit = true;
+    }
+    g_swapchain.m_submitted.notify_one();
+    g_swapchain.m_thread.join();
+
+    FreeBuffers();
+    g_initialised = false;
+}
+
+void Swapchain::Configure(int width, int height, int bufferCount)
+{
+    POW2_ASSERT(g_initialised);
+    POW2_ASSERT(!g_swapchain.m_acquired);
+    POW2_ASSERT(width >= 0 && height >= 0);
+    POW2_ASSERT(bufferCount >= 1 && bufferCount <= kMaxBuffers);
+
+    WaitIdle();
+
+    SwapchainState& s = g_swapchain;
+    FreeBuffers();
+    for (int i = 0; i < bufferCount; ++i)
+    {
+        const size_t bytes = (size_t)width * height * sizeof(uint32_t);
+        s.m_colors[i] = (uint32_t*)malloc(bytes > 0 ? bytes : sizeof(uint32_t));  // minimised
+        POW2_ASSERT(s.m_colors[i]);
+    }
+
+    s.m_width = width;
+    s.m_height = height;
+    s.m_bufferCount = bufferCount;
+
+    // Frame numbers restart so frame 0 is buffer 0 whatever the new count
+    std::lock_guard<std::mutex> lock(s.m_mutex);
+    s.m_submitCount = 0;
+    s.m_presentCount = 0;
+}
+
+int Swapchain::GetBufferCount()
+{
+    return g_swapchain.m_bufferCount;
+}
+
+uint32_t* Swapchain::Acquire()
+{
+    SwapchainState& s = g_swapchain;
+    POW2_ASSERT(g_initialised && s.m_bufferCount > 0);
+    POW2_ASSERT(!s.m_acquired);
+
+    const double startMs = DebugTimer_NowMs();
+
+    uint64_t frame;
+    {
+        // The next buffer is free once the frame that used it last has been presented
+        std::unique_lock<std::mutex> lock(s.m_mutex);
+        s.m_presented.wait(lock, [&] {
+            return s.m_submitCount - s.m_presentCount < (uint64_t)s.m_bufferCount; });
+        frame = s.m_submitCount;
+    }
+
+    s.m_acquired = true;
+    s.m_acquireMs = DebugTimer_NowMs();
+    s.m_acquireWaitMs = s.m_acquireMs - startMs;
+    return s.m_colors[frame % s.m_bufferCount];
+}
+
+void Swapchain::Submit()
+{
+    SwapchainState& s = g_swapchain;
+    POW2_ASSERT(s.m_acquired);
+
+    const double nowMs = DebugTimer_NowMs();
+    s.m_acquired = false;
+
+    {
+        std::lock_guard<std::mutex> lock(s.m_mutex);
+        s.m_submitMs[s.m_submitCount % s.m_bufferCount] = nowMs;
+        ++s.m_submitCount;
+
+        ++s.m_sums.m_submits;
+        s.m_sums.m_renderMs += nowMs - s.m_acquireMs;
+        s.m_sums.m_acquireWaitMs += s.m_acquireWaitMs;
+        s.m_sums.m_queueDepth += (double)(s.m_submitCount - s.m_presentCount);
+    }
+    s.m_submitted.notify_one();
+}
+
+void Swapchain::WaitIdle()
+{
+    SwapchainState& s = g_swapchain;
+    std::unique_lock<std::mutex> lock(s.m_mutex);
+    s.m_presented.wait(lock, [&] { return s.m_presentCount == s.m_submitCount; });
+}
+
+SwapchainMetrics Swapchain::GetMetrics()
+{
+    std::lock_guard<std::mutex> lock(g_swapchain.m_mutex);
+    const SwapchainSums& sums = g_swapchain.m_sums;
+
+    SwapchainMetrics metrics = {};
+    metrics.m_frames = sums.m_frames;
+    if (sums.m_submits > 0)
+    {
+        metrics.m_renderMs = sums.m_renderMs / sums.m_submits;
+        metrics.m_acquireWaitMs = sums.m_acquireWaitMs / sums.m_submits;
+        metrics.m_queueDepth = sums.m_queueDepth / sums.m_submits;
+    }
+    if (sums.m_frames > 0)
+    {
+        metrics.m_presentMs = sums.m_presentMs / sums.m_frames;
+        metrics.m_latencyMs = sums.m_latencyMs / sums.m_frames;
+    }
+    if (sums.m_intervals > 0)
+    {
+        metrics.m_frameIntervalMs = sums.m_frameIntervalMs / sums.m_intervals;
+        metrics.m_frameIntervalMaxMs = sums.m_frameIntervalMaxMs;
+    }
+    return metrics;
+}
+
+void Swapchain::ResetMetrics()
+{
+    std::lock_guard<std::mutex> lock(g_swapchain.m_mutex);
+    g_swapchain.m_sums = {};
+    g_swapchain.m_lastPresentEndMs = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// SWAPCHAIN INPUT: rendered colour buffers
+// SWAPCHAIN OUTPUT: calls to a present function, made from a thread of its own
+//
+// Buffers are used round robin. With 2 or 3 of them frame N is presented (or written out)
+// while frame N + 1 is rendered. With 1 the render thread waits for every present, which is
+// the old synchronous behaviour and a useful baseline.
+//
+
+// Called on the present thread. color is bottom up, 0xAARRGGBB, width * height pixels.
+typedef void (*PresentFunction)(const uint32_t* color, int width, int height, void* userData);
+
+struct SwapchainMetrics  // averages over the frames presented since the last reset, in ms
+{
+    int m_frames;
+    double m_renderMs;          // Acquire returning to Submit
+    double m_acquireWaitMs;     // render thread blocked in Acquire, waiting for a free buffer
+    double m_presentMs;         // inside the present function
+    double m_latencyMs;         // Submit to the end of that frame's present
+    double m_frameIntervalMs;   // between the ends of consecutive presents
+    double m_frameIntervalMaxMs;
+    double m_queueDepth;        // frames submitted but not presented yet, sampled at Submit
+};
+
+namespace Swapchain
+{
+    static const int kMaxBuffers = 3;
+
+    // Starts the present thread. Call Configure before the first Acquire.
+    void Init(PresentFunction present, void* userData);
+
+    // Presents whatever is queued and stops the present thread
+    void Shutdown();
+
+    // Waits for queued frames and reallocates the colour buffers
+    void Configure(int width, int height, int bufferCount);
+
+    int GetBufferCount();
+
+    // Blocks until the next buffer in the ring is free and returns it. It still holds the frame
+    // drawn in it GetBufferCount() frames ago, or garbage after Configure.
+    uint32_t* Acquire();
+
+    // Queues the acquired buffer for presentation and returns straight away
+    void Submit();
+
+    // Blocks until every submitted frame has been presented
+    void WaitIdle();
+
+    SwapchainMetrics GetMetrics();
+    void ResetMetrics();
+}
@@ -0,0 +1,367 @@
+#include "Texture.h"
+
+#include "Log.h"
+
+#include "External/pow2assert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// BLOCK DECODING
+//
+
+static inline uint32_t Rgb565ToColor(uint32_t c)
+{
+    uint32_t r = (c >> 11) & 0x1f;
+    uint32_t g = (c >> 5) & 0x3f;
+    uint32_t b = c & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+// Weighted blend of two 0xAARRGGBB colours: (c0 * w0 + c1 * w1) / (w0 + w1), per channel.
+// w0 + w1 must be 2 or 3. Divides by 3 are done as a multiply and shift, exact for 0..765.
+static inline uint32_t BlendColors(uint32_t c0, uint32_t c1, uint32_t w0, uint32_t w1)
+{
+    const uint32_t multiplier = (w0 + w1 == 3) ? 43691 : 65536;
+    const uint32_t shift = 17;
+    uint32_t r = (((c0 >> 16) & 0xff) * w0 + ((c1 >> 16) & 0xff) * w1) * multiplier >> shift;
+    uint32_t g = (((c0 >> 8) & 0xff) * w0 + ((c1 >> 8) & 0xff) * w1) * multiplier >> shift;
+    uint32_t b = ((c0 & 0xff) * w0 + (c1 & 0xff) * w1) * multiplier >> shift;
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+// Fills the 4 entry palette of a BC1 colour block. BC3 colour blocks are always 4 colour.
+static inline void ColorBlockPalette(
+    const uint8_t* block,
+    bool allowPunchThrough,
+    uint32_t* palette)
+{
+    const uint32_t c0 = block[0] | (block[1] << 8);
+    const uint32_t c1 = block[2] | (block[3] << 8);
+    palette[0] = Rgb565ToColor(c0);
+    palette[1] = Rgb565ToColor(c1);
+
+    if (c0 > c1 || !allowPunchThrough)
+    {
+        palette[2] = BlendColors(palette[0], palette[1], 2, 1);
+        palette[3] = BlendColors(palette[0], palette[1], 1, 2);
+    }
+    else
+    {
+        palette[2] = BlendColors(palette[0], palette[1], 1, 1);
+        palette[3] = 0x00000000;  // transparent black
+    }
+}
+
+static inline uint32_t ColorBlockIndices(const uint8_t* block)
+{
+    return block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+}
+
+static inline void AlphaBlockPalette(const uint8_t* block, uint32_t* palette)
+{
+    const uint32_t a0 = block[0];
+    const uint32_t a1 = block[1];
+    palette[0] = a0;
+    palette[1] = a1;
+
+    if (a0 > a1)
+    {
+        for (uint32_t i = 1; i < 7; ++i)
+        {
+            palette[i + 1] = (a0 * (7 - i) + a1 * i) / 7;
+        }
+    }
+    else
+    {
+        for (uint32_t i = 1; i < 5; ++i)
+        {
+            palette[i + 1] = (a0 * (5 - i) + a1 * i) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static inline uint64_t AlphaBlockIndices(const uint8_t* block)
+{
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    }
+    return indices;
+}
+
+void Texture::DecodeBC1Block(const uint8_t* block, uint32_t* texels)
+{
+    uint32_t palette[4];
+    ColorBlockPalette(block, true, palette);
+
+    uint32_t indices = ColorBlockIndices(block);
+    for (int i = 0; i < 16; ++i)
+    {
+        texels[i] = palette[indices & 3];
+        indices >>= 2;
+    }
+}
+
+void Texture::DecodeBC3Block(const uint8_t* block, uint32_t* texels)
+{
+    uint32_t alphaPalette[8];
+    AlphaBlockPalette(block, alphaPalette);
+
+    uint32_t colorPalette[4];
+    ColorBlockPalette(block + 8, false, colorPalette);
+
+    uint64_t alphaIndices = AlphaBlockIndices(block);
+    uint32_t colorIndices = ColorBlockIndices(block + 8);
+    for (int i = 0; i < 16; ++i)
+    {
+        texels[i] = (colorPalette[colorIndices & 3] & 0x00ffffff) |
+            (alphaPalette[alphaIndices & 7] << 24);
+        colorIndices >>= 2;
+        alphaIndices >>= 3;
+    }
+}
+
+// Decodes one texel only, for when there's no block cache
+static uint32_t DecodeTexel(TextureFormat format, const uint8_t* block, int texel)
+{
+    if (format == TextureFormat::BC1)
+    {
+        uint32_t palette[4];
+        ColorBlockPalette(block, true, palette);
+        return palette[(ColorBlockIndices(block) >> (2 * texel)) & 3];
+    }
+
+    uint32_t alphaPalette[8];
+    AlphaBlockPalette(block, alphaPalette);
+    uint32_t colorPalette[4];
+    ColorBlockPalette(block + 8, false, colorPalette);
+
+    uint32_t color = colorPalette[(ColorBlockIndices(block + 8) >> (2 * texel)) & 3];
+    uint32_t alpha = alphaPalette[(AlphaBlockIndices(block) >> (3 * texel)) & 7];
+    return (color & 0x00ffffff) | (alpha << 24);
+}
+
+//
+// SAMPLING
+//
+
+POW2_STATIC_ASSERT(TextureBlockCache::kEntries == 64);  // FetchTexel maps 8x8 blocks to entries
+
+uint32_t Texture::FetchTexel(const TextureData& texture, int x, int y)
+{
+    if (texture.m_format == TextureFormat::RGBA8)
+    {
+        return texture.m_data[y * texture.m_width + x];
+    }
+
+    const int blockX = x >> 2;
+    const int blockY = y >> 2;
+    const int blocksWide = (texture.m_width + 3) / 4;
+    const size_t blockBytes = texture.m_format == TextureFormat::BC1 ? 8 : 16;
+    const uint8_t* block =
+        (const uint8_t*)texture.m_data + (blockY * blocksWide + blockX) * blockBytes;
+    const int texel = (y & 3) * 4 + (x & 3);
+
+    TextureBlockCache* cache = texture.m_blockCache;
+    if (!cache)
+    {
+        return DecodeTexel(texture.m_format, block, texel);
+    }
+
+    // Entries map to an 8x8 tile of blocks, so any 32x32 texel footprint never conflicts
+    const int entry = (blockX & 7) | ((blockY & 7) << 3);
+
+    if (cache->m_tags[entry] != block)
+    {
+        if (texture.m_format == TextureFormat::BC1)
+        {
+            DecodeBC1Block(block, cache->m_texels[entry]);
+        }
+        else
+        {
+            DecodeBC3Block(block, cache->m_texels[entry]);
+        }
+        cache->m_tags[entry] = block;
+        ++cache->m_misses;
+    }
+    else
+    {
+        ++cache->m_hits;
+    }
+
+    return cache->m_texels[entry][texel];
+}
+
+// In 64 bits, so sizes a 32 bit size_t can't hold don't wrap
+static uint64_t TopLevelBytes(TextureFormat format, uint64_t width, uint64_t height)
+{
+    const uint64_t blocks = ((width + 3) / 4) * ((height + 3) / 4);
+    switch (format)
+    {
+        case TextureFormat::BC1: return blocks * 8;
+        case TextureFormat::BC3: return blocks * 16;
+        default: return width * height * 4;
+    }
+}
+
+size_t Texture::DataBytes(const TextureData& texture)
+{
+    return (size_t)TopLevelBytes(texture.m_format, texture.m_width, texture.m_height);
+}
+
+//
+// DDS LOADING
+//
+
+struct DdsPixelFormat
+{
+    uint32_t m_size;
+    uint32_t m_flags;
+    uint32_t m_fourCC;
+    uint32_t m_rgbBitCount;
+    uint32_t m_rBitMask;
+    uint32_t m_gBitMask;
+    uint32_t m_bBitMask;
+    uint32_t m_aBitMask;
+};
+
+struct DdsHeader
+{
+    uint32_t m_magic;  // "DDS "
+    uint32_t m_size;
+    uint32_t m_flags;
+    uint32_t m_height;
+    uint32_t m_width;
+    uint32_t m_pitchOrLinearSize;
+    uint32_t m_depth;
+    uint32_t m_mipMapCount;
+    uint32_t m_reserved1[11];
+    DdsPixelFormat m_pixelFormat;
+    uint32_t m_caps[4];
+    uint32_t m_reserved2;
+};
+
+POW2_STATIC_ASSERT(sizeof(DdsHeader) == 128);
+
+static const uint32_t kDdsMagic = 0x20534444;  // "DDS "
+static const uint32_t kDdsFourCCDxt1 = 0x31545844;  // "DXT1"
+static const uint32_t kDdsFourCCDxt5 = 0x35545844;  // "DXT5"
+static const uint32_t kDdsPixelFormatFourCC = 0x4;
+static const uint32_t kDdsPixelFormatRgb = 0x40;
+static const uint64_t kDdsMaxBytes = 1 << 30;  // well inside a 32 bit address space
+
+bool Texture::LoadDds(const char* path, TextureData* texture)
+{
+    POW2_ASSERT(texture);
+
+    *texture = {};
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        Log::Warning("Cannot open texture %s", path);
+        return false;
+    }
+
+    DdsHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.m_magic != kDdsMagic ||
+        header.m_size != sizeof(header) - 4 ||
+        header.m_width == 0 ||
+        header.m_height == 0 ||
+        header.m_width > 32768 ||
+        header.m_height > 32768)
+    {
+        Log::Warning("Not a DDS texture: %s", path);
+        fclose(file);
+        return false;
+    }
+
+    const DdsPixelFormat& format = header.m_pixelFormat;
+    bool swapRedBlue = false;
+
+    if ((format.m_flags & kDdsPixelFormatFourCC) && format.m_fourCC == kDdsFourCCDxt1)
+    {
+        texture->m_format = TextureFormat::BC1;
+    }
+    else if ((format.m_flags & kDdsPixelFormatFourCC) && format.m_fourCC == kDdsFourCCDxt5)
+    {
+        texture->m_format = TextureFormat::BC3;
+    }
+    else if ((format.m_flags & kDdsPixelFormatRgb) &&
+        format.m_rgbBitCount == 32 &&
+        format.m_gBitMask == 0x0000ff00 &&
+        (format.m_rBitMask == 0x00ff0000 || format.m_rBitMask == 0x000000ff))
+    {
+        texture->m_format = TextureFormat::RGBA8;
+        swapRedBlue = (format.m_rBitMask == 0x000000ff);
+    }
+    else
+    {
+        Log::Warning("Unsupported DDS format in %s (DXT1, DXT5 and 32 bit RGB only)", path);
+        fclose(file);
+        return false;
+    }
+
+    // Only the top level is read, mipmaps are ignored for now
+    if (TopLevelBytes(texture->m_format, header.m_width, header.m_height) > kDdsMaxBytes)
+    {
+        Log::Warning("DDS texture %s is too big (%ux%u)", path, header.m_width, header.m_height);
+        fclose(file);
+        return false;
+    }
+
+    texture->m_width = header.m_width;
+    texture->m_height = header.m_height;
+
+    const size_t bytes = DataBytes(*texture);
+    texture->m_data = (uint32_t*)malloc(bytes);
+    bool ok = texture->m_data && fread(texture->m_data, 1, bytes, file) == bytes;
+    fclose(file);
+
+    if (!ok)
+    {
+        Log::Warning("DDS texture %s is truncated", path);
+        Free(texture);
+        return false;
+    }
+
+    if (swapRedBlue)
+    {
+        const int count = texture->m_width * texture->m_height;
+        for (int i = 0; i < count; ++i)
+        {
+            const uint32_t c = texture->m_data[i];
+            texture->m_data[i] = (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+        }
+    }
+
+    // Uncompressed DDS files often leave the alpha channel out
+    if (texture->m_format == TextureFormat::RGBA8 && format.m_aBitMask == 0)
+    {
+        const int count = texture->m_width * texture->m_height;
+        for (int i = 0; i < count; ++i)
+        {
+            texture->m_data[i] |= 0xff000000;
+        }
+    }
+
+    return true;
+}
+
+void Texture::Free(TextureData* texture)
+{
+    POW2_ASSERT(texture);
+
+    free(texture->m_data);
+    *texture = {};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class TextureFormat
+{
+    RGBA8,  // one uint32_t per texel, same layout as the colour buffer (0xAARRGGBB)
+    BC1,    // 4x4 blocks of 8 bytes (DXT1), 4 bits per texel
+    BC3     // 4x4 blocks of 16 bytes (DXT5), 8 bits per texel
+};
+
+// Small direct-mapped cache of decoded 4x4 blocks. Neighbouring fragments mostly sample the same
+// few blocks, so each block is decoded once instead of once per texel. A cache can be shared by
+// any number of textures but not by threads. Zero it again if a texture's data is freed.
+struct TextureBlockCache  // zero is initialisation
+{
+    static const int kEntries = 64;  // 4KB of texels, fits in L1
+
+    const void* m_tags[kEntries];  // address of the block held by each entry
+    uint32_t m_texels[kEntries][16];
+    uint32_t m_hits;
+    uint32_t m_misses;
+};
+
+struct TextureData
+{
+    int m_width;
+    int m_height;
+    uint32_t* m_data;  // texels or blocks, depending on m_format
+    TextureFormat m_format;
+    TextureBlockCache* m_blockCache;  // optional, only used by block compressed formats
+};
+
+namespace Texture
+{
+    // Returns the texel at (x, y) as 0xAARRGGBB. Coordinates must be inside the texture.
+    uint32_t FetchTexel(const TextureData& texture, int x, int y);
+
+    // Size of the top level (no mipmaps yet)
+    size_t DataBytes(const TextureData& texture);
+
+    // Decodes a whole 4x4 block into 16 texels (row major, 0xAARRGGBB)
+    void DecodeBC1Block(const uint8_t* block, uint32_t* texels);
+    void DecodeBC3Block(const uint8_t* block, uint32_t* texels);
+
+    // Loads the top level of a DDS file: DXT1, DXT5 or uncompressed 32 bit. The texture owns its
+    // data until Free is called.
+    bool LoadDds(const char* path, TextureData* texture);
+    void Free(TextureData* texture);
+}
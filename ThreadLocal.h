@@ -0,0 +1,7 @@
+#pragma once
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)  // VS2013 has no thread_local
+#else
+#define THREAD_LOCAL __thread
+#endif
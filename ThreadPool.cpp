@@ -0,0 +1,460 @@
+#include "ThreadPool.h"
+
+#include "DebugTimer.h"
+#include "ThreadLocal.h"
+
+#include "External/pow2assert.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const int kMaxThreads = 64;
+
+struct Task
+{
+    void (*m_run)(void* data, int threadIndex);
+    void* m_data;
+};
+
+struct TaskQueue  // the owner pushes and pops at the back (m_tail), thieves take the front
+{
+    static const unsigned kCapacity = 1024;  // power of two
+
+    std::mutex m_mutex;
+    Task m_tasks[kCapacity];
+    unsigned m_head;
+    unsigned m_tail;
+};
+
+struct ThreadPoolState
+{
+    std::vector<std::thread> m_workers;
+    TaskQueue m_queues[kMaxThreads];
+    int m_threadCount;
+    std::atomic<int> m_queued;  // tasks in every queue
+
+    // Threads with nothing to run sleep on m_wake. Anything that can end a sleep (a task queued,
+    // a loop or graph finished, quitting) notifies it if m_sleeping says someone may be asleep.
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_sleeping;
+    bool m_quit;  // protected by m_mutex
+};
+
+struct ParallelForBatch
+{
+    ThreadPool::TaskFunction m_function;
+    void* m_userData;
+    int m_count;
+    std::atomic<int> m_next;
+    std::atomic<int> m_helpers;  // helper tasks queued or running
+};
+
+static ThreadPoolState g_pool;
+static bool g_initialised = false;
+static THREAD_LOCAL int t_threadIndex = -1;  // pool threads only
+
+//
+// QUEUES
+//
+
+static void WakeAll()
+{
+    if (g_pool.m_sleeping.load() > 0)
+    {
+        // Taking the lock means a sleeper is either waiting already or hasn't checked its
+        // condition yet, so the notification can't be lost
+        {
+            std::lock_guard<std::mutex> lock(g_pool.m_mutex);
+        }
+        g_pool.m_wake.notify_all();
+    }
+}
+
+// Returns false if the queue is full, the caller runs the task itself then
+static bool PushTask(int threadIndex, void (*run)(void*, int), void* data)
+{
+    TaskQueue& queue = g_pool.m_queues[threadIndex];
+    {
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (queue.m_tail - queue.m_head == TaskQueue::kCapacity)
+        {
+            return false;
+        }
+
+        Task& task = queue.m_tasks[queue.m_tail++ & (TaskQueue::kCapacity - 1)];
+        task.m_run = run;
+        task.m_data = data;
+    }
+
+    g_pool.m_queued.fetch_add(1);
+    if (g_pool.m_sleeping.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_pool.m_mutex);
+        }
+        g_pool.m_wake.notify_one();
+    }
+    return true;
+}
+
+static bool PopTask(int threadIndex, Task* task)
+{
+    if (g_pool.m_queued.load() == 0)
+    {
+        return false;
+    }
+
+    // Newest task of our own queue first, it's the likeliest to be in cache
+    bool found = false;
+    {
+        TaskQueue& queue = g_pool.m_queues[threadIndex];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (queue.m_tail != queue.m_head)
+        {
+            *task = queue.m_tasks[--queue.m_tail & (TaskQueue::kCapacity - 1)];
+            found = true;
+        }
+    }
+
+    // Then the oldest of somebody else's, which tends to be the biggest piece of work left
+    for (int i = 1; i < g_pool.m_threadCount && !found; ++i)
+    {
+        TaskQueue& queue = g_pool.m_queues[(threadIndex + i) % g_pool.m_threadCount];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (queue.m_tail != queue.m_head)
+        {
+            *task = queue.m_tasks[queue.m_head++ & (TaskQueue::kCapacity - 1)];
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        g_pool.m_queued.fetch_sub(1);
+    }
+    return found;
+}
+
+static bool RunOneTask(int threadIndex)
+{
+    Task task;
+    if (!PopTask(threadIndex, &task))
+    {
+        return false;
+    }
+
+    task.m_run(task.m_data, threadIndex);
+    return true;
+}
+
+// Sleeps until there are tasks to run or done() is true
+template <typename Done>
+static void WaitForWork(Done done)
+{
+    std::unique_lock<std::mutex> lock(g_pool.m_mutex);
+    g_pool.m_sleeping.fetch_add(1);
+    g_pool.m_wake.wait(lock, [&] { return g_pool.m_queued.load() > 0 || done(); });
+    g_pool.m_sleeping.fetch_sub(1);
+}
+
+// Runs tasks until done() is true
+template <typename Done>
+static void RunUntil(int threadIndex, Done done)
+{
+    while (!done())
+    {
+        if (!RunOneTask(threadIndex))
+        {
+            WaitForWork(done);
+        }
+    }
+}
+
+static void WorkerMain(int threadIndex)
+{
+    t_threadIndex = threadIndex;
+
+    for (;;)
+    {
+        if (RunOneTask(threadIndex))
+        {
+            continue;
+        }
+
+        WaitForWork([] { return g_pool.m_quit; });
+        if (g_pool.m_quit)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::Init(int threadCount)
+{
+    POW2_ASSERT(!g_initialised);
+
+    if (threadCount <= 0)
+    {
+        threadCount = (int)std::thread::hardware_concurrency();
+        threadCount = threadCount > 0 ? threadCount : 1;
+    }
+    threadCount = threadCount < kMaxThreads ? threadCount : kMaxThreads;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        g_pool.m_queues[i].m_head = 0;
+        g_pool.m_queues[i].m_tail = 0;
+    }
+    g_pool.m_threadCount = threadCount;
+    g_pool.m_queued = 0;
+    g_pool.m_sleeping = 0;
+    g_pool.m_quit = false;
+
+    t_threadIndex = 0;
+    for (int i = 0; i < threadCount - 1; ++i)
+    {
+        g_pool.m_workers.push_back(std::thread(WorkerMain, i + 1));
+    }
+
+    g_initialised = true;
+}
+
+void ThreadPool::Shutdown()
+{
+    if (!g_initialised)
+    {
+        return;
+    }
+
+    POW2_ASSERT(g_pool.m_queued.load() == 0);
+
+    {
+        std::lock_guard<std::mutex> lock(g_pool.m_mutex);
+        g_pool.m_quit = true;
+    }
+    g_pool.m_wake.notify_all();
+
+    for (size_t i = 0; i < g_pool.m_workers.size(); ++i)
+    {
+        g_pool.m_workers[i].join();
+    }
+    g_pool.m_workers.clear();
+
+    t_threadIndex = -1;
+    g_initialised = false;
+}
+
+int ThreadPool::GetThreadCount()
+{
+    return g_initialised ? g_pool.m_threadCount : 0;
+}
+
+//
+// PARALLEL FOR
+//
+// The calling thread queues one helper per other thread and works through the indices itself.
+// Helpers take indices from the same counter, so threads that start late or run slow tasks just
+// end up doing fewer of them.
+//
+
+static void RunBatch(ParallelForBatch* batch, int threadIndex)
+{
+    for (;;)
+    {
+        const int index = batch->m_next.fetch_add(1);
+        if (index >= batch->m_count)
+        {
+            break;
+        }
+        batch->m_function(index, threadIndex, batch->m_userData);
+    }
+}
+
+static void RunBatchHelper(void* data, int threadIndex)
+{
+    ParallelForBatch* batch = (ParallelForBatch*)data;
+    RunBatch(batch, threadIndex);
+
+    // The batch lives on the caller's stack and may be gone as soon as this reaches 0
+    if (batch->m_helpers.fetch_sub(1) == 1)
+    {
+        WakeAll();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, TaskFunction function, void* userData)
+{
+    if (!g_initialised)
+    {
+        Init(0);
+    }
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    const int threadIndex = t_threadIndex;
+    POW2_ASSERT(threadIndex >= 0);  // only pool threads can wait on the pool
+
+    ParallelForBatch batch;
+    batch.m_function = function;
+    batch.m_userData = userData;
+    batch.m_count = count;
+    batch.m_next = 0;
+
+    const int helpers = (count < g_pool.m_threadCount ? count : g_pool.m_threadCount) - 1;
+    batch.m_helpers = helpers;
+    for (int i = 0; i < helpers; ++i)
+    {
+        if (!PushTask(threadIndex, RunBatchHelper, &batch))
+        {
+            batch.m_helpers.fetch_sub(1);
+        }
+    }
+
+    RunBatch(&batch, threadIndex);
+    RunUntil(threadIndex, [&] { return batch.m_helpers.load() == 0; });
+}
+
+//
+// JOB GRAPHS
+//
+
+static void RunGraphJob(void* data, int threadIndex);
+
+static void QueueGraphJob(GraphJob* job, int threadIndex)
+{
+    if (!PushTask(threadIndex, RunGraphJob, job))
+    {
+        RunGraphJob(job, threadIndex);
+    }
+}
+
+static void RunGraphJob(void* data, int threadIndex)
+{
+    GraphJob* job = (GraphJob*)data;
+    JobGraph* graph = job->m_graph;
+
+    job->m_threadIndex = threadIndex;
+    job->m_startMs = DebugTimer_NowMs();
+    job->m_function(threadIndex, job->m_userData);
+    job->m_endMs = DebugTimer_NowMs();
+
+    for (int i = 0; i < job->m_successorCount; ++i)
+    {
+        GraphJob* successor = &graph->m_jobs[job->m_successors[i]];
+        if (successor->m_pending.fetch_sub(1) == 1)
+        {
+            QueueGraphJob(successor, threadIndex);
+        }
+    }
+
+    // Successors are queued first so the count can't reach 0 early. The graph may be reset as
+    // soon as it does.
+    if (graph->m_remaining.fetch_sub(1) == 1)
+    {
+        WakeAll();
+    }
+}
+
+void ThreadPool::ResetGraph(JobGraph* graph)
+{
+    POW2_ASSERT(graph);
+    POW2_ASSERT(graph->m_remaining.load() == 0);  // not running
+
+    graph->m_jobCount = 0;
+}
+
+int ThreadPool::AddJob(JobGraph* graph, const char* name, JobFunction function, void* userData)
+{
+    POW2_ASSERT(graph && name && function);
+    POW2_ASSERT(graph->m_jobCount < JobGraph::kMaxJobs);
+
+    const int index = graph->m_jobCount++;
+    GraphJob& job = graph->m_jobs[index];
+    job.m_name = name;
+    job.m_function = function;
+    job.m_userData = userData;
+    job.m_graph = graph;
+    job.m_successorCount = 0;
+    job.m_dependencyCount = 0;
+    job.m_startMs = 0;
+    job.m_endMs = 0;
+    job.m_threadIndex = -1;
+    return index;
+}
+
+void ThreadPool::AddDependency(JobGraph* graph, int job, int dependency)
+{
+    POW2_ASSERT(graph);
+    POW2_ASSERT(job >= 0 && job < graph->m_jobCount);
+
+    // Dependencies must be added before the jobs that wait on them, so there can't be cycles
+    POW2_ASSERT(dependency >= 0 && dependency < job);
+
+    GraphJob& before = graph->m_jobs[dependency];
+    POW2_ASSERT(before.m_successorCount < GraphJob::kMaxSuccessors);
+    before.m_successors[before.m_successorCount++] = job;
+    ++graph->m_jobs[job].m_dependencyCount;
+}
+
+void ThreadPool::Kick(JobGraph* graph)
+{
+    POW2_ASSERT(graph);
+    POW2_ASSERT(graph->m_remaining.load() == 0);
+
+    if (!g_initialised)
+    {
+        Init(0);
+    }
+
+    const int threadIndex = t_threadIndex;
+    POW2_ASSERT(threadIndex >= 0);
+
+    // Every count is set before the first job is queued, which may finish straight away
+    graph->m_remaining = graph->m_jobCount;
+    for (int i = 0; i < graph->m_jobCount; ++i)
+    {
+        graph->m_jobs[i].m_pending = graph->m_jobs[i].m_dependencyCount;
+    }
+
+    for (int i = 0; i < graph->m_jobCount; ++i)
+    {
+        if (graph->m_jobs[i].m_dependencyCount == 0)
+        {
+            QueueGraphJob(&graph->m_jobs[i], threadIndex);
+        }
+    }
+}
+
+void ThreadPool::Wait(JobGraph* graph)
+{
+    POW2_ASSERT(graph);
+    POW2_ASSERT(t_threadIndex >= 0);
+
+    RunUntil(t_threadIndex, [&] { return graph->m_remaining.load() == 0; });
+}
+
+void ThreadPool::WriteTrace(FILE* file, const JobGraph& graph, int frame, bool first)
+{
+    POW2_ASSERT(file);
+
+    for (int i = 0; i < graph.m_jobCount; ++i)
+    {
+        const GraphJob& job = graph.m_jobs[i];
+        fprintf(
+            file,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"frame\":%d}}",
+            first && i == 0 ? "" : ",\n",
+            job.m_name,
+            job.m_threadIndex,
+            job.m_startMs * 1000,
+            (job.m_endMs - job.m_startMs) * 1000,
+            frame);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+
+//
+// Work stealing thread pool, for data parallel loops (tiles, rays, ...) and graphs of jobs with
+// dependencies (the stages of a frame).
+//
+// Every thread has a queue of its own. Threads push and pop at the back of theirs, so related
+// work stays on one core, and take from the front of the others' when theirs is empty. Threads
+// waiting on a loop or a graph run queued work meanwhile, so loops can nest inside jobs.
+//
+
+struct JobGraph;
+
+namespace ThreadPool
+{
+    // threadIndex is the pool thread running the task, in [0, GetThreadCount()). The thread that
+    // called Init is 0. Use it to pick per thread state, Memory::GetThreadArena say.
+    typedef void (*TaskFunction)(int index, int threadIndex, void* userData);
+    typedef void (*JobFunction)(int threadIndex, void* userData);
+
+    // Starts threadCount - 1 workers, the calling thread is the last one. 0 uses one thread per
+    // hardware thread. ParallelFor and Kick call it on first use if needed.
+    void Init(int threadCount);
+    void Shutdown();
+
+    int GetThreadCount();
+
+    // Runs function(i, thread, userData) for every i in [0, count) across the pool and returns
+    // once they've all finished. Can be called from tasks and jobs.
+    void ParallelFor(int count, TaskFunction function, void* userData);
+
+    //
+    // Job graphs: add jobs and their dependencies, Kick, then Wait. A graph can be reused once
+    // Wait has returned, ResetGraph empties it.
+    //
+
+    void ResetGraph(JobGraph* graph);
+
+    // name must outlive the graph (a literal). Returns the job's index.
+    int AddJob(JobGraph* graph, const char* name, JobFunction function, void* userData);
+
+    // job won't start before dependency has finished
+    void AddDependency(JobGraph* graph, int job, int dependency);
+
+    // Queues the jobs without dependencies and returns straight away
+    void Kick(JobGraph* graph);
+
+    // Runs queued work until every job of the graph has finished
+    void Wait(JobGraph* graph);
+
+    // Appends the jobs of a finished graph to a Chrome trace file (chrome://tracing, Perfetto)
+    // as complete events, one row per thread. The file is a JSON array: write "[" first and
+    // pass first = true for the first graph of the file. The closing "]" is optional.
+    void WriteTrace(FILE* file, const JobGraph& graph, int frame, bool first);
+}
+
+struct GraphJob
+{
+    static const int kMaxSuccessors = 8;
+
+    const char* m_name;
+    ThreadPool::JobFunction m_function;
+    void* m_userData;
+    JobGraph* m_graph;
+    int m_successors[kMaxSuccessors];  // jobs that depend on this one
+    int m_successorCount;
+    int m_dependencyCount;
+    std::atomic<int> m_pending;  // dependencies left, while the graph runs
+
+    // Filled in as it runs
+    double m_startMs;
+    double m_endMs;
+    int m_threadIndex;
+};
+
+struct JobGraph  // see ThreadPool::ResetGraph
+{
+    static const int kMaxJobs = 32;
+
+    GraphJob m_jobs[kMaxJobs];
+    int m_jobCount;
+    std::atomic<int> m_remaining;  // jobs not finished yet
+};
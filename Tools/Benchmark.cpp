@@ -0,0 +1,2538 @@
+//
+// Renderer benchmarks.
+//
+// Usage:
+//   Benchmark [name] [--iterations N] [--compare modeA modeB] [--json path]
+//
+// Runs every benchmark, or only those whose name starts with name. The options are for the
+// "variants" A/B suite (see below).
+//
+// Builds as a console application from this file plus the renderer sources (everything but
+// Main_*.cpp). Build with optimisations; PROFILE should be 0 in Rasterizer.cpp so the per
+// triangle logging doesn't dominate the timings.
+//
+
+#include "../DebugTimer.h"
+#include "../DirtyRegion.h"
+#include "../DynamicResolution.h"
+#include "../FrameSink.h"
+#include "../Lighting.h"
+#include "../Log.h"
+#include "../MathSimd.h"
+#include "../Memory.h"
+#include "../Occlusion.h"
+#include "../Particles.h"
+#include "../Rasterizer.h"
+#include "../RayTracer.h"
+#include "../ShadingRates.h"
+#include "../SizeOfArray.h"
+#include "../Texture.h"
+#include "../ThreadPool.h"
+#include "../Wireframe.h"
+
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+//
+// HELPERS
+//
+
+static uint32_t g_randomState = 12345;
+
+static uint32_t Random()
+{
+    // xorshift32, deterministic across runs and platforms
+    g_randomState ^= g_randomState << 13;
+    g_randomState ^= g_randomState >> 17;
+    g_randomState ^= g_randomState << 5;
+    return g_randomState;
+}
+
+static float RandomFloat(float range)
+{
+    return (Random() & 0xffff) / 65535.0f * range;
+}
+
+static void PrintResult(const char* name, double timeMs, double count, const char* unit)
+{
+    printf("%-40s %10.2fms %10.2fns/%s\n", name, timeMs, 1000000 * timeMs / count, unit);
+}
+
+static const int kScreenWidth = 1280;
+static const int kScreenHeight = 720;
+
+struct BenchmarkScene
+{
+    std::vector<VertexData> m_vertices;  // window coordinates
+    std::vector<int> m_indices;
+};
+
+struct BenchmarkTarget
+{
+    std::vector<uint32_t> m_color;
+    std::vector<FragmentInput> m_fragments;
+    std::vector<float> m_depth;
+    RasterBuffers m_buffers;
+    DepthBuffer m_depthBuffer;
+};
+
+static void CreateTarget(BenchmarkTarget* target, int width, int height)
+{
+    target->m_color.resize(width * height);
+    target->m_fragments.resize(width * height);
+    target->m_depth.resize(width * height);
+
+    RasterBuffers& buffers = target->m_buffers;
+    buffers = {};
+    buffers.m_color = target->m_color.data();
+    buffers.m_fragmentsTmpBuffer = target->m_fragments.data();
+    buffers.m_width = width;
+    buffers.m_height = height;
+    buffers.m_bytesPerPixel = 4;
+    buffers.m_colorBufferBytes = width * height * 4;
+    buffers.m_fragmentsTmpBufferBytes = width * height * sizeof(FragmentInput);
+
+    buffers.m_depth = target->m_depth.data();
+    buffers.m_depthBufferBytes = width * height * sizeof(float);
+
+    target->m_depthBuffer.m_data = target->m_depth.data();
+    target->m_depthBuffer.m_width = width;
+    target->m_depthBuffer.m_height = height;
+}
+
+// Screen covering grid of cellSize x cellSize quads (two triangles each) with random depth
+static void CreateGridScene(BenchmarkScene* scene, int width, int height, int cellSize)
+{
+    const int cellsX = width / cellSize;
+    const int cellsY = height / cellSize;
+
+    scene->m_vertices.clear();
+    scene->m_indices.clear();
+
+    g_randomState = 7;
+    for (int y = 0; y <= cellsY; ++y)
+    {
+        for (int x = 0; x <= cellsX; ++x)
+        {
+            VertexData vertex = {
+                vec4(
+                    fminf((float)(x * cellSize), width - 1.0f),
+                    fminf((float)(y * cellSize), height - 1.0f),
+                    (Random() & 0xffff) / 65535.0f,
+                    1),
+                vec4(1, 1, 1, 1),
+                vec2(x / (float)cellsX, y / (float)cellsY) };
+            scene->m_vertices.push_back(vertex);
+        }
+    }
+
+    for (int y = 0; y < cellsY; ++y)
+    {
+        for (int x = 0; x < cellsX; ++x)
+        {
+            const int i0 = y * (cellsX + 1) + x;
+            const int i1 = i0 + 1;
+            const int i2 = i0 + cellsX + 1;
+            const int i3 = i2 + 1;
+            const int quad[6] = { i0, i2, i1, i1, i2, i3 };
+            scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static void RasterScene(
+    RasterBuffers* buffers,
+    const BenchmarkScene& scene,
+    const TextureData& texture)
+{
+    for (size_t i = 0; i < scene.m_indices.size(); i += 3)
+    {
+        TriangleInput input = {
+            scene.m_vertices.data(),
+            texture,
+            { scene.m_indices[i], scene.m_indices[i + 1], scene.m_indices[i + 2] } };
+
+        Rasterizer::RasterTriangle(buffers, input);
+    }
+}
+
+//
+// TEXTURE SAMPLING
+//
+// Point samples a 1024x1024 texture uncompressed and block compressed, with and without the
+// decoded block cache. "coherent" walks the texture in scanline order like a 1:1 textured quad,
+// "random" is the worst case for the block cache.
+//
+
+static const int kTextureSize = 1024;
+
+static uint32_t ColorTo565(uint32_t c)
+{
+    return (((c >> 16) & 0xff) >> 3 << 11) | (((c >> 8) & 0xff) >> 2 << 5) | ((c & 0xff) >> 3);
+}
+
+static int ColorDistance(uint32_t a, uint32_t b)
+{
+    int dr = (int)((a >> 16) & 0xff) - (int)((b >> 16) & 0xff);
+    int dg = (int)((a >> 8) & 0xff) - (int)((b >> 8) & 0xff);
+    int db = (int)(a & 0xff) - (int)(b & 0xff);
+    return dr * dr + dg * dg + db * db;
+}
+
+// Bounding box encoder, good enough to produce representative blocks
+static void EncodeColorBlock(const uint32_t* texels, uint8_t* block)
+{
+    uint32_t minC = 0xffffffff;
+    uint32_t maxC = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            uint32_t mask = 0xffu << shift;
+            if ((texels[i] & mask) < (minC & mask)) minC = (minC & ~mask) | (texels[i] & mask);
+            if ((texels[i] & mask) > (maxC & mask)) maxC = (maxC & ~mask) | (texels[i] & mask);
+        }
+    }
+
+    uint32_t c0 = ColorTo565(maxC);
+    uint32_t c1 = ColorTo565(minC);
+    if (c0 < c1)
+    {
+        uint32_t tmp = c0;
+        c0 = c1;
+        c1 = tmp;
+    }
+
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+
+    // Decode the palette the same way the sampler does so indices pick the closest entry
+    uint8_t paletteBlock[8] = { block[0], block[1], block[2], block[3], 0xe4, 0xe4, 0xe4, 0xe4 };
+    uint32_t palette[16];
+    Texture::DecodeBC1Block(paletteBlock, palette);  // indices 0xe4 = entries 0, 1, 2, 3
+
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        for (int p = 1; p < (c0 == c1 ? 1 : 4); ++p)
+        {
+            if (ColorDistance(texels[i], palette[p]) < ColorDistance(texels[i], palette[best]))
+            {
+                best = p;
+            }
+        }
+        indices |= best << (2 * i);
+    }
+
+    block[4] = indices & 0xff;
+    block[5] = (indices >> 8) & 0xff;
+    block[6] = (indices >> 16) & 0xff;
+    block[7] = indices >> 24;
+}
+
+static void EncodeAlphaBlock(const uint32_t* texels, uint8_t* block)
+{
+    uint32_t a0 = 0;
+    uint32_t a1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        uint32_t a = texels[i] >> 24;
+        a0 = a > a0 ? a : a0;
+        a1 = a < a1 ? a : a1;
+    }
+
+    block[0] = (uint8_t)a0;
+    block[1] = (uint8_t)a1;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int a = texels[i] >> 24;
+        int best = 0;
+        int bestError = 1 << 30;
+        for (int p = 0; p < 8; ++p)
+        {
+            // a0 > a1 mode: 0 = a0, 1 = a1, 2..7 = blends from a0 to a1
+            int value = p == 0 ? a0 : p == 1 ? a1 : (a0 * (8 - p) + a1 * (p - 1)) / 7;
+            int error = (value - a) * (value - a);
+            if (a0 > a1 && error < bestError)
+            {
+                best = p;
+                bestError = error;
+            }
+        }
+        indices |= (uint64_t)best << (3 * i);
+    }
+
+    for (int i = 0; i < 6; ++i)
+    {
+        block[2 + i] = (uint8_t)(indices >> (8 * i));
+    }
+}
+
+static void EncodeTexture(const uint32_t* texels, TextureFormat format, std::vector<uint32_t>* out)
+{
+    const int blocksWide = kTextureSize / 4;
+    const size_t blockBytes = format == TextureFormat::BC1 ? 8 : 16;
+    out->resize(blocksWide * blocksWide * blockBytes / 4);
+
+    for (int by = 0; by < blocksWide; ++by)
+    {
+        for (int bx = 0; bx < blocksWide; ++bx)
+        {
+            uint32_t block[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                block[i] = texels[(by * 4 + i / 4) * kTextureSize + bx * 4 + i % 4];
+            }
+
+            uint8_t* dst = (uint8_t*)out->data() + (by * blocksWide + bx) * blockBytes;
+            if (format == TextureFormat::BC1)
+            {
+                EncodeColorBlock(block, dst);
+            }
+            else
+            {
+                EncodeAlphaBlock(block, dst);
+                EncodeColorBlock(block, dst + 8);
+            }
+        }
+    }
+}
+
+static void BenchmarkTextureSampling(const char* name, const TextureData& texture, bool coherent)
+{
+    const int samples = kTextureSize * kTextureSize;
+
+    std::vector<uint32_t> coords(samples);  // precomputed so both patterns cost the same
+    g_randomState = 12345;
+    for (int i = 0; i < samples; ++i)
+    {
+        int x = coherent ? i % kTextureSize : Random() % kTextureSize;
+        int y = coherent ? i / kTextureSize : Random() % kTextureSize;
+        coords[i] = (y << 16) | x;
+    }
+
+    uint32_t checksum = 0;
+
+    DebugTimer_Tic(name);
+
+    for (int i = 0; i < samples; ++i)
+    {
+        checksum += Texture::FetchTexel(texture, coords[i] & 0xffff, coords[i] >> 16);
+    }
+
+    double timeMs = DebugTimer_Toc(name);
+
+    char label[128];
+    snprintf(
+        label,
+        sizeof(label),
+        "%s (%.2fMB%s)",
+        name,
+        Texture::DataBytes(texture) / (1024.0 * 1024.0),
+        checksum == 0 ? ", checksum 0" : "");
+    PrintResult(label, timeMs, samples, "sample");
+
+    if (texture.m_blockCache)
+    {
+        TextureBlockCache* cache = texture.m_blockCache;
+        printf(
+            "%-40s %10.1f%% block cache hits\n",
+            "",
+            100.0 * cache->m_hits / (double)(cache->m_hits + cache->m_misses));
+    }
+}
+
+static void BenchmarkTexture()
+{
+    // Smooth gradients with some noise, like a typical albedo map
+    std::vector<uint32_t> texels(kTextureSize * kTextureSize);
+    g_randomState = 1;
+    for (int y = 0; y < kTextureSize; ++y)
+    {
+        for (int x = 0; x < kTextureSize; ++x)
+        {
+            uint32_t noise = Random() & 0x1f;
+            uint32_t r = (x / 4 + noise) & 0xff;
+            uint32_t g = (y / 4 + noise) & 0xff;
+            uint32_t b = ((x + y) / 8) & 0xff;
+            uint32_t a = ((x / 64 + y / 64) % 2) ? 0xff : 0x80;
+            texels[y * kTextureSize + x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    std::vector<uint32_t> bc1;
+    std::vector<uint32_t> bc3;
+    EncodeTexture(texels.data(), TextureFormat::BC1, &bc1);
+    EncodeTexture(texels.data(), TextureFormat::BC3, &bc3);
+
+    for (int coherent = 1; coherent >= 0; --coherent)
+    {
+        const char* pattern = coherent ? "coherent" : "random";
+        char name[64];
+
+        TextureData rgba8 = { kTextureSize, kTextureSize, texels.data(), TextureFormat::RGBA8 };
+        snprintf(name, sizeof(name), "texture/rgba8/%s", pattern);
+        BenchmarkTextureSampling(name, rgba8, coherent != 0);
+
+        const TextureFormat formats[] = { TextureFormat::BC1, TextureFormat::BC3 };
+        for (int f = 0; f < 2; ++f)
+        {
+            const char* formatName = formats[f] == TextureFormat::BC1 ? "bc1" : "bc3";
+            TextureData texture = {
+                kTextureSize,
+                kTextureSize,
+                formats[f] == TextureFormat::BC1 ? bc1.data() : bc3.data(),
+                formats[f] };
+
+            snprintf(name, sizeof(name), "texture/%s/%s", formatName, pattern);
+            BenchmarkTextureSampling(name, texture, coherent != 0);
+
+            TextureBlockCache cache = {};
+            texture.m_blockCache = &cache;
+            snprintf(name, sizeof(name), "texture/%s-cached/%s", formatName, pattern);
+            BenchmarkTextureSampling(name, texture, coherent != 0);
+        }
+    }
+}
+
+//
+// DEPTH ONLY
+//
+// Same geometry through the colour path (RasterTriangle) and the depth only path (RasterDepth).
+// Then a depth pass used as a shadow map: a sloped receiver under a quad occluder, lit by a
+// light looking down the view direction through a half resolution map. The shadowed pass
+// checks every pixel against the map and counts the self-shadowing the bias prevents.
+//
+
+struct ShadowCounts
+{
+    int m_lit;       // full light
+    int m_shadowed;  // ambient only
+    int m_wrong;     // lit or shadowed against the map, or partly lit without PCF
+};
+
+// Window quad from (x0, y0) to (x1, y1), depth z0 on its left edge and z1 on its right
+static void AddQuad(
+    BenchmarkScene* scene,
+    float x0,
+    float y0,
+    float x1,
+    float y1,
+    float z0,
+    float z1)
+{
+    const int first = (int)scene->m_vertices.size();
+    const float corners[4][3] = { { x0, y0, z0 }, { x1, y0, z1 }, { x0, y1, z0 }, { x1, y1, z1 } };
+    for (int i = 0; i < 4; ++i)
+    {
+        VertexData vertex = {
+            vec4(corners[i][0], corners[i][1], corners[i][2], 1),
+            vec4(1, 1, 1, 1),
+            vec2(0, 0) };
+        scene->m_vertices.push_back(vertex);
+    }
+
+    const int quad[6] = { first, first + 2, first + 1, first + 1, first + 2, first + 3 };
+    scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+}
+
+// Classifies the pixels of a white receiver drawn with shadow, from the red channel
+static ShadowCounts CountShadow(
+    const BenchmarkTarget& target,
+    const DepthBuffer& shadowMap,
+    float occluderDepth,
+    int pcfRadius)
+{
+    // Rasterizer.cpp's kShadowAmbient is 63, either can be a step down from weights that sum
+    // to a little under 1
+    const uint32_t kLitRed = 254;
+    const uint32_t kShadowedRed = 63;
+
+    ShadowCounts counts = {};
+    for (int y = 0; y < kScreenHeight; ++y)
+    {
+        for (int x = 0; x < kScreenWidth; ++x)
+        {
+            const uint32_t red = target.m_color[y * kScreenWidth + x] >> 16 & 0xff;
+            const bool occluded =
+                shadowMap.m_data[(y / 2) * shadowMap.m_width + x / 2] <= occluderDepth;
+            const bool lit = red >= kLitRed;
+            const bool shadowed = red <= kShadowedRed;
+            counts.m_lit += lit;
+            counts.m_shadowed += shadowed;
+            if (pcfRadius == 0)
+            {
+                counts.m_wrong += occluded ? !shadowed : !lit;
+            }
+            else
+            {
+                // Whatever the filter, a pixel over the occluder can't be fully lit, nor one
+                // clear of it fully shadowed
+                counts.m_wrong += occluded ? lit : shadowed;
+            }
+        }
+    }
+    return counts;
+}
+
+static void BenchmarkShadow(BenchmarkTarget* target)
+{
+    const int kFrames = 10;
+    const float kOccluderDepth = 0.1f;
+    const float kBias = 0.002f;  // window depth, several map texels of the receiver's slope
+
+    // The receiver fills the screen and slopes away to the right, the occluder shades the
+    // middle quarter of it
+    BenchmarkScene receiver;
+    AddQuad(&receiver, 0, 0, (float)kScreenWidth, (float)kScreenHeight, 0.4f, 0.9f);
+    BenchmarkScene casters = receiver;
+    AddQuad(&casters,
+        kScreenWidth / 4.0f, kScreenHeight / 4.0f, kScreenWidth * 3 / 4.0f,
+        kScreenHeight * 3 / 4.0f, kOccluderDepth, kOccluderDepth);
+
+    // Light window coordinates of the casters, and of the receiver's vertices for the lookup.
+    // The quarter texel offset keeps pixels off texel edges, where rounding would pick either
+    // texel. The map holds the depth at a texel's first pixel and depth goes up to the right,
+    // so without a bias nearly every pixel is behind it.
+    for (size_t i = 0; i < casters.m_vertices.size(); ++i)
+    {
+        casters.m_vertices[i].m_pos.x = casters.m_vertices[i].m_pos.x * 0.5f + 0.25f;
+        casters.m_vertices[i].m_pos.y = casters.m_vertices[i].m_pos.y * 0.5f + 0.25f;
+    }
+    std::vector<vec4> shadowCoords(receiver.m_vertices.size());
+    for (size_t i = 0; i < shadowCoords.size(); ++i)
+    {
+        shadowCoords[i] = casters.m_vertices[i].m_pos;
+    }
+
+    std::vector<float> shadowData((kScreenWidth / 2) * (kScreenHeight / 2));
+    DepthBuffer shadowMap = { shadowData.data(), kScreenWidth / 2, kScreenHeight / 2 };
+    Rasterizer::ClearDepth(&shadowMap, FLT_MAX);
+    Rasterizer::RasterDepth(
+        &shadowMap,
+        casters.m_vertices.data(),
+        casters.m_indices.data(),
+        (int)casters.m_indices.size());
+
+    uint32_t white = 0xffffffff;
+    const TextureData whiteTexture = { 1, 1, &white };
+
+    const double pixels = (double)kScreenWidth * kScreenHeight * kFrames;
+    DebugTimer_Tic("depth/unshadowed-pass");
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        std::fill(target->m_depth.begin(), target->m_depth.end(), FLT_MAX);
+        RasterScene(&target->m_buffers, receiver, whiteTexture);
+    }
+    PrintResult("depth/unshadowed-pass", DebugTimer_Toc("depth/unshadowed-pass"), pixels, "pixel");
+
+    const float biases[] = { 0, kBias, kBias };
+    const int pcfRadii[] = { 0, 0, 1 };
+    for (int i = 0; i < (int)SizeOfArray(biases); ++i)
+    {
+        const ShadowInput shadow = { &shadowMap, shadowCoords.data(), biases[i], pcfRadii[i] };
+
+        char name[64];
+        snprintf(name, sizeof(name), "depth/shadowed-pass/bias-%g/pcf-%d", biases[i],
+            pcfRadii[i]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            std::fill(target->m_depth.begin(), target->m_depth.end(), FLT_MAX);
+            for (size_t t = 0; t < receiver.m_indices.size(); t += 3)
+            {
+                TriangleInput input = {
+                    receiver.m_vertices.data(),
+                    whiteTexture,
+                    { receiver.m_indices[t], receiver.m_indices[t + 1],
+                        receiver.m_indices[t + 2] },
+                    &shadow };
+                Rasterizer::RasterTriangle(&target->m_buffers, input);
+            }
+        }
+        PrintResult(name, DebugTimer_Toc(name), pixels, "pixel");
+
+        const ShadowCounts counts =
+            CountShadow(*target, shadowMap, kOccluderDepth, pcfRadii[i]);
+        const double total = (double)kScreenWidth * kScreenHeight;
+        printf("%-40s %.1f%% lit, %.1f%% shadowed (25.0%% occluded)\n", "",
+            100 * counts.m_lit / total, 100 * counts.m_shadowed / total);
+        printf("%-40s %d pixels %s\n", "", counts.m_wrong,
+            biases[i] == 0 ? "wrong, self-shadowed without a bias" : "wrong");
+    }
+}
+
+static void BenchmarkDepth()
+{
+    const int kFrames = 10;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    uint32_t texels[4] = { 0xffffffff, 0xff000000, 0xff000000, 0xffffffff };
+    const TextureData texture = { 2, 2, texels };
+
+    const int cellSizes[] = { 64, 16, 4 };
+    for (int c = 0; c < (int)SizeOfArray(cellSizes); ++c)
+    {
+        BenchmarkScene scene;
+        CreateGridScene(&scene, kScreenWidth, kScreenHeight, cellSizes[c]);
+        const double triangles = (double)scene.m_indices.size() / 3 * kFrames;
+
+        char name[64];
+        snprintf(name, sizeof(name), "depth/color-pass/%dpx-cells", cellSizes[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            RasterScene(&target.m_buffers, scene, texture);
+        }
+        const double colorMs = DebugTimer_Toc(name);
+        PrintResult(name, colorMs, triangles, "triangle");
+
+        snprintf(name, sizeof(name), "depth/depth-pass/%dpx-cells", cellSizes[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Rasterizer::ClearDepth(&target.m_depthBuffer, 1);
+            Rasterizer::RasterDepth(
+                &target.m_depthBuffer,
+                scene.m_vertices.data(),
+                scene.m_indices.data(),
+                (int)scene.m_indices.size());
+        }
+        const double depthMs = DebugTimer_Toc(name);
+        PrintResult(name, depthMs, triangles, "triangle");
+
+        printf("%-40s %10.1fx faster\n", "", colorMs / depthMs);
+    }
+
+    BenchmarkShadow(&target);
+}
+
+//
+// WIREFRAME
+//
+// Unique edge extraction (once per mesh) and line rasterization of a 1.8M triangle grid.
+//
+
+static void BenchmarkWireframe()
+{
+    const int kFrames = 10;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    BenchmarkScene scene;
+    CreateGridScene(&scene, kScreenWidth, kScreenHeight, 1);
+    const int indexCount = (int)scene.m_indices.size();
+
+    std::vector<int> edges(2 * indexCount);
+    std::vector<uint64_t> scratch(indexCount);
+    DebugTimer_Tic("wireframe/extract-edges");
+    const int edgeCount = Wireframe::ExtractEdges(
+        scene.m_indices.data(), indexCount, edges.data(), scratch.data());
+    const double extractMs = DebugTimer_Toc("wireframe/extract-edges");
+    PrintResult("wireframe/extract-edges", extractMs, indexCount / 3, "triangle");
+    printf("%-40s %10d triangles, %d edges\n", "", indexCount / 3, edgeCount);
+
+    LineBatch batch = {};
+    batch.m_vertexArray = scene.m_vertices.data();
+    batch.m_edges = edges.data();
+    batch.m_edgeCount = edgeCount;
+    batch.m_color = 0xffffffff;
+
+    for (int depthTest = 0; depthTest < 2; ++depthTest)
+    {
+        const char* name = depthTest ? "wireframe/lines-depth-tested" : "wireframe/lines";
+        batch.m_depthTest = depthTest != 0;
+        target.m_buffers.m_depth = target.m_depth.data();
+
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Rasterizer::RasterLines(&target.m_buffers, batch);
+        }
+        const double timeMs = DebugTimer_Toc(name);
+        PrintResult(name, timeMs / kFrames, edgeCount, "edge");
+    }
+}
+
+//
+// RAY TRACING
+//
+// Same grids through the rasterizer and the ray tracer. The BVH is built once per scene and
+// refit once per frame, like Render.cpp does.
+//
+
+static void BenchmarkRayTrace()
+{
+    const int kFrames = 10;
+
+    // Suites before this one may have started the pool already (ParallelFor does on first use)
+    const bool ownPool = ThreadPool::GetThreadCount() == 0;
+    if (ownPool)
+    {
+        ThreadPool::Init(0);
+    }
+    printf("%-40s %10d threads\n", "raytrace", ThreadPool::GetThreadCount());
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    uint32_t texels[4] = { 0xffffffff, 0xff000000, 0xff000000, 0xffffffff };
+    const TextureData texture = { 2, 2, texels };
+
+    const int cellSizes[] = { 64, 16, 4 };
+    for (int c = 0; c < (int)SizeOfArray(cellSizes); ++c)
+    {
+        BenchmarkScene scene;
+        CreateGridScene(&scene, kScreenWidth, kScreenHeight, cellSizes[c]);
+        const int indexCount = (int)scene.m_indices.size();
+        const double pixels = (double)kScreenWidth * kScreenHeight;
+
+        char name[64];
+        snprintf(name, sizeof(name), "raytrace/raster/%dpx-cells", cellSizes[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Rasterizer::ClearDepth(&target.m_depthBuffer, FLT_MAX);
+            RasterScene(&target.m_buffers, scene, texture);
+        }
+        const double rasterMs = DebugTimer_Toc(name) / kFrames;
+        PrintResult(name, rasterMs, pixels, "pixel");
+
+        Bvh bvh;
+        snprintf(name, sizeof(name), "raytrace/build-bvh/%dpx-cells", cellSizes[c]);
+        DebugTimer_Tic(name);
+        RayTracer::BuildBvh(&bvh, scene.m_vertices.data(), scene.m_indices.data(), indexCount);
+        PrintResult(name, DebugTimer_Toc(name), indexCount / 3, "triangle");
+
+        snprintf(name, sizeof(name), "raytrace/refit-bvh/%dpx-cells", cellSizes[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            RayTracer::RefitBvh(&bvh, scene.m_vertices.data(), scene.m_indices.data());
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kFrames, indexCount / 3, "triangle");
+
+        snprintf(name, sizeof(name), "raytrace/trace/%dpx-cells", cellSizes[c]);
+        double traceMs = 0;
+        double mraysPerSecond = 0;
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Rasterizer::ClearDepth(&target.m_depthBuffer, FLT_MAX);
+            const RayTracerStats stats = RayTracer::Trace(
+                &target.m_buffers, bvh, scene.m_vertices.data(), scene.m_indices.data(), texture,
+                nullptr);
+            traceMs += stats.m_timeMs / kFrames;
+            mraysPerSecond += stats.m_mraysPerSecond / kFrames;
+        }
+        PrintResult(name, traceMs, pixels, "pixel");
+
+        printf("%-40s %10.1f Mrays/s, %.2fx raster time\n", "", mraysPerSecond, traceMs / rasterMs);
+    }
+
+    if (ownPool)
+    {
+        ThreadPool::Shutdown();
+    }
+}
+
+//
+// PARTICLES
+//
+// Update and render cost as the particle count grows, plus the same particles pushed through
+// RasterTriangle as two triangles each for comparison.
+//
+
+static void EmitBenchmarkParticles(ParticlePool* pool, int count)
+{
+    ParticleEmitter emitter = {};
+    emitter.m_max = vec3((float)kScreenWidth, (float)kScreenHeight, 1);
+    emitter.m_velocity = vec3(50, -1000, 0);
+    emitter.m_velocityJitter = vec3(10, 200, 0);
+    emitter.m_life = 1000;  // nothing dies during the benchmark
+    emitter.m_color = 0x80c0d0ff;
+    Particles::Emit(pool, emitter, count);
+}
+
+static void BenchmarkParticles()
+{
+    const int kFrames = 10;
+    const float kTimeStep = 1.0f / 60;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    const int counts[] = { 10000, 100000, 250000, 500000, 1000000 };
+    for (int c = 0; c < (int)SizeOfArray(counts); ++c)
+    {
+        ParticlePool pool;
+        Particles::Create(&pool, counts[c]);
+        EmitBenchmarkParticles(&pool, counts[c]);
+
+        // Particles leaving the screen are drawn clipped, not killed, so the count stays fixed
+        char name[64];
+        snprintf(name, sizeof(name), "particles/update/%d", counts[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Particles::Update(&pool, vec3(0, -500, 0), -FLT_MAX, kTimeStep);
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kFrames, counts[c], "particle");
+
+        ParticleRenderSettings settings = {};
+        settings.m_shape = ParticleShape::POINT;
+        settings.m_pointSize = 2;
+        snprintf(name, sizeof(name), "particles/points-2px/%d", counts[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Particles::Render(&target.m_buffers, pool, settings);
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kFrames, counts[c], "particle");
+
+        settings.m_shape = ParticleShape::STREAK;
+        settings.m_streakSeconds = 0.01f;
+        snprintf(name, sizeof(name), "particles/streaks/%d", counts[c]);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            Particles::Render(&target.m_buffers, pool, settings);
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kFrames, counts[c], "particle");
+
+        Particles::Destroy(&pool);
+    }
+
+    //
+    // 2x2 pixel quads through the general triangle path
+    //
+
+    const int kTriangleParticles = 100000;
+    ParticlePool pool;
+    Particles::Create(&pool, kTriangleParticles);
+    EmitBenchmarkParticles(&pool, kTriangleParticles);
+
+    BenchmarkScene scene;
+    for (int i = 0; i < kTriangleParticles; ++i)
+    {
+        const float x = pool.m_posX[i];
+        const float y = pool.m_posY[i];
+        const int first = (int)scene.m_vertices.size();
+        const vec4 color(0.75f, 0.8f, 1, 1);
+        VertexData corners[4] = {
+            { vec4(x, y, 0, 1), color, vec2(0, 0) },
+            { vec4(x + 2, y, 0, 1), color, vec2(1, 0) },
+            { vec4(x, y + 2, 0, 1), color, vec2(0, 1) },
+            { vec4(x + 2, y + 2, 0, 1), color, vec2(1, 1) } };
+        scene.m_vertices.insert(scene.m_vertices.end(), corners, corners + 4);
+        const int quad[6] = { first, first + 2, first + 1, first + 1, first + 2, first + 3 };
+        scene.m_indices.insert(scene.m_indices.end(), quad, quad + 6);
+    }
+    Particles::Destroy(&pool);
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    char name[64];
+    snprintf(name, sizeof(name), "particles/triangles-2px/%d", kTriangleParticles);
+    target.m_buffers.m_depth = nullptr;
+    DebugTimer_Tic(name);
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        RasterScene(&target.m_buffers, scene, texture);
+    }
+    PrintResult(name, DebugTimer_Toc(name) / kFrames, kTriangleParticles, "particle");
+}
+
+//
+// UPSCALING
+//
+// Dynamic resolution's bilinear upscale from common scales to the benchmark screen size.
+//
+
+static void BenchmarkUpscale()
+{
+    const int kFrames = 20;
+
+    std::vector<uint32_t> src(kScreenWidth * kScreenHeight);
+    std::vector<uint32_t> dst(kScreenWidth * kScreenHeight);
+    std::vector<uint32_t> scratch(2 * kScreenWidth + 1);
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+        src[i] = Random();
+    }
+
+    const float scales[] = { 0.5f, 0.75f, 0.9f };
+    for (int s = 0; s < (int)SizeOfArray(scales); ++s)
+    {
+        int width;
+        int height;
+        DynamicResolution::ScaledSize(scales[s], kScreenWidth, kScreenHeight, &width, &height);
+
+        char name[64];
+        snprintf(name, sizeof(name), "upscale/bilinear/%dx%d", width, height);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            DynamicResolution::UpscaleBilinear(
+                src.data(), width, height, dst.data(), kScreenWidth, kScreenHeight, scratch.data());
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kFrames, kScreenWidth * kScreenHeight, "pixel");
+    }
+}
+
+//
+// OCCLUSION CULLING
+//
+// A wall over the middle of the screen in front of small objects of 256 triangles each, drawn
+// as they are and culled against the wall (a two triangle occluder) first. Culling must not
+// change the image.
+//
+
+static void AddObjectGrid(BenchmarkScene* scene, float x, float y, float size, float z)
+{
+    // 8x16 quads, 256 triangles
+    const int cellsX = 8;
+    const int cellsY = 16;
+    const int first = (int)scene->m_vertices.size();
+    const vec4 color(
+        (Random() & 0xff) / 255.0f, (Random() & 0xff) / 255.0f, (Random() & 0xff) / 255.0f, 1);
+
+    for (int j = 0; j <= cellsY; ++j)
+    {
+        for (int i = 0; i <= cellsX; ++i)
+        {
+            VertexData vertex = {
+                vec4(x + size * i / cellsX, y + size * j / cellsY, z, 1),
+                color,
+                vec2((float)i / cellsX, (float)j / cellsY) };
+            scene->m_vertices.push_back(vertex);
+        }
+    }
+
+    for (int j = 0; j < cellsY; ++j)
+    {
+        for (int i = 0; i < cellsX; ++i)
+        {
+            const int i0 = first + j * (cellsX + 1) + i;
+            const int i1 = i0 + 1;
+            const int i2 = i0 + cellsX + 1;
+            const int i3 = i2 + 1;
+            const int quad[6] = { i0, i2, i1, i1, i2, i3 };
+            scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static void ClearTarget(BenchmarkTarget* target)
+{
+    std::fill(target->m_color.begin(), target->m_color.end(), 0);
+    std::fill(target->m_depth.begin(), target->m_depth.end(), FLT_MAX);
+}
+
+static void RasterObjects(
+    RasterBuffers* buffers,
+    const BenchmarkScene& wall,
+    const BenchmarkScene& objects,
+    const TextureData& texture,
+    const uint8_t* visible)
+{
+    RasterScene(buffers, wall, texture);
+
+    const int objectIndices = 3 * 256;
+    const int objectCount = (int)objects.m_indices.size() / objectIndices;
+    for (int o = 0; o < objectCount; ++o)
+    {
+        if (visible && !visible[o])
+        {
+            continue;
+        }
+
+        for (int i = o * objectIndices; i < (o + 1) * objectIndices; i += 3)
+        {
+            TriangleInput input = {
+                objects.m_vertices.data(),
+                texture,
+                { objects.m_indices[i], objects.m_indices[i + 1], objects.m_indices[i + 2] } };
+
+            Rasterizer::RasterTriangle(buffers, input);
+        }
+    }
+}
+
+static void CullObjects(
+    OcclusionBuffer* occlusion,
+    const BenchmarkScene& wall,
+    const BenchmarkScene& objects,
+    uint8_t* visible)
+{
+    Occlusion::Clear(occlusion, kScreenWidth, kScreenHeight);
+    Occlusion::RasterOccluders(
+        occlusion, wall.m_vertices.data(), wall.m_indices.data(), (int)wall.m_indices.size());
+
+    const int objectIndices = 3 * 256;
+    const int objectCount = (int)objects.m_indices.size() / objectIndices;
+    for (int o = 0; o < objectCount; ++o)
+    {
+        const ScreenBounds bounds = Occlusion::ComputeBounds(
+            objects.m_vertices.data(), objects.m_indices.data() + o * objectIndices,
+            objectIndices);
+        visible[o] = Occlusion::IsVisible(*occlusion, bounds);
+    }
+}
+
+static void BenchmarkOcclusion()
+{
+    const int kFrames = 10;
+    const int kObjects = 2000;
+    const float kObjectSize = 40;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    // The wall is its own occluder, nearer than every object
+    const float x0 = 0.2f * kScreenWidth;
+    const float y0 = 0.25f * kScreenHeight;
+    const float x1 = 0.8f * kScreenWidth;
+    const float y1 = 0.75f * kScreenHeight;
+    const vec4 gray(0.5f, 0.5f, 0.5f, 1);
+    const VertexData corners[4] = {
+        { vec4(x0, y0, 0, 1), gray, vec2(0, 0) },
+        { vec4(x1, y0, 0, 1), gray, vec2(1, 0) },
+        { vec4(x0, y1, 0, 1), gray, vec2(0, 1) },
+        { vec4(x1, y1, 0, 1), gray, vec2(1, 1) } };
+    const int quad[6] = { 0, 2, 1, 1, 2, 3 };
+
+    BenchmarkScene wall;
+    wall.m_vertices.assign(corners, corners + 4);
+    wall.m_indices.assign(quad, quad + 6);
+
+    BenchmarkScene objects;
+    g_randomState = 11;
+    for (int o = 0; o < kObjects; ++o)
+    {
+        const float x = (Random() % 10000) / 10000.0f * (kScreenWidth - kObjectSize);
+        const float y = (Random() % 10000) / 10000.0f * (kScreenHeight - kObjectSize);
+        AddObjectGrid(&objects, x, y, kObjectSize, 0.2f + (Random() % 10000) / 12500.0f);
+    }
+
+    DebugTimer_Tic("occlusion/raster-all");
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        ClearTarget(&target);
+        RasterObjects(&target.m_buffers, wall, objects, texture, nullptr);
+    }
+    const double allMs = DebugTimer_Toc("occlusion/raster-all") / kFrames;
+    PrintResult("occlusion/raster-all", allMs, kObjects, "object");
+    const std::vector<uint32_t> reference = target.m_color;
+
+    static OcclusionBuffer occlusion;  // too big for the stack
+    std::vector<uint8_t> visible(kObjects);
+    DebugTimer_Tic("occlusion/cull");
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        CullObjects(&occlusion, wall, objects, visible.data());
+    }
+    PrintResult("occlusion/cull", DebugTimer_Toc("occlusion/cull") / kFrames, kObjects, "object");
+
+    DebugTimer_Tic("occlusion/cull-and-raster");
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        ClearTarget(&target);
+        CullObjects(&occlusion, wall, objects, visible.data());
+        RasterObjects(&target.m_buffers, wall, objects, texture, visible.data());
+    }
+    const double culledMs = DebugTimer_Toc("occlusion/cull-and-raster") / kFrames;
+    PrintResult("occlusion/cull-and-raster", culledMs, kObjects, "object");
+
+    int culled = 0;
+    for (int o = 0; o < kObjects; ++o)
+    {
+        culled += !visible[o];
+    }
+    int differences = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        differences += reference[i] != target.m_color[i];
+    }
+    printf(
+        "%-40s %d of %d objects culled, %.2fx faster, %d pixels differ\n",
+        "", culled, kObjects, allMs / culledMs, differences);
+}
+
+//
+// SMALL TRIANGLES
+//
+// Jittered grids averaging 1 to 10 pixels per triangle through RasterTriangle, with and without
+// the small triangle path. Its weights only differ by rounding, so the images should match but
+// for a unit here and there.
+//
+
+static void CreateDenseScene(
+    BenchmarkScene* scene,
+    int width,
+    int height,
+    float pixelsPerTriangle)
+{
+    const float cellSize = sqrtf(2 * pixelsPerTriangle);  // two triangles per cell
+    const int cellsX = (int)(width / cellSize);
+    const int cellsY = (int)(height / cellSize);
+
+    scene->m_vertices.clear();
+    scene->m_indices.clear();
+
+    g_randomState = 13;
+    for (int y = 0; y <= cellsY; ++y)
+    {
+        for (int x = 0; x <= cellsX; ++x)
+        {
+            // Inner vertices move up to a quarter cell, so edges don't line up with pixels
+            const bool inner = x > 0 && y > 0 && x < cellsX && y < cellsY;
+            const float jitterX = inner ? (RandomFloat(0.5f) - 0.25f) * cellSize : 0;
+            const float jitterY = inner ? (RandomFloat(0.5f) - 0.25f) * cellSize : 0;
+            VertexData vertex = {
+                vec4(x * cellSize + jitterX, y * cellSize + jitterY, RandomFloat(1), 1),
+                vec4(RandomFloat(1), RandomFloat(1), RandomFloat(1), 1),
+                vec2(x / (float)cellsX, y / (float)cellsY) };
+            scene->m_vertices.push_back(vertex);
+        }
+    }
+
+    for (int y = 0; y < cellsY; ++y)
+    {
+        for (int x = 0; x < cellsX; ++x)
+        {
+            const int i0 = y * (cellsX + 1) + x;
+            const int i1 = i0 + 1;
+            const int i2 = i0 + cellsX + 1;
+            const int i3 = i2 + 1;
+            const int quad[6] = { i0, i2, i1, i1, i2, i3 };
+            scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static double RasterDenseScene(
+    BenchmarkTarget* target,
+    const BenchmarkScene& scene,
+    const TextureData& texture,
+    bool smallTrianglePath)
+{
+    const int kFrames = 5;
+
+    Rasterizer::SetSmallTrianglePath(smallTrianglePath);
+
+    std::vector<double> timesMs;
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        ClearTarget(target);
+        const double startMs = DebugTimer_NowMs();
+        RasterScene(&target->m_buffers, scene, texture);
+        timesMs.push_back(DebugTimer_NowMs() - startMs);
+    }
+
+    std::sort(timesMs.begin(), timesMs.end());
+    return timesMs[kFrames / 2];
+}
+
+static void BenchmarkSmallTriangles()
+{
+    const float kPixelsPerTriangle[] = { 1, 2.5f, 5, 10 };
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    const bool previous = Rasterizer::GetSmallTrianglePath();
+    BenchmarkScene scene;
+
+    for (int i = 0; i < (int)SizeOfArray(kPixelsPerTriangle); ++i)
+    {
+        CreateDenseScene(&scene, kScreenWidth, kScreenHeight, kPixelsPerTriangle[i]);
+        const double triangles = (double)scene.m_indices.size() / 3;
+
+        char name[64];
+        const double generalMs = RasterDenseScene(&target, scene, texture, false);
+        snprintf(name, sizeof(name), "small-triangles/%gpx/general", kPixelsPerTriangle[i]);
+        PrintResult(name, generalMs, triangles, "triangle");
+        const std::vector<uint32_t> reference = target.m_color;
+
+        const double smallMs = RasterDenseScene(&target, scene, texture, true);
+        snprintf(name, sizeof(name), "small-triangles/%gpx/small-path", kPixelsPerTriangle[i]);
+        PrintResult(name, smallMs, triangles, "triangle");
+
+        // Weights only differ by rounding: coverage changes on pixels right on an edge, colours
+        // by a unit
+        int coverageDifferences = 0;
+        int colorDifferences = 0;
+        for (size_t p = 0; p < reference.size(); ++p)
+        {
+            const uint32_t a = reference[p];
+            const uint32_t b = target.m_color[p];
+            if ((a == 0) != (b == 0))
+            {
+                ++coverageDifferences;
+                continue;
+            }
+
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                const int difference = (int)(a >> shift & 0xff) - (int)(b >> shift & 0xff);
+                if (difference > 1 || difference < -1)
+                {
+                    ++colorDifferences;
+                    break;
+                }
+            }
+        }
+        printf(
+            "%-40s %.2fx faster, %d pixels differ in coverage, %d by more than a unit\n",
+            "", generalMs / smallMs, coverageDifferences, colorDifferences);
+    }
+
+    Rasterizer::SetSmallTrianglePath(previous);
+}
+
+//
+// LIGHTING
+//
+// A screen covering rolling surface lit by more and more point lights, scattered at random in
+// front of it. With a fixed radius each light reaches the same number of tiles, so lights per
+// tile grow with the count and so does shading. Shrinking the radius as the count grows keeps
+// the density, and lights per tile, constant: the shading cost should stay flat while culling
+// grows with the total.
+//
+
+static const float kLitDepthPixels = 256;  // lighting space depth of the scene
+
+static void CreateLitScene(BenchmarkScene* scene, int width, int height)
+{
+    const int cellSize = 8;
+    const int cellsX = width / cellSize;
+    const int cellsY = height / cellSize;
+    const float fx = 0.02f;
+    const float fy = 0.03f;
+
+    scene->m_vertices.clear();
+    scene->m_indices.clear();
+
+    for (int y = 0; y <= cellsY; ++y)
+    {
+        for (int x = 0; x <= cellsX; ++x)
+        {
+            // Window depth 0.5 +- 0.25, normals from its slope in lighting space
+            const float px = (float)(x * cellSize);
+            const float py = (float)(y * cellSize);
+            const float depth = 0.5f + 0.25f * sinf(px * fx) * cosf(py * fy);
+            const float dzdx = kLitDepthPixels * 0.25f * fx * cosf(px * fx) * cosf(py * fy);
+            const float dzdy = -kLitDepthPixels * 0.25f * fy * sinf(px * fx) * sinf(py * fy);
+
+            VertexData vertex = {
+                vec4(px, py, depth, 1),
+                vec4(1, 1, 1, 1),
+                vec2(x / (float)cellsX, y / (float)cellsY),
+                vec3Normalize(vec3(dzdx, dzdy, -1)) };
+            scene->m_vertices.push_back(vertex);
+        }
+    }
+
+    for (int y = 0; y < cellsY; ++y)
+    {
+        for (int x = 0; x < cellsX; ++x)
+        {
+            const int i0 = y * (cellsX + 1) + x;
+            const int i1 = i0 + 1;
+            const int i2 = i0 + cellsX + 1;
+            const int i3 = i2 + 1;
+            const int quad[6] = { i0, i2, i1, i1, i2, i3 };
+            scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static void CreateLights(std::vector<Light>* lights, int count, float radius)
+{
+    g_randomState = 17;
+    lights->resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        Light& light = (*lights)[i];
+        light.m_type = LightType::POINT;
+        light.m_position = vec3(
+            RandomFloat((float)kScreenWidth),
+            RandomFloat((float)kScreenHeight),
+            RandomFloat(0.75f * kLitDepthPixels) - radius / 2);
+        light.m_direction = vec3(0, 0, 1);
+        light.m_color = vec3(0.5f, 0.5f, 0.5f);
+        light.m_range = radius;
+        light.m_cosOuter = 0;
+        light.m_cosInner = 1;
+    }
+}
+
+// Median of a few frames of the scene rasterized with the lights of grid, unlit without one
+static double RasterLitScene(
+    BenchmarkTarget* target,
+    const BenchmarkScene& scene,
+    const TextureData& texture,
+    const LightGrid* grid,
+    ShadingRate rate = ShadingRate::Rate1x1)
+{
+    const int kFrames = 3;
+
+    std::vector<double> timesMs;
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        ClearTarget(target);
+        const double startMs = DebugTimer_NowMs();
+        for (size_t i = 0; i < scene.m_indices.size(); i += 3)
+        {
+            TriangleInput input = {
+                scene.m_vertices.data(),
+                texture,
+                { scene.m_indices[i], scene.m_indices[i + 1], scene.m_indices[i + 2] } };
+            input.m_lighting = grid;
+            input.m_shadingRate = rate;
+
+            Rasterizer::RasterTriangle(&target->m_buffers, input);
+        }
+        timesMs.push_back(DebugTimer_NowMs() - startMs);
+    }
+
+    std::sort(timesMs.begin(), timesMs.end());
+    return timesMs[kFrames / 2];
+}
+
+static void BenchmarkLighting()
+{
+    const int kLightCounts[] = { 64, 256, 1024, 4096 };
+    const float kRadius = 64;  // fixed, and at the first count for constant density
+    const int kCullFrames = 5;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    BenchmarkScene scene;
+    CreateLitScene(&scene, kScreenWidth, kScreenHeight);
+    const double fragments = (double)kScreenWidth * kScreenHeight;
+
+    // Depth pre-pass the lights are culled against
+    std::vector<float> prepass(kScreenWidth * kScreenHeight);
+    DepthBuffer depth = { prepass.data(), kScreenWidth, kScreenHeight };
+    Rasterizer::ClearDepth(&depth, FLT_MAX);
+    Rasterizer::RasterDepth(
+        &depth, scene.m_vertices.data(), scene.m_indices.data(), (int)scene.m_indices.size());
+
+    PrintResult("lighting/unlit", RasterLitScene(&target, scene, texture, nullptr), fragments,
+        "fragment");
+
+    static LightGrid grid;  // keeps its tile lists between runs
+    std::vector<Light> lights;
+
+    for (int series = 0; series < 2; ++series)
+    {
+        const bool constantDensity = series == 1;
+        const char* seriesName = constantDensity ? "constant-density" : "fixed-radius";
+
+        for (int i = 0; i < (int)SizeOfArray(kLightCounts); ++i)
+        {
+            const int count = kLightCounts[i];
+            const float radius =
+                constantDensity ? kRadius * sqrtf((float)kLightCounts[0] / count) : kRadius;
+            CreateLights(&lights, count, radius);
+
+            char name[64];
+            snprintf(name, sizeof(name), "lighting/%s/%d/cull", seriesName, count);
+            DebugTimer_Tic(name);
+            for (int frame = 0; frame < kCullFrames; ++frame)
+            {
+                Lighting::CullLights(&grid, lights.data(), count, depth, kLitDepthPixels);
+            }
+            PrintResult(name, DebugTimer_Toc(name) / kCullFrames, count, "light");
+
+            snprintf(name, sizeof(name), "lighting/%s/%d/shade", seriesName, count);
+            PrintResult(name, RasterLitScene(&target, scene, texture, &grid), fragments,
+                "fragment");
+
+            float averageLights;
+            int maxLights;
+            Lighting::GetTileStats(grid, &averageLights, &maxLights);
+            printf(
+                "%-40s radius %.0fpx, %.1f lights per tile on average, %d at most\n",
+                "", radius, averageLights, maxLights);
+        }
+    }
+}
+
+//
+// SHADING RATE
+//
+// The lit scene (smooth, and expensive to shade) with every triangle at each shading rate, then
+// with adaptive rates chosen from the full rate frame and again from the adaptive one, which
+// should barely change them. Images are compared with the full rate one.
+//
+
+// Peak signal to noise ratio of b against a, in dB (higher is closer, identical is infinite)
+static double ImagePsnr(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+    double squares = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            const int difference = (int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff);
+            squares += difference * difference;
+        }
+    }
+    const double meanSquare = squares / (3.0 * a.size());
+    return meanSquare > 0 ? 10 * log10(255 * 255 / meanSquare) : INFINITY;
+}
+
+static void BenchmarkShadingRate()
+{
+    const int kLights = 256;
+    const float kRadius = 64;
+    const float kThresholds[] = { 1, 2, 4 };
+    const double pixels = (double)kScreenWidth * kScreenHeight;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+    RasterCounters counters;
+    target.m_buffers.m_counters = &counters;
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    BenchmarkScene scene;
+    CreateLitScene(&scene, kScreenWidth, kScreenHeight);
+
+    std::vector<float> prepass(kScreenWidth * kScreenHeight);
+    DepthBuffer depth = { prepass.data(), kScreenWidth, kScreenHeight };
+    Rasterizer::ClearDepth(&depth, FLT_MAX);
+    Rasterizer::RasterDepth(
+        &depth, scene.m_vertices.data(), scene.m_indices.data(), (int)scene.m_indices.size());
+
+    static LightGrid grid;
+    std::vector<Light> lights;
+    CreateLights(&lights, kLights, kRadius);
+    Lighting::CullLights(&grid, lights.data(), kLights, depth, kLitDepthPixels);
+
+    std::vector<uint32_t> reference;
+    double referenceMs = 0;
+    for (int r = 0; r < (int)ShadingRate::Count; ++r)
+    {
+        const ShadingRate rate = (ShadingRate)r;
+        char name[64];
+        snprintf(name, sizeof(name), "shading-rate/%s", Rasterizer::GetShadingRateName(rate));
+        counters = {};
+        const double timeMs = RasterLitScene(&target, scene, texture, &grid, rate);
+        PrintResult(name, timeMs, pixels, "pixel");
+
+        if (rate == ShadingRate::Rate1x1)
+        {
+            reference = target.m_color;
+            referenceMs = timeMs;
+        }
+        printf(
+            "%-40s %.1fx faster, %.1f%% of the fragments shaded, PSNR %.1fdB\n",
+            "", referenceMs / timeMs, 100.0 * counters.m_shadedFragments / counters.m_fragments,
+            ImagePsnr(reference, target.m_color));
+    }
+
+    ShadingRateTiles tiles = {};
+    for (int t = 0; t < (int)SizeOfArray(kThresholds); ++t)
+    {
+        ShadingRates::Choose(
+            &tiles, reference.data(), kScreenWidth, kScreenHeight, kThresholds[t]);
+        target.m_buffers.m_shadingRates = &tiles;
+        const std::vector<ShadingRate> firstRates = tiles.m_rates;
+
+        char name[64];
+        snprintf(name, sizeof(name), "shading-rate/adaptive-%.0f", kThresholds[t]);
+        counters = {};
+        const double timeMs = RasterLitScene(&target, scene, texture, &grid);
+        PrintResult(name, timeMs, pixels, "pixel");
+        const double psnr = ImagePsnr(reference, target.m_color);
+
+        ShadingRates::Choose(
+            &tiles, target.m_color.data(), kScreenWidth, kScreenHeight, kThresholds[t]);
+        int changed = 0;
+        for (size_t i = 0; i < tiles.m_rates.size(); ++i)
+        {
+            changed += tiles.m_rates[i] != firstRates[i];
+        }
+        target.m_buffers.m_shadingRates = nullptr;
+
+        printf(
+            "%-40s %.1fx faster, %.1f%% of the fragments shaded, PSNR %.1fdB\n",
+            "", referenceMs / timeMs, 100.0 * counters.m_shadedFragments / counters.m_fragments,
+            psnr);
+        printf(
+            "%-40s %d/%d/%d tiles at 1x1/2x2/4x4, %d change measured again\n",
+            "", tiles.m_tileCounts[0], tiles.m_tileCounts[1], tiles.m_tileCounts[2], changed);
+    }
+}
+
+//
+// REPROJECTION
+//
+// The lit scene panning left a pixel a frame under lights that stay where they are, so the
+// surface moves and its shading changes too: the worst case for reused shading lagging behind.
+// Every frame is drawn again, with the shading reused from the last frame where reprojection
+// finds it, and compared with shading everything.
+//
+
+// Average time of the frames after the first panning the lit scene kFrames pixels, with
+// reprojection refreshing every refreshFrames frames, 1 for none. The target has the last frame.
+static double RasterPannedScene(
+    BenchmarkTarget* target,
+    const BenchmarkScene& scene,
+    const TextureData& texture,
+    const LightGrid* grid,
+    int refreshFrames)
+{
+    const int kFrames = 16;
+    const float kDepthTolerance = 0.01f;  // as Render.cpp's
+
+    std::vector<VertexData> vertices = scene.m_vertices;
+    std::vector<vec4> previousPositions(vertices.size());
+    std::vector<uint32_t> previousColor(target->m_color.size());
+    std::vector<float> previousDepth(target->m_depth.size());
+
+    double totalMs = 0;
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            previousPositions[i] = vertices[i].m_pos;
+            vertices[i].m_pos.x = scene.m_vertices[i].m_pos.x - frame;
+        }
+
+        ReprojectionInput reprojection = {
+            previousPositions.data(),
+            previousColor.data(),
+            previousDepth.data(),
+            kDepthTolerance,
+            refreshFrames,
+            frame % refreshFrames };
+
+        ClearTarget(target);
+        const double startMs = DebugTimer_NowMs();
+        for (size_t i = 0; i < scene.m_indices.size(); i += 3)
+        {
+            TriangleInput input = {
+                vertices.data(),
+                texture,
+                { scene.m_indices[i], scene.m_indices[i + 1], scene.m_indices[i + 2] } };
+            input.m_lighting = grid;
+            input.m_reprojection = frame > 0 && refreshFrames > 1 ? &reprojection : nullptr;
+
+            Rasterizer::RasterTriangle(&target->m_buffers, input);
+        }
+        if (frame > 0)
+        {
+            totalMs += DebugTimer_NowMs() - startMs;
+        }
+
+        previousColor = target->m_color;
+        previousDepth = target->m_depth;
+    }
+
+    return totalMs / (kFrames - 1);
+}
+
+static void BenchmarkReprojection()
+{
+    const int kLights = 256;
+    const float kRadius = 64;
+    const int kRefreshFrames[] = { 1, 2, 4, 8 };
+    const double pixels = (double)kScreenWidth * kScreenHeight;
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+    RasterCounters counters;
+    target.m_buffers.m_counters = &counters;
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    BenchmarkScene scene;
+    CreateLitScene(&scene, kScreenWidth, kScreenHeight);
+
+    std::vector<float> prepass(kScreenWidth * kScreenHeight);
+    DepthBuffer depth = { prepass.data(), kScreenWidth, kScreenHeight };
+    Rasterizer::ClearDepth(&depth, FLT_MAX);
+    Rasterizer::RasterDepth(
+        &depth, scene.m_vertices.data(), scene.m_indices.data(), (int)scene.m_indices.size());
+
+    static LightGrid grid;
+    std::vector<Light> lights;
+    CreateLights(&lights, kLights, kRadius);
+    Lighting::CullLights(&grid, lights.data(), kLights, depth, kLitDepthPixels);
+
+    std::vector<uint32_t> reference;
+    double referenceMs = 0;
+    for (int i = 0; i < (int)SizeOfArray(kRefreshFrames); ++i)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "reprojection/refresh-%d", kRefreshFrames[i]);
+        counters = {};
+        const double timeMs = RasterPannedScene(&target, scene, texture, &grid, kRefreshFrames[i]);
+        PrintResult(name, timeMs, pixels, "pixel");
+
+        if (kRefreshFrames[i] == 1)
+        {
+            reference = target.m_color;
+            referenceMs = timeMs;
+        }
+        const uint64_t visible = counters.m_shadedFragments + counters.m_reusedFragments;
+        printf(
+            "%-40s %.1fx faster, %.1f%% of the visible fragments reused, last frame PSNR %.1fdB\n",
+            "", referenceMs / timeMs, 100.0 * counters.m_reusedFragments / visible,
+            ImagePsnr(reference, target.m_color));
+    }
+}
+
+//
+// DIRTY REGION
+//
+// A dashboard: a grid of widgets, a few of which change colour every frame, drawn into a ring
+// of two colour buffers like the swapchain's with a shared depth buffer. Full redraws are
+// compared with redrawing only the dirty tiles (see DirtyRegion.h). Both runs make the same
+// changes, so their last frames must match.
+//
+
+struct Widget
+{
+    int m_firstIndex;
+    int m_indexCount;
+    int m_firstVertex;
+    int m_vertexCount;
+    uint32_t m_key;
+    ScreenRect m_rect;
+};
+
+static const int kWidgetSize = 72;
+static const int kWidgetGap = 8;
+static const int kWidgetCells = 12;  // per side, two triangles each
+
+static void CreateDashboard(BenchmarkScene* scene, std::vector<Widget>* widgets)
+{
+    scene->m_vertices.clear();
+    scene->m_indices.clear();
+    widgets->clear();
+
+    const int pitch = kWidgetSize + kWidgetGap;
+    const float cellSize = (float)kWidgetSize / kWidgetCells;
+    for (int wy = 0; wy + pitch <= kScreenHeight; wy += pitch)
+    {
+        for (int wx = 0; wx + pitch <= kScreenWidth; wx += pitch)
+        {
+            Widget widget = {};
+            widget.m_firstIndex = (int)scene->m_indices.size();
+            widget.m_firstVertex = (int)scene->m_vertices.size();
+            widget.m_rect.m_minX = wx + kWidgetGap / 2;
+            widget.m_rect.m_minY = wy + kWidgetGap / 2;
+            widget.m_rect.m_maxX = widget.m_rect.m_minX + kWidgetSize - 1;
+            widget.m_rect.m_maxY = widget.m_rect.m_minY + kWidgetSize - 1;
+
+            for (int y = 0; y <= kWidgetCells; ++y)
+            {
+                for (int x = 0; x <= kWidgetCells; ++x)
+                {
+                    const VertexData vertex = {
+                        vec4(
+                            widget.m_rect.m_minX + x * cellSize,
+                            widget.m_rect.m_minY + y * cellSize,
+                            0.5f,
+                            1),
+                        vec4(1, 1, 1, 1),
+                        vec2(x / (float)kWidgetCells, y / (float)kWidgetCells) };
+                    scene->m_vertices.push_back(vertex);
+                }
+            }
+
+            for (int y = 0; y < kWidgetCells; ++y)
+            {
+                for (int x = 0; x < kWidgetCells; ++x)
+                {
+                    const int i0 = widget.m_firstVertex + y * (kWidgetCells + 1) + x;
+                    const int i1 = i0 + 1;
+                    const int i2 = i0 + kWidgetCells + 1;
+                    const int i3 = i2 + 1;
+                    const int quad[6] = { i0, i2, i1, i1, i2, i3 };
+                    scene->m_indices.insert(scene->m_indices.end(), quad, quad + 6);
+                }
+            }
+
+            widget.m_vertexCount = (int)scene->m_vertices.size() - widget.m_firstVertex;
+            widget.m_indexCount = (int)scene->m_indices.size() - widget.m_firstIndex;
+            widgets->push_back(widget);
+        }
+    }
+}
+
+static void RecolorWidget(BenchmarkScene* scene, Widget* widget)
+{
+    const vec4 color(RandomFloat(1), RandomFloat(1), RandomFloat(1), 1);
+    for (int v = 0; v < widget->m_vertexCount; ++v)
+    {
+        scene->m_vertices[widget->m_firstVertex + v].m_color = color;
+    }
+    ++widget->m_key;
+}
+
+// Median frame time of a run where changes widgets are recoloured every frame. Leaves the last
+// frame in the buffers' colour buffer, and the tiles redrawn per frame once both buffers have
+// been drawn.
+static double RunDashboard(
+    BenchmarkTarget* target,
+    std::vector<uint32_t>* otherColor,
+    const TextureData& texture,
+    int changes,
+    bool incremental,
+    int* dirtyTiles)
+{
+    const int kFrames = 30;
+
+    BenchmarkScene scene;
+    std::vector<Widget> widgets;
+    CreateDashboard(&scene, &widgets);
+
+    static DirtyTiles dirty;
+    dirty = DirtyTiles();
+    *dirtyTiles = 0;
+
+    RasterBuffers& buffers = target->m_buffers;
+    uint32_t* colors[2] = { target->m_color.data(), otherColor->data() };
+
+    g_randomState = 23;
+    std::vector<double> timesMs;
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        for (int i = 0; i < changes; ++i)
+        {
+            RecolorWidget(&scene, &widgets[Random() % widgets.size()]);
+        }
+
+        buffers.m_color = colors[frame % 2];
+        const double startMs = DebugTimer_NowMs();
+
+        const ScreenRect screen = { 0, 0, kScreenWidth - 1, kScreenHeight - 1 };
+        const ScreenRect* rects = &screen;
+        int rectCount = 1;
+        if (incremental)
+        {
+            DirtyRegion::BeginFrame(&dirty, buffers.m_color, kScreenWidth, kScreenHeight);
+            for (size_t w = 0; w < widgets.size(); ++w)
+            {
+                DirtyRegion::AddDraw(&dirty, (int)w, widgets[w].m_key, widgets[w].m_rect);
+            }
+            DirtyRegion::EndFrame(&dirty);
+            rects = dirty.m_rects.data();
+            rectCount = (int)dirty.m_rects.size();
+            *dirtyTiles += frame >= 2 ? dirty.m_dirtyTiles : 0;  // both buffers start empty
+        }
+
+        for (int r = 0; r < rectCount; ++r)
+        {
+            const ScreenRect& rect = rects[r];
+            for (int y = rect.m_minY; y <= rect.m_maxY; ++y)
+            {
+                const size_t row = (size_t)y * kScreenWidth;
+                std::fill(buffers.m_color + row + rect.m_minX,
+                    buffers.m_color + row + rect.m_maxX + 1, 0);
+                std::fill(buffers.m_depth + row + rect.m_minX,
+                    buffers.m_depth + row + rect.m_maxX + 1, FLT_MAX);
+            }
+
+            buffers.m_scissor = incremental ? &rect : nullptr;
+            for (size_t w = 0; w < widgets.size(); ++w)
+            {
+                const Widget& widget = widgets[w];
+                if (!DirtyRegion::Overlap(widget.m_rect, rect))
+                {
+                    continue;
+                }
+
+                for (int i = 0; i < widget.m_indexCount; i += 3)
+                {
+                    const int* indices = scene.m_indices.data() + widget.m_firstIndex + i;
+                    TriangleInput input = {
+                        scene.m_vertices.data(),
+                        texture,
+                        { indices[0], indices[1], indices[2] } };
+
+                    Rasterizer::RasterTriangle(&buffers, input);
+                }
+            }
+            buffers.m_scissor = nullptr;
+        }
+
+        timesMs.push_back(DebugTimer_NowMs() - startMs);
+    }
+
+    // The last frame went to colors[1], leave it where the caller looks
+    std::swap(target->m_color, *otherColor);
+    buffers.m_color = target->m_color.data();
+    *dirtyTiles /= kFrames - 2;
+
+    std::sort(timesMs.begin(), timesMs.end());
+    return timesMs[kFrames / 2];
+}
+
+static void BenchmarkDirtyRegion()
+{
+    const int kChanges[] = { 0, 1, 8, 32 };
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kScreenWidth, kScreenHeight);
+    std::vector<uint32_t> otherColor(target.m_color.size());
+
+    uint32_t white = 0xffffffff;
+    const TextureData texture = { 1, 1, &white };
+
+    const int tiles = ((kScreenWidth + DirtyTiles::kTileSize - 1) / DirtyTiles::kTileSize) *
+        ((kScreenHeight + DirtyTiles::kTileSize - 1) / DirtyTiles::kTileSize);
+
+    for (int i = 0; i < (int)SizeOfArray(kChanges); ++i)
+    {
+        int dirtyTiles;
+        char name[64];
+        const double fullMs =
+            RunDashboard(&target, &otherColor, texture, kChanges[i], false, &dirtyTiles);
+        snprintf(name, sizeof(name), "dirty-region/%d-changes/full", kChanges[i]);
+        PrintResult(name, fullMs, (double)kScreenWidth * kScreenHeight, "pixel");
+        const std::vector<uint32_t> reference = target.m_color;
+
+        const double incrementalMs =
+            RunDashboard(&target, &otherColor, texture, kChanges[i], true, &dirtyTiles);
+        snprintf(name, sizeof(name), "dirty-region/%d-changes/incremental", kChanges[i]);
+        PrintResult(name, incrementalMs, (double)kScreenWidth * kScreenHeight, "pixel");
+
+        int differences = 0;
+        for (size_t p = 0; p < reference.size(); ++p)
+        {
+            differences += reference[p] != target.m_color[p];
+        }
+        printf(
+            "%-40s %.1fx faster, %d of %d tiles redrawn per frame, %d pixels differ\n",
+            "", fullMs / incrementalMs, dirtyTiles, tiles, differences);
+    }
+}
+
+//
+// FRAME SINK
+//
+// Streaming 1080p frames: the conversions with and without SSE2 (which must give the same
+// bytes), then every format through the sink to the null device, so what's measured is the
+// sink and not the disk. The sustained rate is what the renderer could be recorded at.
+//
+
+static const int kSinkWidth = 1920;
+static const int kSinkHeight = 1080;
+
+#ifdef _WIN32
+static const char* const kNullDevice = "NUL";
+#else
+static const char* const kNullDevice = "/dev/null";
+#endif
+
+static void BenchmarkFrameSink()
+{
+    const int kFrames = 120;
+    const double pixels = (double)kSinkWidth * kSinkHeight;
+
+    g_randomState = 23;
+    std::vector<uint32_t> color((size_t)kSinkWidth * kSinkHeight);
+    for (size_t i = 0; i < color.size(); ++i)
+    {
+        color[i] = Random() | 0xff000000;
+    }
+
+    const FrameFormat converted[] = { FrameFormat::RGBA, FrameFormat::Y4M };
+    for (int f = 0; f < (int)SizeOfArray(converted); ++f)
+    {
+        const FrameFormat format = converted[f];
+        const size_t bytes = FrameSink::GetFrameBytes(format, kSinkWidth, kSinkHeight);
+        std::vector<uint8_t> outputs[2];
+        double timesMs[2];
+        for (int simd = 0; simd < 2; ++simd)
+        {
+            char name[64];
+            snprintf(
+                name, sizeof(name), "frame-sink/convert/%s/%s",
+                FrameSink::GetFormatName(format), simd ? "sse2" : "scalar");
+            outputs[simd].resize(bytes);
+            FrameSink::SetSimd(simd != 0);
+            DebugTimer_Tic(name);
+            for (int frame = 0; frame < kFrames; ++frame)
+            {
+                FrameSink::ConvertFrame(
+                    format, &color[0], kSinkWidth, kSinkHeight, &outputs[simd][0]);
+            }
+            timesMs[simd] = DebugTimer_Toc(name) / kFrames;
+            PrintResult(name, timesMs[simd], pixels, "pixel");
+        }
+        FrameSink::SetSimd(true);
+
+        printf(
+            "%-40s %.1fx faster, %s\n",
+            "", timesMs[0] / timesMs[1],
+            outputs[0] == outputs[1] ? "same bytes" : "BYTES DIFFER");
+    }
+
+    for (int f = 0; f < (int)FrameFormat::Count; ++f)
+    {
+        FrameSinkSettings settings = {};
+        settings.m_format = (FrameFormat)f;
+        settings.m_width = kSinkWidth;
+        settings.m_height = kSinkHeight;
+        if (!FrameSink::Open(kNullDevice, settings))
+        {
+            printf("%-40s cannot open %s\n", "frame-sink/stream", kNullDevice);
+            return;
+        }
+
+        char name[64];
+        const char* formatName = FrameSink::GetFormatName(settings.m_format);
+        snprintf(name, sizeof(name), "frame-sink/stream/%s", formatName);
+        DebugTimer_Tic(name);
+        for (int frame = 0; frame < kFrames; ++frame)
+        {
+            FrameSink::Write(&color[0]);
+        }
+        FrameSink::WaitIdle();
+        const double timeMs = DebugTimer_Toc(name) / kFrames;
+        const FrameSinkMetrics metrics = FrameSink::GetMetrics();
+        FrameSink::Close();
+
+        PrintResult(name, timeMs, pixels, "pixel");
+        printf(
+            "%-40s %.0f frames/s (%.1fx 60), %.0fMB/s, %.2fms converting per frame\n",
+            "", 1000 / timeMs, 1000 / timeMs / 60,
+            metrics.m_bytes / (1024.0 * 1024.0) / (metrics.m_frames * timeMs / 1000),
+            metrics.m_convertMs);
+    }
+}
+
+//
+// SIMD MATH
+//
+// Normalising a block of vectors one at a time with the checked vec3Normalize (a call and a
+// branch each), unchecked, and eight at a time with vec3x8 (see MathSimd.h), exact and with the
+// fast reciprocal square root. The exact ones must give the same bits as the scalar one.
+//
+
+static void BenchmarkSimdMath()
+{
+    const int kVectors = 1 << 14;  // fits in L2, so the arithmetic is what costs
+    const int kRepeats = 500;
+
+    std::vector<float> x(kVectors);
+    std::vector<float> y(kVectors);
+    std::vector<float> z(kVectors);
+    for (int i = 0; i < kVectors; ++i)
+    {
+        x[i] = RandomFloat(2) - 1;
+        y[i] = RandomFloat(2) - 1;
+        z[i] = RandomFloat(2) + 0.01f;  // never zero length
+    }
+
+    std::vector<vec3> reference(kVectors);
+    DebugTimer_Tic("simd-math/normalize/scalar");
+    for (int r = 0; r < kRepeats; ++r)
+    {
+        for (int i = 0; i < kVectors; ++i)
+        {
+            reference[i] = vec3Normalize(vec3(x[i], y[i], z[i]));
+        }
+    }
+    PrintResult("simd-math/normalize/scalar",
+        DebugTimer_Toc("simd-math/normalize/scalar") / kRepeats, kVectors, "vector");
+
+    std::vector<vec3> unchecked(kVectors);
+    DebugTimer_Tic("simd-math/normalize/scalar-unchecked");
+    for (int r = 0; r < kRepeats; ++r)
+    {
+        for (int i = 0; i < kVectors; ++i)
+        {
+            unchecked[i] = vec3NormalizeUnchecked(vec3(x[i], y[i], z[i]));
+        }
+    }
+    PrintResult("simd-math/normalize/scalar-unchecked",
+        DebugTimer_Toc("simd-math/normalize/scalar-unchecked") / kRepeats, kVectors, "vector");
+
+    std::vector<float> outX(kVectors);
+    std::vector<float> outY(kVectors);
+    std::vector<float> outZ(kVectors);
+    for (int fast = 0; fast < 2; ++fast)
+    {
+        const char* name = fast ? "simd-math/normalize/vec3x8-fast" : "simd-math/normalize/vec3x8";
+        DebugTimer_Tic(name);
+        for (int r = 0; r < kRepeats; ++r)
+        {
+            for (int i = 0; i < kVectors; i += 8)
+            {
+                const vec3x8 v(floatx8Load(&x[i]), floatx8Load(&y[i]), floatx8Load(&z[i]));
+                const vec3x8 n = fast ? vec3xNormalizeFast(v) : vec3xNormalize(v);
+                floatx8Store(n.x, &outX[i]);
+                floatx8Store(n.y, &outY[i]);
+                floatx8Store(n.z, &outZ[i]);
+            }
+        }
+        PrintResult(name, DebugTimer_Toc(name) / kRepeats, kVectors, "vector");
+
+        int differences = 0;
+        float maxError = 0;
+        for (int i = 0; i < kVectors; ++i)
+        {
+            const vec3 error = vec3(outX[i], outY[i], outZ[i]) - reference[i];
+            differences += error.x != 0 || error.y != 0 || error.z != 0;
+            maxError = fmaxf(maxError, fabsf(error.x));
+            maxError = fmaxf(maxError, fabsf(error.y));
+            maxError = fmaxf(maxError, fabsf(error.z));
+        }
+        printf("%-40s %d vectors differ from scalar, by %g at most\n", "", differences, maxError);
+    }
+
+    int differences = 0;
+    for (int i = 0; i < kVectors; ++i)
+    {
+        differences += memcmp(&unchecked[i], &reference[i], sizeof(vec3)) != 0;
+    }
+    printf("%-40s %d unchecked vectors differ from scalar\n", "", differences);
+}
+
+//
+// LOG
+//
+// Bursts of messages like the per triangle PROFILE output, queued (the default) and written by
+// the thread that logs them, from one thread and then from every pool thread at once. Only the
+// callers' time counts: each burst fits in a queue, and the writer catches up between bursts.
+// The messages go to stderr, so redirect it (2>log.txt) to keep them off the terminal.
+//
+
+static const int kLogBurstMessages = Log::kQueueMessages / 2;
+
+static void LogBurst(int burst, int, void* userData)
+{
+    std::atomic<uint64_t>* callerNs = (std::atomic<uint64_t>*)userData;
+
+    const double startMs = DebugTimer_NowMs();
+    for (int i = 0; i < kLogBurstMessages; ++i)
+    {
+        Log::Debug("\tTotal time: %01fms", 0.001 * i);
+        Log::Debug("\tTested pixels count: %d, burst %d", i, burst);
+    }
+    callerNs->fetch_add((uint64_t)((DebugTimer_NowMs() - startMs) * 1e6));
+}
+
+static void BenchmarkLog()
+{
+    const int kBursts = 20;
+
+    const bool ownPool = ThreadPool::GetThreadCount() == 0;  // see BenchmarkRayTrace
+    if (ownPool)
+    {
+        ThreadPool::Init(0);
+    }
+    const int threadCount = ThreadPool::GetThreadCount();
+    const bool previous = Log::GetAsynchronous();
+
+    for (int asynchronous = 1; asynchronous >= 0; --asynchronous)
+    {
+        Log::SetAsynchronous(asynchronous != 0);
+        for (int pool = 0; pool < (threadCount > 1 ? 2 : 1); ++pool)
+        {
+            const int tasks = pool ? threadCount : 1;
+            const uint64_t dropped = Log::GetDroppedCount();
+            std::atomic<uint64_t> callerNs(0);
+
+            for (int burst = 0; burst < kBursts; ++burst)
+            {
+                if (pool)
+                {
+                    ThreadPool::ParallelFor(tasks, LogBurst, &callerNs);
+                }
+                else
+                {
+                    LogBurst(burst, 0, &callerNs);
+                }
+                Log::Flush();
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "log/%s/%d-threads",
+                asynchronous ? "queued" : "direct", tasks);
+            const double messages = 2.0 * kLogBurstMessages * kBursts * tasks;
+            PrintResult(name, callerNs.load() / 1e6 / tasks, messages / tasks, "message");
+            printf("%-40s %llu dropped\n", "",
+                (unsigned long long)(Log::GetDroppedCount() - dropped));
+        }
+    }
+
+    Log::SetAsynchronous(previous);
+    if (ownPool)
+    {
+        ThreadPool::Shutdown();
+    }
+}
+
+//
+// VARIANTS
+//
+// A/B runs of the scan conversion modes over deterministic scenes that stress different parts
+// of the pipeline: setup (tiny triangles), traversal of empty bounding boxes (slivers), fragment
+// throughput (full screen, overdraw) and texture fetches. Every iteration renders the scene once
+// with each mode in turn, so drift (clocks, heat, other processes) hits all of them alike. The
+// small triangle path is off meanwhile, it would take over the tiny triangles of every mode.
+//
+// Reports median and p99 frame times, ns per bounding box pixel (the pixels the first approach
+// tests, the same for every mode) and ns per fragment, and compares modes with a Mann-Whitney U
+// test: frame times are rarely normal and a rank test doesn't assume they are. Every mode is
+// compared with FirstApproach unless --compare picks two. Results are also written as JSON to
+// --json, variants.json by default.
+//
+
+struct BenchmarkOptions
+{
+    int m_iterations;
+    const char* m_compare[2];  // mode names, both null to compare everything with the first
+    const char* m_jsonPath;
+};
+
+static BenchmarkOptions g_options = { 25, { nullptr, nullptr }, "variants.json" };
+
+static const int kVariantWidth = 640;  // a quarter of the screen so a run takes seconds
+static const int kVariantHeight = 360;
+static const int kVariantCount = (int)ScanConversionMode::Count;
+
+struct VariantScene
+{
+    const char* m_name;
+    BenchmarkScene m_scene;
+    TextureData m_texture;
+};
+
+struct VariantResult
+{
+    std::vector<double> m_timesMs;  // one per iteration, sorted once the run is over
+    RasterCounters m_counters;      // of a single frame
+};
+
+static VertexData MakeVertex(float x, float y, float z, float u, float v)
+{
+    const VertexData vertex = { vec4(x, y, z, 1), vec4(1, 1, 1, 1), vec2(u, v) };
+    return vertex;
+}
+
+static void AddTriangle(
+    BenchmarkScene* scene,
+    const VertexData& a,
+    const VertexData& b,
+    const VertexData& c)
+{
+    const int first = (int)scene->m_vertices.size();
+    scene->m_vertices.push_back(a);
+    scene->m_vertices.push_back(b);
+    scene->m_vertices.push_back(c);
+    scene->m_indices.push_back(first);
+    scene->m_indices.push_back(first + 1);
+    scene->m_indices.push_back(first + 2);
+}
+
+static void CreateVariantScenes(std::vector<VariantScene>* scenes, std::vector<uint32_t>* texels)
+{
+    const float w = (float)kVariantWidth;
+    const float h = (float)kVariantHeight;
+
+    static uint32_t s_white = 0xffffffff;
+    const TextureData white = { 1, 1, &s_white };
+
+    g_randomState = 11;
+    scenes->resize(5);
+
+    // 1 to 3 pixel triangles all over the screen
+    VariantScene& tiny = (*scenes)[0];
+    tiny.m_name = "tiny-triangles";
+    tiny.m_texture = white;
+    for (int i = 0; i < 50000; ++i)
+    {
+        const float x = RandomFloat(w - 4);
+        const float y = RandomFloat(h - 4);
+        const float size = 1 + RandomFloat(2);
+        const float z = RandomFloat(1);
+        AddTriangle(&tiny.m_scene,
+            MakeVertex(x, y, z, 0, 0),
+            MakeVertex(x, y + size, z, 0, 1),
+            MakeVertex(x + size, y, z, 1, 0));
+    }
+
+    // A single triangle twice the screen size, clipped to it
+    VariantScene& fullScreen = (*scenes)[1];
+    fullScreen.m_name = "full-screen";
+    fullScreen.m_texture = white;
+    AddTriangle(&fullScreen.m_scene,
+        MakeVertex(0, 0, 0.5f, 0, 0),
+        MakeVertex(0, 2 * h, 0.5f, 0, 2),
+        MakeVertex(2 * w, 0, 0.5f, 2, 0));
+
+    // Long one pixel wide triangles: big bounding boxes, few fragments
+    VariantScene& slivers = (*scenes)[2];
+    slivers.m_name = "slivers";
+    slivers.m_texture = white;
+    for (int i = 0; i < 500; ++i)
+    {
+        const float x0 = RandomFloat(w - 2);
+        const float y0 = RandomFloat(h - 2);
+        const float x1 = RandomFloat(w - 2);
+        const float y1 = RandomFloat(h - 2);
+        const float z = RandomFloat(1);
+        AddTriangle(&slivers.m_scene,
+            MakeVertex(x0, y0, z, 0, 0),
+            MakeVertex(x1 + 1.5f, y1, z, 1, 1),
+            MakeVertex(x1, y1 + 1.5f, z, 0, 1));
+    }
+
+    // Eight screen covering quads back to front, so every fragment passes the depth test
+    VariantScene& overdraw = (*scenes)[3];
+    overdraw.m_name = "overdraw";
+    overdraw.m_texture = white;
+    for (int layer = 0; layer < 8; ++layer)
+    {
+        const float z = 0.9f - layer * 0.1f;
+        const VertexData corners[4] = {
+            MakeVertex(0, 0, z, 0, 0),
+            MakeVertex(w - 1, 0, z, 1, 0),
+            MakeVertex(0, h - 1, z, 0, 1),
+            MakeVertex(w - 1, h - 1, z, 1, 1) };
+        AddTriangle(&overdraw.m_scene, corners[0], corners[2], corners[1]);
+        AddTriangle(&overdraw.m_scene, corners[1], corners[2], corners[3]);
+    }
+
+    // 16 pixel grid over a 1024x1024 noise texture, minified so fetches are scattered
+    VariantScene& textured = (*scenes)[4];
+    textured.m_name = "textured";
+    CreateGridScene(&textured.m_scene, kVariantWidth, kVariantHeight, 16);
+    texels->resize(kTextureSize * kTextureSize);
+    for (size_t i = 0; i < texels->size(); ++i)
+    {
+        (*texels)[i] = Random() | 0xff000000;
+    }
+    const TextureData noise = { kTextureSize, kTextureSize, texels->data() };
+    textured.m_texture = noise;
+}
+
+static double Median(const std::vector<double>& sorted)
+{
+    const size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+// Nearest rank
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+    size_t rank = (size_t)ceil(fraction * sorted.size());
+    rank = rank < 1 ? 1 : (rank > sorted.size() ? sorted.size() : rank);
+    return sorted[rank - 1];
+}
+
+struct Comparison
+{
+    double m_ratio;  // median of a / median of b, over 1 means b is faster
+    double m_u;      // Mann-Whitney U of a
+    double m_z;
+    double m_p;      // two sided
+};
+
+// Mann-Whitney U test with the normal approximation, fine from about 10 samples per side. Ties
+// get the average of their ranks.
+static Comparison Compare(const std::vector<double>& a, const std::vector<double>& b)
+{
+    struct Sample
+    {
+        double m_value;
+        bool m_fromA;
+    };
+
+    std::vector<Sample> samples;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        const Sample sample = { a[i], true };
+        samples.push_back(sample);
+    }
+    for (size_t i = 0; i < b.size(); ++i)
+    {
+        const Sample sample = { b[i], false };
+        samples.push_back(sample);
+    }
+    std::sort(samples.begin(), samples.end(), [](const Sample& l, const Sample& r) {
+        return l.m_value < r.m_value; });
+
+    double rankSumA = 0;
+    for (size_t i = 0; i < samples.size();)
+    {
+        size_t end = i + 1;
+        while (end < samples.size() && samples[end].m_value == samples[i].m_value)
+        {
+            ++end;
+        }
+
+        const double rank = 0.5 * (i + 1 + end);  // ranks i + 1 to end
+        for (size_t j = i; j < end; ++j)
+        {
+            rankSumA += samples[j].m_fromA ? rank : 0;
+        }
+        i = end;
+    }
+
+    const double n1 = (double)a.size();
+    const double n2 = (double)b.size();
+
+    Comparison comparison;
+    comparison.m_ratio = Median(a) / Median(b);
+    comparison.m_u = rankSumA - n1 * (n1 + 1) / 2;
+    comparison.m_z =
+        (comparison.m_u - n1 * n2 / 2) / sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+    comparison.m_p = erfc(fabs(comparison.m_z) / sqrt(2.0));
+    return comparison;
+}
+
+static int FindVariant(const char* name)
+{
+    for (int v = 0; v < kVariantCount; ++v)
+    {
+        if (strcmp(name, Rasterizer::GetScanConversionModeName((ScanConversionMode)v)) == 0)
+        {
+            return v;
+        }
+    }
+
+    fprintf(stderr, "Unknown scan conversion mode %s\n", name);
+    exit(1);
+}
+
+static void BenchmarkVariants()
+{
+    const int iterations = g_options.m_iterations;
+
+    // Pairs to compare
+    std::vector<int> pairs;
+    if (g_options.m_compare[0])
+    {
+        pairs.push_back(FindVariant(g_options.m_compare[0]));
+        pairs.push_back(FindVariant(g_options.m_compare[1]));
+    }
+    else
+    {
+        for (int v = 1; v < kVariantCount; ++v)
+        {
+            pairs.push_back(0);
+            pairs.push_back(v);
+        }
+    }
+
+    FILE* json = fopen(g_options.m_jsonPath, "w");
+    if (!json)
+    {
+        fprintf(stderr, "Cannot open %s\n", g_options.m_jsonPath);
+        exit(1);
+    }
+    fprintf(json, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"iterations\": %d,\n",
+        kVariantWidth, kVariantHeight, iterations);
+    fprintf(json, "  \"scenes\": [\n");
+
+    BenchmarkTarget target;
+    CreateTarget(&target, kVariantWidth, kVariantHeight);
+
+    std::vector<VariantScene> scenes;
+    std::vector<uint32_t> texels;
+    CreateVariantScenes(&scenes, &texels);
+
+    const ScanConversionMode previousMode = Rasterizer::GetScanConversionMode();
+    const bool previousSmallTrianglePath = Rasterizer::GetSmallTrianglePath();
+    Rasterizer::SetSmallTrianglePath(false);
+
+    for (size_t s = 0; s < scenes.size(); ++s)
+    {
+        const VariantScene& scene = scenes[s];
+        VariantResult results[kVariantCount];
+
+        // Untimed frame per mode, to warm caches and count the work
+        for (int v = 0; v < kVariantCount; ++v)
+        {
+            Rasterizer::SetScanConversionMode((ScanConversionMode)v);
+            results[v].m_counters = {};
+            target.m_buffers.m_counters = &results[v].m_counters;
+            Rasterizer::ClearDepth(&target.m_depthBuffer, FLT_MAX);
+            RasterScene(&target.m_buffers, scene.m_scene, scene.m_texture);
+        }
+        target.m_buffers.m_counters = nullptr;
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            for (int v = 0; v < kVariantCount; ++v)
+            {
+                Rasterizer::SetScanConversionMode((ScanConversionMode)v);
+                Rasterizer::ClearDepth(&target.m_depthBuffer, FLT_MAX);
+
+                const double startMs = DebugTimer_NowMs();
+                RasterScene(&target.m_buffers, scene.m_scene, scene.m_texture);
+                results[v].m_timesMs.push_back(DebugTimer_NowMs() - startMs);
+            }
+        }
+
+        fprintf(json, "    {\n      \"name\": \"%s\",\n      \"triangles\": %d,\n",
+            scene.m_name, (int)scene.m_scene.m_indices.size() / 3);
+        fprintf(json, "      \"variants\": [\n");
+
+        for (int v = 0; v < kVariantCount; ++v)
+        {
+            VariantResult& result = results[v];
+            std::sort(result.m_timesMs.begin(), result.m_timesMs.end());
+
+            const double medianMs = Median(result.m_timesMs);
+            const double p99Ms = Percentile(result.m_timesMs, 0.99);
+            const double pixels = (double)result.m_counters.m_boundingBoxPixels;
+            const double fragments = (double)result.m_counters.m_fragments;
+            const char* mode = Rasterizer::GetScanConversionModeName((ScanConversionMode)v);
+
+            char name[64];
+            snprintf(name, sizeof(name), "variants/%s/%s", scene.m_name, mode);
+            PrintResult(name, medianMs, fragments, "fragment");
+            printf("%-40s %10.2fms p99 %10.2fns/pixel\n", "", p99Ms, 1000000 * medianMs / pixels);
+
+            fprintf(json,
+                "        { \"name\": \"%s\", \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+                "\"ns_per_pixel\": %.3f, \"ns_per_fragment\": %.3f, "
+                "\"pixels\": %.0f, \"fragments\": %.0f }%s\n",
+                mode, medianMs, p99Ms, 1000000 * medianMs / pixels,
+                1000000 * medianMs / fragments, pixels, fragments,
+                v + 1 < kVariantCount ? "," : "");
+        }
+
+        fprintf(json, "      ],\n      \"comparisons\": [\n");
+
+        for (size_t p = 0; p < pairs.size(); p += 2)
+        {
+            const int a = pairs[p];
+            const int b = pairs[p + 1];
+            const Comparison comparison = Compare(results[a].m_timesMs, results[b].m_timesMs);
+            const char* nameA = Rasterizer::GetScanConversionModeName((ScanConversionMode)a);
+            const char* nameB = Rasterizer::GetScanConversionModeName((ScanConversionMode)b);
+
+            printf("%-40s %10.2fx %s vs %s, p = %.4f%s\n", "", comparison.m_ratio, nameB, nameA,
+                comparison.m_p, comparison.m_p < 0.01 ? "" : " (not significant)");
+
+            fprintf(json,
+                "        { \"a\": \"%s\", \"b\": \"%s\", \"median_ratio\": %.4f, "
+                "\"u\": %.1f, \"z\": %.3f, \"p\": %.6f }%s\n",
+                nameA, nameB, comparison.m_ratio, comparison.m_u, comparison.m_z,
+                comparison.m_p, p + 2 < pairs.size() ? "," : "");
+        }
+
+        fprintf(json, "      ]\n    }%s\n", s + 1 < scenes.size() ? "," : "");
+    }
+
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+
+    Rasterizer::SetScanConversionMode(previousMode);
+    Rasterizer::SetSmallTrianglePath(previousSmallTrianglePath);
+}
+
+//
+// MAIN
+//
+
+struct BenchmarkEntry
+{
+    const char* m_name;
+    void (*m_function)();
+};
+
+static const BenchmarkEntry g_benchmarks[] = {
+    { "texture", BenchmarkTexture },
+    { "depth", BenchmarkDepth },
+    { "wireframe", BenchmarkWireframe },
+    { "raytrace", BenchmarkRayTrace },
+    { "particles", BenchmarkParticles },
+    { "upscale", BenchmarkUpscale },
+    { "occlusion", BenchmarkOcclusion },
+    { "small-triangles", BenchmarkSmallTriangles },
+    { "lighting", BenchmarkLighting },
+    { "shading-rate", BenchmarkShadingRate },
+    { "reprojection", BenchmarkReprojection },
+    { "dirty-region", BenchmarkDirtyRegion },
+    { "frame-sink", BenchmarkFrameSink },
+    { "simd-math", BenchmarkSimdMath },
+    { "log", BenchmarkLog },
+    { "variants", BenchmarkVariants },
+};
+
+int main(int argc, char** argv)
+{
+    const char* filter = "";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            g_options.m_iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc)
+        {
+            g_options.m_compare[0] = argv[++i];
+            g_options.m_compare[1] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            g_options.m_jsonPath = argv[++i];
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    if (g_options.m_iterations < 1)
+    {
+        fprintf(stderr, "Need at least one iteration\n");
+        return 1;
+    }
+
+    Memory::Init();
+
+    for (size_t i = 0; i < SizeOfArray(g_benchmarks); ++i)
+    {
+        if (strncmp(g_benchmarks[i].m_name, filter, strlen(filter)) == 0)
+        {
+            g_benchmarks[i].m_function();
+        }
+    }
+
+    return 0;
+}
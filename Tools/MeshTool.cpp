@@ -0,0 +1,888 @@
+//
+// Offline mesh tool.
+//
+// Usage:
+//   MeshTool convert <input.obj> <output.mesh>
+//   MeshTool lod <input.obj> <output.mesh> [levels]
+//   MeshTool optimize <input.mesh> <output.mesh>
+//
+// lod also writes a chain of simplified versions of the mesh, each with about half the triangles
+// of the one before, for the renderer to pick from by screen size (see SIMPLIFICATION).
+// optimize reorders the triangles of every level of a mesh file for the vertex cache and less
+// overdraw, and the vertices to match (see MeshOptimize.h). The output can be the input.
+//
+// Builds as a console application from this file plus MeshFile.cpp, MeshOptimize.cpp,
+// MathUtils.cpp, Log.cpp, the platform Log_*.cpp and MeshFile_*.cpp, and
+// External/pow2assert.cpp.
+//
+
+#include "../Geometry.h"
+#include "../MeshFile.h"
+#include "../MeshOptimize.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <queue>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+//
+// OBJ IMPORT
+//
+// Supports positions (with optional "v x y z r g b" vertex colours), texture coordinates,
+// normals and polygonal faces in any of the v, v/vt, v//vn and v/vt/vn forms. Polygons are fan
+// triangulated. Face vertices without a normal get a smooth one, the area weighted average of
+// the faces around their position. Materials and groups are ignored for now.
+//
+
+struct ObjMesh
+{
+    std::vector<VertexData> m_vertices;
+    std::vector<int> m_indices;
+};
+
+static int ResolveObjIndex(int index, int count)
+{
+    // OBJ indices are 1-based, negative indices are relative to the end of the list
+    return index < 0 ? count + index : index - 1;
+}
+
+static bool ParseObjFaceVertex(
+    const char* token,
+    int positionCount,
+    int uvCount,
+    int normalCount,
+    int* p,
+    int* t,
+    int* n)
+{
+    char* end;
+    long position = strtol(token, &end, 10);
+    if (end == token || position == 0)
+    {
+        return false;
+    }
+
+    *p = ResolveObjIndex((int)position, positionCount);
+    *t = -1;
+    *n = -1;
+
+    if (*end == '/')
+    {
+        const char* uvToken = end + 1;
+        long uv = strtol(uvToken, &end, 10);
+        if (end != uvToken && uv != 0)
+        {
+            *t = ResolveObjIndex((int)uv, uvCount);
+        }
+
+        if (*end == '/')
+        {
+            const char* normalToken = end + 1;
+            long normal = strtol(normalToken, &end, 10);
+            if (end != normalToken && normal != 0)
+            {
+                *n = ResolveObjIndex((int)normal, normalCount);
+            }
+        }
+    }
+
+    return *p >= 0 && *p < positionCount && *t < uvCount && *n < normalCount;
+}
+
+static vec3 Normalize(const vec3& v)
+{
+    const float length = sqrtf(vec3Dot(v, v));
+    return length > 0 ? v * (1 / length) : vec3(0, 0, 1);
+}
+
+static bool LoadObj(const char* path, ObjMesh* mesh)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    std::vector<vec4> positions;
+    std::vector<vec4> colors;
+    std::vector<vec2> uvs;
+    std::vector<vec3> normals;
+    std::map<std::tuple<int, int, int>, int> vertexLookup;  // (position, uv, normal) -> vertex
+    std::vector<int> polygon;
+    std::vector<int> polygonPositions;
+
+    // Vertices that need a smooth normal, and the face normals summed at each position
+    std::vector<int> vertexPositions;  // position of every output vertex
+    std::vector<bool> smoothNormals;
+    std::vector<vec3> positionNormals;
+
+    char line[1024];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        ++lineNumber;
+
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            float x = 0, y = 0, z = 0, r = 1, g = 1, b = 1;
+            int count = sscanf(line + 2, "%f %f %f %f %f %f", &x, &y, &z, &r, &g, &b);
+            if (count < 3)
+            {
+                fprintf(stderr, "%s:%d: bad vertex\n", path, lineNumber);
+                ok = false;
+            }
+            positions.push_back(vec4(x, y, z, 1));
+            colors.push_back(count >= 6 ? vec4(r, g, b, 1) : vec4(1, 1, 1, 1));
+            positionNormals.push_back(vec3zero);
+        }
+        else if (line[0] == 'v' && line[1] == 'n' && line[2] == ' ')
+        {
+            float x = 0, y = 0, z = 1;
+            sscanf(line + 3, "%f %f %f", &x, &y, &z);
+            normals.push_back(Normalize(vec3(x, y, z)));
+        }
+        else if (line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+        {
+            float u = 0, v = 0;
+            sscanf(line + 3, "%f %f", &u, &v);
+            uvs.push_back(vec2(u, v));
+        }
+        else if (line[0] == 'f' && line[1] == ' ')
+        {
+            polygon.clear();
+            polygonPositions.clear();
+
+            for (char* token = strtok(line + 2, " \t\r\n"); token; token = strtok(0, " \t\r\n"))
+            {
+                int p, t, n;
+                if (!ParseObjFaceVertex(
+                    token, (int)positions.size(), (int)uvs.size(), (int)normals.size(),
+                    &p, &t, &n))
+                {
+                    fprintf(stderr, "%s:%d: bad face\n", path, lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                const std::tuple<int, int, int> key(p, t, n);
+                auto found = vertexLookup.find(key);
+                if (found == vertexLookup.end())
+                {
+                    VertexData vertex = {
+                        positions[p],
+                        colors[p],
+                        t >= 0 ? uvs[t] : vec2(0, 0),
+                        n >= 0 ? normals[n] : vec3zero };
+                    found = vertexLookup.insert(
+                        std::make_pair(key, (int)mesh->m_vertices.size())).first;
+                    mesh->m_vertices.push_back(vertex);
+                    vertexPositions.push_back(p);
+                    smoothNormals.push_back(n < 0);
+                }
+
+                polygon.push_back(found->second);
+                polygonPositions.push_back(p);
+            }
+
+            // Newell's method, area weighted and fine for non planar polygons
+            vec3 faceNormal = vec3zero;
+            for (size_t i = 0; ok && i < polygonPositions.size(); ++i)
+            {
+                const vec4& a = positions[polygonPositions[i]];
+                const vec4& b = positions[polygonPositions[(i + 1) % polygonPositions.size()]];
+                faceNormal.x += (a.y - b.y) * (a.z + b.z);
+                faceNormal.y += (a.z - b.z) * (a.x + b.x);
+                faceNormal.z += (a.x - b.x) * (a.y + b.y);
+            }
+            for (size_t i = 0; ok && i < polygonPositions.size(); ++i)
+            {
+                positionNormals[polygonPositions[i]] =
+                    positionNormals[polygonPositions[i]] + faceNormal;
+            }
+
+            // OBJ faces are counter-clockwise, the rasterizer takes clockwise triangles
+            for (size_t i = 2; ok && i < polygon.size(); ++i)
+            {
+                mesh->m_indices.push_back(polygon[0]);
+                mesh->m_indices.push_back(polygon[i]);
+                mesh->m_indices.push_back(polygon[i - 1]);
+            }
+        }
+    }
+
+    fclose(file);
+
+    for (size_t v = 0; v < mesh->m_vertices.size(); ++v)
+    {
+        if (smoothNormals[v])
+        {
+            mesh->m_vertices[v].m_normal = Normalize(positionNormals[vertexPositions[v]]);
+        }
+    }
+
+    return ok;
+}
+
+//
+// SIMPLIFICATION
+//
+// Quadric error metric edge collapses (Garland and Heckbert, "Surface Simplification Using
+// Quadric Error Metrics"). Every vertex sums the planes of the triangles around it, and edges
+// collapse cheapest first, the cost being the sum of squared distances from the merged planes.
+// Collapses move a vertex onto one of its neighbours rather than to a new position, so all the
+// levels share the source vertices and only the indices change. Vertices on open borders and
+// seams (a position split for texture coordinates or colours) never move, and collapses that
+// would flip a triangle over are skipped.
+//
+// A level's error is the farthest any collapsed vertex's source position is from the triangles
+// left around the vertex it went to. That is an object space distance from the surface the
+// level leaves out to the source surface, measured at the source vertices.
+//
+
+struct Quadric  // symmetric 4x4 matrix, upper triangle by rows
+{
+    double m_q[10];
+};
+
+struct Collapse
+{
+    double m_cost;
+    int m_from;
+    int m_to;
+    int m_fromVersion;  // the collapse is stale once either vertex has changed
+    int m_toVersion;
+
+    bool operator<(const Collapse& other) const
+    {
+        return m_cost > other.m_cost;  // std::priority_queue pops the largest, we want cheapest
+    }
+};
+
+struct Simplifier
+{
+    const std::vector<VertexData>* m_vertices;
+    std::vector<int> m_indices;  // triangles as they are collapsed
+    std::vector<bool> m_triangleDead;
+    std::vector<std::vector<int>> m_vertexTriangles;
+    std::vector<Quadric> m_quadrics;
+    std::vector<bool> m_locked;
+    std::vector<int> m_versions;  // -1 once collapsed away
+    std::vector<int> m_collapsedTo;  // -1 while the vertex is still used
+    std::priority_queue<Collapse> m_queue;
+    int m_triangleCount;
+};
+
+static vec3 Position(const Simplifier& simplifier, int vertex)
+{
+    const vec4& p = (*simplifier.m_vertices)[vertex].m_pos;
+    return vec3(p.x, p.y, p.z);
+}
+
+static vec3 TriangleNormal(const vec3& p0, const vec3& p1, const vec3& p2)
+{
+    return vec3Cross(p1 - p0, p2 - p0);
+}
+
+static void AddQuadric(Quadric* q, const Quadric& other)
+{
+    for (int i = 0; i < 10; ++i)
+    {
+        q->m_q[i] += other.m_q[i];
+    }
+}
+
+static Quadric PlaneQuadric(const vec3& p0, const vec3& p1, const vec3& p2)
+{
+    Quadric q = {};
+
+    const vec3 n = TriangleNormal(p0, p1, p2);
+    const double length = sqrt((double)vec3Dot(n, n));
+    if (length == 0)
+    {
+        return q;
+    }
+
+    const double a = n.x / length;
+    const double b = n.y / length;
+    const double c = n.z / length;
+    const double d = -(a * p0.x + b * p0.y + c * p0.z);
+    const double plane[4] = { a, b, c, d };
+
+    int k = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = i; j < 4; ++j)
+        {
+            q.m_q[k++] = plane[i] * plane[j];
+        }
+    }
+    return q;
+}
+
+// Sum of squared distances from p to the planes in q
+static double QuadricError(const Quadric& q, const vec3& p)
+{
+    const double x = p.x;
+    const double y = p.y;
+    const double z = p.z;
+    const double* m = q.m_q;
+    const double error =
+        m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+        m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+        m[7] * z * z + 2 * m[8] * z +
+        m[9];
+    return error > 0 ? error : 0;
+}
+
+static void PushCollapse(Simplifier* simplifier, int from, int to)
+{
+    if (simplifier->m_locked[from])
+    {
+        return;
+    }
+
+    Quadric q = simplifier->m_quadrics[from];
+    AddQuadric(&q, simplifier->m_quadrics[to]);
+
+    Collapse collapse;
+    collapse.m_cost = QuadricError(q, Position(*simplifier, to));
+    collapse.m_from = from;
+    collapse.m_to = to;
+    collapse.m_fromVersion = simplifier->m_versions[from];
+    collapse.m_toVersion = simplifier->m_versions[to];
+    simplifier->m_queue.push(collapse);
+}
+
+static void PushCollapsesAround(Simplifier* simplifier, int vertex)
+{
+    for (int t : simplifier->m_vertexTriangles[vertex])
+    {
+        if (simplifier->m_triangleDead[t])
+        {
+            continue;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const int other = simplifier->m_indices[3 * t + i];
+            if (other != vertex)
+            {
+                PushCollapse(simplifier, vertex, other);
+                PushCollapse(simplifier, other, vertex);
+            }
+        }
+    }
+}
+
+static void InitSimplifier(Simplifier* simplifier, const ObjMesh& mesh)
+{
+    const int vertexCount = (int)mesh.m_vertices.size();
+    const int triangleCount = (int)mesh.m_indices.size() / 3;
+
+    simplifier->m_vertices = &mesh.m_vertices;
+    simplifier->m_indices = mesh.m_indices;
+    simplifier->m_triangleDead.assign(triangleCount, false);
+    simplifier->m_vertexTriangles.assign(vertexCount, std::vector<int>());
+    simplifier->m_quadrics.assign(vertexCount, Quadric());
+    simplifier->m_locked.assign(vertexCount, false);
+    simplifier->m_versions.assign(vertexCount, 0);
+    simplifier->m_collapsedTo.assign(vertexCount, -1);
+    simplifier->m_triangleCount = triangleCount;
+
+    // Vertices sharing a position are seams. Borders are found on positions too, so that seams
+    // don't look like borders.
+    std::vector<int> byPosition(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        byPosition[v] = v;
+    }
+    std::sort(byPosition.begin(), byPosition.end(), [&mesh](int a, int b)
+    {
+        const vec4& p = mesh.m_vertices[a].m_pos;
+        const vec4& q = mesh.m_vertices[b].m_pos;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z != q.z ? p.z < q.z : a < b;
+    });
+
+    std::vector<int> positionVertex(vertexCount);  // first vertex at the same position
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const int v = byPosition[i];
+        const int first = i > 0 ? positionVertex[byPosition[i - 1]] : v;
+        const vec4& p = mesh.m_vertices[v].m_pos;
+        const vec4& q = mesh.m_vertices[first].m_pos;
+        if (i > 0 && p.x == q.x && p.y == q.y && p.z == q.z)
+        {
+            positionVertex[v] = first;
+            simplifier->m_locked[v] = true;
+            simplifier->m_locked[first] = true;
+        }
+        else
+        {
+            positionVertex[v] = v;
+        }
+    }
+
+    std::unordered_map<uint64_t, int> edgeUses;  // undirected position edge -> triangles
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        const int* triangle = &mesh.m_indices[3 * t];
+        for (int i = 0; i < 3; ++i)
+        {
+            const uint32_t a = positionVertex[triangle[i]];
+            const uint32_t b = positionVertex[triangle[(i + 1) % 3]];
+            const uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+            ++edgeUses[key];
+        }
+
+        const Quadric q = PlaneQuadric(
+            Position(*simplifier, triangle[0]),
+            Position(*simplifier, triangle[1]),
+            Position(*simplifier, triangle[2]));
+        for (int i = 0; i < 3; ++i)
+        {
+            AddQuadric(&simplifier->m_quadrics[triangle[i]], q);
+            simplifier->m_vertexTriangles[triangle[i]].push_back(t);
+        }
+    }
+
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        const int* triangle = &mesh.m_indices[3 * t];
+        for (int i = 0; i < 3; ++i)
+        {
+            const uint32_t a = positionVertex[triangle[i]];
+            const uint32_t b = positionVertex[triangle[(i + 1) % 3]];
+            const uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+            if (edgeUses[key] != 2)
+            {
+                simplifier->m_locked[triangle[i]] = true;
+                simplifier->m_locked[triangle[(i + 1) % 3]] = true;
+            }
+        }
+    }
+
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            const int a = mesh.m_indices[3 * t + i];
+            const int b = mesh.m_indices[3 * t + (i + 1) % 3];
+            PushCollapse(simplifier, a, b);
+            PushCollapse(simplifier, b, a);
+        }
+    }
+}
+
+// False if moving from onto to would flip or squash one of the triangles that stay
+static bool CanCollapse(const Simplifier& simplifier, int from, int to)
+{
+    const vec3 target = Position(simplifier, to);
+
+    for (int t : simplifier.m_vertexTriangles[from])
+    {
+        const int* triangle = &simplifier.m_indices[3 * t];
+        if (simplifier.m_triangleDead[t] ||
+            triangle[0] == to || triangle[1] == to || triangle[2] == to)
+        {
+            continue;  // dead, or goes away with the edge
+        }
+
+        vec3 p[3];
+        vec3 moved[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            p[i] = Position(simplifier, triangle[i]);
+            moved[i] = triangle[i] == from ? target : p[i];
+        }
+
+        const vec3 before = TriangleNormal(p[0], p[1], p[2]);
+        const vec3 after = TriangleNormal(moved[0], moved[1], moved[2]);
+        const float scale = sqrtf(vec3Dot(before, before) * vec3Dot(after, after));
+        if (!(vec3Dot(before, after) > 0.2f * scale))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ApplyCollapse(Simplifier* simplifier, const Collapse& collapse)
+{
+    const int from = collapse.m_from;
+    const int to = collapse.m_to;
+
+    for (int t : simplifier->m_vertexTriangles[from])
+    {
+        if (simplifier->m_triangleDead[t])
+        {
+            continue;
+        }
+
+        int* triangle = &simplifier->m_indices[3 * t];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+        {
+            simplifier->m_triangleDead[t] = true;
+            --simplifier->m_triangleCount;
+            continue;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            triangle[i] = triangle[i] == from ? to : triangle[i];
+        }
+        simplifier->m_vertexTriangles[to].push_back(t);
+    }
+
+    AddQuadric(&simplifier->m_quadrics[to], simplifier->m_quadrics[from]);
+    simplifier->m_vertexTriangles[from].clear();
+    simplifier->m_versions[from] = -1;
+    simplifier->m_collapsedTo[from] = to;
+    ++simplifier->m_versions[to];
+
+    PushCollapsesAround(simplifier, to);
+}
+
+// Collapses edges until at most targetTriangles are left, or nothing else can go
+static void SimplifyTo(Simplifier* simplifier, int targetTriangles)
+{
+    while (simplifier->m_triangleCount > targetTriangles && !simplifier->m_queue.empty())
+    {
+        const Collapse collapse = simplifier->m_queue.top();
+        simplifier->m_queue.pop();
+
+        if (simplifier->m_versions[collapse.m_from] != collapse.m_fromVersion ||
+            simplifier->m_versions[collapse.m_to] != collapse.m_toVersion)
+        {
+            continue;
+        }
+
+        if (CanCollapse(*simplifier, collapse.m_from, collapse.m_to))
+        {
+            ApplyCollapse(simplifier, collapse);
+        }
+    }
+}
+
+// Squared distance from p to the triangle abc (Ericson, "Real-Time Collision Detection" 5.1.5)
+static float TriangleDistanceSquared(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
+{
+    const vec3 ab = b - a;
+    const vec3 ac = c - a;
+    const vec3 ap = p - a;
+    const float d1 = vec3Dot(ab, ap);
+    const float d2 = vec3Dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+    {
+        return vec3Dot(ap, ap);
+    }
+
+    const vec3 bp = p - b;
+    const float d3 = vec3Dot(ab, bp);
+    const float d4 = vec3Dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+    {
+        return vec3Dot(bp, bp);
+    }
+
+    const vec3 cp = p - c;
+    const float d5 = vec3Dot(ab, cp);
+    const float d6 = vec3Dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+    {
+        return vec3Dot(cp, cp);
+    }
+
+    vec3 closest;
+    const float vc = d1 * d4 - d3 * d2;
+    const float vb = d5 * d2 - d1 * d6;
+    const float va = d3 * d6 - d5 * d4;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        closest = a + ab * (d1 / (d1 - d3));
+    }
+    else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        closest = a + ac * (d2 / (d2 - d6));
+    }
+    else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+    {
+        closest = b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    else
+    {
+        const float denominator = va + vb + vc;
+        if (!(denominator > 0))
+        {
+            return vec3Dot(ap, ap);  // degenerate, a is as good as any
+        }
+        closest = a + ab * (vb / denominator) + ac * (vc / denominator);
+    }
+
+    const vec3 d = p - closest;
+    return vec3Dot(d, d);
+}
+
+// The farthest a collapsed vertex's source position is from the triangles left around the
+// vertex it ended up at (see SIMPLIFICATION)
+static float SurfaceError(const Simplifier& simplifier)
+{
+    float maxDistanceSquared = 0;
+    for (size_t v = 0; v < simplifier.m_collapsedTo.size(); ++v)
+    {
+        int to = simplifier.m_collapsedTo[v];
+        if (to < 0)
+        {
+            continue;
+        }
+        while (simplifier.m_collapsedTo[to] >= 0)
+        {
+            to = simplifier.m_collapsedTo[to];
+        }
+
+        const vec3 p = Position(simplifier, (int)v);
+        const vec3 d = p - Position(simplifier, to);
+        float distanceSquared = vec3Dot(d, d);
+        for (int t : simplifier.m_vertexTriangles[to])
+        {
+            if (!simplifier.m_triangleDead[t])
+            {
+                const int* triangle = &simplifier.m_indices[3 * t];
+                distanceSquared = std::min(distanceSquared, TriangleDistanceSquared(
+                    p,
+                    Position(simplifier, triangle[0]),
+                    Position(simplifier, triangle[1]),
+                    Position(simplifier, triangle[2])));
+            }
+        }
+        maxDistanceSquared = std::max(maxDistanceSquared, distanceSquared);
+    }
+    return sqrtf(maxDistanceSquared);
+}
+
+// Appends the triangles left, in their original order so clusters of them stay coherent
+static void AppendTriangles(const Simplifier& simplifier, std::vector<int>* indices)
+{
+    for (size_t t = 0; t < simplifier.m_triangleDead.size(); ++t)
+    {
+        if (!simplifier.m_triangleDead[t])
+        {
+            indices->insert(
+                indices->end(),
+                simplifier.m_indices.begin() + 3 * t,
+                simplifier.m_indices.begin() + 3 * t + 3);
+        }
+    }
+}
+
+//
+// COMMANDS
+//
+
+static int Convert(const char* inputPath, const char* outputPath)
+{
+    ObjMesh mesh;
+    if (!LoadObj(inputPath, &mesh))
+    {
+        return 1;
+    }
+
+    if (!MeshFile::Write(
+        outputPath,
+        mesh.m_vertices.data(),
+        (int)mesh.m_vertices.size(),
+        mesh.m_indices.data(),
+        (int)mesh.m_indices.size(),
+        nullptr,
+        0))
+    {
+        return 1;
+    }
+
+    printf(
+        "%s: %d vertices, %d triangles\n",
+        outputPath,
+        (int)mesh.m_vertices.size(),
+        (int)mesh.m_indices.size() / 3);
+    return 0;
+}
+
+static int Lod(const char* inputPath, const char* outputPath, int levels)
+{
+    ObjMesh mesh;
+    if (!LoadObj(inputPath, &mesh))
+    {
+        return 1;
+    }
+
+    if (mesh.m_indices.empty())
+    {
+        fprintf(stderr, "%s: no triangles\n", inputPath);
+        return 1;
+    }
+
+    Simplifier simplifier;
+    InitSimplifier(&simplifier, mesh);
+
+    std::vector<int> indices = mesh.m_indices;
+    MeshFileLod lods[kMeshFileMaxLods] = {};
+    lods[0].m_indexCount = (uint32_t)indices.size();
+    int lodCount = 1;
+
+    while (lodCount < levels)
+    {
+        const int previous = (int)lods[lodCount - 1].m_indexCount / 3;
+        SimplifyTo(&simplifier, previous / 2);
+
+        // Stop once a level would save too little to be worth its indices
+        if (simplifier.m_triangleCount > previous * 3 / 4 || simplifier.m_triangleCount == 0)
+        {
+            break;
+        }
+
+        MeshFileLod& lod = lods[lodCount++];
+        lod.m_firstIndex = (uint32_t)indices.size();
+        lod.m_indexCount = 3 * simplifier.m_triangleCount;
+        // Later levels never claim to be closer than the ones before them
+        lod.m_error = std::max(SurfaceError(simplifier), lods[lodCount - 2].m_error);
+        AppendTriangles(simplifier, &indices);
+    }
+
+    if (!MeshFile::Write(
+        outputPath,
+        mesh.m_vertices.data(),
+        (int)mesh.m_vertices.size(),
+        indices.data(),
+        (int)indices.size(),
+        lods,
+        lodCount))
+    {
+        return 1;
+    }
+
+    printf("%s: %d vertices, %d levels\n", outputPath, (int)mesh.m_vertices.size(), lodCount);
+    for (int i = 0; i < lodCount; ++i)
+    {
+        printf("  LOD %d: %d triangles, error %g\n", i, lods[i].m_indexCount / 3, lods[i].m_error);
+    }
+    return 0;
+}
+
+static int Optimize(const char* inputPath, const char* outputPath)
+{
+    MappedMesh mesh;
+    if (!MeshFile::Map(inputPath, &mesh))
+    {
+        return 1;
+    }
+    if (!MeshFile::ValidateIndices(mesh))
+    {
+        MeshFile::Unmap(&mesh);
+        return 1;
+    }
+
+    std::vector<VertexData> vertices(mesh.m_vertices, mesh.m_vertices + mesh.m_vertexCount);
+    const int* indexBlock = mesh.m_indices;
+    std::vector<int> indices(indexBlock, indexBlock + mesh.m_header->m_indexCount);
+    MeshFileLod lods[kMeshFileMaxLods] = {};
+    const int lodCount = mesh.m_lodCount;
+    std::copy(mesh.m_header->m_lods, mesh.m_header->m_lods + lodCount, lods);
+    MeshFile::Unmap(&mesh);  // before writing, in case it's the same file
+
+    int vertexCount = (int)vertices.size();
+    MeshOptimizeStats before[kMeshFileMaxLods];
+    MeshOptimizeStats after[kMeshFileMaxLods];
+    for (int i = 0; i < lodCount; ++i)
+    {
+        int* lodIndices = indices.data() + lods[i].m_firstIndex;
+        const int lodIndexCount = (int)lods[i].m_indexCount;
+        before[i] = MeshOptimize::Analyze(
+            lodIndices, lodIndexCount, vertices.data(), vertexCount);
+        MeshOptimize::OptimizeVertexCache(lodIndices, lodIndexCount, vertexCount);
+        MeshOptimize::OptimizeOverdraw(
+            lodIndices, lodIndexCount, vertices.data(), vertexCount, 1.05f);
+    }
+
+    // LOD 0 comes first in the index block, so its vertices end up first
+    vertexCount = MeshOptimize::OptimizeVertexFetch(
+        vertices.data(), vertexCount, indices.data(), (int)indices.size());
+    for (int i = 0; i < lodCount; ++i)
+    {
+        after[i] = MeshOptimize::Analyze(
+            indices.data() + lods[i].m_firstIndex, (int)lods[i].m_indexCount,
+            vertices.data(), vertexCount);
+    }
+
+    if (!MeshFile::Write(
+        outputPath,
+        vertices.data(),
+        vertexCount,
+        indices.data(),
+        (int)indices.size(),
+        lods,
+        lodCount))
+    {
+        return 1;
+    }
+
+    printf(
+        "%s: %d vertices (%d unused dropped), %d levels\n",
+        outputPath, vertexCount, (int)vertices.size() - vertexCount, lodCount);
+    for (int i = 0; i < lodCount; ++i)
+    {
+        printf(
+            "  LOD %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f\n",
+            i, before[i].m_acmr, after[i].m_acmr, before[i].m_atvr, after[i].m_atvr,
+            before[i].m_overdraw, after[i].m_overdraw);
+    }
+    return 0;
+}
+
+static int Usage()
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "  MeshTool convert <input.obj> <output.mesh>\n");
+    fprintf(stderr, "  MeshTool lod <input.obj> <output.mesh> [levels]\n");
+    fprintf(stderr, "  MeshTool optimize <input.mesh> <output.mesh>\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        return Usage();
+    }
+
+    if (strcmp(argv[1], "convert") == 0 && argc == 4)
+    {
+        return Convert(argv[2], argv[3]);
+    }
+
+    if (strcmp(argv[1], "lod") == 0 && (argc == 4 || argc == 5))
+    {
+        const int levels = argc == 5 ? atoi(argv[4]) : kMeshFileMaxLods;
+        if (levels < 1 || levels > kMeshFileMaxLods)
+        {
+            fprintf(stderr, "levels must be 1 to %d\n", kMeshFileMaxLods);
+            return 1;
+        }
+        return Lod(argv[2], argv[3], levels);
+    }
+
+    if (strcmp(argv[1], "optimize") == 0 && argc == 4)
+    {
+        return Optimize(argv[2], argv[3]);
+    }
+
+    return Usage();
+}
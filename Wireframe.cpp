@@ -0,0 +1,37 @@
+#include "Wireframe.h"
+
+#include "External/pow2assert.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+int Wireframe::ExtractEdges(const int* indices, int indexCount, int* edges, uint64_t* scratch)
+{
+    POW2_ASSERT(indexCount % 3 == 0);
+    POW2_ASSERT(scratch || indexCount == 0);
+
+    // Key each edge by its (smallest, largest) vertex so both windings match, then sort and
+    // drop duplicates. Sorting also leaves the edges ordered by vertex, which keeps the vertex
+    // fetches of the line rasterizer mostly sequential.
+    uint64_t* keys = scratch;
+    for (int i = 0; i < indexCount; i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            uint32_t a = indices[i + e];
+            uint32_t b = indices[i + (e + 1) % 3];
+            keys[i + e] = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        }
+    }
+
+    std::sort(keys, keys + indexCount);
+    const int count = (int)(std::unique(keys, keys + indexCount) - keys);
+
+    for (int i = 0; i < count; ++i)
+    {
+        edges[2 * i] = (int)(keys[i] >> 32);
+        edges[2 * i + 1] = (int)(keys[i] & 0xffffffff);
+    }
+
+    return count;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Edge lists for the wireframe render modes.
+//
+
+namespace Wireframe
+{
+    // Writes each unique edge of a triangle list once, as pairs of vertex indices, so edges
+    // shared by two triangles are only drawn once. edges must have room for indexCount pairs
+    // (2 * indexCount ints) and scratch for indexCount uint64_t. Returns the number of edges
+    // written.
+    int ExtractEdges(const int* indices, int indexCount, int* edges, uint64_t* scratch);
+}